@@ -5,7 +5,8 @@
 #ifndef CAELUM__ASTRONOMY_H
 #define CAELUM__ASTRONOMY_H
 
-#include "CaelumPrerequisites.h"
+#include "CaelumCorePrerequisites.h"
+#include "LunarTheory.h"
 
 namespace Caelum
 {
@@ -13,9 +14,9 @@ namespace Caelum
      *  This class contains various astronomical routines useful in Caelum.
      *
      *  Most of the formulas are from http://stjarnhimlen.se/comp/ppcomp.html
-     *  That site contains much more than was implemented here; it has code
-     *  for determining the positions of all the planets. Only the sun and
-     *  moon are actually useful for caelum.
+     *  That site contains much more than was implemented here. The sun and
+     *  moon are used for lighting; the planets out to Saturn are drawn by
+     *  PointStarfield.
      *
      *  The formulas are isolated here in pure procedural code for easier
      *  testing (Tests are done as assertions in the demo).
@@ -24,8 +25,12 @@ namespace Caelum
      *  instead of Ogre::Real(float) for precission. All angles are in degrees
      *  unless otherwise mentioned. Ogre::Degree and Ogre::Radian use
      *  Ogre::Real and should be avoided here.
+     *
+     *  The core routines are implemented by BasicAstronomy (AstronomyScalar.h),
+     *  templated on a scalar policy; this class forwards to the double
+     *  instantiation. Use FastAstronomy for directions that are only drawn.
      */
-    class CAELUM_EXPORT Astronomy
+    class CAELUM_CORE_EXPORT Astronomy
     {
     private:
         Astronomy() {}
@@ -51,6 +56,12 @@ namespace Caelum
         /// January 1, 2000, noon
         static const LongReal J2000;
 
+        /** Hour angle of the vernal equinox as used by convertEquatorialToHorizontal.
+         *  This is longitude plus an angle in [0, 360); not normalized.
+         *  Subtract right ascension to get an object's hour angle.
+         */
+        static LongReal getLocalSiderealAngle (LongReal jday, LongReal longitude);
+
         /** Convert from ecliptic to ecuatorial spherical coordinates, in radians.
          *  @param lon Ecliptic longitude
          *  @param lat Ecliptic latitude
@@ -87,6 +98,19 @@ namespace Caelum
                 LongReal rasc,      LongReal decl,
                 LongReal &azimuth,  LongReal &altitude);
 
+        /** Convert from equatorial rectangular to horizontal coordinates.
+         *  Same as convertEquatorialToHorizontal, but takes a direction
+         *  vector (x towards the vernal equinox, z towards the north
+         *  celestial pole) instead of rasc/decl angles. This avoids a round
+         *  trip through atan2 when the position is already a vector.
+         *  The vector does not have to be normalized.
+         */
+        static void convertEquatorialRectangularToHorizontal (
+                LongReal jday,
+                LongReal longitude, LongReal latitude,
+                LongReal x, LongReal y, LongReal z,
+                LongReal &azimuth, LongReal &altitude);
+
         /** Hour angle is zero for objects on sky meridian, and grows to the east.
          *  @param jday Astronomical time as julian day.
          *  @param longitude Observer's longitude in degrees east.
@@ -95,6 +119,16 @@ namespace Caelum
         static void getVernalEquinoxHourAngle (
                 LongReal jday, LongReal longitude, LongReal& hourAngle);
 
+        /** Get the sun's position in equatorial coordinates.
+         *  This does not depend on the observer.
+         *  @param jday Astronomical time as julian day.
+         *  @param rasc Right ascension in degrees.
+         *  @param decl Declination in degrees.
+         */
+        static void getEquatorialSunPosition (
+                LongReal jday,
+                LongReal &rasc, LongReal &decl);
+
         /** Get the sun's position in the sky in, relative to the horizon.
          *  @param jday Astronomical time as julian day.
          *  @param longitude Observer longitude
@@ -107,33 +141,324 @@ namespace Caelum
                 LongReal longitude, LongReal latitude,
                 LongReal &azimuth, LongReal &altitude);
 
+        /** getHorizontalSunPosition for an angle class like Ogre::Degree.
+         *  Angle needs valueDegrees and a constructor from degrees.
+         */
+        template <class Angle>
         static void getHorizontalSunPosition (
                 LongReal jday,
-                Ogre::Degree longitude, Ogre::Degree latitude,
-                Ogre::Degree &azimuth, Ogre::Degree &altitude);
+                Angle longitude, Angle latitude,
+                Angle &azimuth, Angle &altitude)
+        {
+            LongReal az, al;
+            getHorizontalSunPosition (jday, LongReal (longitude.valueDegrees ()), LongReal (latitude.valueDegrees ()), az, al);
+            azimuth = Angle (az);
+            altitude = Angle (al);
+        }
 
         /// Gets the moon position at a specific time in ecliptic coordinates
         /// @param lon: Ecliptic longitude, in radians.
         /// @param lat: Ecliptic latitude, in radians.
+        /// Uses the lunar theory selected by CAELUM_LUNAR_THEORY at build time.
 		static void getEclipticMoonPositionRad (
                 LongReal jday,
                 LongReal &lon,
                 LongReal &lat);
 
+        /** Moon position in ecliptic coordinates with an explicit precision.
+         *  Use LunarTheory::getEclipticPositionRad directly when the tier
+         *  is known at compile time.
+         *  @see LunarTheoryPrecision
+         */
+        static void getEclipticMoonPositionRad (
+                LongReal jday,
+                LunarTheoryPrecision precision,
+                LongReal &lon,
+                LongReal &lat);
+
+        /** Get the moon's position in equatorial coordinates.
+         *  This does not depend on the observer.
+         *  @param jday Astronomical time as julian day.
+         *  @param rasc Right ascension in degrees.
+         *  @param decl Declination in degrees.
+         */
+        static void getEquatorialMoonPosition (
+                LongReal jday,
+                LongReal &rasc, LongReal &decl);
+
         static void getHorizontalMoonPosition (
                 LongReal jday,
                 LongReal longitude, LongReal latitude,
                 LongReal &azimuth, LongReal &altitude);
+        /// getHorizontalMoonPosition for an angle class like Ogre::Degree.
+        template <class Angle>
         static void getHorizontalMoonPosition (
                 LongReal jday,
-                Ogre::Degree longitude, Ogre::Degree latitude,
-                Ogre::Degree &azimuth, Ogre::Degree &altitude);
+                Angle longitude, Angle latitude,
+                Angle &azimuth, Angle &altitude)
+        {
+            LongReal az, al;
+            getHorizontalMoonPosition (jday, LongReal (longitude.valueDegrees ()), LongReal (latitude.valueDegrees ()), az, al);
+            azimuth = Angle (az);
+            altitude = Angle (al);
+        }
+
+        /** Batched version of getHorizontalSunPosition.
+         *  Computes the sun's horizontal position for many julian days at once,
+         *  for a single observer. Input and output are plain arrays
+         *  (structure-of-arrays), and the work is done in fixed-size blocks
+         *  with the vectorizable kernels from BatchMath.h.
+         *
+         *  Results match the scalar function to well under a milli-degree;
+         *  the scalar function remains the reference implementation.
+         *
+         *  @param jday Array of count julian days.
+         *  @param count Number of elements in all arrays.
+         *  @param longitude Observer longitude in degrees east.
+         *  @param latitude Observer latitude in degrees north.
+         *  @param azimuth Output array of count azimuths, in degrees.
+         *  @param altitude Output array of count altitudes, in degrees.
+         */
+        static void getHorizontalSunPositionBatch (
+                const LongReal *jday, size_t count,
+                LongReal longitude, LongReal latitude,
+                LongReal *azimuth, LongReal *altitude);
 
+        /** Batched version of getHorizontalMoonPosition.
+         *  @see getHorizontalSunPositionBatch for the conventions.
+         */
+        static void getHorizontalMoonPositionBatch (
+                const LongReal *jday, size_t count,
+                LongReal longitude, LongReal latitude,
+                LongReal *azimuth, LongReal *altitude);
+
+        /** Observer positions prepared for the multi-observer routines.
+         *  This stores the sines and cosines of observer longitude and
+         *  latitude as plain arrays (structure-of-arrays). Observers usually
+         *  don't move, so build this once and reuse it every frame.
+         */
+        struct CAELUM_CORE_EXPORT ObserverBatch
+        {
+            std::vector<LongReal> sinLongitude, cosLongitude;
+            std::vector<LongReal> sinLatitude, cosLatitude;
+
+            /** Fill from arrays of observer coordinates.
+             *  @param longitude Array of count longitudes in degrees east.
+             *  @param latitude Array of count latitudes in degrees north.
+             */
+            void assign (const LongReal *longitude, const LongReal *latitude, size_t count);
+
+            /// Number of observers.
+            inline size_t size () const { return sinLongitude.size (); }
+        };
+
+        /** Convert one equatorial position to horizontal for many observers.
+         *  The time dependent part (sidereal angle and the position vector)
+         *  is computed once; each observer only costs a rotation and two
+         *  atan2 in a vectorizable loop.
+         *  @param jday Astronomical time as julian day.
+         *  @param rasc Object's right ascension, degrees.
+         *  @param decl Object's declination, degrees.
+         *  @param observers Observer positions.
+         *  @param azimuth Output array of observers.size () azimuths, in degrees.
+         *  @param altitude Output array of observers.size () altitudes, in degrees.
+         */
+        static void convertEquatorialToHorizontalBatch (
+                LongReal jday,
+                LongReal rasc, LongReal decl,
+                const ObserverBatch &observers,
+                LongReal *azimuth, LongReal *altitude);
+
+        /** Sun position for many observers at the same time.
+         *  The ephemeris is evaluated once per call.
+         *  @see convertEquatorialToHorizontalBatch
+         */
+        static void getHorizontalSunPositionForObservers (
+                LongReal jday,
+                const ObserverBatch &observers,
+                LongReal *azimuth, LongReal *altitude);
+
+        /** Moon position for many observers at the same time.
+         *  The ephemeris is evaluated once per call.
+         *  @see convertEquatorialToHorizontalBatch
+         */
+        static void getHorizontalMoonPositionForObservers (
+                LongReal jday,
+                const ObserverBatch &observers,
+                LongReal *azimuth, LongReal *altitude);
+
+        /// North ecliptic pole position for an angle class like Ogre::Degree; defined in AstronomyScalar.h.
+        template <class Angle>
         static void getHorizontalNorthEclipticPolePosition (
                 LongReal jday,
-                Ogre::Degree longitude, Ogre::Degree latitude,
-                Ogre::Degree &azimuth, Ogre::Degree &altitude);
+                Angle longitude, Angle latitude,
+                Angle &azimuth, Angle &altitude);
 		
+        /// Bodies supported by the event solver.
+        enum EventBody
+        {
+            EVENT_BODY_SUN,
+            EVENT_BODY_MOON,
+        };
+
+        /// Sun altitude at sunrise/sunset; includes refraction and semidiameter.
+        static const LongReal SUN_RISE_SET_ALTITUDE;
+        /// Moon altitude at moonrise/moonset; includes refraction, semidiameter and parallax.
+        static const LongReal MOON_RISE_SET_ALTITUDE;
+        /// Sun altitude at the start/end of civil twilight.
+        static const LongReal CIVIL_TWILIGHT_ALTITUDE;
+        /// Sun altitude at the start/end of nautical twilight.
+        static const LongReal NAUTICAL_TWILIGHT_ALTITUDE;
+        /// Sun altitude at the start/end of astronomical twilight.
+        static const LongReal ASTRONOMICAL_TWILIGHT_ALTITUDE;
+
+        /** Sun and moon events during one day, as julian days.
+         *  Events which don't happen during that day (polar day or night, or
+         *  the moon rising after midnight) are NaN.
+         */
+        struct DailyEvents
+        {
+            LongReal astronomicalDawn;
+            LongReal nauticalDawn;
+            LongReal civilDawn;
+            LongReal sunrise;
+            /// Sun culmination (upper transit).
+            LongReal solarNoon;
+            LongReal sunset;
+            LongReal civilDusk;
+            LongReal nauticalDusk;
+            LongReal astronomicalDusk;
+            LongReal moonrise;
+            /// Moon culmination (upper transit).
+            LongReal moonCulmination;
+            LongReal moonset;
+        };
+
+        /** Find the first time a body crosses an altitude.
+         *  The interval is scanned in one hour steps and every bracketed
+         *  crossing is refined with Brent's method. Crossings closer together
+         *  than the step (grazing the horizon near the poles) can be missed.
+         *  @param body Body to track.
+         *  @param start Start of the search interval, julian day.
+         *  @param end End of the search interval, julian day.
+         *  @param longitude Observer longitude in degrees east.
+         *  @param latitude Observer latitude in degrees north.
+         *  @param altitude Target altitude, degrees.
+         *  @param rising Look for the body going up (true) or down (false).
+         *  @param jday Result julian day.
+         *  @return false if there is no such crossing in the interval.
+         */
+        static bool findAltitudeCrossing (
+                EventBody body,
+                LongReal start, LongReal end,
+                LongReal longitude, LongReal latitude,
+                LongReal altitude, bool rising,
+                LongReal &jday);
+
+        /** Find the first culmination (upper transit) of a body.
+         *  This solves for a zero hour angle with Newton's method.
+         *  @return false if the body does not culminate in the interval.
+         */
+        static bool findCulmination (
+                EventBody body,
+                LongReal start, LongReal end,
+                LongReal longitude,
+                LongReal &jday);
+
+        /** Get the julian day of local mean midnight at the start of a date.
+         *  This is the natural start of the interval for getDailyEvents.
+         */
+        static LongReal getLocalMidnight (
+                int year, int month, int day, LongReal longitude);
+
+        /** Get all sun and moon events in the day starting at start.
+         *  @param start Start of the day; usually from getLocalMidnight.
+         *  @param longitude Observer longitude in degrees east.
+         *  @param latitude Observer latitude in degrees north.
+         *  @param events Result events.
+         */
+        static void getDailyEvents (
+                LongReal start,
+                LongReal longitude, LongReal latitude,
+                DailyEvents &events);
+
+        /** Get events for many consecutive days.
+         *  Day i starts at start + i. This samples altitudes for the whole
+         *  range with the batch routines and then refines every crossing, so
+         *  a year of events costs a few milliseconds.
+         *  @param events Output array of dayCount elements.
+         */
+        static void getDailyEventsBatch (
+                LongReal start, size_t dayCount,
+                LongReal longitude, LongReal latitude,
+                DailyEvents *events);
+
+        /// Planets supported by getPlanetPositions.
+        enum Planet
+        {
+            PLANET_MERCURY,
+            PLANET_VENUS,
+            PLANET_MARS,
+            PLANET_JUPITER,
+            PLANET_SATURN,
+            PLANET_COUNT,
+        };
+
+        /// Apparent position and brightness of a planet.
+        struct PlanetPosition
+        {
+            /// Right ascension in degrees, equinox J2000 (like the star catalogue).
+            LongReal rasc;
+            /// Declination in degrees, equinox J2000.
+            LongReal decl;
+            /// Distance from the earth, in AU.
+            LongReal distance;
+            /// Distance from the sun, in AU.
+            LongReal heliocentricDistance;
+            /// Illuminated fraction of the disc, from 0 to 1.
+            LongReal phase;
+            /// Visual magnitude, from phase angle and distances.
+            LongReal magnitude;
+        };
+
+        /** Get the positions of Mercury through Saturn.
+         *  This uses the mean orbital elements from stjarnhimlen.se plus the
+         *  largest Jupiter/Saturn perturbations; positions are good to a
+         *  few arc minutes. All planets are solved together in one pass,
+         *  sharing the sun's position.
+         *  @param jday Astronomical time as julian day.
+         *  @param positions Output array of PLANET_COUNT elements.
+         */
+        static void getPlanetPositions (
+                LongReal jday,
+                PlanetPosition *positions);
+
+        /// Mean obliquity of the ecliptic, in degrees.
+        static LongReal getMeanObliquity (LongReal jday);
+
+        /** Nutation in longitude and obliquity, in degrees.
+         *  This is the four term series from Meeus, good to about 0.5".
+         */
+        static void getNutation (
+                LongReal jday,
+                LongReal &longitude, LongReal &obliquity);
+
+        /** Difference between apparent and mean sidereal time, in degrees.
+         *  Add it to getVernalEquinoxHourAngle to measure the hour angle
+         *  from the true equinox of date.
+         */
+        static LongReal getEquationOfEquinoxes (LongReal jday);
+
+        /** Rotation from J2000 equatorial coordinates to the true equator
+         *  and equinox of date; IAU 1976 precession and getNutation.
+         *  Row major; rectangular J2000 vectors are multiplied on the right.
+         *  Aberration is not a rotation and is not included; it moves
+         *  stars by up to 20".
+         */
+        static void getPrecessionNutationMatrix (
+                LongReal jday,
+                LongReal matrix[3][3]);
+
         /** Get astronomical julian day from normal gregorian calendar.
          *  From wikipedia: the integer number of days that have elapsed
          *  since the initial epoch defined as
@@ -206,7 +531,7 @@ namespace Caelum
      *
      *  @see Astronomy::enterHighPrecissionFloatingPointMode
      */ 
-    class CAELUM_EXPORT ScopedHighPrecissionFloatSwitch
+    class CAELUM_CORE_EXPORT ScopedHighPrecissionFloatSwitch
     {
     private:
         int mOldFpMode;
@@ -0,0 +1,764 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#ifndef CAELUM__ASTRONOMY_SCALAR_H
+#define CAELUM__ASTRONOMY_SCALAR_H
+
+#include "CaelumCorePrerequisites.h"
+#include "Astronomy.h"
+#include "BatchMath.h"
+#include "LunarTheory.h"
+
+namespace Caelum
+{
+    /// Trigonometry from the standard library, in any floating point type.
+    template <typename T>
+    struct StdAstronomyTrig
+    {
+        /// Sine used for the lunar series, which are always double.
+        typedef LunarTheory::StdTrig LunarTrig;
+
+        static inline T sin (T x) { return std::sin (x); }
+        static inline T cos (T x) { return std::cos (x); }
+        static inline T atan2 (T y, T x) { return std::atan2 (y, x); }
+        static inline T sqrt (T x) { return std::sqrt (x); }
+    };
+
+    /** Single precision polynomial trigonometry from BatchMath.
+     *  Absolute error is below 1e-7 for sin/cos and 3e-7 radians for atan2;
+     *  @see BatchMath. Branch-free, so loops over it vectorize in float lanes.
+     */
+    struct FastAstronomyTrig
+    {
+        typedef LunarTheory::BatchTrig LunarTrig;
+
+        static inline float sin (float x) { return BatchMath::sin (x); }
+        static inline float cos (float x) { return BatchMath::cos (x); }
+        static inline float atan2 (float y, float x) { return BatchMath::atan2 (y, x); }
+        static inline float sqrt (float x) { return std::sqrt (x); }
+    };
+
+    /// Double precision branch-free trigonometry from BatchMath.
+    struct BatchAstronomyTrig
+    {
+        typedef LunarTheory::BatchTrig LunarTrig;
+
+        static inline double sin (double x) { return BatchMath::sin (x); }
+        static inline double cos (double x) { return BatchMath::cos (x); }
+        static inline double atan2 (double y, double x) { return BatchMath::atan2 (y, x); }
+        static inline double sqrt (double x) { return std::sqrt (x); }
+    };
+
+    /** Stand-in for ScopedHighPrecissionFloatSwitch which does nothing.
+     *  Single precision math doesn't care about the FPU precision mode.
+     */
+    class NullPrecissionFloatSwitch
+    {
+    public:
+        inline NullPrecissionFloatSwitch () {}
+    };
+
+    /** Scalar policy for BasicAstronomy.
+     *  @param ScalarT Type used for angles and coordinates.
+     *  @param TrigT Trigonometry on ScalarT; StdAstronomyTrig, FastAstronomyTrig or BatchAstronomyTrig.
+     *  @param TimeT Type used for julian days. A float can't hold a julian
+     *  day to better than a quarter of a day, so this is at least double.
+     *  @param PrecissionSwitchT Guard created around date conversions.
+     */
+    template <typename ScalarT, class TrigT,
+            typename TimeT = LongReal,
+            class PrecissionSwitchT = ScopedHighPrecissionFloatSwitch>
+    struct AstronomyPolicy
+    {
+        typedef ScalarT Scalar;
+        typedef TrigT Trig;
+        typedef TimeT Time;
+        typedef PrecissionSwitchT PrecissionSwitch;
+    };
+
+    /// Float with polynomial trig; for per-frame visual directions.
+    typedef AstronomyPolicy<float, FastAstronomyTrig, LongReal, NullPrecissionFloatSwitch> FastFloatAstronomyPolicy;
+    /// Float with the standard library trig.
+    typedef AstronomyPolicy<float, StdAstronomyTrig<float>, LongReal, NullPrecissionFloatSwitch> FloatAstronomyPolicy;
+    /// Double with the standard library trig; this is what Astronomy uses.
+    typedef AstronomyPolicy<double, StdAstronomyTrig<double> > DoubleAstronomyPolicy;
+    /// Double with branch-free trig, for loops which should vectorize.
+    typedef AstronomyPolicy<double, BatchAstronomyTrig> BatchDoubleAstronomyPolicy;
+    /// Long double everywhere, including julian days.
+    typedef AstronomyPolicy<long double, StdAstronomyTrig<long double>, long double> LongDoubleAstronomyPolicy;
+
+    template <class Policy> class BasicObserver;
+
+    /** The core Astronomy routines, templated on a scalar policy.
+     *
+     *  Astronomy is this class instantiated with DoubleAstronomyPolicy.
+     *  Use FastAstronomy where a direction only has to look right: it is
+     *  several times cheaper and stays within 0.0002 degrees of
+     *  DoubleAstronomy for sun and moon directions.
+     *
+     *  Julian days are always passed as Policy::Time. Everything that
+     *  grows with time (mean anomalies, sidereal angle) is reduced to
+     *  [0, 360) degrees in that type before being converted to
+     *  Policy::Scalar, so float instantiations lose no precision to the
+     *  size of the julian day.
+     *
+     *  All angles are in degrees unless the function name ends with Rad.
+     *  The moon's series are always summed in double, with the sine from
+     *  Policy::Trig::LunarTrig; @see LunarTheory.
+     */
+    template <class Policy>
+    class BasicAstronomy
+    {
+    public:
+        typedef typename Policy::Scalar Scalar;
+        typedef typename Policy::Trig Trig;
+        typedef typename Policy::Time Time;
+
+    private:
+        BasicAstronomy () {}
+
+    public:
+        static inline Scalar pi () {
+            return Scalar (3.1415926535897932384626433832795029L);
+        }
+
+        static inline Scalar radToDeg (Scalar x) { return x * (Scalar (180) / pi ()); }
+        static inline Scalar degToRad (Scalar x) { return x * (pi () / Scalar (180)); }
+
+        static inline Scalar sinDeg (Scalar x) { return Trig::sin (degToRad (x)); }
+        static inline Scalar cosDeg (Scalar x) { return Trig::cos (degToRad (x)); }
+        static inline Scalar atan2Deg (Scalar y, Scalar x) { return radToDeg (Trig::atan2 (y, x)); }
+
+        /// Normalize an angle to the 0, 360 range.
+        static inline Scalar normalizeDegrees (Scalar x)
+        {
+            x = std::fmod (x, Scalar (360));
+            if (x < Scalar (0)) {
+                x += Scalar (360);
+            }
+            return x;
+        }
+
+        /// Normalize a time dependent angle to [0, 360) before narrowing it.
+        static inline Scalar reduceDegrees (Time x) {
+            return Scalar (x - 360 * std::floor (x / 360));
+        }
+
+        /// @see Astronomy::convertEclipticToEquatorialRad
+        static void convertEclipticToEquatorialRad (
+                Scalar lon, Scalar lat,
+                Scalar &rasc, Scalar &decl)
+        {
+            Scalar ecl = degToRad (Scalar (23.439281));
+            Scalar sinEcl = Trig::sin (ecl), cosEcl = Trig::cos (ecl);
+            Scalar sinLon = Trig::sin (lon), cosLon = Trig::cos (lon);
+            Scalar sinLat = Trig::sin (lat), cosLat = Trig::cos (lat);
+
+            Scalar x = cosLon * cosLat;
+            Scalar y = cosEcl * sinLon * cosLat - sinEcl * sinLat;
+            Scalar z = sinEcl * sinLon * cosLat + cosEcl * sinLat;
+
+            Scalar r = Trig::sqrt (x * x + y * y);
+            rasc = Trig::atan2 (y, x);
+            decl = Trig::atan2 (z, r);
+        }
+
+        static void convertRectangularToSpherical (
+                Scalar x, Scalar y, Scalar z,
+                Scalar &rasc, Scalar &decl, Scalar &dist)
+        {
+            dist = Trig::sqrt (x * x + y * y + z * z);
+            rasc = atan2Deg (y, x);
+            decl = atan2Deg (z, Trig::sqrt (x * x + y * y));
+        }
+
+        static void convertSphericalToRectangular (
+                Scalar rasc, Scalar decl, Scalar dist,
+                Scalar &x, Scalar &y, Scalar &z)
+        {
+            x = dist * cosDeg (rasc) * cosDeg (decl);
+            y = dist * sinDeg (rasc) * cosDeg (decl);
+            z = dist * sinDeg (decl);
+        }
+
+        /** @see Astronomy::getVernalEquinoxHourAngle
+         *  The result is the observer longitude plus an angle in [0, 360).
+         */
+        static void getVernalEquinoxHourAngle (
+                Time jday, Scalar longitude, Scalar &hourAngle)
+        {
+            // julian days since J2000
+            Time d = jday - Time (2451545.0);
+            // julian centuries since J2000
+            Time T = d / Time (36525.0);
+            // Greenweech Mean Sidereal Time in seconds  of a day of 86400s UT1 at 0h UT1
+            Time GMST0 = Time (24110.54841) + Time (8640184.812866) * T
+                    + Time (0.093104) * (T * T) - Time (0.0000062) * (T * T * T);
+            // Universal time of day in degrees.
+            Time UT = (d - std::trunc (d)) * 360;
+            hourAngle = reduceDegrees (GMST0 * (Time (360.0) / Time (86400.0)) + 180 + UT) + longitude;
+        }
+
+        /** Hour angle of the vernal equinox as used by convertEquatorialToHorizontal.
+         *  The time dependent part is in [0, 360); longitude is added as is.
+         *  Subtract right ascension to get an object's hour angle.
+         */
+        static Scalar getLocalSiderealAngle (Time jday, Scalar longitude)
+        {
+            Time d = jday - Time (2451543.5);
+            Time w = Time (282.9404) + Time (4.70935E-5) * d;
+            Time M = Time (356.0470) + Time (0.9856002585) * d;
+            // Sun's mean longitude
+            Time L = w + M;
+            // Universal time of day in degrees.
+            Time UT = (d - std::trunc (d)) * 360;
+            return longitude + reduceDegrees (L + 180 + UT);
+        }
+
+        /// @see Astronomy::convertEquatorialToHorizontal
+        static void convertEquatorialToHorizontal (
+                Time jday,
+                Scalar longitude, Scalar latitude,
+                Scalar rasc,      Scalar decl,
+                Scalar &azimuth,  Scalar &altitude)
+        {
+            Scalar hourAngle = getLocalSiderealAngle (jday, longitude) - rasc;
+            Scalar cosDecl = cosDeg (decl);
+            Scalar sinLat = sinDeg (latitude), cosLat = cosDeg (latitude);
+
+            Scalar x = cosDeg (hourAngle) * cosDecl;
+            Scalar y = sinDeg (hourAngle) * cosDecl;
+            Scalar z = sinDeg (decl);
+
+            Scalar xhor = x * sinLat - z * cosLat;
+            Scalar yhor = y;
+            Scalar zhor = x * cosLat + z * sinLat;
+
+            azimuth = atan2Deg (yhor, xhor) + Scalar (180);
+            altitude = atan2Deg (zhor, Trig::sqrt (xhor * xhor + yhor * yhor));
+        }
+
+        /// @see Astronomy::convertEquatorialRectangularToHorizontal
+        static void convertEquatorialRectangularToHorizontal (
+                Time jday,
+                Scalar longitude, Scalar latitude,
+                Scalar x, Scalar y, Scalar z,
+                Scalar &azimuth, Scalar &altitude)
+        {
+            // Hour angle of the vernal equinox; rasc is subtracted below.
+            Scalar lst = getLocalSiderealAngle (jday, longitude);
+
+            Scalar sinLst = sinDeg (lst), cosLst = cosDeg (lst);
+            Scalar xe = cosLst * x + sinLst * y;
+            Scalar ye = sinLst * x - cosLst * y;
+
+            Scalar sinLat = sinDeg (latitude), cosLat = cosDeg (latitude);
+            Scalar xhor = xe * sinLat - z * cosLat;
+            Scalar yhor = ye;
+            Scalar zhor = xe * cosLat + z * sinLat;
+
+            azimuth = atan2Deg (yhor, xhor) + Scalar (180);
+            altitude = atan2Deg (zhor, Trig::sqrt (xhor * xhor + yhor * yhor));
+        }
+
+        /** Equatorial rectangular to horizontal, for a prepared observer.
+         *  Same as the other overload but the sidereal angle and observer
+         *  trig come from the observer's cache.
+         */
+        static void convertEquatorialRectangularToHorizontal (
+                const BasicObserver<Policy> &observer,
+                Scalar x, Scalar y, Scalar z,
+                Scalar &azimuth, Scalar &altitude)
+        {
+            Scalar sinLst = observer.getSinLocalSiderealAngle ();
+            Scalar cosLst = observer.getCosLocalSiderealAngle ();
+            Scalar xe = cosLst * x + sinLst * y;
+            Scalar ye = sinLst * x - cosLst * y;
+
+            Scalar sinLat = observer.getSinLatitude (), cosLat = observer.getCosLatitude ();
+            Scalar xhor = xe * sinLat - z * cosLat;
+            Scalar yhor = ye;
+            Scalar zhor = xe * cosLat + z * sinLat;
+
+            azimuth = atan2Deg (yhor, xhor) + Scalar (180);
+            altitude = atan2Deg (zhor, Trig::sqrt (xhor * xhor + yhor * yhor));
+        }
+
+        /// Equatorial to horizontal, for a prepared observer.
+        static void convertEquatorialToHorizontal (
+                const BasicObserver<Policy> &observer,
+                Scalar rasc, Scalar decl,
+                Scalar &azimuth, Scalar &altitude)
+        {
+            Scalar cosDecl = cosDeg (decl);
+            convertEquatorialRectangularToHorizontal (observer,
+                    cosDeg (rasc) * cosDecl, sinDeg (rasc) * cosDecl, sinDeg (decl),
+                    azimuth, altitude);
+        }
+
+        /// @see Astronomy::getEquatorialSunPosition
+        static void getEquatorialSunPosition (
+                Time jday,
+                Scalar &rasc, Scalar &decl)
+        {
+            // 2451543.5 == Astronomy::getJulianDayFromGregorianDateTime(1999, 12, 31, 0, 0, 0));
+            Time d = jday - Time (2451543.5);
+
+            // Sun's Orbital elements:
+            // argument of perihelion
+            Scalar w = reduceDegrees (Time (282.9404) + Time (4.70935E-5) * d);
+            // eccentricity (0=circle, 0-1=ellipse, 1=parabola)
+            Scalar e = Scalar (Time (0.016709) - Time (1.151E-9) * d);
+            // mean anomaly (0 at perihelion; increases uniformly with time)
+            Scalar M = reduceDegrees (Time (356.0470) + Time (0.9856002585) * d);
+
+            // Eccentric anomaly
+            Scalar E = M + radToDeg (e * sinDeg (M) * (Scalar (1) + e * cosDeg (M)));
+
+            // Sun's Distance(R) and true longitude(L)
+            Scalar xv = cosDeg (E) - e;
+            Scalar yv = sinDeg (E) * Trig::sqrt (Scalar (1) - e * e);
+            Scalar lon = atan2Deg (yv, xv) + w;
+
+            convertEclipticToEquatorialRad (degToRad (lon), Scalar (0), rasc, decl);
+            rasc = radToDeg (rasc);
+            decl = radToDeg (decl);
+        }
+
+        /// @see Astronomy::getHorizontalSunPosition
+        static void getHorizontalSunPosition (
+                Time jday,
+                Scalar longitude, Scalar latitude,
+                Scalar &azimuth, Scalar &altitude)
+        {
+            Scalar rasc, decl;
+            getEquatorialSunPosition (jday, rasc, decl);
+            convertEquatorialToHorizontal (
+                    jday, longitude, latitude, rasc, decl, azimuth, altitude);
+        }
+
+        /// Sun position at the observer's time and place.
+        static void getHorizontalSunPosition (
+                const BasicObserver<Policy> &observer,
+                Scalar &azimuth, Scalar &altitude)
+        {
+            Scalar rasc, decl;
+            getEquatorialSunPosition (observer.getJulianDay (), rasc, decl);
+            convertEquatorialToHorizontal (observer, rasc, decl, azimuth, altitude);
+        }
+
+        /** Moon position in ecliptic coordinates, in radians.
+         *  Uses the lunar theory selected by CAELUM_LUNAR_THEORY.
+         *  Longitude is reduced to [0, 2pi).
+         */
+        static void getEclipticMoonPositionRad (
+                Time jday,
+                Scalar &lon, Scalar &lat)
+        {
+            const double TWO_PI = 6.28318530717958647692;
+            double l, b;
+            LunarTheory::getEclipticPositionRad<CAELUM_LUNAR_THEORY, typename Trig::LunarTrig> (
+                    double (jday), l, b);
+            lon = Scalar (l - TWO_PI * std::floor (l / TWO_PI));
+            lat = Scalar (b);
+        }
+
+        /// @see Astronomy::getEquatorialMoonPosition
+        static void getEquatorialMoonPosition (
+                Time jday,
+                Scalar &rasc, Scalar &decl)
+        {
+            Scalar lonecl, latecl;
+            getEclipticMoonPositionRad (jday, lonecl, latecl);
+            convertEclipticToEquatorialRad (lonecl, latecl, rasc, decl);
+            rasc = radToDeg (rasc);
+            decl = radToDeg (decl);
+        }
+
+        /// @see Astronomy::getHorizontalMoonPosition
+        static void getHorizontalMoonPosition (
+                Time jday,
+                Scalar longitude, Scalar latitude,
+                Scalar &azimuth, Scalar &altitude)
+        {
+            Scalar rasc, decl;
+            getEquatorialMoonPosition (jday, rasc, decl);
+            convertEquatorialToHorizontal (
+                    jday, longitude, latitude, rasc, decl, azimuth, altitude);
+        }
+
+        /// Moon position at the observer's time and place.
+        static void getHorizontalMoonPosition (
+                const BasicObserver<Policy> &observer,
+                Scalar &azimuth, Scalar &altitude)
+        {
+            Scalar rasc, decl;
+            getEquatorialMoonPosition (observer.getJulianDay (), rasc, decl);
+            convertEquatorialToHorizontal (observer, rasc, decl, azimuth, altitude);
+        }
+
+        /// @see Astronomy::getHorizontalNorthEclipticPolePosition
+        static void getHorizontalNorthEclipticPolePosition (
+                Time jday,
+                Scalar longitude, Scalar latitude,
+                Scalar &azimuth, Scalar &altitude)
+        {
+            Scalar rasc = Scalar (270.0);
+            Scalar decl = Scalar (90.0 - 23.439281);
+            convertEquatorialToHorizontal (
+                    jday, longitude, latitude, rasc, decl, azimuth, altitude);
+        }
+
+        /// North ecliptic pole position at the observer's time and place.
+        static void getHorizontalNorthEclipticPolePosition (
+                const BasicObserver<Policy> &observer,
+                Scalar &azimuth, Scalar &altitude)
+        {
+            convertEquatorialToHorizontal (observer,
+                    Scalar (270.0), Scalar (90.0 - 23.439281), azimuth, altitude);
+        }
+
+        /// Unit direction in horizontal coordinates.
+        struct HorizontalVector
+        {
+            Scalar north, east, up;
+
+            /// Azimuth, clockwise degrees from true north, in [0, 360).
+            inline Scalar getAzimuth () const { return normalizeDegrees (atan2Deg (east, north)); }
+            /// Altitude, degrees above the horizon.
+            inline Scalar getAltitude () const { return atan2Deg (up, Trig::sqrt (north * north + east * east)); }
+        };
+
+        /// Everything CaelumSystem needs from astronomy for one frame.
+        struct SkyEvaluation
+        {
+            HorizontalVector sun;
+            HorizontalVector moon;
+            HorizontalVector eclipticNorthPole;
+            /// Moon phase; from 0 (full moon) to 1 (again full moon). @see CaelumSystem::getMoonPhase
+            Scalar moonPhase;
+        };
+
+        /** Sun direction in equatorial rectangular coordinates; not normalized.
+         *  Same orbital elements as getEquatorialSunPosition, but the true
+         *  longitude is never turned into an angle.
+         */
+        static void getEquatorialSunVector (Time jday, Scalar &x, Scalar &y, Scalar &z)
+        {
+            Time d = jday - Time (2451543.5);
+            Scalar w = reduceDegrees (Time (282.9404) + Time (4.70935E-5) * d);
+            Scalar e = Scalar (Time (0.016709) - Time (1.151E-9) * d);
+            Scalar M = reduceDegrees (Time (356.0470) + Time (0.9856002585) * d);
+
+            Scalar sinM = sinDeg (M), cosM = cosDeg (M);
+            Scalar E = M + radToDeg (e * sinM * (Scalar (1) + e * cosM));
+            Scalar xv = cosDeg (E) - e;
+            Scalar yv = sinDeg (E) * Trig::sqrt (Scalar (1) - e * e);
+
+            // r * cos (lon) and r * sin (lon)
+            Scalar sinW = sinDeg (w), cosW = cosDeg (w);
+            Scalar cosLon = xv * cosW - yv * sinW;
+            Scalar sinLon = yv * cosW + xv * sinW;
+
+            x = cosLon;
+            y = getCosEcliptic () * sinLon;
+            z = getSinEcliptic () * sinLon;
+        }
+
+        /// Moon direction in equatorial rectangular coordinates; a unit vector.
+        static void getEquatorialMoonVector (Time jday, Scalar &x, Scalar &y, Scalar &z)
+        {
+            Scalar lon, lat;
+            getEclipticMoonPositionRad (jday, lon, lat);
+            Scalar sinLon = Trig::sin (lon), cosLon = Trig::cos (lon);
+            Scalar sinLat = Trig::sin (lat), cosLat = Trig::cos (lat);
+
+            x = cosLon * cosLat;
+            y = getCosEcliptic () * sinLon * cosLat - getSinEcliptic () * sinLat;
+            z = getSinEcliptic () * sinLon * cosLat + getCosEcliptic () * sinLat;
+        }
+
+        /** Evaluate sun, moon, moon phase and ecliptic pole in one pass.
+         *  This replaces separate calls to getHorizontalSunPosition,
+         *  getHorizontalMoonPosition, getHorizontalNorthEclipticPolePosition
+         *  and the moon phase. The time terms are computed once, positions
+         *  stay vectors instead of going through rasc/decl angles, and one
+         *  equatorial to horizontal basis is applied to all bodies.
+         */
+        static void evaluateSky (const BasicObserver<Policy> &observer, SkyEvaluation &sky)
+        {
+            typename Policy::PrecissionSwitch precissionSwitch;
+
+            Scalar sun[3], moon[3];
+            getEquatorialSunVector (observer.getJulianDay (), sun[0], sun[1], sun[2]);
+            getEquatorialMoonVector (observer.getJulianDay (), moon[0], moon[1], moon[2]);
+            evaluateSky (observer, sun, moon, sky);
+        }
+
+        /** Fused pass with sun and moon equatorial vectors from elsewhere.
+         *  For example from an EphemerisCache. Vectors need not be normalized.
+         */
+        static void evaluateSky (
+                const BasicObserver<Policy> &observer,
+                const Scalar sun[3], const Scalar moon[3],
+                SkyEvaluation &sky)
+        {
+            // Equatorial to horizontal basis; the rows of
+            // convertEquatorialRectangularToHorizontal as one matrix.
+            Scalar sinLst = observer.getSinLocalSiderealAngle ();
+            Scalar cosLst = observer.getCosLocalSiderealAngle ();
+            Scalar sinLat = observer.getSinLatitude (), cosLat = observer.getCosLatitude ();
+            const Scalar basis[3][3] = {
+                { -sinLat * cosLst, -sinLat * sinLst, cosLat },
+                { -sinLst, cosLst, Scalar (0) },
+                { cosLat * cosLst, cosLat * sinLst, sinLat },
+            };
+
+            const Scalar pole[3] = { Scalar (0), -getSinEcliptic (), getCosEcliptic () };
+            transformToHorizontal (basis, sun, sky.sun);
+            transformToHorizontal (basis, moon, sky.moon);
+            transformToHorizontal (basis, pole, sky.eclipticNorthPole);
+
+            // Julian days since June 04, 1993 20:31 (full moon), in synodic months.
+            Time T = (observer.getJulianDay () - Time (2449143.3552943347L)) / Time (29.53058867L);
+            sky.moonPhase = Scalar (T - std::floor (T));
+        }
+
+        /** Interpolate between two sky evaluations.
+         *  Directions are blended and renormalized; for the small steps
+         *  between fixed ticks this is indistinguishable from a rotation.
+         *  The moon phase takes the short way round its wrap.
+         *  @param alpha 0 for from, 1 for to.
+         */
+        static void interpolateSky (
+                const SkyEvaluation &from, const SkyEvaluation &to, Scalar alpha,
+                SkyEvaluation &sky)
+        {
+            interpolateDirection (from.sun, to.sun, alpha, sky.sun);
+            interpolateDirection (from.moon, to.moon, alpha, sky.moon);
+            interpolateDirection (from.eclipticNorthPole, to.eclipticNorthPole, alpha, sky.eclipticNorthPole);
+
+            Scalar phaseStep = to.moonPhase - from.moonPhase;
+            phaseStep -= Scalar (std::floor (phaseStep + Scalar (0.5)));
+            Scalar phase = from.moonPhase + phaseStep * alpha;
+            sky.moonPhase = phase - Scalar (std::floor (phase));
+        }
+
+        /// @see Astronomy::getJulianDayFromGregorianDateTime
+        static Time getJulianDayFromGregorianDateTime (
+                int year, int month, int day,
+                int hour, int minute, Time second)
+        {
+            typename Policy::PrecissionSwitch precissionSwitch;
+
+            int jdn = Astronomy::getJulianDayFromGregorianDate (year, month, day);
+            // These are NOT integer divisions.
+            return jdn + (hour - 12) / Time (24.0) + minute / Time (1440.0) + second / Time (86400.0);
+        }
+
+        /// @see Astronomy::getJulianDayFromGregorianDateTime
+        static Time getJulianDayFromGregorianDateTime (
+                int year, int month, int day,
+                Time secondsFromMidnight)
+        {
+            int jdn = Astronomy::getJulianDayFromGregorianDate (year, month, day);
+            return jdn + secondsFromMidnight / Time (86400.0) - Time (0.5);
+        }
+
+        /// @see Astronomy::getGregorianDateTimeFromJulianDay
+        static void getGregorianDateTimeFromJulianDay (
+                Time julianDay, int &year, int &month, int &day,
+                int &hour, int &minute, Time &second)
+        {
+            typename Policy::PrecissionSwitch precissionSwitch;
+
+            // Integer julian days are at noon.
+            // static_cast<int)(floor( is more precise than Ogre::Math::IFloor.
+            // Yes, it does matter.
+            julianDay += Time (0.5);
+            int ijd = static_cast<int> (std::floor (julianDay));
+            Astronomy::getGregorianDateFromJulianDay (ijd, year, month, day);
+
+            Time s = (julianDay - Time (ijd)) * Time (86400.0);
+            hour = static_cast<int> (std::floor (s / 3600));
+            s -= hour * 3600;
+            minute = static_cast<int> (std::floor (s / 60));
+            s -= minute * 60;
+            second = s;
+        }
+
+    private:
+        /// Sine and cosine of the obliquity used by convertEclipticToEquatorialRad.
+        static inline Scalar getSinEcliptic () { return Scalar (0.397776994021848L); }
+        static inline Scalar getCosEcliptic () { return Scalar (0.917482132265769L); }
+
+        /// Normalized linear blend of two unit directions.
+        static void interpolateDirection (
+                const HorizontalVector &from, const HorizontalVector &to, Scalar alpha,
+                HorizontalVector &result)
+        {
+            Scalar north = from.north + (to.north - from.north) * alpha;
+            Scalar east = from.east + (to.east - from.east) * alpha;
+            Scalar up = from.up + (to.up - from.up) * alpha;
+            Scalar scale = Scalar (1) / Trig::sqrt (north * north + east * east + up * up);
+            result.north = north * scale;
+            result.east = east * scale;
+            result.up = up * scale;
+        }
+
+        static inline void transformToHorizontal (
+                const Scalar basis[3][3], const Scalar v[3], HorizontalVector &result)
+        {
+            Scalar invLength = Scalar (1) / Trig::sqrt (v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+            result.north = (basis[0][0] * v[0] + basis[0][1] * v[1] + basis[0][2] * v[2]) * invLength;
+            result.east = (basis[1][0] * v[0] + basis[1][1] * v[1] + basis[1][2] * v[2]) * invLength;
+            result.up = (basis[2][0] * v[0] + basis[2][1] * v[1] + basis[2][2] * v[2]) * invLength;
+        }
+    };
+
+    /** Observer position and time with the trigonometry cached.
+     *
+     *  Every horizontal transform needs the sine and cosine of the
+     *  observer latitude and of the local sidereal angle. This keeps them
+     *  and only evaluates them again when the location or the julian day
+     *  actually change, so the sun, moon, ecliptic pole and starfield of
+     *  one frame all share one evaluation.
+     *
+     *  The local sidereal angle is split in a time part and the longitude,
+     *  each with their own cached sine and cosine; they are combined with
+     *  the angle sum identities.
+     *
+     *  The evaluation counters only ever grow. Each count is one
+     *  evaluation of the location (or time) transcendentals.
+     */
+    template <class Policy>
+    class BasicObserver
+    {
+    public:
+        typedef typename Policy::Scalar Scalar;
+        typedef typename Policy::Time Time;
+        typedef BasicAstronomy<Policy> AstronomyT;
+
+        /// Observer at longitude and latitude 0, at J2000.
+        BasicObserver ():
+                mLongitude (0), mLatitude (0),
+                mJulianDay (Astronomy::J2000),
+                mLocationEvaluationCount (0), mTimeEvaluationCount (0)
+        {
+            evaluateLocation ();
+            evaluateTime ();
+        }
+
+        /// Observer at a location, in degrees, and time.
+        BasicObserver (Scalar longitude, Scalar latitude, Time jday):
+                mLongitude (longitude), mLatitude (latitude),
+                mJulianDay (jday),
+                mLocationEvaluationCount (0), mTimeEvaluationCount (0)
+        {
+            evaluateLocation ();
+            evaluateTime ();
+        }
+
+        /** Set observer location, in degrees.
+         *  Does nothing if the location did not change.
+         */
+        void setLocation (Scalar longitude, Scalar latitude)
+        {
+            if (longitude != mLongitude || latitude != mLatitude) {
+                mLongitude = longitude;
+                mLatitude = latitude;
+                evaluateLocation ();
+            }
+        }
+
+        /** Set the time, as a julian day.
+         *  Does nothing if the time did not change.
+         */
+        void setJulianDay (Time jday)
+        {
+            if (jday != mJulianDay) {
+                mJulianDay = jday;
+                evaluateTime ();
+            }
+        }
+
+        inline Scalar getLongitude () const { return mLongitude; }
+        inline Scalar getLatitude () const { return mLatitude; }
+        inline Time getJulianDay () const { return mJulianDay; }
+
+        inline Scalar getSinLatitude () const { return mSinLatitude; }
+        inline Scalar getCosLatitude () const { return mCosLatitude; }
+
+        /// @see Astronomy::getLocalSiderealAngle; longitude plus [0, 360).
+        inline Scalar getLocalSiderealAngle () const { return mLongitude + mSiderealAngle; }
+        inline Scalar getSinLocalSiderealAngle () const {
+            return mSinSiderealAngle * mCosLongitude + mCosSiderealAngle * mSinLongitude;
+        }
+        inline Scalar getCosLocalSiderealAngle () const {
+            return mCosSiderealAngle * mCosLongitude - mSinSiderealAngle * mSinLongitude;
+        }
+
+        /// Number of times the longitude/latitude trig was evaluated.
+        inline unsigned long getLocationEvaluationCount () const { return mLocationEvaluationCount; }
+        /// Number of times the sidereal angle and its trig were evaluated.
+        inline unsigned long getTimeEvaluationCount () const { return mTimeEvaluationCount; }
+
+    private:
+        void evaluateLocation ()
+        {
+            mSinLongitude = AstronomyT::sinDeg (mLongitude);
+            mCosLongitude = AstronomyT::cosDeg (mLongitude);
+            mSinLatitude = AstronomyT::sinDeg (mLatitude);
+            mCosLatitude = AstronomyT::cosDeg (mLatitude);
+            ++mLocationEvaluationCount;
+        }
+
+        void evaluateTime ()
+        {
+            mSiderealAngle = AstronomyT::getLocalSiderealAngle (mJulianDay, Scalar (0));
+            mSinSiderealAngle = AstronomyT::sinDeg (mSiderealAngle);
+            mCosSiderealAngle = AstronomyT::cosDeg (mSiderealAngle);
+            ++mTimeEvaluationCount;
+        }
+
+        Scalar mLongitude, mLatitude;
+        Scalar mSinLongitude, mCosLongitude;
+        Scalar mSinLatitude, mCosLatitude;
+
+        Time mJulianDay;
+        /// Sidereal angle at longitude 0, in [0, 360).
+        Scalar mSiderealAngle;
+        Scalar mSinSiderealAngle, mCosSiderealAngle;
+
+        unsigned long mLocationEvaluationCount;
+        unsigned long mTimeEvaluationCount;
+    };
+
+    /// Observer for FastAstronomy.
+    typedef BasicObserver<FastFloatAstronomyPolicy> FastObserver;
+    /// Observer for DoubleAstronomy.
+    typedef BasicObserver<DoubleAstronomyPolicy> Observer;
+
+    /// Float astronomy with polynomial trig; for per-frame visuals.
+    typedef BasicAstronomy<FastFloatAstronomyPolicy> FastAstronomy;
+    /// Double astronomy; the reference, used to implement Astronomy.
+    typedef BasicAstronomy<DoubleAstronomyPolicy> DoubleAstronomy;
+    /// Long double astronomy, for long range date arithmetic.
+    typedef BasicAstronomy<LongDoubleAstronomyPolicy> LongDoubleAstronomy;
+
+    template <class Angle>
+    void Astronomy::getHorizontalNorthEclipticPolePosition (
+            LongReal jday,
+            Angle longitude, Angle latitude,
+            Angle &azimuth, Angle &altitude)
+    {
+        LongReal az, al;
+        DoubleAstronomy::getHorizontalNorthEclipticPolePosition (
+                jday, LongReal (longitude.valueDegrees ()), LongReal (latitude.valueDegrees ()), az, al);
+        azimuth = Angle (az);
+        altitude = Angle (al);
+    }
+}
+
+#endif // CAELUM__ASTRONOMY_SCALAR_H
@@ -0,0 +1,102 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#ifndef CAELUM__ATMOSPHERIC_LOOKUP_H
+#define CAELUM__ATMOSPHERIC_LOOKUP_H
+
+#include "CaelumCorePrerequisites.h"
+
+namespace Caelum
+{
+    /** Lookup tables for atmospheric refraction and extinction.
+     *
+     *  Astronomy returns geometric altitudes. Near the horizon the
+     *  atmosphere lifts objects by up to half a degree (refraction) and
+     *  dims them by several magnitudes (extinction). Both only depend on
+     *  altitude, so they are tabulated once and linearly interpolated.
+     *
+     *  Refraction uses Saemundsson's formula for standard pressure and
+     *  temperature, from true to apparent altitude. Below -1 degree it
+     *  tapers linearly to zero at -5 degrees; the formula is meaningless
+     *  there and a sun well below the horizon should not jump.
+     *
+     *  Extinction is the airmass from Kasten and Young times an extinction
+     *  coefficient, relative to the zenith; a star at the zenith keeps
+     *  its catalogue magnitude. The shader table is indexed by
+     *  sqrt (sin (altitude)), which puts most entries near the horizon
+     *  where the airmass changes quickly.
+     */
+    class CAELUM_CORE_EXPORT AtmosphericLookup
+    {
+    public:
+        /// Entries in the refraction table; spaced evenly over the altitude range.
+        static const int REFRACTION_TABLE_SIZE = 512;
+
+        /// Entries in the extinction table passed to shaders.
+        static const int EXTINCTION_TABLE_SIZE = 32;
+
+        /// Lowest altitude with any refraction, in degrees.
+        static const LongReal MIN_REFRACTION_ALTITUDE;
+
+        /** Constructor.
+         *  @param extinctionCoefficient Magnitudes of extinction per airmass.
+         *  0.2 is typical for visual magnitudes at a clear site.
+         */
+        AtmosphericLookup (LongReal extinctionCoefficient = 0.2);
+
+        /// Reference refraction for a true altitude, in degrees.
+        static LongReal computeRefraction (LongReal altitude);
+
+        /// Reference airmass for an apparent altitude; 1 at the zenith.
+        static LongReal computeAirmass (LongReal altitude);
+
+        /// Refraction for a true altitude, in degrees; from the table.
+        LongReal getRefraction (LongReal altitude) const;
+
+        /// Apparent altitude for a true altitude, in degrees; from the table.
+        inline LongReal getApparentAltitude (LongReal altitude) const {
+            return altitude + getRefraction (altitude);
+        }
+
+        /** Refract a unit direction vector.
+         *  The vertical component is measured along the zenith (north,
+         *  east, up like Astronomy's horizontal vectors); the direction is
+         *  raised toward the zenith keeping its azimuth.
+         */
+        template <typename T>
+        void refract (T &north, T &east, T &up) const
+        {
+            const LongReal RAD_TO_DEG = 57.295779513082320877;
+            LongReal horizontal = std::sqrt (LongReal (north) * north + LongReal (east) * east);
+            LongReal altitude = std::atan2 (LongReal (up), horizontal) * RAD_TO_DEG;
+            LongReal apparent = getApparentAltitude (altitude) / RAD_TO_DEG;
+            if (horizontal > 0) {
+                LongReal scale = std::cos (apparent) / horizontal;
+                north = T (north * scale);
+                east = T (east * scale);
+            }
+            up = T (std::sin (apparent));
+        }
+
+        /// Magnitudes of extinction relative to the zenith, for an apparent altitude.
+        LongReal getExtinction (LongReal altitude) const;
+
+        /** Extinction table for shaders.
+         *  Entry i is the extinction at sin (altitude) = (i / (size - 1))^2;
+         *  objects below the horizon use entry 0.
+         */
+        inline const float* getExtinctionTable () const { return mExtinctionTable; }
+
+        /// Extinction coefficient; rebuilds the extinction table.
+        void setExtinctionCoefficient (LongReal value);
+        inline LongReal getExtinctionCoefficient () const { return mExtinctionCoefficient; }
+
+    private:
+        LongReal mExtinctionCoefficient;
+        float mRefractionTable[REFRACTION_TABLE_SIZE];
+        float mExtinctionTable[EXTINCTION_TABLE_SIZE];
+    };
+}
+
+#endif // CAELUM__ATMOSPHERIC_LOOKUP_H
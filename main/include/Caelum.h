@@ -16,7 +16,22 @@
 #include "Sun.h"
 #include "Moon.h"
 #include "UniversalClock.h"
+#include "ClockDomain.h"
+#include "UpdateThrottle.h"
 #include "Astronomy.h"
+#include "AstronomyScalar.h"
+#include "LunarTheory.h"
+#include "EphemerisCache.h"
+#include "EclipseTable.h"
+#include "AtmosphericLookup.h"
+#include "SatelliteConstellation.h"
+#include "CelestialBodies.h"
+#include "SkyStateEvaluator.h"
+#include "TaskGraph.h"
+#include "SkySnapshot.h"
+#include "KeyframedSky.h"
+#include "SkyTimeline.h"
+#include "SkyFrameEvaluator.h"
 #include "CloudSystem.h"
 #include "PrecipitationController.h"
 #include "FlatCloudLayer.h"
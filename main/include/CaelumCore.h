@@ -0,0 +1,25 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#ifndef CAELUM_CORE_H
+#define CAELUM_CORE_H
+
+// Everything in the caelum_core library; usable without Ogre.
+#include "CaelumCorePrerequisites.h"
+#include "Astronomy.h"
+#include "AstronomyScalar.h"
+#include "LunarTheory.h"
+#include "EphemerisCache.h"
+#include "EclipseTable.h"
+#include "AtmosphericLookup.h"
+#include "SatelliteConstellation.h"
+#include "CelestialBodies.h"
+#include "SkyStateEvaluator.h"
+#include "TaskGraph.h"
+#include "SkySnapshot.h"
+#include "KeyframedSky.h"
+#include "SkyTimeline.h"
+#include "SkyFrameEvaluator.h"
+
+#endif // CAELUM_CORE_H
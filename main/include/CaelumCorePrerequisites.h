@@ -0,0 +1,45 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#ifndef CAELUM__CAELUM_CORE_PREREQUISITES_H
+#define CAELUM__CAELUM_CORE_PREREQUISITES_H
+
+// The caelum_core library: astronomy and the sky colour model, without Ogre.
+// Nothing included from here may include Ogre headers.
+
+#include "CaelumConfig.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Define the dll export qualifier if compiling for Windows
+#if defined (_WIN32)
+	#ifdef CAELUM_CORE_LIB
+		#define CAELUM_CORE_EXPORT __declspec (dllexport)
+	#else
+		#ifdef __MINGW32__
+			#define CAELUM_CORE_EXPORT
+		#else
+			#define CAELUM_CORE_EXPORT __declspec (dllimport)
+		#endif
+	#endif
+#elif defined (__APPLE__)
+	#define CAELUM_CORE_EXPORT __attribute__ ((visibility("default")))
+#else
+	#define CAELUM_CORE_EXPORT
+#endif
+
+namespace Caelum
+{
+    // Caelum needs a lot of precission for astronomical calculations.
+    // Very few calculations use it, and the precission IS required.
+    typedef double LongReal;
+}
+
+#endif // CAELUM__CAELUM_CORE_PREREQUISITES_H
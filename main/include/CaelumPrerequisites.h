@@ -14,6 +14,7 @@
 #endif
 
 #include "CaelumConfig.h"
+#include "CaelumCorePrerequisites.h"
 
 #include <memory>
 
@@ -60,10 +61,6 @@
  */
 namespace Caelum
 {
-    // Caelum needs a lot of precission for astronomical calculations.
-    // Very few calculations use it, and the precission IS required.
-    typedef double LongReal;
-
     // Use some ogre types.
     using Ogre::uint8;
     using Ogre::uint16;
@@ -7,6 +7,8 @@
 
 #include "CaelumPrerequisites.h"
 #include "UniversalClock.h"
+#include "ClockDomain.h"
+#include "UpdateThrottle.h"
 #include "ImageStarfield.h"
 #include "PointStarfield.h"
 #include "SkyLight.h"
@@ -17,8 +19,19 @@
 #include "DepthComposer.h"
 #include "PrecipitationController.h"
 #include "GroundFog.h"
+#include "EphemerisCache.h"
+#include "EclipseTable.h"
+#include "AtmosphericLookup.h"
+#include "CelestialBodies.h"
+#include "AstronomyScalar.h"
+#include "SkyStateEvaluator.h"
+#include "TaskGraph.h"
+#include "SkySnapshot.h"
+#include "SkyTimeline.h"
 #include "PrivatePtr.h"
 
+#include <future>
+
 namespace Caelum
 {
     /** This is the "root class" of caelum.
@@ -146,6 +159,7 @@ namespace Caelum
 
         /// Minimum ambient light; only useful if mManageAmbientLight
         Ogre::ColourValue mMinimumAmbientLight;
+        Ogre::ColourValue mLunarEclipseColour;
 
         /// If only one light source should enabled at a time.
         bool mEnsureSingleLightSource;
@@ -153,19 +167,108 @@ namespace Caelum
         /// Ensure only one of the light sources casts shadows.
         bool mEnsureSingleShadowSource;
 
+        /// Most sky lights enabled at once; 0 for no limit.
+        int mMaxSkyLights;
+
+        /// Refraction table for the sun and moon directions.
+        AtmosphericLookup mAtmosphere;
+        bool mAtmosphericRefraction;
+
 		/// The sky gradients image (for lookups).
-        std::unique_ptr<Ogre::Image> mSkyGradientsImage;
+        ColourGradient mSkyGradients;
 
         /// The sun gradients image (for lookups).
-        std::unique_ptr<Ogre::Image> mSunColoursImage;
+        ColourGradient mSunColours;
 
         /// Observer Latitude (on the earth).
         Ogre::Degree mObserverLatitude;
         /// Observer Longitude (on the earth).
         Ogre::Degree mObserverLongitude;
 
+        /** Observer for getSunDirection, getMoonDirection and evaluateClockDomain.
+         *  Updates evaluate through the observer of their SkyFrame instead.
+         */
+        FastObserver mObserver;
+
+        /// Bring mObserver to the current location and a julian day.
+        void updateObserver (LongReal jday);
+
+        /// Bring mObserver to a location and a julian day.
+        void updateObserver (LongReal jday, Ogre::Degree longitude, Ogre::Degree latitude);
+
         static const Ogre::Vector3 makeDirection (
                 Ogre::Degree azimuth, Ogre::Degree altitude);
+        static const Ogre::Vector3 makeDirection (
+                const FastAstronomy::HorizontalVector &direction);
+
+        /** A SkyState with what only CaelumSystem needs on top.
+         *  Fog multipliers are left out; applySkyState takes them as
+         *  they are when it runs.
+         */
+        struct SkyFrame: public SkyFrameEvaluator::Frame
+        {
+            Ogre::Degree longitude, latitude;
+            Real timeScale;
+            Ogre::Vector3 sunDirection, moonDirection;
+        };
+
+        /** Astronomy and colour lookups for a clock and place.
+         *  SkyFrameEvaluator with this system's timeline, keyframes and
+         *  extra bodies; bodies have the indices of mCelestialBodyLights.
+         *  Doesn't touch Ogre objects or components, so it can run on the
+         *  sky state worker.
+         */
+        void computeSkyState (const UniversalClock &clock,
+                Ogre::Degree longitude, Ogre::Degree latitude, const SkyStateConfig &config,
+                CachedSky &cache, SkyFrame &frame);
+
+        /** Set everything in the components from a sky state.
+         *  @param timeSinceLastFrame Real time to animate clouds and
+         *  precipitation by, times the state's time scale, and to throttle by.
+         *  @param force Update every component whatever its throttle says.
+         */
+        void applySkyState (const SkyFrame &frame, Real timeSinceLastFrame, bool force);
+
+        /// computeSkyState then applySkyState.
+        void applySky (const UniversalClock &clock,
+                Ogre::Degree longitude, Ogre::Degree latitude, CachedSky &cache,
+                SkyFrame &frame, Real timeSinceLastFrame, bool force);
+
+        /// Compute the main clock's state for the next frame on the worker.
+        void scheduleSkyState ();
+
+        /// Main clock's sky as last applied, for other threads.
+        SkySnapshotBuffer mSkySnapshots;
+
+        /// Publish the main clock's sky after applying it.
+        void publishSkySnapshot (const SkyFrame &frame);
+
+        /// Sky of the main clock and location.
+        CachedSky mSky;
+
+        /// Named clocks; see createClockDomain.
+        std::map<Ogre::String, std::unique_ptr<ClockDomain> > mClockDomains;
+        std::map<Ogre::Viewport*, ClockDomain*> mViewportClockDomains;
+
+        /// Domain the components currently show; null for the main clock.
+        ClockDomain *mAppliedClockDomain;
+
+        /// Main clock states; the worker fills the back one while the front one is shown.
+        SkyFrame mSkyStates[2];
+        int mFrontSkyState;
+
+        /// State of the last clock domain applied.
+        SkyFrame mDomainSkyState;
+
+        /// Sky state being computed by the worker, if any.
+        std::future<void> mPendingSkyState;
+        bool mAsynchronousSkyState;
+
+        /// If the back state was finished and not shown yet.
+        bool mSkyStateFinished;
+
+        /// If the front state was ever computed.
+        bool mSkyStateValid;
 		
 		// References to sub-components
         std::unique_ptr<UniversalClock> mUniversalClock;
@@ -178,6 +281,29 @@ namespace Caelum
         std::unique_ptr<CloudSystem> mCloudSystem;
 		std::unique_ptr<PrecipitationController> mPrecipitationController;
 		std::unique_ptr<DepthComposer> mDepthComposer;
+        std::unique_ptr<EphemerisCache> mEphemerisCache;
+        std::unique_ptr<EclipseTable> mEclipseTable;
+
+        /** Extra suns and moons; one light per body, same indices.
+         *  Updated by computeSkyState, possibly on the worker; the states
+         *  are only read from the SkyFrame it fills.
+         */
+        CelestialBodies mCelestialBodies;
+        std::vector<std::unique_ptr<BaseSkyLight> > mCelestialBodyLights;
+
+        /** Sun, moon and extra bodies; the UPDATE_LIGHTS group with updateAmbientLight.
+         *  The colours are the state's after eclipses.
+         */
+        void updateLights (const SkyFrame &frame,
+                const Ogre::ColourValue &sunLightColour,
+                const Ogre::ColourValue &moonLightColour, const Ogre::ColourValue &moonBodyColour);
+
+        /// Scene ambient light from the sky lights, after updateLights.
+        void updateAmbientLight ();
+
+        /// Enable the brightest sky lights up to the limit; see setMaxSkyLights.
+        void limitSkyLights (const std::vector<CelestialBodies::State> &bodies,
+                const Ogre::ColourValue &sunLightColour, const Ogre::ColourValue &moonLightColour);
 
     public:
         typedef std::set<Ogre::Viewport*> AttachedViewportSet;
@@ -228,6 +354,57 @@ namespace Caelum
                     | CAELUM_COMPONENT_GROUND_FOG,
         };
 
+        /** Groups of components throttled together.
+         *  @see getUpdateThrottle
+         */
+        enum UpdateGroup
+        {
+            /// Sky dome sun direction and haze colour.
+            UPDATE_SKY_DOME,
+
+            /// Image and point starfield rotation.
+            UPDATE_STARFIELD,
+
+            /// Cloud colours and animation; skipped time is carried to the next update.
+            UPDATE_CLOUDS,
+
+            /// Scene fog, ground fog and screen space fog.
+            UPDATE_FOG,
+
+            /// Sun, moon and extra body lights, the sky light limit and ambient light.
+            UPDATE_LIGHTS,
+
+            UPDATE_GROUP_COUNT
+        };
+
+    private:
+        UpdateThrottle mUpdateThrottles[UPDATE_GROUP_COUNT];
+
+        /// Cloud animation time held back by the clouds throttle.
+        Real mSkippedCloudTime;
+
+        /// Component updates of the last applySkyState, with their timings.
+        TaskGraph mUpdateGraph;
+
+        /// Runs the update graph's astronomy when mParallelUpdate is set.
+        std::unique_ptr<TaskExecutor> mTaskExecutor;
+        bool mParallelUpdate;
+
+        /// Settings copied into every CachedSky's keyframes before evaluating.
+        bool mKeyframedSky;
+        LongReal mKeyframeInterval;
+        LongReal mKeyframeMaxAngle;
+
+        /// Main clock's precomputed sky states; null unless enabled.
+        std::unique_ptr<SkyTimeline> mSkyTimeline;
+
+        /** Drop the keyframes of the main clock and every domain, and the timeline.
+         *  Call before changing what the sky state config points to.
+         */
+        void invalidateSkySamples ();
+
+    public:
+
         static const String DEFAULT_SKY_GRADIENTS_IMAGE;
         static const String DEFAULT_SUN_COLOURS_IMAGE;
     
@@ -401,6 +578,44 @@ namespace Caelum
 		/// Gets the universal clock.
         inline UniversalClock *getUniversalClock () const { return mUniversalClock.get(); }
 
+        /** Create a named clock domain, or get it if it already exists.
+         *  The domain's clock is advanced in updateSubcomponents with the
+         *  same frame time as the main clock, times its own time scale.
+         *  @see ClockDomain
+         */
+        ClockDomain* createClockDomain (const Ogre::String &name);
+
+        /// Get a clock domain by name; null if there is none.
+        ClockDomain* getClockDomain (const Ogre::String &name) const;
+
+        /// Destroy a clock domain; viewports bound to it go back to the main clock.
+        void destroyClockDomain (const Ogre::String &name);
+
+        /** Show a viewport with a clock domain's time and place.
+         *  Components are switched to the domain in preViewportUpdate,
+         *  only when the previous viewport showed a different one.
+         *  @param domain Domain to bind to, or null for the main clock.
+         */
+        void setViewportClockDomain (Ogre::Viewport *viewport, ClockDomain *domain);
+
+        /// Domain a viewport is bound to; null for the main clock.
+        ClockDomain* getViewportClockDomain (Ogre::Viewport *viewport) const;
+
+        /** Switch all components to a clock domain's time and place.
+         *  preViewportUpdate does this for bound viewports; call it
+         *  yourself before rendering if you render without it. Clouds and
+         *  precipitation only animate with the main clock.
+         *  @param domain Domain to show, or null for the main clock.
+         */
+        void applyClockDomain (ClockDomain *domain);
+
+        /** Sky of a clock domain at its current time, for game logic.
+         *  Shares the per-frame evaluation with the viewports on that domain.
+         *  For a ticking clock this is the current tick, not interpolated.
+         *  @param domain Domain, or null for the main clock.
+         */
+        const FastAstronomy::SkyEvaluation& evaluateClockDomain (ClockDomain *domain);
+
 		/// Get the current sky dome, or null if disabled.
         inline SkyDome* getSkyDome () const { return mSkyDome.get (); }
 		/// Set the skydome, or null to disable.
@@ -416,6 +631,37 @@ namespace Caelum
 		/// Set the moon, or null to disable.
 		void setMoon (Moon* obj);
 
+        /** Add an extra sun or moon; takes ownership of the light.
+         *  Bodies are evaluated together once per update and drive their
+         *  lights' direction and colour; a Moon light also gets its phase.
+         *  The sun and moon above keep their own models.
+         *  @param light Light to show the body with; may be null to only
+         *  compute its state.
+         *  @return Index of the body.
+         */
+        size_t addCelestialBody (const CelestialBodies::Body &body, BaseSkyLight *light);
+
+        /// Remove all extra suns and moons, with their lights.
+        void clearCelestialBodies ();
+
+        /// Number of extra suns and moons.
+        inline size_t getCelestialBodyCount () const { return mCelestialBodyLights.size (); }
+
+        /// Definition of an extra body.
+        inline const CelestialBodies::Body& getCelestialBody (size_t index) const { return mCelestialBodies.getBody (index); }
+
+        /** States of the extra bodies the last update applied, same indices.
+         *  Bodies added since then are missing until the next update. The
+         *  sky state worker fills the other frame, so these are safe to
+         *  read while it runs.
+         */
+        inline const std::vector<CelestialBodies::State>& getCelestialBodyStates () const {
+            return mSkyStates[mFrontSkyState].bodies;
+        }
+
+        /// Light of an extra body; may be null.
+        inline BaseSkyLight* getCelestialBodyLight (size_t index) const { return mCelestialBodyLights[index].get (); }
+
 		/// Gets the current image starfield, or null if disabled.
         inline ImageStarfield* getImageStarfield () const { return mImageStarfield.get (); }
 		/// Set image starfield, or null to disable.
@@ -445,6 +691,50 @@ namespace Caelum
 		inline DepthComposer* getDepthComposer () { return mDepthComposer.get (); }
         /// Set depth composer; or null to disable.
 		void setDepthComposer (DepthComposer *obj);
+
+        /** Observer of the sky state the last update applied.
+         *  Its evaluation counters tell how often the latitude and
+         *  sidereal angle trigonometry was actually recomputed; with a
+         *  fixed location that is once per frame. With
+         *  setAsynchronousSkyState the two frames in flight have an
+         *  observer each, so each counts every other frame.
+         */
+        inline const FastObserver& getObserver () const { return mSkyStates[mFrontSkyState].observer; }
+
+        /** Get the ephemeris cache; or null if disabled.
+         *  @see setEphemerisCache
+         */
+        inline EphemerisCache* getEphemerisCache () { return mEphemerisCache.get (); }
+
+        /** Set an ephemeris cache; or null to disable (the default).
+         *  If set then getSunDirection and getMoonDirection are evaluated
+         *  from the cache's polynomial fit when possible and only fall back
+         *  to the exact astronomy routines outside the fitted window. The
+         *  cache is advanced in updateSubcomponents.
+         */
+        void setEphemerisCache (EphemerisCache *obj);
+
+        /** Get the eclipse table; or null if disabled.
+         *  @see setEclipseTable
+         */
+        inline EclipseTable* getEclipseTable () { return mEclipseTable.get (); }
+
+        /** Set an eclipse table; or null to disable (the default).
+         *  The table should already be generated for the dates you use.
+         *  During a solar eclipse the sun's light is dimmed by the covered
+         *  fraction of its disc, as seen by the observer. During a lunar
+         *  eclipse the moon is tinted with the lunar eclipse colour in
+         *  proportion to the part inside the umbra.
+         */
+        void setEclipseTable (EclipseTable *obj);
+
+        /** Colour multiplier for the part of the moon inside the umbra.
+         *  Default is a dark red.
+         */
+        inline void setLunarEclipseColour (const Ogre::ColourValue &value) { mLunarEclipseColour = value; }
+
+        /// @see setLunarEclipseColour
+        inline const Ogre::ColourValue getLunarEclipseColour () const { return mLunarEclipseColour; }
  
 		/** Enables/disables Caelum managing standard Ogre::Scene fog.
             This makes CaelumSystem control standard Ogre::Scene fogging. It
@@ -570,6 +860,174 @@ namespace Caelum
         /// See setEnsureSingleShadowSource
         inline bool getEnsureSingleShadowSource () const { return mEnsureSingleShadowSource; }
 
+        /** Keep at most this many of caelum's light sources active (the brightest).
+         *  Like setEnsureSingleLightSource, but for any number of lights;
+         *  the sun, the moon and extra celestial bodies are ranked together
+         *  every update, by the sum of the red, green and blue of their
+         *  light colour. Disabled lights still add to ambient lighting.
+         *  0 means no limit, which is the default. setEnsureSingleLightSource
+         *  takes precedence.
+         */
+        inline void setMaxSkyLights (int value) { mMaxSkyLights = value; }
+
+        /// See setMaxSkyLights
+        inline int getMaxSkyLights () const { return mMaxSkyLights; }
+
+        /** When a group of components gets new parameters.
+         *  Every group updates every frame by default. Throttled groups
+         *  keep their Ogre state from the last update they were allowed;
+         *  the throttle counts updates done and skipped.
+         *
+         *  Changes to CaelumSystem settings like fog multipliers show at
+         *  the group's next update; invalidate the throttle to force one.
+         *  Viewports bound to clock domains force updates when switching,
+         *  so throttling only saves work in frames that show the main
+         *  clock alone.
+         */
+        inline UpdateThrottle& getUpdateThrottle (UpdateGroup group) { return mUpdateThrottles[group]; }
+        inline const UpdateThrottle& getUpdateThrottle (UpdateGroup group) const { return mUpdateThrottles[group]; }
+
+        /** Compute the sky state on a worker thread.
+         *
+         *  Astronomy and colour lookups for the next frame run in the
+         *  background while the current frame renders; updateSubcomponents
+         *  only applies the finished state to the components. Visuals are
+         *  the same as without, one frame late. Disabled by default.
+         *
+         *  Setters of CaelumSystem wait for the worker where needed. Wait
+         *  yourself with waitForSkyState before changing the ephemeris
+         *  cache, eclipse table or celestial bodies through their own
+         *  pointers, or reading celestial body states. Clock domains wait
+         *  too when applied, so they take the work back to the render thread.
+         */
+        void setAsynchronousSkyState (bool value);
+
+        /// @see setAsynchronousSkyState
+        inline bool getAsynchronousSkyState () const { return mAsynchronousSkyState; }
+
+        /** Run component updates as a task graph on an executor.
+         *
+         *  Once the sky state is known the components are independent.
+         *  Their astronomy (starfield precession, planets and satellites)
+         *  then runs on the executor while this thread sets the sky dome,
+         *  fog, lights, clouds and precipitation; anything touching Ogre
+         *  stays on the thread calling updateSubcomponents, in the same
+         *  order as without the graph.
+         *
+         *  Without an executor from setTaskExecutor a ThreadPoolExecutor
+         *  is created. Disabled by default; then the graph runs inline.
+         */
+        void setParallelUpdate (bool value);
+
+        /// @see setParallelUpdate
+        inline bool getParallelUpdate () const { return mParallelUpdate; }
+
+        /** Executor for the update graph; CaelumSystem takes ownership.
+         *  Wrap an engine's job system or Ogre's WorkQueue in a
+         *  TaskExecutor to share its threads. Pass null to fall back to
+         *  the built-in pool when parallel updates are enabled.
+         */
+        void setTaskExecutor (TaskExecutor *executor);
+
+        /// @see setTaskExecutor
+        inline TaskExecutor* getTaskExecutor () const { return mTaskExecutor.get (); }
+
+        /** Component updates of the last frame, with the timing of each.
+         *  @see TaskGraph::dumpTimings, logUpdateTimings
+         */
+        inline const TaskGraph& getUpdateGraph () const { return mUpdateGraph; }
+
+        /// Write the last frame's update timings and critical path to the Ogre log.
+        void logUpdateTimings () const;
+
+        /** Sky of the main clock as of the last updateSubcomponents.
+         *  Safe to call from any thread, unlike everything else here:
+         *  it never blocks and never sees a half written update. Clock
+         *  domains are not published.
+         */
+        inline SkySnapshot getSkySnapshot () const { return mSkySnapshots.read (); }
+
+        /// Buffer getSkySnapshot reads; poll its version to see new updates.
+        inline const SkySnapshotBuffer& getSkySnapshotBuffer () const { return mSkySnapshots; }
+
+        /** Sample the sky at intervals and interpolate in between.
+         *
+         *  Sun and moon move about a quarter degree a minute at most, so
+         *  at normal time scales most frames can blend two exact states
+         *  instead of evaluating astronomy and the colour model again.
+         *  Only for clocks without a tick length, which already
+         *  interpolate between ticks. Clocks running fast enough to pass
+         *  a whole interval every frame are still evaluated exactly.
+         *  Disabled by default. @see KeyframedSky
+         */
+        void setKeyframedSky (bool value);
+
+        /// @see setKeyframedSky
+        inline bool getKeyframedSky () const { return mKeyframedSky; }
+
+        /// Most game seconds between keyframes; 0 for no limit. 60 by default.
+        void setKeyframeInterval (LongReal seconds);
+
+        /// @see setKeyframeInterval
+        inline LongReal getKeyframeInterval () const { return mKeyframeInterval; }
+
+        /// Most the sun or moon may move between keyframes; 0 for no limit. A quarter degree by default.
+        void setKeyframeMaxAngle (Ogre::Radian value);
+
+        /// @see setKeyframeMaxAngle
+        inline Ogre::Radian getKeyframeMaxAngle () const { return Ogre::Radian (Real (mKeyframeMaxAngle)); }
+
+        /** Precompute sky states for the main clock on a background thread.
+         *
+         *  For time-lapses, where every frame jumps minutes of sky time,
+         *  and for scrubbing time in editors. Frames read interpolated
+         *  states from a bounded window around the current time, so they
+         *  cost the same at any time scale. Takes precedence over
+         *  keyframes; clocks with a tick length and clock domains are
+         *  evaluated as usual. The timeline leaves out the ephemeris
+         *  cache, which changes every frame. Disabled by default.
+         *  @see SkyTimeline
+         */
+        void setSkyTimeline (bool value);
+
+        /// @see setSkyTimeline
+        inline bool getSkyTimelineEnabled () const { return mSkyTimeline.get () != 0; }
+
+        /// Timeline for tuning its spacing and capacity and reading its counters; null if disabled.
+        inline SkyTimeline* getSkyTimeline () const { return mSkyTimeline.get (); }
+
+        /** Keyframes of the main clock, with their counters and error statistics.
+         *  Waits for the sky state worker, which updates them; the
+         *  reference may only be read until the next updateSubcomponents.
+         */
+        const KeyframedSky& getSkyKeyframes ();
+
+        /// Compare every new keyframe bracket of the main clock with an exact state; waits for the worker.
+        void setKeyframeErrorTracking (bool value);
+
+        /// Zero the main clock's keyframe counters and errors; waits for the worker.
+        void resetKeyframeStatistics ();
+
+        /// Wait until the worker is done with the sky state it is computing, if any.
+        void waitForSkyState ();
+
+        /** Apply atmospheric refraction to the sun and moon directions.
+         *  This lifts them by about half a degree at the horizon, so the
+         *  sun rises earlier and sets later, like the real one.
+         *  Enabled by default. @see AtmosphericLookup
+         */
+        void setAtmosphericRefraction (bool value);
+
+        /// @see setAtmosphericRefraction
+        inline bool getAtmosphericRefraction () const { return mAtmosphericRefraction; }
+
+        /** Colour model, caches and refraction as CaelumSystem uses them.
+         *  Pass it to SkyStateEvaluator to compute the sky this system
+         *  would show at any time and place. It borrows from this object;
+         *  don't keep it past the next change of images or caches.
+         */
+        SkyStateConfig getSkyStateConfig () const;
+
 		/** Gets the fog colour for a certain daytime.
 			@param time The current time.
 			@param sunDir The sun direction.
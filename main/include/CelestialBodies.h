@@ -0,0 +1,140 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#ifndef CAELUM__CELESTIAL_BODIES_H
+#define CAELUM__CELESTIAL_BODIES_H
+
+#include "CaelumCorePrerequisites.h"
+#include "AstronomyScalar.h"
+
+namespace Caelum
+{
+    /** A list of extra suns and moons, defined by orbital elements.
+     *
+     *  The real sun and moon have their own theories in Astronomy; this is
+     *  for invented skies. Every body moves on a Kepler orbit around the
+     *  observer's planet, with elements in the same form Astronomy uses
+     *  for the sun and planets (stjarnhimlen.se): each angle is a value
+     *  plus a rate times days since 2000 Jan 0.0, in degrees relative to
+     *  the ecliptic. The sun's own elements give back the real sun.
+     *
+     *  update evaluates all bodies in one pass over plain arrays, one
+     *  stage at a time (elements, Kepler's equation, directions, then
+     *  phases and colours), like Astronomy::getPlanetPositions.
+     *
+     *  Stars shine with their colour times intensity, falling off with
+     *  the square of the distance relative to the semi-major axis. Moons
+     *  do the same times their illuminated fraction; the illuminating
+     *  star is another body in the list or the real sun, and is treated
+     *  as infinitely far away. Both fade out just below the horizon.
+     *
+     *  @see CaelumSystem::addCelestialBody
+     */
+    class CAELUM_CORE_EXPORT CelestialBodies
+    {
+    public:
+        enum BodyType
+        {
+            /// Emits light; always fully lit.
+            BODY_STAR,
+            /// Reflects light from its illuminator; has phases.
+            BODY_MOON,
+        };
+
+        /// Illuminator for moons lit by the real sun.
+        static const int ILLUMINATED_BY_SUN = -1;
+
+        /// Definition of one body.
+        struct Body
+        {
+            BodyType type;
+            /// Longitude of the ascending node.
+            LongReal N0, N1;
+            /// Inclination.
+            LongReal i0, i1;
+            /// Argument of periapsis.
+            LongReal w0, w1;
+            /// Semi-major axis; any unit, shared with radius.
+            LongReal a;
+            /// Eccentricity, below 1.
+            LongReal e;
+            /// Mean anomaly.
+            LongReal M0, M1;
+            /// Radius of the body, in the unit of a.
+            LongReal radius;
+            /// Light colour at full brightness.
+            float colour[3];
+            /// Light multiplier at full brightness and mean distance.
+            float intensity;
+            /// For moons: index of the star lighting it, or ILLUMINATED_BY_SUN.
+            int illuminator;
+
+            /// A white star with the size and mean motion of the sun.
+            Body ();
+        };
+
+        /// Evaluated state of one body.
+        struct State
+        {
+            /// Unit vector to the body, like Astronomy's horizontal vectors.
+            float north, east, up;
+            /// Distance in the unit of Body::a.
+            LongReal distance;
+            /// Apparent radius, in degrees.
+            float angularRadius;
+            /// Illuminated fraction of the disc; 1 for stars.
+            float phase;
+            /// Intensity after distance, phase and horizon fade.
+            float brightness;
+            /// Light colour; Body::colour times brightness.
+            float lightColour[3];
+        };
+
+        CelestialBodies ();
+
+        /** Add a body.
+         *  @return Index of the body; indices never change until clear.
+         */
+        size_t add (const Body &body);
+
+        /// Remove all bodies.
+        void clear ();
+
+        inline size_t getBodyCount () const { return mBodies.size (); }
+
+        /// Definition of a body; changes take effect on the next update.
+        inline Body& getBody (size_t index) { return mBodies[index]; }
+        inline const Body& getBody (size_t index) const { return mBodies[index]; }
+
+        /** Evaluate all bodies.
+         *  @param sinLatitude, cosLatitude Observer latitude.
+         *  @param sinSiderealAngle, cosSiderealAngle Local sidereal angle.
+         */
+        void update (LongReal jday,
+                LongReal sinLatitude, LongReal cosLatitude,
+                LongReal sinSiderealAngle, LongReal cosSiderealAngle);
+
+        /// Evaluate all bodies for an observer's time and location.
+        template <class Policy>
+        void update (const BasicObserver<Policy> &observer)
+        {
+            update (LongReal (observer.getJulianDay ()),
+                    observer.getSinLatitude (), observer.getCosLatitude (),
+                    observer.getSinLocalSiderealAngle (), observer.getCosLocalSiderealAngle ());
+        }
+
+        /// State of a body from the last update.
+        inline const State& getState (size_t index) const { return mStates[index]; }
+
+    private:
+        std::vector<Body> mBodies;
+        std::vector<State> mStates;
+
+        /// Per body scratch arrays for update.
+        std::vector<LongReal> mMeanAnomaly, mEccentricAnomaly;
+        std::vector<LongReal> mEclipticX, mEclipticY, mEclipticZ;
+    };
+}
+
+#endif // CAELUM__CELESTIAL_BODIES_H
@@ -0,0 +1,60 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#ifndef CAELUM__CLOCK_DOMAIN_H
+#define CAELUM__CLOCK_DOMAIN_H
+
+#include "CaelumPrerequisites.h"
+#include "UniversalClock.h"
+#include "SkyFrameEvaluator.h"
+
+namespace Caelum
+{
+    /** A named clock and observer location sharing one CaelumSystem.
+     *
+     *  Regions of a sharded world or instanced dungeons can run their own
+     *  time, at their own scale or offset, and stand on their own spot of
+     *  the planet while drawing with the same sky components. Viewports
+     *  are bound to a domain with CaelumSystem::setViewportClockDomain;
+     *  unbound viewports use CaelumSystem's own clock and location.
+     *
+     *  The clock is advanced by CaelumSystem::updateSubcomponents along
+     *  with the main one. Astronomy is evaluated at most once per domain
+     *  and frame, however many viewports show it.
+     *
+     *  @see CaelumSystem::createClockDomain
+     */
+    class CAELUM_EXPORT ClockDomain
+    {
+    public:
+        /// Starts at J2000 at latitude 45, longitude 0, like CaelumSystem.
+        explicit ClockDomain (const Ogre::String &name);
+
+        inline const Ogre::String& getName () const { return mName; }
+
+        /// Clock of this domain; set its time and scale freely.
+        inline UniversalClock* getUniversalClock () { return &mClock; }
+        inline const UniversalClock* getUniversalClock () const { return &mClock; }
+
+        /// Observer longitude. East is positive, west is negative.
+        inline void setObserverLongitude (Ogre::Degree value) { mObserverLongitude = value; }
+        inline const Ogre::Degree getObserverLongitude () const { return mObserverLongitude; }
+
+        /// Observer latitude. North is positive, south is negative.
+        inline void setObserverLatitude (Ogre::Degree value) { mObserverLatitude = value; }
+        inline const Ogre::Degree getObserverLatitude () const { return mObserverLatitude; }
+
+        /// Sky of this domain, as last evaluated by CaelumSystem.
+        inline const CachedSky& getCachedSky () const { return mSky; }
+        inline CachedSky& getCachedSky () { return mSky; }
+
+    private:
+        Ogre::String mName;
+        UniversalClock mClock;
+        Ogre::Degree mObserverLongitude, mObserverLatitude;
+        CachedSky mSky;
+    };
+}
+
+#endif // CAELUM__CLOCK_DOMAIN_H
@@ -0,0 +1,162 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#ifndef CAELUM__ECLIPSE_TABLE_H
+#define CAELUM__ECLIPSE_TABLE_H
+
+#include "CaelumCorePrerequisites.h"
+
+namespace Caelum
+{
+    /** Precomputed table of eclipses and close conjunctions.
+     *
+     *  Finding an eclipse means minimizing the separation of the sun and
+     *  moon around every new and full moon; far too much work to repeat
+     *  every frame. This class does that once for a range of dates and
+     *  keeps the results in small sorted arrays. Per frame queries are a
+     *  binary search, so their cost does not depend on how many years the
+     *  table covers.
+     *
+     *  Generation splits the range into chunks which are scanned on
+     *  separate threads; the results are merged and sorted at the end.
+     *
+     *  Eclipses are computed with the planetarium lunar theory and the
+     *  distance terms from LunarTheory, whatever CAELUM_LUNAR_THEORY is.
+     *  Positions are good to an arc minute or so; with universal time
+     *  passed for dynamical time, contact times are good to a couple of
+     *  minutes. Enough to dim the light at the right moment, not enough
+     *  to plan an expedition.
+     *
+     *  Conjunctions are closest approaches of the moon and the planets
+     *  from Astronomy::getPlanetPositions, as seen from the earth's center.
+     */
+    class CAELUM_CORE_EXPORT EclipseTable
+    {
+    public:
+        enum EclipseType
+        {
+            SOLAR_PARTIAL,
+            SOLAR_ANNULAR,
+            SOLAR_TOTAL,
+            LUNAR_PENUMBRAL,
+            LUNAR_PARTIAL,
+            LUNAR_TOTAL,
+        };
+
+        /// One eclipse, as seen from the earth's center.
+        struct Eclipse
+        {
+            /** First contact, as a julian day.
+             *  For solar eclipses this is the first contact anywhere on
+             *  earth; for lunar eclipses the moon entering the penumbra.
+             */
+            LongReal start;
+            /// Time of the smallest geocentric separation.
+            LongReal maximum;
+            /// Last contact; @see start.
+            LongReal end;
+            /** Magnitude of the eclipse.
+             *  Solar: fraction of the sun's diameter covered at best; for
+             *  central eclipses the ratio of apparent diameters.
+             *  Lunar: fraction of the moon's diameter inside the umbra;
+             *  negative for penumbral eclipses.
+             */
+            float magnitude;
+            EclipseType type;
+
+            inline bool isSolar () const { return type <= SOLAR_TOTAL; }
+        };
+
+        /// Conjunction body for the moon; planets use Astronomy::Planet values.
+        static const int MOON = -1;
+
+        /// Closest approach of two bodies.
+        struct Conjunction
+        {
+            /// Time of closest approach, as a julian day.
+            LongReal time;
+            /// Geocentric separation, in degrees.
+            float separation;
+            /// The two bodies; MOON or Astronomy::Planet values.
+            signed char first, second;
+        };
+
+        EclipseTable ();
+
+        /** Fill the table for a range of julian days.
+         *  This replaces any previous contents and blocks until all the
+         *  worker threads are done; a century takes on the order of a
+         *  second of cpu time.
+         */
+        void generate (LongReal start, LongReal end);
+
+        /// Start of the generated range.
+        inline LongReal getStart () const { return mStart; }
+
+        /// End of the generated range.
+        inline LongReal getEnd () const { return mEnd; }
+
+        /** Number of threads used by generate.
+         *  The default 0 means std::thread::hardware_concurrency.
+         */
+        inline void setThreadCount (unsigned value) { mThreadCount = value; }
+        inline unsigned getThreadCount () const { return mThreadCount; }
+
+        /** Conjunctions closer than this are recorded, in degrees.
+         *  Default 1; 0 disables the conjunction search.
+         */
+        inline void setConjunctionThreshold (LongReal value) { mConjunctionThreshold = value; }
+        inline LongReal getConjunctionThreshold () const { return mConjunctionThreshold; }
+
+        /// All eclipses, sorted by time.
+        inline const std::vector<Eclipse>& getEclipses () const { return mEclipses; }
+
+        /// All conjunctions, sorted by time.
+        inline const std::vector<Conjunction>& getConjunctions () const { return mConjunctions; }
+
+        /// Eclipse in progress at a certain time; or null.
+        const Eclipse* findEclipse (LongReal jday) const;
+
+        /// First eclipse which has not ended at a certain time; or null.
+        const Eclipse* findNextEclipse (LongReal jday) const;
+
+        /// First conjunction at or after a certain time; or null.
+        const Conjunction* findNextConjunction (LongReal jday) const;
+
+        /** Fraction of the sun's disc not covered by the moon, for an observer.
+         *  This is 1 unless a solar eclipse from the table is in progress;
+         *  then the moon's parallax is applied for the observer and the
+         *  overlap of the two discs is computed. Limb darkening is ignored.
+         *  @param longitude Observer longitude in degrees east.
+         *  @param latitude Observer latitude in degrees north.
+         */
+        LongReal getSunVisibleFraction (LongReal jday, LongReal longitude, LongReal latitude) const;
+
+        /** Fraction of the moon's disc inside the earth's umbra.
+         *  This is 0 unless a lunar eclipse from the table is in progress.
+         *  It does not depend on the observer.
+         */
+        LongReal getMoonUmbraFraction (LongReal jday) const;
+
+    private:
+        /// Results of scanning one chunk of the range.
+        struct Chunk
+        {
+            std::vector<Eclipse> eclipses;
+            std::vector<Conjunction> conjunctions;
+        };
+
+        static void scanEclipses (LongReal start, LongReal end, std::vector<Eclipse> &eclipses);
+        static void scanConjunctions (LongReal start, LongReal end, LongReal threshold,
+                std::vector<Conjunction> &conjunctions);
+
+        LongReal mStart, mEnd;
+        unsigned mThreadCount;
+        LongReal mConjunctionThreshold;
+        std::vector<Eclipse> mEclipses;
+        std::vector<Conjunction> mConjunctions;
+    };
+}
+
+#endif // CAELUM__ECLIPSE_TABLE_H
@@ -0,0 +1,161 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#ifndef CAELUM__EPHEMERIS_CACHE_H
+#define CAELUM__EPHEMERIS_CACHE_H
+
+#include "CaelumCorePrerequisites.h"
+#include <future>
+
+namespace Caelum
+{
+    /** Chebyshev-fitted cache of sun and moon positions.
+     *
+     *  The exact routines in Astronomy run a long chain of trigonometry for
+     *  every call. The sun and moon move slowly against the stars though,
+     *  so over a window of a few days their equatorial direction vectors
+     *  are very well approximated by low degree Chebyshev polynomials.
+     *  This class fits those polynomials around the current time and
+     *  evaluates them with a few multiply-adds per component.
+     *
+     *  Only the observer independent equatorial position is fitted; the
+     *  rotation to horizontal coordinates is still done exactly, so earth
+     *  rotation does not need to be captured by the polynomials.
+     *
+     *  The window slides with time: when update is called with a time past
+     *  the refit margin a new window centered on that time is fitted in the
+     *  background (if asynchronous) and swapped in when ready. Queries
+     *  outside the current window fail and the caller should fall back to
+     *  the exact routines.
+     *
+     *  After each fit the result is compared against the exact routines
+     *  between the fit nodes and the maximum error is recorded.
+     *
+     *  All methods must be called from the same thread; only the fitting
+     *  itself runs in the background.
+     */
+    class CAELUM_CORE_EXPORT EphemerisCache
+    {
+    public:
+        /** Constructor.
+         *  @param halfWidth Half the width of the fitted window, in days.
+         *  @param degree Degree of the fitted polynomials.
+         */
+        EphemerisCache (LongReal halfWidth = 1, int degree = 10);
+
+        /// Destructor. Waits for any pending fit.
+        ~EphemerisCache ();
+
+        /** Advance the cache to a certain time.
+         *  This swaps in finished fits and schedules a new one if the time is
+         *  outside the refit margin of the current window. Called from
+         *  CaelumSystem::updateSubcomponents.
+         */
+        void update (LongReal jday);
+
+        /// Discard the current fit; the next update will fit again.
+        void invalidate ();
+
+        /// Check if a time is inside the fitted window.
+        bool isValidAt (LongReal jday) const;
+
+        /** Get the sun's equatorial direction vector from the fit.
+         *  @return false if jday is outside the fitted window.
+         */
+        bool getEquatorialSunVector (LongReal jday, LongReal &x, LongReal &y, LongReal &z) const;
+
+        /** Get the moon's equatorial direction vector from the fit.
+         *  @return false if jday is outside the fitted window.
+         */
+        bool getEquatorialMoonVector (LongReal jday, LongReal &x, LongReal &y, LongReal &z) const;
+
+        /** Fitted equivalent of Astronomy::getHorizontalSunPosition.
+         *  @return false if jday is outside the fitted window.
+         */
+        bool getHorizontalSunPosition (
+                LongReal jday,
+                LongReal longitude, LongReal latitude,
+                LongReal &azimuth, LongReal &altitude) const;
+
+        /** Fitted equivalent of Astronomy::getHorizontalMoonPosition.
+         *  @return false if jday is outside the fitted window.
+         */
+        bool getHorizontalMoonPosition (
+                LongReal jday,
+                LongReal longitude, LongReal latitude,
+                LongReal &azimuth, LongReal &altitude) const;
+
+        /// Half width of newly fitted windows, in days.
+        inline void setHalfWidth (LongReal value) { mHalfWidth = value; }
+        inline LongReal getHalfWidth () const { return mHalfWidth; }
+
+        /// Degree of newly fitted polynomials.
+        inline void setDegree (int value) { mDegree = value; }
+        inline int getDegree () const { return mDegree; }
+
+        /** Fraction of the half width the clock can move away from the
+         *  window center before a refit is scheduled. Default 0.5.
+         *  Refitting before the clock actually leaves the window gives the
+         *  background fit time to finish.
+         */
+        inline void setRefitMargin (LongReal value) { mRefitMargin = value; }
+        inline LongReal getRefitMargin () const { return mRefitMargin; }
+
+        /** If fits should run on a background thread (default true).
+         *  If false update fits synchronously; this is useful for tests.
+         */
+        inline void setAsynchronous (bool value) { mAsynchronous = value; }
+        inline bool getAsynchronous () const { return mAsynchronous; }
+
+        /// Start of the current window, or 0 if there is no fit.
+        LongReal getWindowStart () const;
+
+        /// End of the current window, or 0 if there is no fit.
+        LongReal getWindowEnd () const;
+
+        /// Maximum angle between fitted and exact sun direction, in degrees.
+        LongReal getSunFitError () const;
+
+        /// Maximum angle between fitted and exact moon direction, in degrees.
+        LongReal getMoonFitError () const;
+
+        /// Number of fits completed so far.
+        inline unsigned long getFitCount () const { return mFitCount; }
+
+    private:
+        /// One fitted window; immutable once computed.
+        struct Fit
+        {
+            LongReal center;
+            LongReal halfWidth;
+            /// Chebyshev coefficients for x, y, z of sun and moon vectors.
+            std::vector<LongReal> sun[3];
+            std::vector<LongReal> moon[3];
+            LongReal sunError;
+            LongReal moonError;
+        };
+        typedef std::shared_ptr<const Fit> FitPtr;
+
+        static FitPtr computeFit (LongReal center, LongReal halfWidth, int degree);
+        static void evaluate (const std::vector<LongReal> *coeffs, LongReal t,
+                LongReal &x, LongReal &y, LongReal &z);
+
+        /// Map jday to [-1, 1] inside the window; false if outside.
+        bool getNormalizedTime (LongReal jday, LongReal &t) const;
+
+        /// Schedule a fit centered on jday.
+        void scheduleFit (LongReal jday);
+
+        FitPtr mFit;
+        std::future<FitPtr> mPendingFit;
+
+        LongReal mHalfWidth;
+        int mDegree;
+        LongReal mRefitMargin;
+        bool mAsynchronous;
+        unsigned long mFitCount;
+    };
+}
+
+#endif // CAELUM__EPHEMERIS_CACHE_H
@@ -115,6 +115,20 @@ namespace Caelum
         /// @copydoc FastGpuParamRef::doSet
         inline void set(const Ogre::GpuProgramParametersSharedPtr& params, const Ogre::Matrix4& val) const { doSet<const Ogre::Matrix4*>(params, &val, 1); }
 
+        /** Set an array of floats, starting at the bound parameter.
+         *  The count is in floats and must include any register padding;
+         *  for a float4 array that is four floats per element.
+         */
+        inline void setArray(const Ogre::GpuProgramParametersSharedPtr& params, const float *val, size_t count) const {
+            #if CAELUM_DEBUG_PARAM_REF
+                assert(params.get() == mParams.get());
+            #endif
+            assert(params);
+            if (mPhysicalIndex != InvalidPhysicalIndex) {
+                params->_writeRawConstants(mPhysicalIndex, val, count);
+            }
+        }
+
     private:
         #if CAELUM_DEBUG_PARAM_REF
             Ogre::GpuProgramParametersSharedPtr mParams;
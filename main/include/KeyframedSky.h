@@ -0,0 +1,113 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#ifndef CAELUM__KEYFRAMED_SKY_H
+#define CAELUM__KEYFRAMED_SKY_H
+
+#include "CaelumCorePrerequisites.h"
+#include "SkyStateEvaluator.h"
+
+namespace Caelum
+{
+    /** Sky states sampled at intervals and interpolated in between.
+     *
+     *  At normal time scales the sun and moon move by microradians per
+     *  frame, so evaluating the full sky every frame is mostly wasted.
+     *  This keeps two exact samples bracketing the current time and
+     *  interpolates between them: directions with the normalized lerp
+     *  of FastAstronomy::interpolateSky, colours, fog and eclipse
+     *  fractions linearly. When time runs past a sample the bracket moves
+     *  on by one interval, which costs one exact evaluation.
+     *
+     *  The interval is the smaller of a span of game time and the time
+     *  the fastest sky object needs to move by a maximum angle. If the
+     *  clock advances a whole interval per call, as with a large time
+     *  scale, samples would be needed every frame anyway; then the
+     *  current time is evaluated exactly instead, which is cheaper and
+     *  has no error.
+     *
+     *  With error tracking the middle of every new bracket is also
+     *  evaluated exactly and compared with the interpolation, which is
+     *  where the interpolation is worst.
+     */
+    class CAELUM_CORE_EXPORT KeyframedSky
+    {
+    public:
+        /** Upper bound of how fast a sky direction turns, in radians per second.
+         *  Diurnal rotation plus the moon's motion along its orbit.
+         */
+        static const LongReal MAX_ANGULAR_SPEED;
+
+        KeyframedSky ();
+
+        /// Most game seconds between samples; 0 for no limit. 60 by default.
+        inline void setInterval (LongReal seconds) { mInterval = seconds; }
+        inline LongReal getInterval () const { return mInterval; }
+
+        /// Most any direction may turn between samples, in radians; 0 for no limit. A quarter degree by default.
+        inline void setMaxAngle (LongReal radians) { mMaxAngle = radians; }
+        inline LongReal getMaxAngle () const { return mMaxAngle; }
+
+        /// Game seconds between samples with the current settings; 0 if every call is exact.
+        LongReal getEffectiveInterval () const;
+
+        /// Compare every new bracket's middle with an exact evaluation.
+        inline void setErrorTracking (bool value) { mErrorTracking = value; }
+        inline bool getErrorTracking () const { return mErrorTracking; }
+
+        /** Sky state at a julian day.
+         *  Same as SkyStateEvaluator::evaluate up to the interpolation
+         *  error. A different place or config starts new samples.
+         */
+        void evaluate (LongReal julianDay, LongReal longitude, LongReal latitude,
+                const SkyStateConfig &config, SkyState &state);
+
+        /// Drop the samples, for example after the config's images changed.
+        void invalidate ();
+
+        /// Calls to evaluate.
+        inline unsigned long getEvaluateCount () const { return mEvaluateCount; }
+
+        /// Exact evaluations done, for samples, fallbacks and error tracking.
+        inline unsigned long getExactCount () const { return mExactCount; }
+
+        /// Largest angle between an interpolated and exact sun or moon direction, in radians.
+        inline LongReal getMaxDirectionError () const { return mMaxDirectionError; }
+
+        /// Largest difference of an interpolated colour channel or fog density.
+        inline LongReal getMaxColourError () const { return mMaxColourError; }
+
+        /// Zero the counters and errors.
+        void resetStatistics ();
+
+        /// Interpolate every field of two states; directions like FastAstronomy::interpolateSky.
+        static void interpolate (const SkyState &from, const SkyState &to, LongReal alpha, SkyState &result);
+
+    private:
+        /// Exact state at a julian day, counted.
+        void sample (LongReal julianDay, SkyState &state);
+
+        /// Compare the middle of the bracket with an exact state.
+        void trackError ();
+
+        LongReal mInterval;
+        LongReal mMaxAngle;
+        bool mErrorTracking;
+
+        /// Bracketing samples, earlier first; for mLongitude, mLatitude and mConfig.
+        SkyState mSamples[2];
+        bool mValid;
+        LongReal mLongitude, mLatitude;
+        SkyStateConfig mConfig;
+
+        /// Previous call, to see how fast the clock runs.
+        LongReal mLastJulianDay;
+        bool mHaveLastJulianDay;
+
+        unsigned long mEvaluateCount, mExactCount;
+        LongReal mMaxDirectionError, mMaxColourError;
+    };
+}
+
+#endif // CAELUM__KEYFRAMED_SKY_H
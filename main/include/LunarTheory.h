@@ -0,0 +1,379 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#ifndef CAELUM__LUNAR_THEORY_H
+#define CAELUM__LUNAR_THEORY_H
+
+#include "CaelumCorePrerequisites.h"
+#include "BatchMath.h"
+
+namespace Caelum
+{
+    /** Precision tiers for the moon's position.
+     *  @see LunarTheory
+     */
+    enum LunarTheoryPrecision
+    {
+        /// A handful of terms; errors below a degree.
+        LUNAR_THEORY_GAME,
+        /// The 13+7 term series Caelum always used; errors below 10 arc minutes.
+        LUNAR_THEORY_CLASSIC,
+        /** Truncated ELP-2000/82 as given by Meeus (Astronomical Algorithms,
+         *  chapter 47); about 10 arc seconds against the full theory.
+         */
+        LUNAR_THEORY_PLANETARIUM,
+    };
+
+// The tier used by Astronomy::getEclipticMoonPositionRad; set from CMake.
+#ifndef CAELUM_LUNAR_THEORY
+    #define CAELUM_LUNAR_THEORY LUNAR_THEORY_CLASSIC
+#endif
+
+    /** Periodic term series for the moon's ecliptic position.
+     *
+     *  Each precision tier is a compile-time table of periodic terms plus
+     *  its own set of fundamental arguments. The series are summed by
+     *  template recursion over the table, so the compiler sees every
+     *  term's integer multipliers as constants and unrolls the whole sum.
+     *
+     *  All tiers take a julian day and return ecliptic longitude and
+     *  latitude in radians, like Astronomy::getEclipticMoonPositionRad.
+     *  The planetarium tier is meant to be evaluated at dynamical time;
+     *  Caelum passes universal time, which adds an error of roughly half
+     *  an arc minute for present-day dates.
+     */
+    namespace LunarTheory
+    {
+        /// One periodic term: coefficient * sin (d * D + m * M + mprim * M' + f * F).
+        struct Term
+        {
+            int d, m, mprim, f;
+            double coefficient;
+        };
+
+        /// Fundamental arguments, all in radians.
+        struct Arguments
+        {
+            /// Mean longitude.
+            double lprim;
+            /// Mean elongation.
+            double d;
+            /// Sun's mean anomaly.
+            double m;
+            /// Moon's mean anomaly.
+            double mprim;
+            /// Argument of latitude.
+            double f;
+            /// Earth orbit eccentricity factor for terms involving M.
+            double e;
+            /// Planetary perturbation arguments (planetarium tier only).
+            double a1, a2, a3;
+        };
+
+        /// Sine from the standard library.
+        struct StdTrig
+        {
+            static inline double sin (double x) { return std::sin (x); }
+        };
+
+        /// Branch-free sine; lets batch loops vectorize.
+        struct BatchTrig
+        {
+            static inline double sin (double x) { return BatchMath::sin (x); }
+        };
+
+        constexpr double DEG_TO_RAD = 1.74532925199432957692e-02;
+
+        /// Degrees (possibly large) to radians in [0, 2pi).
+        inline double reduceDegrees (double x) {
+            return (x - 360.0 * std::floor (x * (1.0 / 360.0))) * DEG_TO_RAD;
+        }
+
+        constexpr Term GAME_LONGITUDE_TERMS[] = {
+            { 0, 0, 1, 0, 0.1098 },
+            { 2, 0,-1, 0, 0.0222 },
+            { 2, 0, 0, 0, 0.0115 },
+            { 0, 0, 2, 0, 0.0037 },
+        };
+
+        constexpr Term GAME_LATITUDE_TERMS[] = {
+            { 0, 0, 0, 1, 0.0895 },
+            { 0, 0, 1, 1, 0.0049 },
+            { 0, 0, 1,-1, 0.0048 },
+        };
+
+        constexpr Term CLASSIC_LONGITUDE_TERMS[] = {
+            { 0, 0, 1, 0, 0.1098 },
+            { 2, 0,-1, 0, 0.0222 },
+            { 2, 0, 0, 0, 0.0115 },
+            { 0, 0, 2, 0, 0.0037 },
+            { 0, 1, 0, 0,-0.0032 },
+            { 0, 0, 0, 2,-0.0020 },
+            { 2, 0,-2, 0, 0.0010 },
+            { 2,-1,-1, 0, 0.0010 },
+            { 2, 0, 1, 0, 0.0009 },
+            { 2,-1, 0, 0, 0.0008 },
+            { 0,-1, 1, 0, 0.0007 },
+            { 1, 0, 0, 0,-0.0006 },
+            { 0, 1, 1, 0,-0.0005 },
+        };
+
+        constexpr Term CLASSIC_LATITUDE_TERMS[] = {
+            { 0, 0, 0, 1, 0.0895 },
+            { 0, 0, 1, 1, 0.0049 },
+            { 0, 0, 1,-1, 0.0048 },
+            { 2, 0, 0,-1, 0.0030 },
+            { 2, 0,-1, 1, 0.0010 },
+            { 2, 0,-1,-1, 0.0008 },
+            { 2, 0, 0, 1, 0.0006 },
+        };
+
+        /// Meeus table 47.A; coefficients in millionths of a degree.
+        constexpr Term PLANETARIUM_LONGITUDE_TERMS[] = {
+            { 0, 0, 1, 0, 6288774 }, { 2, 0,-1, 0, 1274027 }, { 2, 0, 0, 0, 658314 },
+            { 0, 0, 2, 0, 213618 }, { 0, 1, 0, 0,-185116 }, { 0, 0, 0, 2,-114332 },
+            { 2, 0,-2, 0, 58793 }, { 2,-1,-1, 0, 57066 }, { 2, 0, 1, 0, 53322 },
+            { 2,-1, 0, 0, 45758 }, { 0, 1,-1, 0,-40923 }, { 1, 0, 0, 0,-34720 },
+            { 0, 1, 1, 0,-30383 }, { 2, 0, 0,-2, 15327 }, { 0, 0, 1, 2,-12528 },
+            { 0, 0, 1,-2, 10980 }, { 4, 0,-1, 0, 10675 }, { 0, 0, 3, 0, 10034 },
+            { 4, 0,-2, 0, 8548 }, { 2, 1,-1, 0,-7888 }, { 2, 1, 0, 0,-6766 },
+            { 1, 0,-1, 0,-5163 }, { 1, 1, 0, 0, 4987 }, { 2,-1, 1, 0, 4036 },
+            { 2, 0, 2, 0, 3994 }, { 4, 0, 0, 0, 3861 }, { 2, 0,-3, 0, 3665 },
+            { 0, 1,-2, 0,-2689 }, { 2, 0,-1, 2,-2602 }, { 2,-1,-2, 0, 2390 },
+            { 1, 0, 1, 0,-2348 }, { 2,-2, 0, 0, 2236 }, { 0, 1, 2, 0,-2120 },
+            { 0, 2, 0, 0,-2069 }, { 2,-2,-1, 0, 2048 }, { 2, 0, 1,-2,-1773 },
+            { 2, 0, 0, 2,-1595 }, { 4,-1,-1, 0, 1215 }, { 0, 0, 2, 2,-1110 },
+            { 3, 0,-1, 0,-892 }, { 2, 1, 1, 0,-810 }, { 4,-1,-2, 0, 759 },
+            { 0, 2,-1, 0,-713 }, { 2, 2,-1, 0,-700 }, { 2, 1,-2, 0, 691 },
+            { 2,-1, 0,-2, 596 }, { 4, 0, 1, 0, 549 }, { 0, 0, 4, 0, 537 },
+            { 4,-1, 0, 0, 520 }, { 1, 0,-2, 0,-487 }, { 2, 1, 0,-2,-399 },
+            { 0, 0, 2,-2,-381 }, { 1, 1, 1, 0, 351 }, { 3, 0,-2, 0,-340 },
+            { 4, 0,-3, 0, 330 }, { 2,-1, 2, 0, 327 }, { 0, 2, 1, 0,-323 },
+            { 1, 1,-1, 0, 299 }, { 2, 0, 3, 0, 294 },
+        };
+
+        /// Meeus table 47.B; coefficients in millionths of a degree.
+        constexpr Term PLANETARIUM_LATITUDE_TERMS[] = {
+            { 0, 0, 0, 1, 5128122 }, { 0, 0, 1, 1, 280602 }, { 0, 0, 1,-1, 277693 },
+            { 2, 0, 0,-1, 173237 }, { 2, 0,-1, 1, 55413 }, { 2, 0,-1,-1, 46271 },
+            { 2, 0, 0, 1, 32573 }, { 0, 0, 2, 1, 17198 }, { 2, 0, 1,-1, 9266 },
+            { 0, 0, 2,-1, 8822 }, { 2,-1, 0,-1, 8216 }, { 2, 0,-2,-1, 4324 },
+            { 2, 0, 1, 1, 4200 }, { 2, 1, 0,-1,-3359 }, { 2,-1,-1, 1, 2463 },
+            { 2,-1, 0, 1, 2211 }, { 2,-1,-1,-1, 2065 }, { 0, 1,-1,-1,-1870 },
+            { 4, 0,-1,-1, 1828 }, { 0, 1, 0, 1,-1794 }, { 0, 0, 0, 3,-1749 },
+            { 0, 1,-1, 1,-1565 }, { 1, 0, 0, 1,-1491 }, { 0, 1, 1, 1,-1475 },
+            { 0, 1, 1,-1,-1410 }, { 0, 1, 0,-1,-1344 }, { 1, 0, 0,-1,-1335 },
+            { 0, 0, 3, 1, 1107 }, { 4, 0, 0,-1, 1021 }, { 4, 0,-1, 1, 833 },
+            { 0, 0, 1,-3, 777 }, { 4, 0,-2, 1, 671 }, { 2, 0, 0,-3, 607 },
+            { 2, 0, 2,-1, 596 }, { 2,-1, 1,-1, 491 }, { 2, 0,-2, 1,-451 },
+            { 0, 0, 3,-1, 439 }, { 2, 0, 2, 1, 422 }, { 2, 0,-3,-1, 421 },
+            { 2, 1,-1, 1,-366 }, { 2, 1, 0, 1,-351 }, { 4, 0, 0, 1, 331 },
+            { 2,-1, 1, 1, 315 }, { 2,-2, 0,-1, 302 }, { 0, 0, 1, 3,-283 },
+            { 2, 1, 1,-1,-229 }, { 1, 1, 0,-1, 223 }, { 1, 1, 0, 1, 223 },
+            { 0, 1,-2,-1,-220 }, { 2, 1,-1,-1,-220 }, { 1, 0, 1, 1,-185 },
+            { 2,-1,-2,-1, 181 }, { 0, 1, 2, 1,-177 }, { 4, 0,-2,-1, 176 },
+            { 4,-1,-1,-1, 166 }, { 1, 0, 1,-1,-164 }, { 4, 0, 1,-1, 132 },
+            { 1, 0,-1,-1,-119 }, { 4,-1, 0,-1, 115 }, { 2,-2, 0, 1, 107 },
+        };
+
+        /// Arguments used by the game and classic tiers; linear in time.
+        inline Arguments getClassicArguments (double jday)
+        {
+            // Julian centuries since January 1, 2000
+            double T = (jday - 2451545.0) / 36525.0;
+            Arguments a;
+            a.lprim = 3.8104 + 8399.7091 * T;
+            a.mprim = 2.3554 + 8328.6911 * T;
+            a.m = 6.2400 + 628.3019 * T;
+            a.d = 5.1985 + 7771.3772 * T;
+            a.f = 1.6280 + 8433.4663 * T;
+            a.e = 1;
+            a.a1 = a.a2 = a.a3 = 0;
+            return a;
+        }
+
+        /// Meeus 47.1 to 47.6.
+        inline Arguments getPlanetariumArguments (double jday)
+        {
+            double T = (jday - 2451545.0) / 36525.0;
+            double T2 = T * T, T3 = T2 * T, T4 = T3 * T;
+            Arguments a;
+            a.lprim = reduceDegrees (218.3164477 + 481267.88123421 * T - 0.0015786 * T2 + T3 / 538841 - T4 / 65194000);
+            a.d = reduceDegrees (297.8501921 + 445267.1114034 * T - 0.0018819 * T2 + T3 / 545868 - T4 / 113065000);
+            a.m = reduceDegrees (357.5291092 + 35999.0502909 * T - 0.0001536 * T2 + T3 / 24490000);
+            a.mprim = reduceDegrees (134.9633964 + 477198.8675055 * T + 0.0087414 * T2 + T3 / 69699 - T4 / 14712000);
+            a.f = reduceDegrees (93.2720950 + 483202.0175233 * T - 0.0036539 * T2 - T3 / 3526000 + T4 / 863310000);
+            a.e = 1 - 0.002516 * T - 0.0000074 * T2;
+            a.a1 = reduceDegrees (119.75 + 131.849 * T);
+            a.a2 = reduceDegrees (53.09 + 479264.290 * T);
+            a.a3 = reduceDegrees (313.45 + 481266.484 * T);
+            return a;
+        }
+
+        /** Description of one precision tier.
+         *  Specializations provide the term tables, the fundamental
+         *  arguments, the unit of the coefficients and any additive terms.
+         */
+        template <LunarTheoryPrecision P>
+        struct Tier;
+
+        template <>
+        struct Tier<LUNAR_THEORY_GAME>
+        {
+            static constexpr double SCALE = 1;
+            static constexpr size_t LONGITUDE_TERM_COUNT = sizeof (GAME_LONGITUDE_TERMS) / sizeof (Term);
+            static constexpr size_t LATITUDE_TERM_COUNT = sizeof (GAME_LATITUDE_TERMS) / sizeof (Term);
+            static constexpr Term longitudeTerm (size_t i) { return GAME_LONGITUDE_TERMS[i]; }
+            static constexpr Term latitudeTerm (size_t i) { return GAME_LATITUDE_TERMS[i]; }
+            static inline Arguments getArguments (double jday) { return getClassicArguments (jday); }
+            template <class Trig> static inline double getLongitudeCorrection (const Arguments &) { return 0; }
+            template <class Trig> static inline double getLatitudeCorrection (const Arguments &) { return 0; }
+        };
+
+        template <>
+        struct Tier<LUNAR_THEORY_CLASSIC>
+        {
+            static constexpr double SCALE = 1;
+            static constexpr size_t LONGITUDE_TERM_COUNT = sizeof (CLASSIC_LONGITUDE_TERMS) / sizeof (Term);
+            static constexpr size_t LATITUDE_TERM_COUNT = sizeof (CLASSIC_LATITUDE_TERMS) / sizeof (Term);
+            static constexpr Term longitudeTerm (size_t i) { return CLASSIC_LONGITUDE_TERMS[i]; }
+            static constexpr Term latitudeTerm (size_t i) { return CLASSIC_LATITUDE_TERMS[i]; }
+            static inline Arguments getArguments (double jday) { return getClassicArguments (jday); }
+            template <class Trig> static inline double getLongitudeCorrection (const Arguments &) { return 0; }
+            template <class Trig> static inline double getLatitudeCorrection (const Arguments &) { return 0; }
+        };
+
+        template <>
+        struct Tier<LUNAR_THEORY_PLANETARIUM>
+        {
+            static constexpr double SCALE = 1e-6 * DEG_TO_RAD;
+            static constexpr size_t LONGITUDE_TERM_COUNT = sizeof (PLANETARIUM_LONGITUDE_TERMS) / sizeof (Term);
+            static constexpr size_t LATITUDE_TERM_COUNT = sizeof (PLANETARIUM_LATITUDE_TERMS) / sizeof (Term);
+            static constexpr Term longitudeTerm (size_t i) { return PLANETARIUM_LONGITUDE_TERMS[i]; }
+            static constexpr Term latitudeTerm (size_t i) { return PLANETARIUM_LATITUDE_TERMS[i]; }
+            static inline Arguments getArguments (double jday) { return getPlanetariumArguments (jday); }
+
+            /// Venus, Jupiter and flattening of the earth.
+            template <class Trig>
+            static inline double getLongitudeCorrection (const Arguments &a) {
+                return 3958 * Trig::sin (a.a1) + 1962 * Trig::sin (a.lprim - a.f) + 318 * Trig::sin (a.a2);
+            }
+
+            template <class Trig>
+            static inline double getLatitudeCorrection (const Arguments &a) {
+                return -2235 * Trig::sin (a.lprim) + 382 * Trig::sin (a.a3)
+                        + 175 * Trig::sin (a.a1 - a.f) + 175 * Trig::sin (a.a1 + a.f)
+                        + 127 * Trig::sin (a.lprim - a.mprim) - 115 * Trig::sin (a.lprim + a.mprim);
+            }
+        };
+
+        /// k * x, with the trivial multipliers resolved at compile time.
+        template <int K> inline double multiple (double x) { return K * x; }
+        template <> inline double multiple<0> (double) { return 0; }
+        template <> inline double multiple<1> (double x) { return x; }
+        template <> inline double multiple<-1> (double x) { return -x; }
+
+        /// Eccentricity factor for a term with multiplier M of the sun's anomaly.
+        template <int M> inline double eccentricityFactor (double e) { return e * e; }
+        template <> inline double eccentricityFactor<0> (double) { return 1; }
+        template <> inline double eccentricityFactor<1> (double e) { return e; }
+        template <> inline double eccentricityFactor<-1> (double e) { return e; }
+
+        /// Sum terms [I, N) of a longitude series; unrolled by recursion.
+        template <class TierT, class Trig, size_t I, size_t N>
+        struct LongitudeSeries
+        {
+            static inline double sum (const Arguments &a)
+            {
+                constexpr Term t = TierT::longitudeTerm (I);
+                return t.coefficient * eccentricityFactor<t.m> (a.e) * Trig::sin (
+                        multiple<t.d> (a.d) + multiple<t.m> (a.m) +
+                        multiple<t.mprim> (a.mprim) + multiple<t.f> (a.f))
+                        + LongitudeSeries<TierT, Trig, I + 1, N>::sum (a);
+            }
+        };
+
+        template <class TierT, class Trig, size_t N>
+        struct LongitudeSeries<TierT, Trig, N, N>
+        {
+            static inline double sum (const Arguments &) { return 0; }
+        };
+
+        /// Sum terms [I, N) of a latitude series; unrolled by recursion.
+        template <class TierT, class Trig, size_t I, size_t N>
+        struct LatitudeSeries
+        {
+            static inline double sum (const Arguments &a)
+            {
+                constexpr Term t = TierT::latitudeTerm (I);
+                return t.coefficient * eccentricityFactor<t.m> (a.e) * Trig::sin (
+                        multiple<t.d> (a.d) + multiple<t.m> (a.m) +
+                        multiple<t.mprim> (a.mprim) + multiple<t.f> (a.f))
+                        + LatitudeSeries<TierT, Trig, I + 1, N>::sum (a);
+            }
+        };
+
+        template <class TierT, class Trig, size_t N>
+        struct LatitudeSeries<TierT, Trig, N, N>
+        {
+            static inline double sum (const Arguments &) { return 0; }
+        };
+
+        /** Moon's ecliptic position using a certain precision tier.
+         *  @param jday Julian day.
+         *  @param lon Ecliptic longitude, in radians (not normalized).
+         *  @param lat Ecliptic latitude, in radians.
+         */
+        template <LunarTheoryPrecision P, class Trig>
+        inline void getEclipticPositionRad (double jday, double &lon, double &lat)
+        {
+            typedef Tier<P> TierT;
+            Arguments a = TierT::getArguments (jday);
+            lon = a.lprim + TierT::SCALE * (
+                    LongitudeSeries<TierT, Trig, 0, TierT::LONGITUDE_TERM_COUNT>::sum (a) +
+                    TierT::template getLongitudeCorrection<Trig> (a));
+            lat = TierT::SCALE * (
+                    LatitudeSeries<TierT, Trig, 0, TierT::LATITUDE_TERM_COUNT>::sum (a) +
+                    TierT::template getLatitudeCorrection<Trig> (a));
+        }
+
+        /// @see getEclipticPositionRad; using the standard library sine.
+        template <LunarTheoryPrecision P>
+        inline void getEclipticPositionRad (double jday, double &lon, double &lat)
+        {
+            getEclipticPositionRad<P, StdTrig> (jday, lon, lat);
+        }
+
+        /// Largest distance terms of Meeus table 47.A; cosine coefficients in metres.
+        constexpr Term DISTANCE_TERMS[] = {
+            { 0, 0, 1, 0,-20905355 }, { 2, 0,-1, 0,-3699111 }, { 2, 0, 0, 0,-2955968 },
+            { 0, 0, 2, 0,-569925 }, { 0, 1, 0, 0, 48888 }, { 0, 0, 0, 2,-3149 },
+            { 2, 0,-2, 0, 246158 }, { 2,-1,-1, 0,-152138 }, { 2, 0, 1, 0,-170733 },
+            { 2,-1, 0, 0,-204586 }, { 0, 1,-1, 0,-129620 }, { 1, 0, 0, 0, 108743 },
+            { 0, 1, 1, 0, 104755 }, { 4, 0,-1, 0,-34782 }, { 0, 0, 3, 0,-23210 },
+            { 4, 0,-2, 0,-21636 }, { 2, 1,-1, 0, 24208 }, { 2, 1, 0, 0, 30824 },
+            { 1, 0,-1, 0,-8379 }, { 1, 1, 0, 0,-16675 }, { 2,-1, 1, 0,-12831 },
+            { 2, 0, 2, 0,-10445 }, { 4, 0, 0, 0,-11650 }, { 2, 0,-3, 0, 14403 },
+            { 0, 1,-2, 0,-7003 }, { 2,-1,-2, 0, 10056 }, { 1, 0, 1, 0, 6322 },
+            { 2,-2, 0, 0,-9884 },
+        };
+
+        /** Distance between the centers of the earth and the moon, in km.
+         *  This is only needed for eclipses and parallax, so it is a plain
+         *  loop over the largest terms; good to about 10 km.
+         */
+        inline double getDistanceKm (double jday)
+        {
+            Arguments a = getPlanetariumArguments (jday);
+            double r = 0;
+            for (const Term &t : DISTANCE_TERMS) {
+                double e = (t.m == 0) ? 1 : (t.m == 1 || t.m == -1) ? a.e : a.e * a.e;
+                r += t.coefficient * e * std::cos (t.d * a.d + t.m * a.m + t.mprim * a.mprim + t.f * a.f);
+            }
+            return 385000.56 + r / 1000;
+        }
+    }
+}
+
+#endif // CAELUM__LUNAR_THEORY_H
@@ -9,6 +9,10 @@
 #include "CameraBoundElement.h"
 #include "PrivatePtr.h"
 #include "FastGpuParamRef.h"
+#include "Astronomy.h"
+#include "AstronomyScalar.h"
+#include "AtmosphericLookup.h"
+#include "SatelliteConstellation.h"
 
 namespace Caelum
 {
@@ -40,6 +44,31 @@ namespace Caelum
      * 
      *  Loading a bright-star catalogue is supported but star positions are
      *  likely only correct relative to each other. External rotation is probably wrong.
+     *
+     *  The planets Mercury through Saturn are drawn as extra points with
+     *  the same material. They live in a second, dynamic ManualObject on
+     *  the same node so moving them only rewrites their few vertices and
+     *  never rebuilds the star geometry. Planet positions are cached and
+     *  only recomputed when the clock moves by more than the planet
+     *  update interval.
+     *
+     *  Catalogue and planet positions are J2000. Precession and nutation
+     *  to the true equator and equinox of date are folded into the node
+     *  orientation; the matrix is only rebuilt when the clock moves by
+     *  more than the precession update interval. This keeps the sky right
+     *  for dates centuries away from J2000 without touching the vertices.
+     *  Aberration (up to 20") is not a rotation and is ignored.
+     *
+     *  Atmospheric extinction dims stars and planets near the horizon.
+     *  It is done in the vertex program from a small AtmosphericLookup
+     *  table and the zenith direction, which are shader constants; there
+     *  is no per-star work on the CPU.
+     *
+     *  An optional SatelliteConstellation is drawn with the same material.
+     *  Satellites move every frame, so their vertices are streamed into
+     *  a third, dynamic ManualObject: its buffer is sized once per
+     *  satellite count and then locked with discard and written in one
+     *  pass from the constellation's batch update.
      */
     class CAELUM_EXPORT PointStarfield:
             public CameraBoundElement
@@ -114,12 +143,64 @@ namespace Caelum
 		void invalidateGeometry();
 		void ensureGeometry();
 
+        /// Dynamic manual object for the planets.
+        PrivateManualObjectPtr mPlanetManualObj;
+
+        /// Cached planet positions, valid at mPlanetJulDay.
+        Astronomy::PlanetPosition mPlanets[Astronomy::PLANET_COUNT];
+        LongReal mPlanetJulDay;
+        LongReal mPlanetUpdateInterval;
+        bool mPlanetsEnabled;
+        bool mValidPlanets;
+        bool mPlanetGeometryDirty;
+        void updatePlanetGeometry ();
+
+        /// Cached J2000 to true-of-date rotation and equation of the equinoxes, valid at mPrecessionJulDay.
+        Ogre::Quaternion mPrecessionOrientation;
+        LongReal mEquationOfEquinoxes;
+        LongReal mPrecessionJulDay;
+        LongReal mPrecessionUpdateInterval;
+        bool mPrecessionEnabled;
+        bool mValidPrecession;
+        void updatePrecession (LongReal julDay);
+
+        /// Extinction table source; uploaded to the vertex program on change.
+        AtmosphericLookup mAtmosphere;
+        bool mExtinctionEnabled;
+        void updateExtinctionTable ();
+
+        /// Dynamic manual object for the satellites; rewritten every update.
+        PrivateManualObjectPtr mSatelliteManualObj;
+        std::unique_ptr<SatelliteConstellation> mSatellites;
+        size_t mSatelliteVertexCount;
+        void updateSatelliteGeometry (const Ogre::Quaternion &orientation);
+
+        /// Time and place prepareUpdate last computed for; cleared by update.
+        LongReal mPreparedJulDay;
+        float mPreparedLongitude, mPreparedLatitude;
+        bool mPrepared;
+
     public:
-	    /** Update function; called from CaelumSystem::updateSubcomponents
+	    /** Update function.
             @param julDay Julian day and time.
 	     */
 	    void update (LongReal julDay);
 
+        /** Update function; called from CaelumSystem::updateSubcomponents
+         *  This shares the observer's cached sidereal angle with the sun and
+         *  moon, and sets the observer latitude and longitude from it.
+         */
+        void update (const FastObserver &observer);
+
+        /** Astronomy for the next update, without touching Ogre.
+         *  Precession, planet positions and satellite propagation; safe
+         *  to run on another thread while the rest of the sky updates,
+         *  as long as nothing else uses this starfield meanwhile. An
+         *  update for the same observer then only sets Ogre state;
+         *  otherwise it prepares again itself.
+         */
+        void prepareUpdate (const FastObserver &observer);
+
         /** Magnitude power scale.
          *  Star magnitudes are logarithming; one magnitude difference
          *  means a star is 2.512 times brighter.
@@ -143,6 +224,51 @@ namespace Caelum
         void setObserverLongitude (Ogre::Degree value) { mObserverLongitude = value; }
         inline Ogre::Degree getObserverLongitude () const { return mObserverLongitude; }
 
+        /// Enable or disable drawing the planets. Enabled by default.
+        void setPlanetsEnabled (bool value);
+        inline bool getPlanetsEnabled () const { return mPlanetsEnabled; }
+
+        /** How far the clock can move before planet positions are
+         *  recomputed, in days. Default is five minutes; Mercury, the
+         *  fastest, moves less than 0.01 degrees in that time.
+         */
+        inline void setPlanetUpdateInterval (LongReal value) { mPlanetUpdateInterval = value; }
+        inline LongReal getPlanetUpdateInterval () const { return mPlanetUpdateInterval; }
+
+        /// Last computed position of a planet; valid after update.
+        inline const Astronomy::PlanetPosition& getPlanetPosition (Astronomy::Planet planet) const {
+            return mPlanets[planet];
+        }
+
+        /// Enable or disable precession and nutation. Enabled by default.
+        void setPrecessionEnabled (bool value);
+        inline bool getPrecessionEnabled () const { return mPrecessionEnabled; }
+
+        /** How far the clock can move before the precession and nutation
+         *  rotation is rebuilt, in days. Default is one day; in that time
+         *  precession moves stars less than 0.2" and nutation under 0.1".
+         */
+        inline void setPrecessionUpdateInterval (LongReal value) { mPrecessionUpdateInterval = value; }
+        inline LongReal getPrecessionUpdateInterval () const { return mPrecessionUpdateInterval; }
+
+        /// Enable or disable atmospheric extinction. Enabled by default.
+        void setExtinctionEnabled (bool value);
+        inline bool getExtinctionEnabled () const { return mExtinctionEnabled; }
+
+        /** Magnitudes of extinction per airmass. Default 0.2.
+         *  @see AtmosphericLookup
+         */
+        void setExtinctionCoefficient (Ogre::Real value);
+        inline Ogre::Real getExtinctionCoefficient () const { return Ogre::Real (mAtmosphere.getExtinctionCoefficient ()); }
+
+        /** Set the satellites to draw; takes ownership.
+         *  They are propagated on every update. Pass null to remove them.
+         */
+        void setSatelliteConstellation (SatelliteConstellation *value);
+
+        /// Satellites being drawn; may be null. Adding satellites is fine between updates.
+        inline SatelliteConstellation* getSatelliteConstellation () const { return mSatellites.get (); }
+
     public:
 
         /// Material used to draw all the points.
@@ -156,9 +282,17 @@ namespace Caelum
         virtual void setFarRadius (Ogre::Real radius);
 
     public:
-        void setQueryFlags (uint flags) { mManualObj->setQueryFlags (flags); }
+        void setQueryFlags (uint flags) {
+            mManualObj->setQueryFlags (flags);
+            mPlanetManualObj->setQueryFlags (flags);
+            mSatelliteManualObj->setQueryFlags (flags);
+        }
         uint getQueryFlags () const { return mManualObj->getQueryFlags (); }
-        void setVisibilityFlags (uint flags) { mManualObj->setVisibilityFlags (flags); }
+        void setVisibilityFlags (uint flags) {
+            mManualObj->setVisibilityFlags (flags);
+            mPlanetManualObj->setVisibilityFlags (flags);
+            mSatelliteManualObj->setVisibilityFlags (flags);
+        }
         uint getVisibilityFlags () const { return mManualObj->getVisibilityFlags (); }
 
     private:
@@ -171,6 +305,8 @@ namespace Caelum
             FastGpuParamRef min_size;
             FastGpuParamRef max_size;
             FastGpuParamRef aspect_ratio;
+            FastGpuParamRef zenith_direction;
+            FastGpuParamRef extinction_lut;
         } mParams;
     };
 }
@@ -0,0 +1,190 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#ifndef CAELUM__SATELLITE_CONSTELLATION_H
+#define CAELUM__SATELLITE_CONSTELLATION_H
+
+#include "CaelumCorePrerequisites.h"
+#include "AstronomyScalar.h"
+
+#include <istream>
+#include <string>
+
+namespace Caelum
+{
+    /** Artificial satellites from two-line element sets, propagated in bulk.
+     *
+     *  Positions come from the SGP4 model (Hoots and Roehrich, Spacetrack
+     *  Report 3, as revised by Vallado et al. 2006) with WGS72 constants,
+     *  which is what TLEs are fitted with. Only the near earth part is
+     *  implemented: satellites with a period of 225 minutes or more
+     *  (GPS, geostationary, Molniya) need the SDP4 deep space terms and
+     *  are rejected by addSatellite. Low orbits are the ones that visibly
+     *  move anyway.
+     *
+     *  Elements are kept as structure-of-arrays, one array per SGP4
+     *  coefficient, and update propagates every satellite in one pass of
+     *  branch-free loops over those arrays, with BatchMath for the
+     *  transcendentals; the compiler vectorizes them. Kepler's equation is
+     *  solved with a fixed number of Newton steps instead of iterating
+     *  until convergence, which is plenty below the eccentricities where
+     *  SGP4 is useful at all.
+     *
+     *  Propagated positions are in the TEME frame of the SGP4 output. They
+     *  are turned into horizontal directions with the observer's cached
+     *  latitude and local sidereal angle, the same ones the sun, moon and
+     *  starfield use; TEME is treated as the true equator of date.
+     *
+     *  Brightness is a standard magnitude at 1000 km plus the distance
+     *  term. Phase is ignored. Satellites inside the earth's (cylindrical)
+     *  shadow get SHADOW_MAGNITUDE, which the starfield shader fades out.
+     *
+     *  @see PointStarfield::setSatelliteConstellation
+     */
+    class CAELUM_CORE_EXPORT SatelliteConstellation
+    {
+    public:
+        /// Mean elements from a TLE, in TLE units.
+        struct OrbitalElements
+        {
+            /// NORAD catalogue number.
+            int catalogNumber;
+            /// Epoch, as a julian day.
+            LongReal epoch;
+            /// Drag term, in inverse earth radii.
+            LongReal bstar;
+            /// Angles, in degrees.
+            LongReal inclination;
+            LongReal rightAscension;
+            LongReal argumentOfPerigee;
+            LongReal meanAnomaly;
+            LongReal eccentricity;
+            /// Kozai mean motion, in revolutions per day.
+            LongReal meanMotion;
+        };
+
+        /// Magnitude given to satellites in the earth's shadow.
+        static const float SHADOW_MAGNITUDE;
+
+        /// Floats written per satellite by writeVertices.
+        static const int VERTEX_FLOATS_PER_SATELLITE = 36;
+
+        SatelliteConstellation ();
+
+        /** Parse the two data lines of a TLE.
+         *  Only the columns are checked, not the checksums.
+         *  @return false if the lines are malformed.
+         */
+        static bool parseTle (const std::string &line1, const std::string &line2, OrbitalElements &elements);
+
+        /** Add a satellite.
+         *  @param standardMagnitude Magnitude at a range of 1000 km.
+         *  @return false if the orbit is deep space, decayed or hyperbolic;
+         *  nothing is added then.
+         */
+        bool addSatellite (const OrbitalElements &elements, float standardMagnitude = 5,
+                const std::string &name = std::string ());
+
+        /** Add a satellite from the two data lines of a TLE.
+         *  @return false if the lines are malformed or addSatellite refuses the orbit.
+         */
+        bool addTle (const std::string &line1, const std::string &line2, float standardMagnitude = 5,
+                const std::string &name = std::string ());
+
+        /** Add every satellite in a TLE file.
+         *  Both the two line format and the three line format with names
+         *  are accepted. Unusable entries are skipped.
+         *  @return Number of satellites added.
+         */
+        size_t addTleStream (std::istream &stream, float standardMagnitude = 5);
+
+        /// Remove all satellites.
+        void clear ();
+
+        inline size_t getSatelliteCount () const { return mNames.size (); }
+        inline const std::string& getName (size_t index) const { return mNames[index]; }
+        inline int getCatalogNumber (size_t index) const { return mCatalogNumbers[index]; }
+
+        /** Propagate all satellites to a julian day.
+         *  Only fills the TEME positions; @see update.
+         */
+        void propagate (LongReal jday);
+
+        /** Propagate all satellites and compute what the observer sees.
+         *  @param sinLatitude, cosLatitude Geodetic latitude of the observer.
+         *  @param sinSiderealAngle, cosSiderealAngle Local sidereal angle.
+         */
+        void update (LongReal jday,
+                LongReal sinLatitude, LongReal cosLatitude,
+                LongReal sinSiderealAngle, LongReal cosSiderealAngle);
+
+        /// Propagate all satellites for an observer's time and location.
+        template <class Policy>
+        void update (const BasicObserver<Policy> &observer)
+        {
+            update (LongReal (observer.getJulianDay ()),
+                    observer.getSinLatitude (), observer.getCosLatitude (),
+                    observer.getSinLocalSiderealAngle (), observer.getCosLocalSiderealAngle ());
+        }
+
+        /// Julian day of the last propagate or update.
+        inline LongReal getJulianDay () const { return mJulianDay; }
+
+        /// Position in the TEME frame, in km; valid after propagate.
+        inline void getTemePosition (size_t index, LongReal &x, LongReal &y, LongReal &z) const {
+            x = mX[index];
+            y = mY[index];
+            z = mZ[index];
+        }
+
+        /// Unit vector from the observer, like Astronomy's horizontal vectors; valid after update.
+        inline void getHorizontalDirection (size_t index, float &north, float &east, float &up) const {
+            north = mNorth[index];
+            east = mEast[index];
+            up = mUp[index];
+        }
+
+        /// Distance from the observer, in km; valid after update.
+        inline float getRange (size_t index) const { return mRange[index]; }
+
+        /// Apparent magnitude; valid after update.
+        inline float getMagnitude (size_t index) const { return mMagnitude[index]; }
+
+        /// If a satellite is lit by the sun; valid after update.
+        inline bool isSunlit (size_t index) const { return mMagnitude[index] < SHADOW_MAGNITUDE; }
+
+        /** Write the vertices of every satellite, as from the last update.
+         *  Each satellite is two triangles in PointStarfield's vertex
+         *  format: position (3 floats) then texture coordinates with the
+         *  magnitude in the third (3 floats).
+         *  @param transform Maps (north, east, up) to vertex positions;
+         *  position = transform * direction.
+         *  @param dest VERTEX_FLOATS_PER_SATELLITE floats per satellite.
+         */
+        void writeVertices (const float transform[3][3], float *dest) const;
+
+    private:
+        /// Constant SGP4 coefficients; one array each.
+        enum Coefficient
+        {
+            EPOCH, NO, ECCO, INCLO, NODEO, ARGPO, MO, BSTAR,
+            MDOT, ARGPDOT, NODEDOT, NODECF, AO_BASE,
+            CC1, CC4, CC5, D2, D3, D4, T2COF, T3COF, T4COF, T5COF,
+            OMGCOF, XMCOF, ETA, DELMO, SINMAO,
+            AYCOF, XLCOF, CON41, X1MTH2, X7THM1, SINIO, COSIO,
+            STANDARD_MAGNITUDE,
+            COEFFICIENT_COUNT
+        };
+
+        std::vector<double> mCoefficients[COEFFICIENT_COUNT];
+        std::vector<std::string> mNames;
+        std::vector<int> mCatalogNumbers;
+
+        LongReal mJulianDay;
+        std::vector<double> mX, mY, mZ;
+        std::vector<float> mNorth, mEast, mUp, mRange, mMagnitude;
+    };
+}
+
+#endif // CAELUM__SATELLITE_CONSTELLATION_H
@@ -0,0 +1,146 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#ifndef CAELUM__SKY_FRAME_EVALUATOR_H
+#define CAELUM__SKY_FRAME_EVALUATOR_H
+
+#include "CaelumCorePrerequisites.h"
+#include "AstronomyScalar.h"
+#include "CelestialBodies.h"
+#include "KeyframedSky.h"
+#include "SkyStateEvaluator.h"
+
+#include <cstdint>
+
+namespace Caelum
+{
+    class SkyTimeline;
+
+    /** A clock time as SkyFrameEvaluator needs it.
+     *  The plain values of a UniversalClock, which lives with Ogre.
+     *  @see UniversalClock::getSkyClockTime
+     */
+    struct CAELUM_CORE_EXPORT SkyClockTime
+    {
+        /// Current time, as julian day number and nanosecond of day.
+        std::int64_t day, nanosecond;
+
+        /// Tick before the current one; the current time if there is none.
+        std::int64_t previousDay, previousNanosecond;
+
+        /// The same three times as julian days.
+        LongReal julianDay, previousTickJulianDay, renderJulianDay;
+
+        /// How far rendering is from the previous tick to the current one.
+        float renderAlpha;
+
+        /// If the clock runs in fixed ticks.
+        bool ticking;
+
+        SkyClockTime ();
+    };
+
+    /** A sky evaluation, with the clock time and place it is for.
+     *  Clock times are compared as integers; UniversalClock keeps exact
+     *  time, so this never mistakes two different instants for one.
+     *
+     *  For a ticking clock previousSky holds the tick before, so
+     *  rendering can interpolate between the two.
+     */
+    struct CAELUM_CORE_EXPORT CachedSky
+    {
+        FastAstronomy::SkyEvaluation sky;
+        FastAstronomy::SkyEvaluation previousSky;
+        std::int64_t day, nanosecond;
+
+        /// The clock's previous tick; previousSky is for that time.
+        std::int64_t previousDay, previousNanosecond;
+        LongReal longitude, latitude;
+        bool valid;
+
+        /// Number of times sky was evaluated; for checking that viewports share them.
+        unsigned long evaluationCount;
+
+        /// Samples for CaelumSystem::setKeyframedSky; used instead of sky when enabled.
+        KeyframedSky keyframes;
+
+        CachedSky ();
+
+        /// If sky is for this clock time, previous tick and observer location.
+        bool isCurrent (const SkyClockTime &time, LongReal longitude, LongReal latitude) const;
+
+        /// If sky is for this instant and observer location, whatever the previous tick.
+        bool isAt (std::int64_t day, std::int64_t nanosecond, LongReal longitude, LongReal latitude) const;
+
+        /// Remember that sky is now for this clock time and observer location.
+        void markCurrent (const SkyClockTime &time, LongReal longitude, LongReal latitude);
+    };
+
+    /** Where the sky of a frame comes from besides the clock and place.
+     *  The objects are borrowed, like those in SkyStateConfig.
+     */
+    struct CAELUM_CORE_EXPORT SkyFrameConfig
+    {
+        SkyStateConfig sky;
+
+        /** States precomputed around the time; null for none.
+         *  Only used for clocks that don't tick. Evaluated without the
+         *  ephemeris cache, which belongs to the calling thread.
+         */
+        SkyTimeline *timeline;
+
+        /// Blend CachedSky::keyframes for clocks that don't tick and have no timeline.
+        bool keyframed;
+
+        /// Copied into CachedSky::keyframes before evaluating them.
+        LongReal keyframeInterval, keyframeMaxAngle;
+
+        /// Extra suns and moons to update for the frame; null for none.
+        CelestialBodies *bodies;
+
+        /// Plain evaluation: no timeline, keyframes or bodies.
+        SkyFrameConfig ();
+    };
+
+    /** The sky of one frame for a clock and place, without Ogre.
+     *
+     *  Picks the timeline, keyframes or a cached sky, interpolates
+     *  between the last two ticks of a ticking clock, adds the colour
+     *  model and updates the extra bodies. Only touches the cache, the
+     *  frame and the objects in the config, so it can run on a worker
+     *  while the caller does something else.
+     *
+     *  @see CaelumSystem::setAsynchronousSkyState
+     */
+    class CAELUM_CORE_EXPORT SkyFrameEvaluator
+    {
+    public:
+        /// What evaluate fills.
+        struct Frame
+        {
+            /// Sky at the render time; interpolated for a ticking clock.
+            SkyState state;
+
+            /// At the render time and place.
+            FastObserver observer;
+
+            /// Extra suns and moons, same indices as the config's bodies.
+            std::vector<CelestialBodies::State> bodies;
+        };
+
+        /** Evaluate a sky into a cache unless it is already for this time and place.
+         *  For a ticking clock this also fills the previous tick, reusing
+         *  the old sky when it is that tick.
+         */
+        static const FastAstronomy::SkyEvaluation& evaluateCachedSky (const SkyClockTime &time,
+                LongReal longitude, LongReal latitude, const SkyStateConfig &config,
+                CachedSky &cache, FastObserver &observer);
+
+        /// Sky, colours and bodies of a frame.
+        static void evaluate (const SkyClockTime &time, LongReal longitude, LongReal latitude,
+                const SkyFrameConfig &config, CachedSky &cache, Frame &frame);
+    };
+}
+
+#endif // CAELUM__SKY_FRAME_EVALUATOR_H
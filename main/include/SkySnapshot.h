@@ -0,0 +1,81 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#ifndef CAELUM__SKY_SNAPSHOT_H
+#define CAELUM__SKY_SNAPSHOT_H
+
+#include "CaelumCorePrerequisites.h"
+
+#include <atomic>
+
+namespace Caelum
+{
+    /** What other threads usually want to know about the sky, as plain data.
+     *
+     *  Directions are in Ogre coordinates, like CaelumSystem::getSunDirection;
+     *  colours are RGBA. Fog is as applied to the scene, with the global
+     *  multipliers but not the scene fog ones.
+     */
+    struct SkySnapshot
+    {
+        /// Number of the update that published this; 0 before the first.
+        std::uint64_t version;
+
+        LongReal julianDay;
+        float longitude, latitude;
+
+        float sunDirection[3];
+        float sunLightColour[4];
+        float sunVisibleFraction;
+
+        float moonDirection[3];
+        float moonLightColour[4];
+        /// Moon phase; from 0 (full moon) to 1 (again full moon).
+        float moonPhase;
+        float moonUmbraFraction;
+
+        float fogColour[4];
+        float fogDensity;
+    };
+
+    /** Hands SkySnapshots from one writer to any number of readers.
+     *
+     *  A sequence lock: the writer bumps a counter to odd, copies the
+     *  snapshot in and bumps it to even again. Readers copy the snapshot
+     *  out and retry if the counter changed meanwhile. The writer never
+     *  waits and readers never block it; a reader only spins while a
+     *  publish is in progress, which is a few dozen stores.
+     *
+     *  The words are atomics, so concurrent copies are not a data race.
+     */
+    class CAELUM_CORE_EXPORT SkySnapshotBuffer
+    {
+    public:
+        /// Starts with a zeroed snapshot of version 0.
+        SkySnapshotBuffer ();
+
+        /// Replace the snapshot; only one thread may publish. Sets its version.
+        void publish (const SkySnapshot &snapshot);
+
+        /** Copy the snapshot if no publish is in progress or interferes.
+         *  @return False if the copy would have been torn; try again.
+         */
+        bool tryRead (SkySnapshot &snapshot) const;
+
+        /// Copy the latest consistent snapshot; any thread.
+        SkySnapshot read () const;
+
+        /// Version of the latest published snapshot; any thread.
+        std::uint64_t getVersion () const;
+
+    private:
+        static const size_t WORD_COUNT = (sizeof (SkySnapshot) + sizeof (std::uint64_t) - 1) / sizeof (std::uint64_t);
+
+        /// Twice the version, plus one while publishing.
+        std::atomic<std::uint64_t> mSequence;
+        std::atomic<std::uint64_t> mWords[WORD_COUNT];
+    };
+}
+
+#endif // CAELUM__SKY_SNAPSHOT_H
@@ -0,0 +1,140 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#ifndef CAELUM__SKY_STATE_EVALUATOR_H
+#define CAELUM__SKY_STATE_EVALUATOR_H
+
+#include "CaelumCorePrerequisites.h"
+#include "AstronomyScalar.h"
+
+namespace Caelum
+{
+    class EphemerisCache;
+    class EclipseTable;
+    class AtmosphericLookup;
+
+    /// RGBA colour with float channels; the core's Ogre::ColourValue.
+    struct CAELUM_CORE_EXPORT SkyColour
+    {
+        float r, g, b, a;
+
+        inline SkyColour (): r (0), g (0), b (0), a (1) { }
+        inline SkyColour (float r, float g, float b, float a = 1): r (r), g (g), b (b), a (a) { }
+    };
+
+    /** An RGBA float image for the sky colour model.
+     *  CaelumSystem converts its gradient images to this when loading
+     *  them, so lookups need neither Ogre nor the image's pixel format.
+     */
+    class CAELUM_CORE_EXPORT ColourGradient
+    {
+    public:
+        /// Empty gradient; lookups fall back to defaults.
+        ColourGradient ();
+
+        /// Copy width * height RGBA pixels, row by row.
+        ColourGradient (size_t width, size_t height, const float *rgba);
+
+        inline size_t getWidth () const { return mWidth; }
+        inline size_t getHeight () const { return mHeight; }
+        inline bool isEmpty () const { return mPixels.empty (); }
+
+        SkyColour getColour (size_t x, size_t y) const;
+
+        /** Interpolated colour at normalized coordinates.
+         *  Same as InternalUtilities::getInterpolatedColour without
+         *  wrapping: nearest row, linear between the two nearest columns.
+         */
+        SkyColour getInterpolatedColour (float fx, float fy) const;
+
+    private:
+        size_t mWidth, mHeight;
+        std::vector<float> mPixels;
+    };
+
+    /** What a sky state depends on besides time and place.
+     *  Everything is borrowed and optional; the evaluator never changes it.
+     */
+    struct CAELUM_CORE_EXPORT SkyStateConfig
+    {
+        /// Fog colour and density, light colours; @see CaelumSystem::setSkyGradientsImage
+        const ColourGradient *skyGradients;
+
+        /// Sun sphere colour; @see CaelumSystem::setSunColoursImage
+        const ColourGradient *sunColours;
+
+        /// Used for sun and moon vectors when it covers the time.
+        const EphemerisCache *ephemerisCache;
+
+        /// Dims the sun and tints the moon during eclipses.
+        const EclipseTable *eclipseTable;
+
+        /// Refracts sun and moon directions; null for none.
+        const AtmosphericLookup *refraction;
+
+        /// Moon tint at the middle of a total lunar eclipse.
+        SkyColour lunarEclipseColour;
+
+        SkyStateConfig ();
+
+        /// Same objects and colour; states evaluated with either are the same.
+        bool operator== (const SkyStateConfig &other) const;
+        inline bool operator!= (const SkyStateConfig &other) const { return !(*this == other); }
+    };
+
+    /// Sky and colours for one time and place; eclipses already applied.
+    struct CAELUM_CORE_EXPORT SkyState
+    {
+        LongReal julianDay;
+        LongReal longitude, latitude;
+
+        FastAstronomy::SkyEvaluation sky;
+
+        float fogDensity;
+        SkyColour fogColour;
+        SkyColour sunLightColour, sunSphereColour;
+        SkyColour moonLightColour, moonBodyColour;
+        float sunVisibleFraction, moonUmbraFraction;
+
+        SkyState ();
+    };
+
+    /** Astronomy and the sky colour model as pure functions.
+     *
+     *  Given a time, a place and a configuration this computes everything
+     *  CaelumSystem sets on its components, without touching Ogre or any
+     *  state. Several threads can evaluate at once, and tools and servers
+     *  can compute skies without a renderer.
+     *
+     *  Directions are horizontal vectors; CaelumSystem::makeDirection
+     *  turns them into Ogre coordinates. Colour functions take the up
+     *  component of the sun or moon direction.
+     */
+    class CAELUM_CORE_EXPORT SkyStateEvaluator
+    {
+    public:
+        /// Full sky state for a julian day and an observer, in degrees.
+        static SkyState evaluate (LongReal julianDay,
+                LongReal longitude, LongReal latitude, const SkyStateConfig &config);
+
+        /** Only the astronomy part of evaluate.
+         *  @param observer Moved to the place and time; callers can reuse it.
+         */
+        static void evaluateSky (LongReal julianDay,
+                LongReal longitude, LongReal latitude, const SkyStateConfig &config,
+                FastObserver &observer, FastAstronomy::SkyEvaluation &sky);
+
+        /// Colours and eclipses of a state from its time, place and sky.
+        static void evaluateColours (const SkyStateConfig &config, SkyState &state);
+
+        static SkyColour getFogColour (const SkyStateConfig &config, float sunUp);
+        static float getFogDensity (const SkyStateConfig &config, float sunUp);
+        static SkyColour getSunSphereColour (const SkyStateConfig &config, float sunUp);
+        static SkyColour getSunLightColour (const SkyStateConfig &config, float sunUp);
+        static SkyColour getMoonBodyColour (const SkyStateConfig &config, float moonUp);
+        static SkyColour getMoonLightColour (const SkyStateConfig &config, float moonUp);
+    };
+}
+
+#endif // CAELUM__SKY_STATE_EVALUATOR_H
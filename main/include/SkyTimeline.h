@@ -0,0 +1,145 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#ifndef CAELUM__SKY_TIMELINE_H
+#define CAELUM__SKY_TIMELINE_H
+
+#include "CaelumCorePrerequisites.h"
+#include "SkyStateEvaluator.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace Caelum
+{
+    /** Sky states precomputed on a background thread around the current time.
+     *
+     *  For time-lapses and editors. Samples lie on a fixed grid of game
+     *  time and are kept in a ring of bounded size; a worker thread fills
+     *  the ring ahead of the time last asked for, in the direction time
+     *  is going, and keeps a quarter of it behind for scrubbing back.
+     *  Any time between two cached samples is interpolated like
+     *  KeyframedSky, so a frame costs the same at every time scale, and
+     *  jumping around inside the cached window costs nothing more.
+     *  Times outside it are evaluated exactly and the worker starts over
+     *  around them.
+     *
+     *  The worker borrows the objects in the config. Call clear before
+     *  changing or destroying any of them, including the content of a
+     *  gradient at the same address.
+     */
+    class CAELUM_CORE_EXPORT SkyTimeline
+    {
+    public:
+        SkyTimeline ();
+
+        /// Stops the worker.
+        ~SkyTimeline ();
+
+        /// Game seconds between samples; 60 by default. Drops all samples.
+        void setSpacing (LongReal seconds);
+        inline LongReal getSpacing () const { return mSpacing; }
+
+        /// Most samples kept, at least 4; 2880 by default, two game days at the default spacing. Drops all samples.
+        void setCapacity (size_t samples);
+        inline size_t getCapacity () const { return mCapacity; }
+
+        /** Sky state at a julian day; thread safe.
+         *  A different place or config drops the samples and starts over.
+         *  @return True if it came from the cache, false if it was
+         *  evaluated exactly.
+         */
+        bool evaluate (LongReal julianDay, LongReal longitude, LongReal latitude,
+                const SkyStateConfig &config, SkyState &state);
+
+        /// If evaluate would interpolate at a julian day with the current samples.
+        bool isCached (LongReal julianDay) const;
+
+        /// Samples in the ring now.
+        size_t getCachedCount () const;
+
+        /// Wait until the worker has filled the window around the time last evaluated; for tools and tests.
+        void waitForWindow ();
+
+        /// Drop all samples and forget the config; returns once the worker no longer uses it.
+        void clear ();
+
+        /// Calls to evaluate served from the cache.
+        unsigned long getHitCount () const;
+
+        /// Calls to evaluate that had to be evaluated exactly.
+        unsigned long getMissCount () const;
+
+        /// Samples the worker computed.
+        unsigned long getComputedCount () const;
+
+        void resetStatistics ();
+
+    private:
+        struct Sample
+        {
+            /// Number of the grid point; NO_SAMPLE when empty.
+            std::int64_t index;
+            SkyState state;
+        };
+
+        static const std::int64_t NO_SAMPLE;
+
+        /// Grid point at or before a julian day.
+        std::int64_t getIndex (LongReal julianDay) const;
+
+        /// Ring slot of a grid point.
+        size_t getSlot (std::int64_t index) const;
+
+        /// Sample of a grid point if it is in the ring; call locked.
+        const Sample* findSample (std::int64_t index) const;
+
+        /// Nearest missing grid point in the window; call locked.
+        bool findMissing (std::int64_t &index);
+
+        /** If the worker should top up the window; call locked.
+         *  Only once less than half the samples ahead are left, so it
+         *  wakes up for batches rather than every grid point.
+         */
+        bool needsRefill () const;
+
+        /// Empty the ring and make the worker drop what it computes; call locked.
+        void dropSamples (std::unique_lock<std::mutex> &lock);
+
+        void workerLoop ();
+
+        LongReal mSpacing;
+        size_t mCapacity;
+
+        std::vector<Sample> mSamples;
+
+        /// Where samples are for; valid if mHaveSource.
+        bool mHaveSource;
+        LongReal mLongitude, mLatitude;
+        SkyStateConfig mConfig;
+
+        /// Bumped when samples are dropped, so a sample in flight is not stored.
+        unsigned long mGeneration;
+
+        /// Grid point before the time last evaluated, and which way time went.
+        std::int64_t mCursor;
+        int mDirection;
+
+        /// Grid points around the cursor known to be in the ring; empty if low > high.
+        std::int64_t mFilledLow, mFilledHigh;
+
+        unsigned long mHitCount, mMissCount, mComputedCount;
+
+        mutable std::mutex mMutex;
+        std::condition_variable mWork;
+        std::condition_variable mIdle;
+        bool mComputing;
+        bool mWindowFilled;
+        bool mStopping;
+        std::thread mThread;
+    };
+}
+
+#endif // CAELUM__SKY_TIMELINE_H
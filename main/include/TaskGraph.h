@@ -0,0 +1,176 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#ifndef CAELUM__TASK_GRAPH_H
+#define CAELUM__TASK_GRAPH_H
+
+#include "CaelumCorePrerequisites.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+namespace Caelum
+{
+    /** Runs tasks for a TaskGraph.
+     *
+     *  Implement this to run Caelum's work on an engine's job system or
+     *  Ogre's WorkQueue. Tasks are short and never wait for each other;
+     *  an executor may run them on any thread, in any order, but must
+     *  run every task it is given.
+     */
+    class CAELUM_CORE_EXPORT TaskExecutor
+    {
+    public:
+        virtual ~TaskExecutor ();
+
+        /// Run a task soon, on any thread.
+        virtual void submit (const std::function<void ()> &task) = 0;
+    };
+
+    /** Fallback executor with its own worker threads.
+     *  Tasks are run in the order they are submitted.
+     */
+    class CAELUM_CORE_EXPORT ThreadPoolExecutor: public TaskExecutor
+    {
+    public:
+        /// @param threadCount Worker threads; 0 for one less than the hardware threads, at least one.
+        explicit ThreadPoolExecutor (unsigned threadCount = 0);
+
+        /// Finishes the tasks already submitted.
+        virtual ~ThreadPoolExecutor ();
+
+        virtual void submit (const std::function<void ()> &task);
+
+        inline unsigned getThreadCount () const { return unsigned (mThreads.size ()); }
+
+    private:
+        void workerLoop ();
+
+        std::vector<std::thread> mThreads;
+        std::deque<std::function<void ()> > mQueue;
+        std::mutex mMutex;
+        std::condition_variable mCondition;
+        bool mStopping;
+    };
+
+    /** A small dependency graph of tasks, run once per call to run.
+     *
+     *  Tasks are added in an order where dependencies come first, so the
+     *  graph can never have cycles. Tasks with CALLING_THREAD affinity
+     *  run on the thread calling run, one at a time, in the order they
+     *  become ready; use that for anything touching Ogre. Other tasks go
+     *  to the executor and run alongside them.
+     *
+     *  Each run records when every task started and finished, so the
+     *  critical path of the last run can be read back or dumped.
+     */
+    class CAELUM_CORE_EXPORT TaskGraph
+    {
+    public:
+        typedef size_t TaskId;
+
+        enum Affinity
+        {
+            /// Any thread the executor picks.
+            ANY_THREAD,
+
+            /// The thread calling run; serialised with all other such tasks.
+            CALLING_THREAD,
+        };
+
+        /// Start and finish of a task in the last run, in seconds since the run started.
+        struct Timing
+        {
+            double start;
+            double finish;
+
+            inline double getDuration () const { return finish - start; }
+        };
+
+        TaskGraph ();
+
+        /// Remove all tasks and timings; keeps allocated memory for the next frame's graph.
+        void clear ();
+
+        /// Add a task; it runs after all tasks later passed to addDependency for it.
+        TaskId addTask (const std::string &name, const std::function<void ()> &work,
+                Affinity affinity = ANY_THREAD);
+
+        /// Make a task wait for another; dependsOn must have been added before task.
+        void addDependency (TaskId task, TaskId dependsOn);
+
+        inline size_t getTaskCount () const { return mTasks.size (); }
+        inline const std::string& getTaskName (TaskId task) const { return mTasks[task].name; }
+        inline Affinity getTaskAffinity (TaskId task) const { return mTasks[task].affinity; }
+
+        /** Run every task once and return when all have finished.
+         *  @param executor Runs ANY_THREAD tasks; null runs everything
+         *  on the calling thread, in the order tasks were added.
+         *  The first exception thrown by a task is rethrown here, after
+         *  the other tasks finished.
+         */
+        void run (TaskExecutor *executor);
+
+        /// Timing of a task in the last run.
+        inline const Timing& getTiming (TaskId task) const { return mTasks[task].timing; }
+
+        /// Wall time of the last run, in seconds.
+        inline double getRunDuration () const { return mRunDuration; }
+
+        /// Longest chain of dependent tasks in the last run by their durations, first task first.
+        std::vector<TaskId> getCriticalPath () const;
+
+        /// Sum of the durations along the critical path, in seconds.
+        double getCriticalPathDuration () const;
+
+        /// Write every task's timing and the critical path, one line each.
+        void dumpTimings (std::ostream &out) const;
+
+    private:
+        struct Task
+        {
+            std::string name;
+            std::function<void ()> work;
+            Affinity affinity;
+            std::vector<TaskId> dependents;
+            std::vector<TaskId> dependencies;
+            size_t pending;
+            Timing timing;
+        };
+
+        typedef std::chrono::steady_clock Clock;
+
+        /// Run a task and time it, keeping the first exception.
+        void execute (TaskId task);
+
+        /** Count a task as finished and hand out dependents it was the last for.
+         *  Call locked; executor tasks are added to submit, to pass to
+         *  the executor after unlocking.
+         */
+        void release (TaskId task, std::vector<TaskId> &submit);
+
+        /// Give tasks to the executor; call unlocked.
+        void submit (TaskExecutor *executor, const std::vector<TaskId> &tasks);
+
+        std::vector<Task> mTasks;
+
+        // State of the current run.
+        std::mutex mMutex;
+        std::condition_variable mCondition;
+        std::deque<TaskId> mCallingQueue;
+        size_t mFinishedCount;
+        std::exception_ptr mException;
+        Clock::time_point mRunStart;
+        double mRunDuration;
+    };
+}
+
+#endif // CAELUM__TASK_GRAPH_H
@@ -7,37 +7,77 @@
 
 #include "CaelumPrerequisites.h"
 
+#include <cstdint>
+
 namespace Caelum {
 
+    struct SkyClockTime;
+
     /** The system's time model.
      *  This class is responsible of keeping track of current astronomical time
      *  and syncronising with ogre time.
      *
-     *  It maintains a snapshot point: At mCurrentTime == 0 julian day was mJulianDayBase.
-     *  At any time the julian day can be calculated from mCurrentTime and mJulianDayBase.
-     *  This increases precission; mCurrentTime is tracked in seconds while mJulianDayBase
-     *  uses days. It would be silly to track the current time in days.
+     *  Time is kept as an integer julian day number plus integer
+     *  nanoseconds since its start (noon, like julian days). Unlike a
+     *  floating point julian day this doesn't lose precission the
+     *  longer the clock runs: after weeks of updates it is still exact
+     *  to the nanosecond, and two clocks given the same updates are equal
+     *  bit for bit on any machine. The floating point getters are derived
+     *  from it with plain double arithmetic and need no high precission
+     *  FPU mode.
+     *
+     *  update rounds each frame's scaled time to whole nanoseconds;
+     *  advance adds an exact amount.
+     *
+     *  With a tick length set the clock runs in fixed ticks instead:
+     *  update collects real frame time and only moves the clock by
+     *  whole ticks of getTickAdvance nanoseconds, keeping the remainder
+     *  for the next frame. The clock then depends only on the number of
+     *  ticks, so lockstep clients stay identical however their frame
+     *  times differ; they can also drive it with stepTicks directly.
+     *  getRenderAlpha and getRenderJulianDay tell how far rendering is
+     *  between the previous tick and the current one.
      */
     class CAELUM_EXPORT UniversalClock
     {
 	private:
-        /// Astronomical julian day at mCurrentTime = 0;
-		LongReal mJulianDayBase;
+        /// Julian day number; the day starts at noon.
+        std::int64_t mDay;
 
-        /// Seconds since mJulianDayBase.
-        LongReal mCurrentTime;
+        /// Nanoseconds since the start of mDay, in [0, NANOSECONDS_PER_DAY).
+        std::int64_t mNanosecond;
 
-		/// Seconds since mJulianDayBase at last update.
-		LongReal mLastUpdateTime;
+        /// Nanoseconds added by the last update.
+        std::int64_t mLastUpdateDifference;
 
         /// Time scale.
         Ogre::Real mTimeScale;
 
+        /// Real nanoseconds per tick; 0 when not ticking.
+        std::int64_t mTickLength;
+
+        /// Clock nanoseconds per tick; mTickLength scaled by mTimeScale.
+        std::int64_t mTickAdvance;
+
+        /// Real nanoseconds collected towards the next tick, in [0, mTickLength).
+        std::int64_t mAccumulator;
+
+        /** Time of the tick before the current one, as it was when the
+         *  tick happened; the current time if there is none.
+         */
+        std::int64_t mPreviousTickDay, mPreviousTickNanosecond;
+
+        /// Set the time, carrying whole days out of nanosecond.
+        void setTime (std::int64_t day, std::int64_t nanosecond);
+
 	public:
         /** Number of seconds per day; exactly 60*60*24.
          */
         static const LongReal SECONDS_PER_DAY;
 
+        /// Number of nanoseconds per day.
+        static const std::int64_t NANOSECONDS_PER_DAY = 86400000000000LL;
+
 		/** Constructor.
 		 */
 		UniversalClock ();
@@ -57,31 +97,104 @@ namespace Caelum {
 		 */
 		void update (const Ogre::Real time);
 
+        /** Run the clock in fixed ticks.
+         *  @param nanoseconds Real time per tick; 100000000 for 10 ticks a second.
+         *  0 (the default) goes back to moving every update.
+         *  Drops any time collected towards the next tick.
+         */
+        void setTickLength (std::int64_t nanoseconds);
+
+        /// Real nanoseconds per tick; 0 when not ticking.
+        inline std::int64_t getTickLength () const { return mTickLength; }
+
+        /// Clock nanoseconds per tick, after the time scale.
+        inline std::int64_t getTickAdvance () const { return mTickAdvance; }
+
+        /** Move the clock by whole ticks.
+         *  For lockstep clients counting ticks themselves. Doesn't touch
+         *  the time collected by update.
+         */
+        void stepTicks (std::int64_t count);
+
+        /** How far rendering is between the previous tick and this one.
+         *  In [0, 1); always 0 when not ticking.
+         */
+        Ogre::Real getRenderAlpha () const;
+
+        /** Julian day to render at.
+         *  Rendering runs one tick behind so it can interpolate between
+         *  two evaluated ticks: this is alpha of the way from the
+         *  previous tick to the current time. Same as getJulianDay when
+         *  not ticking.
+         */
+        LongReal getRenderJulianDay () const;
+
+        /** Julian day number of the tick before the current one.
+         *  Recorded when the clock ticks, so a later setTimeScale doesn't
+         *  move it. Setting the time or any move other than stepTicks
+         *  leaves no previous tick; then this is the current time.
+         */
+        inline std::int64_t getPreviousTickJulianDayNumber () const { return mPreviousTickDay; }
+
+        /// Nanoseconds since the start of getPreviousTickJulianDayNumber.
+        inline std::int64_t getPreviousTickNanosecondOfDay () const { return mPreviousTickNanosecond; }
+
+        /// Julian day of the tick before the current one; @see getPreviousTickJulianDayNumber
+        LongReal getPreviousTickJulianDay () const;
+
+        /// The current, previous tick and render times, for SkyFrameEvaluator.
+        SkyClockTime getSkyClockTime () const;
+
+        /** Move the clock by an exact number of nanoseconds.
+         *  Not affected by the time scale. Counts as an update for the
+         *  difference getters.
+         */
+        void advance (std::int64_t nanoseconds);
+
         /** Set the current time as a julian day.
          *  Set the current time as a julian day, which you build using one
          *  of the static getJulianDayFromXXX functions.
          *  Defaults to J2000 (noon january 1st)
+         *  Rounded to the nearest nanosecond the double can resolve.
+         *  Drops any time collected towards the next tick.
          */
         void setJulianDay(LongReal value);
 
+        /** Set the current time exactly.
+         *  @param day Julian day number; the day starts at noon.
+         *  @param nanosecond Nanoseconds since the start of the day;
+         *  values outside a day carry into day.
+         */
+        void setJulianDay (std::int64_t day, std::int64_t nanosecond);
+
         /** Set the current time as a gregorian date.
          *  This is here as an easy to use function.
+         *  Exact to the nanosecond.
          */
         void setGregorianDateTime(
                 int year, int month, int day,
                 int hour, int minute, double second);
 
+        /// Julian day number of the current time; the day starts at noon.
+        inline std::int64_t getJulianDayNumber () const { return mDay; }
+
+        /// Nanoseconds since the start of getJulianDayNumber.
+        inline std::int64_t getNanosecondOfDay () const { return mNanosecond; }
+
+        /// Nanoseconds added by the last update.
+        inline std::int64_t getNanosecondDifference () const { return mLastUpdateDifference; }
+
         /** Get current julian day.
          */
         LongReal getJulianDay() const;
 
         /** Get the difference in julian day between this and the last update.
-         *  This is most likely very small and unprecise.
          */
         LongReal getJulianDayDifference() const;
 
         /** Get the current julian second (getJulianDay * SECONDS_PER_DAY)
-         *  This is most likely very very large and unprecise.
+         *  This is very large; a double only resolves it to about a
+         *  microsecond today.
          */
         LongReal getJulianSecond() const;
 
@@ -89,6 +202,12 @@ namespace Caelum {
          *  This is what you want for per-frame updates.
          */
         LongReal getJulianSecondDifference() const;
+
+        /// Same time, bit for bit.
+        inline bool operator== (const UniversalClock &other) const {
+            return mDay == other.mDay && mNanosecond == other.mNanosecond;
+        }
+        inline bool operator!= (const UniversalClock &other) const { return !(*this == other); }
     };
 }
 
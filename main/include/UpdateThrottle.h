@@ -0,0 +1,96 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#ifndef CAELUM__UPDATE_THROTTLE_H
+#define CAELUM__UPDATE_THROTTLE_H
+
+#include "CaelumPrerequisites.h"
+
+namespace Caelum
+{
+    /** Decides when a component is worth updating.
+     *
+     *  CaelumSystem keeps one per group of components and asks it every
+     *  frame before pushing new parameters to them. A skipped update
+     *  doesn't touch the components at all, so Ogre state keeps the
+     *  values from the last real update.
+     *
+     *  Inputs are a few numbers describing what the component would get:
+     *  unit directions, colours and angles in radians, so one epsilon
+     *  means about the same for all of them.
+     *
+     *  @see CaelumSystem::getUpdateThrottle
+     */
+    class CAELUM_EXPORT UpdateThrottle
+    {
+    public:
+        enum UpdatePolicy
+        {
+            /// Update every frame; the default.
+            UPDATE_EVERY_FRAME,
+
+            /// Update once every interval of real time.
+            UPDATE_INTERVAL,
+
+            /// Update when an input moved more than epsilon since the last update.
+            UPDATE_ON_CHANGE,
+        };
+
+        /// Largest number of inputs a throttle compares.
+        static const size_t MAX_INPUTS = 24;
+
+        UpdateThrottle ();
+
+        inline void setPolicy (UpdatePolicy value) { mPolicy = value; }
+        inline UpdatePolicy getPolicy () const { return mPolicy; }
+
+        /// Real seconds between updates for UPDATE_INTERVAL.
+        inline void setInterval (Ogre::Real value) { mInterval = value; }
+        inline Ogre::Real getInterval () const { return mInterval; }
+
+        /// Largest change of any input UPDATE_ON_CHANGE ignores.
+        inline void setEpsilon (Ogre::Real value) { mEpsilon = value; }
+        inline Ogre::Real getEpsilon () const { return mEpsilon; }
+
+        /** Decide about this frame's update and count it.
+         *  @param timeSinceLastFrame Real time since the last call.
+         *  @param inputs What the components would be updated with.
+         *  @param count Number of inputs; at most MAX_INPUTS.
+         *  @param force Update whatever the policy says, for example
+         *  because the components were just set from elsewhere.
+         *  @return If the components should be updated. The inputs are
+         *  remembered only then.
+         */
+        bool shouldUpdate (Ogre::Real timeSinceLastFrame,
+                const LongReal *inputs, size_t count, bool force = false);
+
+        /// Make the next shouldUpdate say yes.
+        void invalidate ();
+
+        /// Number of updates done.
+        inline unsigned long getUpdateCount () const { return mUpdateCount; }
+
+        /// Number of updates skipped.
+        inline unsigned long getSkipCount () const { return mSkipCount; }
+
+        /// Set both counters back to 0.
+        void resetCounters ();
+
+    private:
+        UpdatePolicy mPolicy;
+        Ogre::Real mInterval;
+        Ogre::Real mEpsilon;
+
+        /// Real time since the last update.
+        Ogre::Real mElapsed;
+
+        bool mValid;
+        LongReal mInputs[MAX_INPUTS];
+        size_t mInputCount;
+
+        unsigned long mUpdateCount, mSkipCount;
+    };
+}
+
+#endif // CAELUM__UPDATE_THROTTLE_H
@@ -2,8 +2,14 @@
 // It is subject to the license terms in the LICENSE file found in the top-level directory
 // of this distribution.
 
-#include "CaelumPrecompiled.h"
+#include "CaelumCorePrerequisites.h"
 #include "Astronomy.h"
+#include "AstronomyScalar.h"
+#include "BatchMath.h"
+
+#if defined (_MSC_VER) && defined (_M_IX86)
+#include <float.h>
+#endif
 
 namespace Caelum
 {
@@ -46,48 +52,27 @@ namespace Caelum
             LongReal lon, LongReal lat,
             LongReal &rasc, LongReal &decl)
 	{
-		double ecl = Astronomy::degToRad(23.439281);
-
-		double x = cos(lon) * cos(lat);
-		double y = cos(ecl) * sin(lon) * cos(lat) - sin(ecl) * sin(lat);
-		double z = sin(ecl) * sin(lon) * cos(lat) + cos(ecl) * sin(lat);
-
-        double r = sqrt(x * x + y * y);
-        rasc = atan2(y, x);
-        decl = atan2(z, r);
+		DoubleAstronomy::convertEclipticToEquatorialRad (lon, lat, rasc, decl);
 	} 
 
     void Astronomy::convertRectangularToSpherical (
             LongReal x, LongReal y, LongReal z,
             LongReal &rasc, LongReal &decl, LongReal &dist)
     {
-        dist = sqrt (x * x + y * y + z * z);
-        rasc = atan2Deg (y, x);
-        decl = atan2Deg (z, sqrt (x * x + y * y));
+        DoubleAstronomy::convertRectangularToSpherical (x, y, z, rasc, decl, dist);
     }
 
     void Astronomy::convertSphericalToRectangular (
             LongReal rasc, LongReal decl, LongReal dist,
             LongReal &x, LongReal &y, LongReal &z)
     {
-        x = dist * cosDeg (rasc) * cosDeg (decl);
-        y = dist * sinDeg (rasc) * cosDeg (decl);
-        z = dist * sinDeg (decl);
+        DoubleAstronomy::convertSphericalToRectangular (rasc, decl, dist, x, y, z);
     }
 
     void Astronomy::getVernalEquinoxHourAngle(
             LongReal jday, LongReal longitude, LongReal& hourAngle)
     {
-        // julian days since J2000
-        LongReal d = jday - 2451545.0;
-        // julian centuries since J2000
-        LongReal T = d / 36525.0;
-        // Greenweech Mean Sidereal Time in seconds  of a day of 86400s UT1 at 0h UT1
-        LongReal GMST0 = 24110.54841 + 8640184.812866 * T + 0.093104 * (T * T) - 0.0000062 * (T * T * T);
-        // Universal time of day in degrees.
-        LongReal UT = LongReal(fmod(d, 1) * 360);
-        // Hour angle, in degrees
-        hourAngle = GMST0 * (360.0 / 86400.0) + LongReal(180) + UT + longitude;
+        DoubleAstronomy::getVernalEquinoxHourAngle (jday, longitude, hourAngle);
     }
 
     void Astronomy::convertEquatorialToHorizontal (
@@ -96,163 +81,285 @@ namespace Caelum
             LongReal rasc,        LongReal decl,
             LongReal &azimuth,    LongReal &altitude)
     {
-        LongReal d = jday - 2451543.5;
-        LongReal w = LongReal (282.9404 + 4.70935E-5 * d);
-        LongReal M = LongReal (356.0470 + 0.9856002585 * d);
-        // Sun's mean longitude
-        LongReal L = w + M;
-        // Universal time of day in degrees.
-        LongReal UT = LongReal(fmod(d, 1) * 360);
-        LongReal hourAngle = longitude + L + LongReal (180) + UT - rasc;
-
-        LongReal x = cosDeg (hourAngle) * cosDeg (decl);
-        LongReal y = sinDeg (hourAngle) * cosDeg (decl);
-        LongReal z = sinDeg (decl);
+        DoubleAstronomy::convertEquatorialToHorizontal (
+                jday, longitude, latitude, rasc, decl, azimuth, altitude);
+    }
 
-        LongReal xhor = x * sinDeg (latitude) - z * cosDeg (latitude);
-        LongReal yhor = y;
-        LongReal zhor = x * cosDeg (latitude) + z * sinDeg (latitude);
+    void Astronomy::getEquatorialSunPosition (
+            LongReal jday,
+            LongReal &rasc, LongReal &decl)
+    {
+        DoubleAstronomy::getEquatorialSunPosition (jday, rasc, decl);
+    }
 
-        azimuth = atan2Deg (yhor, xhor) + LongReal (180);
-        altitude = atan2Deg (zhor, sqrt (xhor * xhor + yhor * yhor));
+    LongReal Astronomy::getLocalSiderealAngle (LongReal jday, LongReal longitude)
+    {
+        return DoubleAstronomy::getLocalSiderealAngle (jday, longitude);
     }
 
-    void Astronomy::getHorizontalSunPosition (
+    void Astronomy::convertEquatorialRectangularToHorizontal (
             LongReal jday,
             LongReal longitude, LongReal latitude,
+            LongReal x, LongReal y, LongReal z,
             LongReal &azimuth, LongReal &altitude)
     {
-        // 2451544.5 == Astronomy::getJulianDayFromGregorianDateTime(2000, 1, 1, 0, 0, 0));
-        // 2451543.5 == Astronomy::getJulianDayFromGregorianDateTime(1999, 12, 31, 0, 0, 0));
-        LongReal d = jday - 2451543.5;
-
-        // Sun's Orbital elements:
-        // argument of perihelion
-        LongReal w = LongReal (282.9404 + 4.70935E-5 * d);
-        // eccentricity (0=circle, 0-1=ellipse, 1=parabola)
-        LongReal e = 0.016709 - 1.151E-9 * d;
-        // mean anomaly (0 at perihelion; increases uniformly with time)
-        LongReal M = LongReal(356.0470 + 0.9856002585 * d);
-        // Obliquity of the ecliptic.
-        //LongReal oblecl = LongReal (23.4393 - 3.563E-7 * d);
-
-        // Eccentric anomaly
-        LongReal E = M + radToDeg(e * sinDeg (M) * (1 + e * cosDeg (M)));
-
-        // Sun's Distance(R) and true longitude(L)
-        LongReal xv = cosDeg (E) - e;
-        LongReal yv = sinDeg (E) * sqrt (1 - e * e);
-        //LongReal r = sqrt (xv * xv + yv * yv);
-        LongReal lon = atan2Deg (yv, xv) + w;
-        LongReal lat = 0;
-
-		LongReal lambda = degToRad(lon);
-		LongReal beta = degToRad(lat);
-        LongReal rasc, decl;
-		convertEclipticToEquatorialRad (lambda, beta, rasc, decl);
-		rasc = radToDeg(rasc);
-		decl = radToDeg(decl);
-
-        // Horizontal spherical.
-        Astronomy::convertEquatorialToHorizontal (
-                jday, longitude, latitude, rasc, decl, azimuth, altitude);
+        DoubleAstronomy::convertEquatorialRectangularToHorizontal (
+                jday, longitude, latitude, x, y, z, azimuth, altitude);
     }
 
     void Astronomy::getHorizontalSunPosition (
             LongReal jday,
-            Ogre::Degree longitude, Ogre::Degree latitude,
-            Ogre::Degree &azimuth, Ogre::Degree &altitude)
+            LongReal longitude, LongReal latitude,
+            LongReal &azimuth, LongReal &altitude)
     {
-        LongReal az, al;
-        getHorizontalSunPosition(jday, longitude.valueDegrees (), latitude.valueDegrees (), az, al);
-        azimuth = Ogre::Degree(az);                
-        altitude = Ogre::Degree(al);                
+        DoubleAstronomy::getHorizontalSunPosition (
+                jday, longitude, latitude, azimuth, altitude);
     }
 
 	void Astronomy::getEclipticMoonPositionRad (
             LongReal jday,
             LongReal &lon, LongReal &lat)
 	{
-        // Julian centuries since January 1, 2000
-		double T = (jday - 2451545.0L) / 36525.0L; 
-		double lprim = 3.8104L + 8399.7091L * T;
-		double mprim = 2.3554L + 8328.6911L * T;
-		double m = 6.2300L + 648.3019L * T;
-		double d = 5.1985L + 7771.3772L * T;
-		double f = 1.6280L + 8433.4663L * T;
-		lon = lprim
-                + 0.1098L * sin(mprim)
-                + 0.0222L * sin(2.0L * d - mprim)
-                + 0.0115L * sin(2.0L * d)
-				+ 0.0037L * sin(2.0L * mprim)
-                - 0.0032L * sin(m)
-                - 0.0020L * sin(2.0L * f)
-                + 0.0010L * sin(2.0L * d - 2.0L * mprim)
-				+ 0.0010L * sin(2.0L * d - m - mprim)
-                + 0.0009L * sin(2.0L * d + mprim)
-                + 0.0008L * sin(2.0L * d - m)
-				+ 0.0007L * sin(mprim - m)
-                - 0.0006L * sin(d)
-                - 0.0005L * sin(m + mprim);
-		lat =
-                + 0.0895L * sin(f)
-                + 0.0049L * sin(mprim + f)
-                + 0.0048L * sin(mprim - f)
-                + 0.0030L * sin(2.0L * d - f)
-                + 0.0010L * sin(2.0L * d + f - mprim)
-                + 0.0008  * sin(2.0L * d - f - mprim)
-                + 0.0006L * sin(2.0L * d + f);
+        LunarTheory::getEclipticPositionRad<CAELUM_LUNAR_THEORY> (jday, lon, lat);
 	}
 
+    void Astronomy::getEclipticMoonPositionRad (
+            LongReal jday,
+            LunarTheoryPrecision precision,
+            LongReal &lon, LongReal &lat)
+    {
+        switch (precision) {
+            case LUNAR_THEORY_GAME:
+                LunarTheory::getEclipticPositionRad<LUNAR_THEORY_GAME> (jday, lon, lat);
+                break;
+            case LUNAR_THEORY_PLANETARIUM:
+                LunarTheory::getEclipticPositionRad<LUNAR_THEORY_PLANETARIUM> (jday, lon, lat);
+                break;
+            default:
+                LunarTheory::getEclipticPositionRad<LUNAR_THEORY_CLASSIC> (jday, lon, lat);
+                break;
+        }
+    }
+
+    void Astronomy::getEquatorialMoonPosition (
+            LongReal jday,
+            LongReal &rasc, LongReal &decl)
+    {
+        DoubleAstronomy::getEquatorialMoonPosition (jday, rasc, decl);
+    }
+
     void Astronomy::getHorizontalMoonPosition (
             LongReal jday,
             LongReal longitude, LongReal latitude,
             LongReal &azimuth, LongReal &altitude)
     {
-        // Ecliptic spherical
-		LongReal lonecl, latecl;
-		Astronomy::getEclipticMoonPositionRad (jday, lonecl, latecl);
+        DoubleAstronomy::getHorizontalMoonPosition (
+                jday, longitude, latitude, azimuth, altitude);
+    }
 
-		// Equatorial spherical
-        LongReal rasc, decl; 
-		Astronomy::convertEclipticToEquatorialRad (lonecl, latecl, rasc, decl);
+    namespace
+    {
+        /// Number of elements processed per block in the batch routines.
+        /// Block temporaries live on the stack and should stay in L1.
+        const size_t BATCH_BLOCK_SIZE = 256;
 
-		// Radians to degrees (all angles are in radians up to this point)
-        rasc = radToDeg(rasc);
-		decl = radToDeg(decl);
+        const double BATCH_DEG_TO_RAD = 1.74532925199432957692e-02;
+        const double BATCH_RAD_TO_DEG = 5.72957795130823208768e+01;
 
-		// Equatorial to horizontal
-        Astronomy::convertEquatorialToHorizontal (
-                jday, longitude, latitude, rasc, decl, azimuth, altitude);
+        /// Obliquity of the ecliptic used by convertEclipticToEquatorialRad.
+        const double BATCH_ECLIPTIC_OBLIQUITY = 23.439281;
+
+        /// Normalize degrees to [0, 360) without branches.
+        inline double batchNormalizeDegrees (double x) {
+            return x - 360.0 * std::floor (x * (1.0 / 360.0));
+        }
+
+        /** Horizontal coordinates from equatorial rectangular coordinates.
+         *  This is convertEquatorialToHorizontal written with angle-sum
+         *  identities instead of going through rasc/decl angles. The input
+         *  vectors don't have to be normalized.
+         */
+        void batchEquatorialRectangularToHorizontal (
+                const LongReal *jday, size_t count,
+                const double *x, const double *y, const double *z,
+                double longitude, double sinLat, double cosLat,
+                LongReal *azimuth, LongReal *altitude)
+        {
+            for (size_t i = 0; i < count; ++i) {
+                double d = jday[i] - 2451543.5;
+                // Sun's mean longitude, same as in convertEquatorialToHorizontal.
+                double L = (282.9404 + 4.70935E-5 * d) + (356.0470 + 0.9856002585 * d);
+                double UT = (d - std::trunc (d)) * 360;
+                double lst = batchNormalizeDegrees (longitude + L + 180 + UT) * BATCH_DEG_TO_RAD;
+                double sinLst, cosLst;
+                BatchMath::sinCos (lst, sinLst, cosLst);
+
+                // cos/sin (lst - rasc) * cos (decl), scaled by the vector length.
+                double xe = cosLst * x[i] + sinLst * y[i];
+                double ye = sinLst * x[i] - cosLst * y[i];
+                double xhor = xe * sinLat - z[i] * cosLat;
+                double yhor = ye;
+                double zhor = xe * cosLat + z[i] * sinLat;
+
+                azimuth[i] = BatchMath::atan2 (yhor, xhor) * BATCH_RAD_TO_DEG + 180;
+                altitude[i] = BatchMath::atan2 (zhor, std::sqrt (xhor * xhor + yhor * yhor)) * BATCH_RAD_TO_DEG;
+            }
+        }
     }
 
-    void Astronomy::getHorizontalMoonPosition (
+    void Astronomy::getHorizontalSunPositionBatch (
+            const LongReal *jday, size_t count,
+            LongReal longitude, LongReal latitude,
+            LongReal *azimuth, LongReal *altitude)
+    {
+        const double sinLat = sinDeg (latitude);
+        const double cosLat = cosDeg (latitude);
+        const double sinEcl = sinDeg (BATCH_ECLIPTIC_OBLIQUITY);
+        const double cosEcl = cosDeg (BATCH_ECLIPTIC_OBLIQUITY);
+
+        double x[BATCH_BLOCK_SIZE], y[BATCH_BLOCK_SIZE], z[BATCH_BLOCK_SIZE];
+        for (size_t begin = 0; begin < count; begin += BATCH_BLOCK_SIZE) {
+            const size_t n = std::min (BATCH_BLOCK_SIZE, count - begin);
+            const LongReal *jd = jday + begin;
+
+            // Same orbital elements as getHorizontalSunPosition. The true
+            // longitude is never turned into an angle; atan2 and the
+            // following sin/cos cancel out.
+            for (size_t i = 0; i < n; ++i) {
+                double d = jd[i] - 2451543.5;
+                double w = batchNormalizeDegrees (282.9404 + 4.70935E-5 * d) * BATCH_DEG_TO_RAD;
+                double e = 0.016709 - 1.151E-9 * d;
+                double M = batchNormalizeDegrees (356.0470 + 0.9856002585 * d) * BATCH_DEG_TO_RAD;
+
+                double sinM, cosM, sinE, cosE, sinW, cosW;
+                BatchMath::sinCos (M, sinM, cosM);
+                BatchMath::sinCos (M + e * sinM * (1 + e * cosM), sinE, cosE);
+                BatchMath::sinCos (w, sinW, cosW);
+
+                double xv = cosE - e;
+                double yv = sinE * std::sqrt (1 - e * e);
+                // r * cos (lon) and r * sin (lon)
+                double cosLon = xv * cosW - yv * sinW;
+                double sinLon = yv * cosW + xv * sinW;
+
+                x[i] = cosLon;
+                y[i] = cosEcl * sinLon;
+                z[i] = sinEcl * sinLon;
+            }
+
+            batchEquatorialRectangularToHorizontal (
+                    jd, n, x, y, z, longitude, sinLat, cosLat,
+                    azimuth + begin, altitude + begin);
+        }
+    }
+
+    void Astronomy::getHorizontalMoonPositionBatch (
+            const LongReal *jday, size_t count,
+            LongReal longitude, LongReal latitude,
+            LongReal *azimuth, LongReal *altitude)
+    {
+        const double sinLat = sinDeg (latitude);
+        const double cosLat = cosDeg (latitude);
+        const double sinEcl = sinDeg (BATCH_ECLIPTIC_OBLIQUITY);
+        const double cosEcl = cosDeg (BATCH_ECLIPTIC_OBLIQUITY);
+
+        double x[BATCH_BLOCK_SIZE], y[BATCH_BLOCK_SIZE], z[BATCH_BLOCK_SIZE];
+        for (size_t begin = 0; begin < count; begin += BATCH_BLOCK_SIZE) {
+            const size_t n = std::min (BATCH_BLOCK_SIZE, count - begin);
+            const LongReal *jd = jday + begin;
+
+            // Same series as getEclipticMoonPositionRad.
+            for (size_t i = 0; i < n; ++i) {
+                double lon, lat;
+                LunarTheory::getEclipticPositionRad<CAELUM_LUNAR_THEORY, LunarTheory::BatchTrig> (
+                        jd[i], lon, lat);
+
+                double sinLon, cosLon, sinLatEcl, cosLatEcl;
+                BatchMath::sinCos (lon, sinLon, cosLon);
+                BatchMath::sinCos (lat, sinLatEcl, cosLatEcl);
+
+                x[i] = cosLon * cosLatEcl;
+                y[i] = cosEcl * sinLon * cosLatEcl - sinEcl * sinLatEcl;
+                z[i] = sinEcl * sinLon * cosLatEcl + cosEcl * sinLatEcl;
+            }
+
+            batchEquatorialRectangularToHorizontal (
+                    jd, n, x, y, z, longitude, sinLat, cosLat,
+                    azimuth + begin, altitude + begin);
+        }
+    }
+
+    void Astronomy::ObserverBatch::assign (
+            const LongReal *longitude, const LongReal *latitude, size_t count)
+    {
+        sinLongitude.resize (count);
+        cosLongitude.resize (count);
+        sinLatitude.resize (count);
+        cosLatitude.resize (count);
+        for (size_t i = 0; i < count; ++i) {
+            BatchMath::sinCos (longitude[i] * BATCH_DEG_TO_RAD, sinLongitude[i], cosLongitude[i]);
+            BatchMath::sinCos (latitude[i] * BATCH_DEG_TO_RAD, sinLatitude[i], cosLatitude[i]);
+        }
+    }
+
+    void Astronomy::convertEquatorialToHorizontalBatch (
             LongReal jday,
-            Ogre::Degree longitude, Ogre::Degree latitude,
-            Ogre::Degree &azimuth, Ogre::Degree &altitude)
+            LongReal rasc, LongReal decl,
+            const ObserverBatch &observers,
+            LongReal *azimuth, LongReal *altitude)
     {
-        LongReal az, al;
-        getHorizontalMoonPosition(jday, longitude.valueDegrees (), latitude.valueDegrees (), az, al);
-        azimuth = Ogre::Degree(az);                
-        altitude = Ogre::Degree(al);  
+        // Observer independent part of convertEquatorialToHorizontal.
+        LongReal d = jday - 2451543.5;
+        LongReal L = LongReal (282.9404 + 4.70935E-5 * d) + LongReal (356.0470 + 0.9856002585 * d);
+        LongReal UT = LongReal (fmod (d, 1) * 360);
+        LongReal lst0 = L + LongReal (180) + UT;
+        const double sinLst0 = sinDeg (lst0), cosLst0 = cosDeg (lst0);
+
+        const double x = cosDeg (rasc) * cosDeg (decl);
+        const double y = sinDeg (rasc) * cosDeg (decl);
+        const double z = sinDeg (decl);
+
+        const LongReal *sinLon = observers.sinLongitude.empty () ? 0 : &observers.sinLongitude[0];
+        const LongReal *cosLon = observers.cosLongitude.empty () ? 0 : &observers.cosLongitude[0];
+        const LongReal *sinLat = observers.sinLatitude.empty () ? 0 : &observers.sinLatitude[0];
+        const LongReal *cosLat = observers.cosLatitude.empty () ? 0 : &observers.cosLatitude[0];
+        const size_t count = observers.size ();
+        for (size_t i = 0; i < count; ++i) {
+            // Rotate the sidereal angle by the observer longitude.
+            double cosLst = cosLst0 * cosLon[i] - sinLst0 * sinLon[i];
+            double sinLst = sinLst0 * cosLon[i] + cosLst0 * sinLon[i];
+
+            double xe = cosLst * x + sinLst * y;
+            double ye = sinLst * x - cosLst * y;
+            double xhor = xe * sinLat[i] - z * cosLat[i];
+            double yhor = ye;
+            double zhor = xe * cosLat[i] + z * sinLat[i];
+
+            azimuth[i] = BatchMath::atan2 (yhor, xhor) * BATCH_RAD_TO_DEG + 180;
+            altitude[i] = BatchMath::atan2 (zhor, std::sqrt (xhor * xhor + yhor * yhor)) * BATCH_RAD_TO_DEG;
+        }
     }
 
-    void Astronomy::getHorizontalNorthEclipticPolePosition (
-			LongReal jday,
-			Ogre::Degree longitude, Ogre::Degree latitude,
-			Ogre::Degree &azimuth, Ogre::Degree &altitude)
+    void Astronomy::getHorizontalSunPositionForObservers (
+            LongReal jday,
+            const ObserverBatch &observers,
+            LongReal *azimuth, LongReal *altitude)
     {
-		// Get precise equatorial spherical coordinates of North Ecliptic Pole
-        LongReal rasc = 270.0;
-		LongReal decl = 90.0 - 23.439281;
-		
-		// Equatorial to horizontal
-        LongReal az, al;
-        Astronomy::convertEquatorialToHorizontal (
-				jday, longitude.valueDegrees (), latitude.valueDegrees (), rasc, decl, az, al);
-        azimuth = Ogre::Degree(az);                
-        altitude = Ogre::Degree(al);  
+        LongReal rasc, decl;
+        getEquatorialSunPosition (jday, rasc, decl);
+        convertEquatorialToHorizontalBatch (jday, rasc, decl, observers, azimuth, altitude);
     }
+
+    void Astronomy::getHorizontalMoonPositionForObservers (
+            LongReal jday,
+            const ObserverBatch &observers,
+            LongReal *azimuth, LongReal *altitude)
+    {
+        LongReal rasc, decl;
+        getEquatorialMoonPosition (jday, rasc, decl);
+        convertEquatorialToHorizontalBatch (jday, rasc, decl, observers, azimuth, altitude);
+    }
+
 	
     int Astronomy::getJulianDayFromGregorianDate(
             int year, int month, int day)
@@ -270,22 +377,16 @@ namespace Caelum
             int year, int month, int day,
             int hour, int minute, LongReal second)
     {
-        ScopedHighPrecissionFloatSwitch precissionSwitch;
-
-        int jdn = getJulianDayFromGregorianDate (year, month, day);
-        // These are NOT integer divisions.
-        LongReal jd = jdn + (hour - 12) / 24.0 + minute / 1440.0 + second / 86400.0;
-
-        return jd;
+        return DoubleAstronomy::getJulianDayFromGregorianDateTime (
+                year, month, day, hour, minute, second);
     }
 
     LongReal Astronomy::getJulianDayFromGregorianDateTime(
             int year, int month, int day,
             LongReal secondsFromMidnight)
     {
-        int jdn = getJulianDayFromGregorianDate(year, month, day);
-        LongReal jd = jdn + secondsFromMidnight / 86400.0 - 0.5;
-        return jd;
+        return DoubleAstronomy::getJulianDayFromGregorianDateTime (
+                year, month, day, secondsFromMidnight);
     }
 
     void Astronomy::getGregorianDateFromJulianDay(
@@ -315,23 +416,8 @@ namespace Caelum
             LongReal julianDay, int &year, int &month, int &day,
             int &hour, int &minute, LongReal &second)
     {
-        // Integer julian days are at noon.
-        // static_cast<int)(floor( is more precise than Ogre::Math::IFloor.
-        // Yes, it does matter.
-        int fpmode = enterHighPrecissionFloatingPointMode();
-        julianDay += (LongReal)0.5;
-       int ijd = static_cast<int>(floor(julianDay));
-        getGregorianDateFromJulianDay(ijd, year, month, day);
-
-
-      LongReal s = (julianDay - (LongReal)ijd);
-      s *= 86400.0;
-        hour = static_cast<int>(floor(s / 3600));
-        s -= hour * 3600;
-        minute = static_cast<int>(floor(s / 60));
-        s -= minute * 60;
-        second = s;
-      restoreFloatingPointMode(fpmode);
+        DoubleAstronomy::getGregorianDateTimeFromJulianDay (
+                julianDay, year, month, day, hour, minute, second);
     }
 
     void Astronomy::getGregorianDateFromJulianDay(
@@ -343,7 +429,7 @@ namespace Caelum
         getGregorianDateTimeFromJulianDay(julianDay, year, month, day, hour, minute, second);
     }
 
-#if (OGRE_PLATFORM == OGRE_PLATFORM_WIN32) && (OGRE_COMPILER == OGRE_COMPILER_MSVC) && (OGRE_ARCH_TYPE == OGRE_ARCHITECTURE_32)
+#if defined (_MSC_VER) && defined (_M_IX86)
     int Astronomy::enterHighPrecissionFloatingPointMode ()
     {
         int oldMode = ::_controlfp (0, 0);
@@ -0,0 +1,286 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#include "CaelumCorePrerequisites.h"
+#include "Astronomy.h"
+#include <limits>
+
+namespace Caelum
+{
+    const LongReal Astronomy::SUN_RISE_SET_ALTITUDE = -0.833;
+    const LongReal Astronomy::MOON_RISE_SET_ALTITUDE = 0.125;
+    const LongReal Astronomy::CIVIL_TWILIGHT_ALTITUDE = -6;
+    const LongReal Astronomy::NAUTICAL_TWILIGHT_ALTITUDE = -12;
+    const LongReal Astronomy::ASTRONOMICAL_TWILIGHT_ALTITUDE = -18;
+
+    namespace
+    {
+        /// Step used to bracket altitude crossings, in days.
+        const int EVENT_STEPS_PER_DAY = 24;
+
+        /// Tolerance for refined event times, in days (about 0.1 seconds).
+        const LongReal EVENT_TOLERANCE = 1e-6;
+
+        /// Approximate rate of change of the hour angle, in degrees per day.
+        const LongReal SUN_HOUR_ANGLE_RATE = 360.9856;
+        const LongReal MOON_HOUR_ANGLE_RATE = 347.81;
+
+        LongReal getBodyAltitude (Astronomy::EventBody body,
+                LongReal jday, LongReal longitude, LongReal latitude)
+        {
+            LongReal azimuth, altitude;
+            if (body == Astronomy::EVENT_BODY_SUN) {
+                Astronomy::getHorizontalSunPosition (jday, longitude, latitude, azimuth, altitude);
+            } else {
+                Astronomy::getHorizontalMoonPosition (jday, longitude, latitude, azimuth, altitude);
+            }
+            return altitude;
+        }
+
+        /** Brent's root finder on [a, b]; fa and fb must have different signs.
+         *  This is the classic combination of bisection, secant and inverse
+         *  quadratic interpolation; it never does worse than bisection.
+         */
+        template <class Function>
+        LongReal findRootBrent (Function f, LongReal a, LongReal b, LongReal fa, LongReal fb, LongReal tol)
+        {
+            const LongReal EPS = std::numeric_limits<LongReal>::epsilon ();
+            LongReal c = a, fc = fa;
+            LongReal d = b - a, e = d;
+            for (int iter = 0; iter < 100; ++iter) {
+                if ((fb > 0) == (fc > 0)) {
+                    c = a;
+                    fc = fa;
+                    d = e = b - a;
+                }
+                if (std::abs (fc) < std::abs (fb)) {
+                    a = b; b = c; c = a;
+                    fa = fb; fb = fc; fc = fa;
+                }
+                LongReal tol1 = 2 * EPS * std::abs (b) + tol / 2;
+                LongReal xm = (c - b) / 2;
+                if (std::abs (xm) <= tol1 || fb == 0) {
+                    return b;
+                }
+                if (std::abs (e) >= tol1 && std::abs (fa) > std::abs (fb)) {
+                    // Try interpolation.
+                    LongReal p, q, s = fb / fa;
+                    if (a == c) {
+                        p = 2 * xm * s;
+                        q = 1 - s;
+                    } else {
+                        LongReal r = fb / fc;
+                        q = fa / fc;
+                        p = s * (2 * xm * q * (q - r) - (b - a) * (r - 1));
+                        q = (q - 1) * (r - 1) * (s - 1);
+                    }
+                    if (p > 0) {
+                        q = -q;
+                    }
+                    p = std::abs (p);
+                    if (2 * p < std::min (3 * xm * q - std::abs (tol1 * q), std::abs (e * q))) {
+                        e = d;
+                        d = p / q;
+                    } else {
+                        d = xm;
+                        e = d;
+                    }
+                } else {
+                    // Bisection.
+                    d = xm;
+                    e = d;
+                }
+                a = b;
+                fa = fb;
+                b += (std::abs (d) > tol1) ? d : (xm > 0 ? tol1 : -tol1);
+                fb = f (b);
+            }
+            return b;
+        }
+
+        /// Refine an altitude crossing bracketed by [a, b].
+        LongReal refineAltitudeCrossing (Astronomy::EventBody body,
+                LongReal a, LongReal b,
+                LongReal longitude, LongReal latitude, LongReal altitude)
+        {
+            auto f = [=] (LongReal t) {
+                return getBodyAltitude (body, t, longitude, latitude) - altitude;
+            };
+            LongReal fa = f (a), fb = f (b);
+            if ((fa > 0) == (fb > 0)) {
+                // Bracket came from slightly different (batch) samples.
+                return std::abs (fa) < std::abs (fb) ? a : b;
+            }
+            return findRootBrent (f, a, b, fa, fb, EVENT_TOLERANCE);
+        }
+
+        /// Find crossings of all thresholds in one day of altitude samples.
+        struct AltitudeThreshold
+        {
+            LongReal altitude;
+            LongReal *rising;
+            LongReal *setting;
+        };
+
+        void findDailyCrossings (Astronomy::EventBody body,
+                const LongReal *jday, const LongReal *altitude,
+                LongReal longitude, LongReal latitude,
+                const AltitudeThreshold *thresholds, size_t thresholdCount)
+        {
+            for (size_t t = 0; t < thresholdCount; ++t) {
+                const AltitudeThreshold &th = thresholds[t];
+                for (int i = 0; i < EVENT_STEPS_PER_DAY; ++i) {
+                    bool below0 = altitude[i] < th.altitude;
+                    bool below1 = altitude[i + 1] < th.altitude;
+                    LongReal *result = 0;
+                    if (below0 && !below1) {
+                        result = th.rising;
+                    } else if (!below0 && below1) {
+                        result = th.setting;
+                    }
+                    if (result && std::isnan (*result)) {
+                        *result = refineAltitudeCrossing (body, jday[i], jday[i + 1],
+                                longitude, latitude, th.altitude);
+                    }
+                }
+            }
+        }
+    }
+
+    bool Astronomy::findAltitudeCrossing (
+            EventBody body,
+            LongReal start, LongReal end,
+            LongReal longitude, LongReal latitude,
+            LongReal altitude, bool rising,
+            LongReal &jday)
+    {
+        ScopedHighPrecissionFloatSwitch precissionSwitch;
+
+        const LongReal step = LongReal (1) / EVENT_STEPS_PER_DAY;
+        LongReal t0 = start;
+        LongReal f0 = getBodyAltitude (body, t0, longitude, latitude) - altitude;
+        while (t0 < end) {
+            LongReal t1 = std::min (t0 + step, end);
+            LongReal f1 = getBodyAltitude (body, t1, longitude, latitude) - altitude;
+            if (rising ? (f0 < 0 && f1 >= 0) : (f0 >= 0 && f1 < 0)) {
+                jday = refineAltitudeCrossing (body, t0, t1, longitude, latitude, altitude);
+                return true;
+            }
+            t0 = t1;
+            f0 = f1;
+        }
+        return false;
+    }
+
+    bool Astronomy::findCulmination (
+            EventBody body,
+            LongReal start, LongReal end,
+            LongReal longitude,
+            LongReal &jday)
+    {
+        ScopedHighPrecissionFloatSwitch precissionSwitch;
+
+        const LongReal rate = (body == EVENT_BODY_SUN) ? SUN_HOUR_ANGLE_RATE : MOON_HOUR_ANGLE_RATE;
+        auto hourAngle = [=] (LongReal t) {
+            LongReal rasc, decl;
+            if (body == EVENT_BODY_SUN) {
+                getEquatorialSunPosition (t, rasc, decl);
+            } else {
+                getEquatorialMoonPosition (t, rasc, decl);
+            }
+            return normalizeDegrees (getLocalSiderealAngle (t, longitude) - rasc);
+        };
+
+        // First guess from the mean rate, then Newton on the hour angle.
+        LongReal t = start + (360 - hourAngle (start)) / rate;
+        for (int iter = 0; iter < 8; ++iter) {
+            LongReal h = hourAngle (t);
+            if (h > 180) {
+                h -= 360;
+            }
+            t -= h / rate;
+            if (std::abs (h / rate) < EVENT_TOLERANCE) {
+                break;
+            }
+        }
+
+        if (t < start || t >= end) {
+            return false;
+        }
+        jday = t;
+        return true;
+    }
+
+    LongReal Astronomy::getLocalMidnight (
+            int year, int month, int day, LongReal longitude)
+    {
+        // Integer julian days are at noon.
+        return getJulianDayFromGregorianDate (year, month, day) - LongReal (0.5) - longitude / 360;
+    }
+
+    void Astronomy::getDailyEvents (
+            LongReal start,
+            LongReal longitude, LongReal latitude,
+            DailyEvents &events)
+    {
+        getDailyEventsBatch (start, 1, longitude, latitude, &events);
+    }
+
+    void Astronomy::getDailyEventsBatch (
+            LongReal start, size_t dayCount,
+            LongReal longitude, LongReal latitude,
+            DailyEvents *events)
+    {
+        ScopedHighPrecissionFloatSwitch precissionSwitch;
+
+        if (dayCount == 0) {
+            return;
+        }
+
+        // Sample altitudes for the whole range in one batch.
+        const size_t sampleCount = dayCount * EVENT_STEPS_PER_DAY + 1;
+        std::vector<LongReal> jday (sampleCount), azimuth (sampleCount);
+        std::vector<LongReal> sunAltitude (sampleCount), moonAltitude (sampleCount);
+        for (size_t i = 0; i < sampleCount; ++i) {
+            jday[i] = start + LongReal (i) / EVENT_STEPS_PER_DAY;
+        }
+        getHorizontalSunPositionBatch (&jday[0], sampleCount, longitude, latitude,
+                &azimuth[0], &sunAltitude[0]);
+        getHorizontalMoonPositionBatch (&jday[0], sampleCount, longitude, latitude,
+                &azimuth[0], &moonAltitude[0]);
+
+        const LongReal nan = std::numeric_limits<LongReal>::quiet_NaN ();
+        for (size_t day = 0; day < dayCount; ++day) {
+            DailyEvents &ev = events[day];
+            ev.astronomicalDawn = ev.nauticalDawn = ev.civilDawn = ev.sunrise = nan;
+            ev.solarNoon = nan;
+            ev.sunset = ev.civilDusk = ev.nauticalDusk = ev.astronomicalDusk = nan;
+            ev.moonrise = ev.moonCulmination = ev.moonset = nan;
+
+            const size_t first = day * EVENT_STEPS_PER_DAY;
+            const AltitudeThreshold sunThresholds[] = {
+                { SUN_RISE_SET_ALTITUDE, &ev.sunrise, &ev.sunset },
+                { CIVIL_TWILIGHT_ALTITUDE, &ev.civilDawn, &ev.civilDusk },
+                { NAUTICAL_TWILIGHT_ALTITUDE, &ev.nauticalDawn, &ev.nauticalDusk },
+                { ASTRONOMICAL_TWILIGHT_ALTITUDE, &ev.astronomicalDawn, &ev.astronomicalDusk },
+            };
+            findDailyCrossings (EVENT_BODY_SUN, &jday[first], &sunAltitude[first],
+                    longitude, latitude, sunThresholds, sizeof (sunThresholds) / sizeof (sunThresholds[0]));
+
+            const AltitudeThreshold moonThresholds[] = {
+                { MOON_RISE_SET_ALTITUDE, &ev.moonrise, &ev.moonset },
+            };
+            findDailyCrossings (EVENT_BODY_MOON, &jday[first], &moonAltitude[first],
+                    longitude, latitude, moonThresholds, 1);
+
+            LongReal culmination;
+            if (findCulmination (EVENT_BODY_SUN, jday[first], jday[first] + 1, longitude, culmination)) {
+                ev.solarNoon = culmination;
+            }
+            if (findCulmination (EVENT_BODY_MOON, jday[first], jday[first] + 1, longitude, culmination)) {
+                ev.moonCulmination = culmination;
+            }
+        }
+    }
+}
@@ -0,0 +1,190 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#include "CaelumCorePrerequisites.h"
+#include "Astronomy.h"
+
+namespace Caelum
+{
+    namespace
+    {
+        const int PLANET_COUNT = Astronomy::PLANET_COUNT;
+
+        /** Mean orbital elements from stjarnhimlen.se; value + rate * d, with
+         *  d in days since 2000 Jan 0.0 UT. Angles are in degrees, relative
+         *  to the ecliptic and equinox of date.
+         */
+        struct OrbitalElements
+        {
+            /// Longitude of the ascending node.
+            LongReal N0, N1;
+            /// Inclination.
+            LongReal i0, i1;
+            /// Argument of perihelion.
+            LongReal w0, w1;
+            /// Semi-major axis, AU.
+            LongReal a;
+            /// Eccentricity.
+            LongReal e0, e1;
+            /// Mean anomaly.
+            LongReal M0, M1;
+        };
+
+        const OrbitalElements PLANET_ELEMENTS[PLANET_COUNT] = {
+            // Mercury
+            {  48.3313, 3.24587E-5, 7.0047,  5.00E-8,   29.1241, 1.01444E-5, 0.387098, 0.205635,  5.59E-10, 168.6562, 4.0923344368 },
+            // Venus
+            {  76.6799, 2.46590E-5, 3.3946,  2.75E-8,   54.8910, 1.38374E-5, 0.723330, 0.006773, -1.302E-9,   48.0052, 1.6021302244 },
+            // Mars
+            {  49.5574, 2.11081E-5, 1.8497, -1.78E-8,  286.5016, 2.92961E-5, 1.523688, 0.093405,  2.516E-9,   18.6021, 0.5240207766 },
+            // Jupiter
+            { 100.4542, 2.76854E-5, 1.3030, -1.557E-7, 273.8777, 1.64505E-5, 5.20256,  0.048498,  4.469E-9,   19.8950, 0.0830853001 },
+            // Saturn
+            { 113.6634, 2.38980E-5, 2.4886, -1.081E-7, 339.3939, 2.97661E-5, 9.55475,  0.055546, -9.499E-9,  316.9670, 0.0334442282 },
+        };
+
+        /** Magnitude model: base + 5 log10 (r R) + linear * FV + power term,
+         *  where FV is the phase angle in degrees.
+         */
+        struct MagnitudeCoefficients
+        {
+            LongReal base;
+            LongReal linear;
+            LongReal power;
+            LongReal exponent;
+        };
+
+        const MagnitudeCoefficients PLANET_MAGNITUDES[PLANET_COUNT] = {
+            { -0.36, 0.027, 2.2E-13, 6 },
+            { -4.34, 0.013, 4.2E-7,  3 },
+            { -1.51, 0.016, 0,       1 },
+            { -9.25, 0.014, 0,       1 },
+            { -9.0,  0.044, 0,       1 },
+        };
+
+        /// Precession in longitude, degrees per day; used to go back to J2000.
+        const LongReal PRECESSION_RATE = 3.82394E-5;
+
+        /// Fixed iteration count so all planets solve in lockstep.
+        const int KEPLER_ITERATIONS = 4;
+    }
+
+    void Astronomy::getPlanetPositions (
+            LongReal jday,
+            PlanetPosition *positions)
+    {
+        ScopedHighPrecissionFloatSwitch precissionSwitch;
+
+        const LongReal d = jday - 2451543.5;
+
+        // Evaluate elements and mean anomalies for all planets.
+        LongReal N[PLANET_COUNT], i[PLANET_COUNT], w[PLANET_COUNT];
+        LongReal a[PLANET_COUNT], e[PLANET_COUNT], M[PLANET_COUNT], E[PLANET_COUNT];
+        for (int p = 0; p < PLANET_COUNT; ++p) {
+            const OrbitalElements &el = PLANET_ELEMENTS[p];
+            N[p] = el.N0 + el.N1 * d;
+            i[p] = el.i0 + el.i1 * d;
+            w[p] = el.w0 + el.w1 * d;
+            a[p] = el.a;
+            e[p] = el.e0 + el.e1 * d;
+            M[p] = normalizeDegrees (el.M0 + el.M1 * d);
+        }
+
+        // Kepler's equation; Newton's method from the usual first guess.
+        for (int p = 0; p < PLANET_COUNT; ++p) {
+            E[p] = M[p] + radToDeg (e[p]) * sinDeg (M[p]) * (1 + e[p] * cosDeg (M[p]));
+        }
+        for (int iter = 0; iter < KEPLER_ITERATIONS; ++iter) {
+            for (int p = 0; p < PLANET_COUNT; ++p) {
+                E[p] -= (E[p] - radToDeg (e[p]) * sinDeg (E[p]) - M[p]) / (1 - e[p] * cosDeg (E[p]));
+            }
+        }
+
+        // Heliocentric ecliptic longitude, latitude and distance.
+        LongReal lon[PLANET_COUNT], lat[PLANET_COUNT], r[PLANET_COUNT];
+        for (int p = 0; p < PLANET_COUNT; ++p) {
+            LongReal xv = a[p] * (cosDeg (E[p]) - e[p]);
+            LongReal yv = a[p] * std::sqrt (1 - e[p] * e[p]) * sinDeg (E[p]);
+            LongReal v = atan2Deg (yv, xv);
+            r[p] = std::sqrt (xv * xv + yv * yv);
+
+            LongReal vw = v + w[p];
+            LongReal xh = cosDeg (N[p]) * cosDeg (vw) - sinDeg (N[p]) * sinDeg (vw) * cosDeg (i[p]);
+            LongReal yh = sinDeg (N[p]) * cosDeg (vw) + cosDeg (N[p]) * sinDeg (vw) * cosDeg (i[p]);
+            LongReal zh = sinDeg (vw) * sinDeg (i[p]);
+            lon[p] = atan2Deg (yh, xh);
+            lat[p] = atan2Deg (zh, std::sqrt (xh * xh + yh * yh));
+        }
+
+        // Largest mutual perturbations of Jupiter and Saturn.
+        const LongReal Mj = M[PLANET_JUPITER], Ms = M[PLANET_SATURN];
+        lon[PLANET_JUPITER] +=
+                -0.332 * sinDeg (2 * Mj - 5 * Ms - 67.6)
+                -0.056 * sinDeg (2 * Mj - 2 * Ms + 21)
+                +0.042 * sinDeg (3 * Mj - 5 * Ms + 21)
+                -0.036 * sinDeg (Mj - 2 * Ms)
+                +0.022 * cosDeg (Mj - Ms)
+                +0.023 * sinDeg (2 * Mj - 3 * Ms + 52)
+                -0.016 * sinDeg (Mj - 5 * Ms - 69);
+        lon[PLANET_SATURN] +=
+                +0.812 * sinDeg (2 * Mj - 5 * Ms - 67.6)
+                -0.229 * cosDeg (2 * Mj - 4 * Ms - 2)
+                +0.119 * sinDeg (Mj - 2 * Ms - 3)
+                +0.046 * sinDeg (2 * Mj - 6 * Ms - 69)
+                +0.014 * sinDeg (Mj - 3 * Ms + 32);
+        lat[PLANET_SATURN] +=
+                -0.020 * cosDeg (2 * Mj - 4 * Ms - 2)
+                +0.018 * sinDeg (2 * Mj - 6 * Ms - 49);
+
+        // Sun's geocentric position, same elements as getEquatorialSunPosition.
+        LongReal sunW = 282.9404 + 4.70935E-5 * d;
+        LongReal sunE = 0.016709 - 1.151E-9 * d;
+        LongReal sunM = normalizeDegrees (356.0470 + 0.9856002585 * d);
+        LongReal sunEA = sunM + radToDeg (sunE) * sinDeg (sunM) * (1 + sunE * cosDeg (sunM));
+        LongReal sunXv = cosDeg (sunEA) - sunE;
+        LongReal sunYv = std::sqrt (1 - sunE * sunE) * sinDeg (sunEA);
+        LongReal sunDist = std::sqrt (sunXv * sunXv + sunYv * sunYv);
+        LongReal sunLon = atan2Deg (sunYv, sunXv) + sunW;
+        LongReal sunX = sunDist * cosDeg (sunLon);
+        LongReal sunY = sunDist * sinDeg (sunLon);
+
+        for (int p = 0; p < PLANET_COUNT; ++p) {
+            // Geocentric ecliptic rectangular.
+            LongReal xg = r[p] * cosDeg (lon[p]) * cosDeg (lat[p]) + sunX;
+            LongReal yg = r[p] * sinDeg (lon[p]) * cosDeg (lat[p]) + sunY;
+            LongReal zg = r[p] * sinDeg (lat[p]);
+            LongReal dist = std::sqrt (xg * xg + yg * yg + zg * zg);
+            LongReal geoLon = atan2Deg (yg, xg);
+            LongReal geoLat = atan2Deg (zg, std::sqrt (xg * xg + yg * yg));
+
+            // Phase angle from the sun-planet-earth triangle.
+            LongReal cosFV = (r[p] * r[p] + dist * dist - sunDist * sunDist) / (2 * r[p] * dist);
+            cosFV = std::max (LongReal (-1), std::min (LongReal (1), cosFV));
+            LongReal FV = radToDeg (std::acos (cosFV));
+
+            const MagnitudeCoefficients &mc = PLANET_MAGNITUDES[p];
+            LongReal magnitude = mc.base + 5 * std::log10 (r[p] * dist) +
+                    mc.linear * FV + mc.power * std::pow (FV, mc.exponent);
+            if (p == PLANET_SATURN) {
+                // Ring brightness from the tilt of the rings towards the earth.
+                LongReal ir = 28.06;
+                LongReal Nr = 169.51 + 3.82E-5 * d;
+                LongReal sinB = sinDeg (geoLat) * cosDeg (ir) -
+                        cosDeg (geoLat) * sinDeg (ir) * sinDeg (geoLon - Nr);
+                magnitude += -2.6 * std::abs (sinB) + 1.2 * sinB * sinB;
+            }
+
+            PlanetPosition &pos = positions[p];
+            LongReal rasc, decl;
+            convertEclipticToEquatorialRad (
+                    degToRad (geoLon - PRECESSION_RATE * d), degToRad (geoLat), rasc, decl);
+            pos.rasc = normalizeDegrees (radToDeg (rasc));
+            pos.decl = radToDeg (decl);
+            pos.distance = dist;
+            pos.heliocentricDistance = r[p];
+            pos.phase = (1 + cosFV) / 2;
+            pos.magnitude = magnitude;
+        }
+    }
+}
@@ -0,0 +1,105 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#include "CaelumCorePrerequisites.h"
+#include "Astronomy.h"
+
+namespace Caelum
+{
+    namespace
+    {
+        const LongReal ARCSEC = LongReal (1) / 3600;
+
+        /// Product c = a * b of 3x3 matrices; c may not alias a or b.
+        void multiplyMatrix (const LongReal a[3][3], const LongReal b[3][3], LongReal c[3][3])
+        {
+            for (int i = 0; i < 3; ++i) {
+                for (int j = 0; j < 3; ++j) {
+                    c[i][j] = a[i][0] * b[0][j] + a[i][1] * b[1][j] + a[i][2] * b[2][j];
+                }
+            }
+        }
+
+        /// Coordinate rotation about the x axis.
+        void setRotationX (LongReal c, LongReal s, LongReal m[3][3])
+        {
+            m[0][0] = 1; m[0][1] = 0;  m[0][2] = 0;
+            m[1][0] = 0; m[1][1] = c;  m[1][2] = s;
+            m[2][0] = 0; m[2][1] = -s; m[2][2] = c;
+        }
+
+        /// Coordinate rotation about the z axis.
+        void setRotationZ (LongReal c, LongReal s, LongReal m[3][3])
+        {
+            m[0][0] = c;  m[0][1] = s; m[0][2] = 0;
+            m[1][0] = -s; m[1][1] = c; m[1][2] = 0;
+            m[2][0] = 0;  m[2][1] = 0; m[2][2] = 1;
+        }
+    }
+
+    LongReal Astronomy::getMeanObliquity (LongReal jday)
+    {
+        // Meeus 22.2
+        LongReal T = (jday - J2000) / 36525;
+        return 23.4392911111 + (-46.8150 * T - 0.00059 * T * T + 0.001813 * T * T * T) * ARCSEC;
+    }
+
+    void Astronomy::getNutation (
+            LongReal jday,
+            LongReal &longitude, LongReal &obliquity)
+    {
+        // Meeus chapter 22, the low accuracy (0.5") series.
+        LongReal T = (jday - J2000) / 36525;
+        LongReal omega = 125.04452 - 1934.136261 * T;
+        LongReal L = 280.4665 + 36000.7698 * T;
+        LongReal Lprim = 218.3165 + 481267.8813 * T;
+        longitude = (-17.20 * sinDeg (omega) - 1.32 * sinDeg (2 * L)
+                - 0.23 * sinDeg (2 * Lprim) + 0.21 * sinDeg (2 * omega)) * ARCSEC;
+        obliquity = (9.20 * cosDeg (omega) + 0.57 * cosDeg (2 * L)
+                + 0.10 * cosDeg (2 * Lprim) - 0.09 * cosDeg (2 * omega)) * ARCSEC;
+    }
+
+    void Astronomy::getPrecessionNutationMatrix (
+            LongReal jday,
+            LongReal matrix[3][3])
+    {
+        ScopedHighPrecissionFloatSwitch precissionSwitch;
+
+        // IAU 1976 precession angles from J2000 (Meeus 21.3).
+        LongReal T = (jday - J2000) / 36525;
+        LongReal T2 = T * T, T3 = T2 * T;
+        LongReal zeta = (2306.2181 * T + 0.30188 * T2 + 0.017998 * T3) * ARCSEC;
+        LongReal z = (2306.2181 * T + 1.09468 * T2 + 0.018203 * T3) * ARCSEC;
+        LongReal theta = (2004.3109 * T - 0.42665 * T2 - 0.041833 * T3) * ARCSEC;
+
+        LongReal cosZeta = cosDeg (zeta), sinZeta = sinDeg (zeta);
+        LongReal cosZ = cosDeg (z), sinZ = sinDeg (z);
+        LongReal cosTheta = cosDeg (theta), sinTheta = sinDeg (theta);
+        LongReal precession[3][3] = {
+            { cosZeta * cosZ * cosTheta - sinZeta * sinZ, -sinZeta * cosZ * cosTheta - cosZeta * sinZ, -cosZ * sinTheta },
+            { cosZeta * sinZ * cosTheta + sinZeta * cosZ, -sinZeta * sinZ * cosTheta + cosZeta * cosZ, -sinZ * sinTheta },
+            { cosZeta * sinTheta, -sinZeta * sinTheta, cosTheta },
+        };
+
+        // Nutation: to the ecliptic, shift by dpsi, back to the true equator.
+        LongReal dpsi, deps;
+        getNutation (jday, dpsi, deps);
+        LongReal eps = getMeanObliquity (jday);
+        LongReal toEcliptic[3][3], shift[3][3], toEquator[3][3], tmp[3][3], nutation[3][3];
+        setRotationX (cosDeg (eps), sinDeg (eps), toEcliptic);
+        setRotationZ (cosDeg (-dpsi), sinDeg (-dpsi), shift);
+        setRotationX (cosDeg (-eps - deps), sinDeg (-eps - deps), toEquator);
+        multiplyMatrix (shift, toEcliptic, tmp);
+        multiplyMatrix (toEquator, tmp, nutation);
+
+        multiplyMatrix (nutation, precession, matrix);
+    }
+
+    LongReal Astronomy::getEquationOfEquinoxes (LongReal jday)
+    {
+        LongReal dpsi, deps;
+        getNutation (jday, dpsi, deps);
+        return dpsi * cosDeg (getMeanObliquity (jday) + deps);
+    }
+}
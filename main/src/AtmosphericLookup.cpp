@@ -0,0 +1,96 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#include "CaelumCorePrerequisites.h"
+#include "AtmosphericLookup.h"
+
+namespace Caelum
+{
+    const LongReal AtmosphericLookup::MIN_REFRACTION_ALTITUDE = -5;
+
+    namespace
+    {
+        const LongReal DEG_TO_RAD = 0.017453292519943295769;
+
+        /// Top of the refraction table; nothing is refracted at the zenith.
+        const LongReal MAX_REFRACTION_ALTITUDE = 90;
+
+        /// Where Saemundsson's formula stops and the taper starts.
+        const LongReal REFRACTION_TAPER_ALTITUDE = -1;
+
+        LongReal getRefractionStep ()
+        {
+            return (MAX_REFRACTION_ALTITUDE - AtmosphericLookup::MIN_REFRACTION_ALTITUDE) /
+                    (AtmosphericLookup::REFRACTION_TABLE_SIZE - 1);
+        }
+
+        /// Saemundsson, Sky and Telescope 72 (1986); arc minutes from true altitude.
+        LongReal getSaemundssonRefraction (LongReal altitude)
+        {
+            LongReal r = 1.02 / std::tan ((altitude + 10.3 / (altitude + 5.11)) * DEG_TO_RAD);
+            return std::max (LongReal (0), r) / 60;
+        }
+    }
+
+    AtmosphericLookup::AtmosphericLookup (LongReal extinctionCoefficient)
+    {
+        const LongReal step = getRefractionStep ();
+        for (int i = 0; i < REFRACTION_TABLE_SIZE; ++i) {
+            mRefractionTable[i] = float (computeRefraction (MIN_REFRACTION_ALTITUDE + i * step));
+        }
+        setExtinctionCoefficient (extinctionCoefficient);
+    }
+
+    LongReal AtmosphericLookup::computeRefraction (LongReal altitude)
+    {
+        if (altitude <= MIN_REFRACTION_ALTITUDE) {
+            return 0;
+        }
+        if (altitude < REFRACTION_TAPER_ALTITUDE) {
+            return getSaemundssonRefraction (REFRACTION_TAPER_ALTITUDE) *
+                    (altitude - MIN_REFRACTION_ALTITUDE) / (REFRACTION_TAPER_ALTITUDE - MIN_REFRACTION_ALTITUDE);
+        }
+        return getSaemundssonRefraction (std::min (altitude, MAX_REFRACTION_ALTITUDE));
+    }
+
+    LongReal AtmosphericLookup::computeAirmass (LongReal altitude)
+    {
+        // Kasten and Young, Applied Optics 28 (1989); finite at the horizon.
+        altitude = std::max (LongReal (0), altitude);
+        return 1 / (std::sin (altitude * DEG_TO_RAD) + 0.50572 * std::pow (altitude + 6.07995, -1.6364));
+    }
+
+    LongReal AtmosphericLookup::getRefraction (LongReal altitude) const
+    {
+        LongReal x = (altitude - MIN_REFRACTION_ALTITUDE) / getRefractionStep ();
+        if (x <= 0) {
+            return 0;
+        }
+        if (x >= REFRACTION_TABLE_SIZE - 1) {
+            return mRefractionTable[REFRACTION_TABLE_SIZE - 1];
+        }
+        int i = int (x);
+        LongReal f = x - i;
+        return mRefractionTable[i] * (1 - f) + mRefractionTable[i + 1] * f;
+    }
+
+    LongReal AtmosphericLookup::getExtinction (LongReal altitude) const
+    {
+        LongReal s = std::sin (altitude * DEG_TO_RAD);
+        LongReal x = std::sqrt (std::max (LongReal (0), s)) * (EXTINCTION_TABLE_SIZE - 1);
+        int i = std::min (int (x), EXTINCTION_TABLE_SIZE - 2);
+        LongReal f = x - i;
+        return mExtinctionTable[i] * (1 - f) + mExtinctionTable[i + 1] * f;
+    }
+
+    void AtmosphericLookup::setExtinctionCoefficient (LongReal value)
+    {
+        mExtinctionCoefficient = value;
+        for (int i = 0; i < EXTINCTION_TABLE_SIZE; ++i) {
+            LongReal u = LongReal (i) / (EXTINCTION_TABLE_SIZE - 1);
+            LongReal altitude = std::asin (u * u) / DEG_TO_RAD;
+            mExtinctionTable[i] = float (value * (computeAirmass (altitude) - 1));
+        }
+    }
+}
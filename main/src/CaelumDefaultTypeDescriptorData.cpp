@@ -138,6 +138,14 @@ namespace Caelum
                     new AccesorPropertyDescriptor<Caelum::CaelumSystem, bool, bool, bool>(
                             &Caelum::CaelumSystem::getEnsureSingleShadowSource,
                             &Caelum::CaelumSystem::setEnsureSingleShadowSource));
+            td->add("max_sky_lights",
+                    new AccesorPropertyDescriptor<Caelum::CaelumSystem, int, int, int>(
+                            &Caelum::CaelumSystem::getMaxSkyLights,
+                            &Caelum::CaelumSystem::setMaxSkyLights));
+            td->add("atmospheric_refraction",
+                    new AccesorPropertyDescriptor<Caelum::CaelumSystem, bool, bool, bool>(
+                            &Caelum::CaelumSystem::getAtmosphericRefraction,
+                            &Caelum::CaelumSystem::setAtmosphericRefraction));
 
             CaelumSystemTypeDescriptor = td.release ();
         }
@@ -169,6 +177,22 @@ namespace Caelum
                     new AccesorPropertyDescriptor<Caelum::PointStarfield, Degree, Degree, Degree>(
                             &Caelum::PointStarfield::getObserverLongitude,
                             &Caelum::PointStarfield::setObserverLongitude));
+            td->add("planets_enabled",
+                    new AccesorPropertyDescriptor<Caelum::PointStarfield, bool, bool, bool>(
+                            &Caelum::PointStarfield::getPlanetsEnabled,
+                            &Caelum::PointStarfield::setPlanetsEnabled));
+            td->add("precession_enabled",
+                    new AccesorPropertyDescriptor<Caelum::PointStarfield, bool, bool, bool>(
+                            &Caelum::PointStarfield::getPrecessionEnabled,
+                            &Caelum::PointStarfield::setPrecessionEnabled));
+            td->add("extinction_enabled",
+                    new AccesorPropertyDescriptor<Caelum::PointStarfield, bool, bool, bool>(
+                            &Caelum::PointStarfield::getExtinctionEnabled,
+                            &Caelum::PointStarfield::setExtinctionEnabled));
+            td->add("extinction_coefficient",
+                    new AccesorPropertyDescriptor<Caelum::PointStarfield, Real, Real, Real>(
+                            &Caelum::PointStarfield::getExtinctionCoefficient,
+                            &Caelum::PointStarfield::setExtinctionCoefficient));
             PointStarfieldTypeDescriptor = td.release ();
         }
 
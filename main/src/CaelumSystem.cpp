@@ -4,17 +4,52 @@
 
 #include "CaelumSystem.h"
 #include "Astronomy.h"
+#include "AstronomyScalar.h"
 #include "CaelumExceptions.h"
 #include "CaelumPlugin.h"
 #include "CaelumPrecompiled.h"
 #include "FlatCloudLayer.h"
-#include "InternalUtilities.h"
 #include <functional>
+#include <sstream>
 
 using namespace Ogre;
 
 namespace Caelum
 {
+    namespace
+    {
+        /// Ask a throttle about a fixed list of inputs.
+        template <size_t N>
+        inline bool shouldUpdate (UpdateThrottle &throttle, Real timeSinceLastFrame,
+                const LongReal (&inputs)[N], bool force)
+        {
+            return throttle.shouldUpdate (timeSinceLastFrame, inputs, N, force);
+        }
+
+        inline Ogre::ColourValue toColourValue (const SkyColour &colour)
+        {
+            return Ogre::ColourValue (colour.r, colour.g, colour.b, colour.a);
+        }
+
+        /// Pixels of an image as RGBA floats, whatever its format.
+        ColourGradient makeColourGradient (const Ogre::Image &image)
+        {
+            const size_t width = image.getWidth (), height = image.getHeight ();
+            std::vector<float> pixels (width * height * 4);
+            for (size_t y = 0; y < height; ++y) {
+                for (size_t x = 0; x < width; ++x) {
+                    Ogre::ColourValue colour = image.getColourAt (x, y, 0);
+                    float *pixel = &pixels[(y * width + x) * 4];
+                    pixel[0] = colour.r;
+                    pixel[1] = colour.g;
+                    pixel[2] = colour.b;
+                    pixel[3] = colour.a;
+                }
+            }
+            return ColourGradient (width, height, pixels.data ());
+        }
+    }
+
     const String CaelumSystem::DEFAULT_SKY_GRADIENTS_IMAGE = "EarthClearSky2.png";
     const String CaelumSystem::DEFAULT_SUN_COLOURS_IMAGE = "SunGradient.png";
 
@@ -26,7 +61,16 @@ namespace Caelum
     ):
         mOgreRoot (root),
         mSceneMgr (sceneMgr),
-        mCleanup (false)
+        mCleanup (false),
+        mAppliedClockDomain (0),
+        mFrontSkyState (0),
+        mAsynchronousSkyState (false),
+        mSkyStateFinished (false),
+        mSkyStateValid (false),
+        mParallelUpdate (false),
+        mKeyframedSky (false),
+        mKeyframeInterval (KeyframedSky ().getInterval ()),
+        mKeyframeMaxAngle (KeyframedSky ().getMaxAngle ())
     {
         LogManager::getSingleton().logMessage ("Caelum: Initialising Caelum system...");
         //LogManager::getSingleton().logMessage ("Caelum: CaelumSystem* at d" +
@@ -59,6 +103,9 @@ namespace Caelum
 
     void CaelumSystem::destroySubcomponents (bool destroyEverything)
     {
+        // The sky state worker reads the caches and lookups below.
+        waitForSkyState ();
+
         // Destroy sub-components
         setSkyDome (0);
         setSun (0);
@@ -69,13 +116,20 @@ namespace Caelum
         setDepthComposer (0);
         setGroundFog (0);
         setMoon (0);
-        mSkyGradientsImage.reset ();
-        mSunColoursImage.reset ();
+        setEphemerisCache (0);
+        setEclipseTable (0);
+        clearCelestialBodies ();
+        invalidateSkySamples ();
+        mSkyGradients = ColourGradient ();
+        mSunColours = ColourGradient ();
 
         // These things can't be rebuilt.
         if (destroyEverything) {
             LogManager::getSingleton ().logMessage("Caelum: Delete UniversalClock");
             mUniversalClock.reset ();
+            mViewportClockDomains.clear ();
+            mClockDomains.clear ();
+            mAppliedClockDomain = 0;
             mCaelumCameraNode.reset ();
             mCaelumGroundNode.reset ();
         }
@@ -115,8 +169,20 @@ namespace Caelum
         // Ambient lighting.
         setManageAmbientLight (true);
         setMinimumAmbientLight (Ogre::ColourValue (0.1, 0.1, 0.3));
+        setLunarEclipseColour (Ogre::ColourValue (0.5, 0.2, 0.1));
         mEnsureSingleLightSource = false;
         mEnsureSingleShadowSource = false;
+        mMaxSkyLights = 0;
+        mAtmosphericRefraction = true;
+
+        // Update everything every frame, on the render thread.
+        for (int group = 0; group < UPDATE_GROUP_COUNT; ++group) {
+            mUpdateThrottles[group] = UpdateThrottle ();
+        }
+        mSkippedCloudTime = 0;
+        mAsynchronousSkyState = false;
+        mSkyStateFinished = false;
+        mSkyStateValid = false;
 
         // Observer time & position. J2000 is midday.
         mObserverLatitude = Ogre::Degree(45);
@@ -286,6 +352,7 @@ namespace Caelum
 
     void CaelumSystem::detachViewport (Ogre::Viewport* vp)
     {
+        mViewportClockDomains.erase (vp);
         std::set<Viewport*>::size_type erase_result = mAttachedViewports.erase(vp);
         assert(erase_result == 0 || erase_result == 1);
         bool found = erase_result == 1;
@@ -309,30 +376,50 @@ namespace Caelum
 
     void CaelumSystem::setSkyDome (SkyDome *obj) {
         mSkyDome.reset (obj);
+        mUpdateThrottles[UPDATE_SKY_DOME].invalidate ();
     }
 
     void CaelumSystem::setSun (BaseSkyLight* obj) {
         mSun.reset (obj);
+        mUpdateThrottles[UPDATE_LIGHTS].invalidate ();
     }
 
     void CaelumSystem::setMoon (Moon* obj) {
         mMoon.reset (obj);
+        mUpdateThrottles[UPDATE_LIGHTS].invalidate ();
+    }
+
+    size_t CaelumSystem::addCelestialBody (const CelestialBodies::Body &body, BaseSkyLight *light) {
+        waitForSkyState ();
+        mCelestialBodyLights.push_back (std::unique_ptr<BaseSkyLight> (light));
+        mUpdateThrottles[UPDATE_LIGHTS].invalidate ();
+        return mCelestialBodies.add (body);
+    }
+
+    void CaelumSystem::clearCelestialBodies () {
+        waitForSkyState ();
+        mCelestialBodyLights.clear ();
+        mCelestialBodies.clear ();
     }
 
     void CaelumSystem::setImageStarfield (ImageStarfield* obj) {
         mImageStarfield.reset (obj);
+        mUpdateThrottles[UPDATE_STARFIELD].invalidate ();
     }
 
     void CaelumSystem::setPointStarfield (PointStarfield* obj) {
         mPointStarfield.reset (obj);
+        mUpdateThrottles[UPDATE_STARFIELD].invalidate ();
     }
 
     void CaelumSystem::setGroundFog (GroundFog* obj) {
         mGroundFog.reset (obj);
+        mUpdateThrottles[UPDATE_FOG].invalidate ();
     }
 
     void CaelumSystem::setCloudSystem (CloudSystem* obj) {
         mCloudSystem.reset (obj);
+        mUpdateThrottles[UPDATE_CLOUDS].invalidate ();
     }
 
     void CaelumSystem::setPrecipitationController (PrecipitationController* newptr) {
@@ -357,6 +444,7 @@ namespace Caelum
 
     void CaelumSystem::setDepthComposer (DepthComposer* ptr) {
         mDepthComposer.reset(ptr);
+        mUpdateThrottles[UPDATE_FOG].invalidate ();
         if (getDepthComposer() && getAutoAttachViewportsToComponents()) {
             for (Ogre::Viewport* vp : mAttachedViewports) {
                 getDepthComposer()->createViewportInstance(vp);
@@ -364,10 +452,232 @@ namespace Caelum
         }
     }
 
+    void CaelumSystem::setEphemerisCache (EphemerisCache* obj) {
+        waitForSkyState ();
+        mEphemerisCache.reset (obj);
+    }
+
+    void CaelumSystem::setEclipseTable (EclipseTable* obj) {
+        waitForSkyState ();
+        invalidateSkySamples ();
+        mEclipseTable.reset (obj);
+    }
+
+    ClockDomain* CaelumSystem::createClockDomain (const Ogre::String &name)
+    {
+        std::unique_ptr<ClockDomain> &domain = mClockDomains[name];
+        if (!domain) {
+            domain.reset (new ClockDomain (name));
+        }
+        return domain.get ();
+    }
+
+    ClockDomain* CaelumSystem::getClockDomain (const Ogre::String &name) const
+    {
+        std::map<Ogre::String, std::unique_ptr<ClockDomain> >::const_iterator it = mClockDomains.find (name);
+        return it == mClockDomains.end () ? 0 : it->second.get ();
+    }
+
+    void CaelumSystem::destroyClockDomain (const Ogre::String &name)
+    {
+        ClockDomain *domain = getClockDomain (name);
+        if (!domain) {
+            return;
+        }
+        std::map<Ogre::Viewport*, ClockDomain*>::iterator it = mViewportClockDomains.begin ();
+        while (it != mViewportClockDomains.end ()) {
+            if (it->second == domain) {
+                mViewportClockDomains.erase (it++);
+            } else {
+                ++it;
+            }
+        }
+        if (mAppliedClockDomain == domain) {
+            applyClockDomain (0);
+        }
+        mClockDomains.erase (name);
+    }
+
+    void CaelumSystem::setViewportClockDomain (Ogre::Viewport *viewport, ClockDomain *domain)
+    {
+        if (domain) {
+            mViewportClockDomains[viewport] = domain;
+        } else {
+            mViewportClockDomains.erase (viewport);
+        }
+    }
+
+    ClockDomain* CaelumSystem::getViewportClockDomain (Ogre::Viewport *viewport) const
+    {
+        std::map<Ogre::Viewport*, ClockDomain*>::const_iterator it = mViewportClockDomains.find (viewport);
+        return it == mViewportClockDomains.end () ? 0 : it->second;
+    }
+
+    void CaelumSystem::applyClockDomain (ClockDomain *domain)
+    {
+        if (domain == mAppliedClockDomain) {
+            return;
+        }
+        mAppliedClockDomain = domain;
+
+        // The sky state worker shares the celestial bodies and caches.
+        waitForSkyState ();
+        if (domain) {
+            applySky (*domain->getUniversalClock (),
+                    domain->getObserverLongitude (), domain->getObserverLatitude (),
+                    domain->getCachedSky (), mDomainSkyState, 0, true);
+
+            // The components show another domain now; the main clock must update them again.
+            for (int group = 0; group < UPDATE_GROUP_COUNT; ++group) {
+                mUpdateThrottles[group].invalidate ();
+            }
+        } else {
+            // Back to what updateSubcomponents applied, delay included.
+            if (!mSkyStateValid) {
+                computeSkyState (*mUniversalClock, getObserverLongitude (), getObserverLatitude (),
+                        getSkyStateConfig (), mSky, mSkyStates[mFrontSkyState]);
+                mSkyStateValid = true;
+            }
+            applySkyState (mSkyStates[mFrontSkyState], 0, true);
+        }
+    }
+
+    const FastAstronomy::SkyEvaluation& CaelumSystem::evaluateClockDomain (ClockDomain *domain)
+    {
+        waitForSkyState ();
+        if (domain) {
+            return SkyFrameEvaluator::evaluateCachedSky (domain->getUniversalClock ()->getSkyClockTime (),
+                    domain->getObserverLongitude ().valueDegrees (), domain->getObserverLatitude ().valueDegrees (),
+                    getSkyStateConfig (), domain->getCachedSky (), mObserver);
+        }
+        return SkyFrameEvaluator::evaluateCachedSky (mUniversalClock->getSkyClockTime (),
+                getObserverLongitude ().valueDegrees (), getObserverLatitude ().valueDegrees (),
+                getSkyStateConfig (), mSky, mObserver);
+    }
+
+    void CaelumSystem::setAtmosphericRefraction (bool value)
+    {
+        waitForSkyState ();
+        mAtmosphericRefraction = value;
+    }
+
+    void CaelumSystem::setAsynchronousSkyState (bool value)
+    {
+        waitForSkyState ();
+        mAsynchronousSkyState = value;
+    }
+
+    void CaelumSystem::setParallelUpdate (bool value)
+    {
+        mParallelUpdate = value;
+        if (mParallelUpdate && !mTaskExecutor) {
+            mTaskExecutor.reset (new ThreadPoolExecutor ());
+        }
+    }
+
+    void CaelumSystem::setTaskExecutor (TaskExecutor *executor)
+    {
+        mTaskExecutor.reset (executor);
+        if (mParallelUpdate && !mTaskExecutor) {
+            mTaskExecutor.reset (new ThreadPoolExecutor ());
+        }
+    }
+
+    void CaelumSystem::setKeyframedSky (bool value)
+    {
+        waitForSkyState ();
+        mKeyframedSky = value;
+        invalidateSkySamples ();
+    }
+
+    void CaelumSystem::setKeyframeInterval (LongReal seconds)
+    {
+        waitForSkyState ();
+        mKeyframeInterval = seconds;
+        invalidateSkySamples ();
+    }
+
+    void CaelumSystem::setKeyframeMaxAngle (Ogre::Radian value)
+    {
+        waitForSkyState ();
+        mKeyframeMaxAngle = value.valueRadians ();
+        invalidateSkySamples ();
+    }
+
+    const KeyframedSky& CaelumSystem::getSkyKeyframes ()
+    {
+        waitForSkyState ();
+        return mSky.keyframes;
+    }
+
+    void CaelumSystem::setKeyframeErrorTracking (bool value)
+    {
+        waitForSkyState ();
+        mSky.keyframes.setErrorTracking (value);
+    }
+
+    void CaelumSystem::resetKeyframeStatistics ()
+    {
+        waitForSkyState ();
+        mSky.keyframes.resetStatistics ();
+    }
+
+    void CaelumSystem::setSkyTimeline (bool value)
+    {
+        waitForSkyState ();
+        if (!value) {
+            mSkyTimeline.reset ();
+        } else if (!mSkyTimeline) {
+            mSkyTimeline.reset (new SkyTimeline ());
+        }
+    }
+
+    void CaelumSystem::invalidateSkySamples ()
+    {
+        if (mSkyTimeline) {
+            mSkyTimeline->clear ();
+        }
+        mSky.keyframes.invalidate ();
+        std::map<Ogre::String, std::unique_ptr<ClockDomain> >::iterator it;
+        for (it = mClockDomains.begin (); it != mClockDomains.end (); ++it) {
+            it->second->getCachedSky ().keyframes.invalidate ();
+        }
+    }
+
+    void CaelumSystem::logUpdateTimings () const
+    {
+        std::stringstream stream;
+        mUpdateGraph.dumpTimings (stream);
+        LogManager::getSingleton ().logMessage ("Caelum: " + stream.str ());
+    }
+
+    void CaelumSystem::waitForSkyState ()
+    {
+        if (mPendingSkyState.valid ()) {
+            mPendingSkyState.get ();
+            mSkyStateFinished = true;
+        }
+    }
+
+    void CaelumSystem::scheduleSkyState ()
+    {
+        const int back = 1 - mFrontSkyState;
+        const UniversalClock clock = *mUniversalClock;
+        const Ogre::Degree longitude = getObserverLongitude (), latitude = getObserverLatitude ();
+        const SkyStateConfig config = getSkyStateConfig ();
+        mPendingSkyState = std::async (std::launch::async, [this, back, clock, longitude, latitude, config] () {
+            computeSkyState (clock, longitude, latitude, config, mSky, mSkyStates[back]);
+        });
+    }
+
     void CaelumSystem::preViewportUpdate (const Ogre::RenderTargetViewportEvent &e) {
         Ogre::Viewport *viewport = e.source;
         Ogre::Camera *camera = viewport->getCamera ();
 
+        if (!mViewportClockDomains.empty ()) {
+            applyClockDomain (getViewportClockDomain (viewport));
+        }
+
         if (getAutoViewportBackground ()) {
             viewport->setBackgroundColour (Ogre::ColourValue::Black);
         }
@@ -396,6 +706,12 @@ namespace Caelum
             getMoon ()->notifyCameraChanged (cam);
         }
 
+        for (size_t i = 0; i < mCelestialBodyLights.size (); ++i) {
+            if (mCelestialBodyLights[i]) {
+                mCelestialBodyLights[i]->notifyCameraChanged (cam);
+            }
+        }
+
         if (getImageStarfield ()) {
             getImageStarfield ()->notifyCameraChanged (cam);
         }
@@ -432,134 +748,368 @@ namespace Caelum
 
         mUniversalClock->update (timeSinceLastFrame);
 
-        // Timing variables
-        LongReal julDay = mUniversalClock->getJulianDay ();
-        LongReal relDayTime = fmod(julDay, 1);
-        Real secondDiff = timeSinceLastFrame * mUniversalClock->getTimeScale ();
+        // Last frame's sky state; the worker is done with the caches after this.
+        waitForSkyState ();
 
-        // Get astronomical parameters.
-        Ogre::Vector3 sunDir = getSunDirection(julDay);
-        Ogre::Vector3 moonDir = getMoonDirection(julDay);
-        Real moonPhase = getMoonPhase(julDay);
+        // A new frame; every domain is evaluated again, at most once.
+        // Ticking clocks keep their sky until the next tick.
+        if (mUniversalClock->getTickLength () == 0) {
+            mSky.valid = false;
+        }
+        std::map<Ogre::String, std::unique_ptr<ClockDomain> >::iterator it;
+        for (it = mClockDomains.begin (); it != mClockDomains.end (); ++it) {
+            UniversalClock *clock = it->second->getUniversalClock ();
+            clock->update (timeSinceLastFrame);
+            if (clock->getTickLength () == 0) {
+                it->second->getCachedSky ().valid = false;
+            }
+        }
 
-        // Get parameters from sky colour model.
-        Real fogDensity = getFogDensity (relDayTime, sunDir);
-        Ogre::ColourValue fogColour = getFogColour (relDayTime, sunDir);
-        Ogre::ColourValue sunLightColour = getSunLightColour (relDayTime, sunDir);
-        Ogre::ColourValue sunSphereColour = getSunSphereColour (relDayTime, sunDir);
-        Ogre::ColourValue moonLightColour = getMoonLightColour (moonDir);
-        Ogre::ColourValue moonBodyColour = getMoonBodyColour (moonDir);
+        if (getEphemerisCache ()) {
+            getEphemerisCache ()->update (mUniversalClock->getJulianDay ());
+        }
 
-        fogDensity *= mGlobalFogDensityMultiplier;
-        fogColour = fogColour * mGlobalFogColourMultiplier;
+        // Apply the state finished in the background, or compute one now.
+        mAppliedClockDomain = 0;
+        if (mSkyStateFinished) {
+            mFrontSkyState = 1 - mFrontSkyState;
+            mSkyStateFinished = false;
+        } else {
+            computeSkyState (*mUniversalClock, getObserverLongitude (), getObserverLatitude (),
+                    getSkyStateConfig (), mSky, mSkyStates[mFrontSkyState]);
+        }
+        mSkyStateValid = true;
+        applySkyState (mSkyStates[mFrontSkyState], timeSinceLastFrame, false);
+        publishSkySnapshot (mSkyStates[mFrontSkyState]);
 
-        // Update image starfield
-        if (getImageStarfield ()) {
-            getImageStarfield ()->update (relDayTime);
-            getImageStarfield ()->setInclination (-getObserverLatitude ());
+        // The next frame shows this frame's time.
+        if (mAsynchronousSkyState) {
+            scheduleSkyState ();
         }
+    }
 
-        // Update point starfield
-        if (getPointStarfield ()) {
-            getPointStarfield ()->setObserverLatitude (getObserverLatitude ());
-            getPointStarfield ()->setObserverLongitude (getObserverLongitude ());
-            getPointStarfield ()->update (julDay);
+    void CaelumSystem::applySky (const UniversalClock &clock,
+            Ogre::Degree longitude, Ogre::Degree latitude, CachedSky &cache,
+            SkyFrame &frame, Real timeSinceLastFrame, bool force)
+    {
+        computeSkyState (clock, longitude, latitude, getSkyStateConfig (), cache, frame);
+        applySkyState (frame, timeSinceLastFrame, force);
+    }
+
+    void CaelumSystem::computeSkyState (const UniversalClock &clock,
+            Ogre::Degree longitude, Ogre::Degree latitude, const SkyStateConfig &config,
+            CachedSky &cache, SkyFrame &frame)
+    {
+        // The timeline follows the main clock only.
+        SkyFrameConfig frameConfig;
+        frameConfig.sky = config;
+        frameConfig.timeline = &cache == &mSky ? mSkyTimeline.get () : 0;
+        frameConfig.keyframed = mKeyframedSky;
+        frameConfig.keyframeInterval = mKeyframeInterval;
+        frameConfig.keyframeMaxAngle = mKeyframeMaxAngle;
+        frameConfig.bodies = &mCelestialBodies;
+        SkyFrameEvaluator::evaluate (clock.getSkyClockTime (), longitude.valueDegrees (), latitude.valueDegrees (),
+                frameConfig, cache, frame);
+
+        frame.longitude = longitude;
+        frame.latitude = latitude;
+        frame.timeScale = clock.getTimeScale ();
+        frame.sunDirection = makeDirection (frame.state.sky.sun);
+        frame.moonDirection = makeDirection (frame.state.sky.moon);
+    }
+
+    void CaelumSystem::applySkyState (const SkyFrame &frame, Real timeSinceLastFrame, bool force)
+    {
+        const SkyState &state = frame.state;
+        Real secondDiff = timeSinceLastFrame * frame.timeScale;
+        LongReal julDay = state.julianDay;
+        LongReal relDayTime = fmod(julDay, 1);
+        const Ogre::Degree latitude = frame.latitude;
+        const Ogre::Vector3 &sunDir = frame.sunDirection;
+        const Ogre::Vector3 &moonDir = frame.moonDirection;
+        Real moonPhase = state.sky.moonPhase;
+
+        // Eclipses are already in these colours.
+        Real fogDensity = state.fogDensity;
+        Ogre::ColourValue fogColour = toColourValue (state.fogColour);
+        Ogre::ColourValue sunLightColour = toColourValue (state.sunLightColour);
+        Ogre::ColourValue sunSphereColour = toColourValue (state.sunSphereColour);
+        Ogre::ColourValue moonLightColour = toColourValue (state.moonLightColour);
+        Ogre::ColourValue moonBodyColour = toColourValue (state.moonBodyColour);
+
+        fogDensity *= mGlobalFogDensityMultiplier;
+        fogColour = fogColour * mGlobalFogColourMultiplier;
+
+        // Component updates as a graph: astronomy for the starfield runs on
+        // the executor, everything touching Ogre stays on this thread.
+        mUpdateGraph.clear ();
+
+        // Update image and point starfield.
+        if (getImageStarfield () || getPointStarfield ()) {
+            const LongReal inputs[] = {
+                    julDay * Ogre::Math::TWO_PI, frame.longitude.valueRadians (), latitude.valueRadians () };
+            if (shouldUpdate (mUpdateThrottles[UPDATE_STARFIELD], timeSinceLastFrame, inputs, force)) {
+                PointStarfield *pointStarfield = getPointStarfield ();
+                TaskGraph::TaskId prepare = 0;
+                if (pointStarfield) {
+                    prepare = mUpdateGraph.addTask ("starfield astronomy", [pointStarfield, &frame] () {
+                        pointStarfield->prepareUpdate (frame.observer);
+                    });
+                }
+                TaskGraph::TaskId apply = mUpdateGraph.addTask ("starfield", [&] () {
+                    if (getImageStarfield ()) {
+                        getImageStarfield ()->update (relDayTime);
+                        getImageStarfield ()->setInclination (-latitude);
+                    }
+                    if (pointStarfield) {
+                        pointStarfield->update (frame.observer);
+                    }
+                }, TaskGraph::CALLING_THREAD);
+                if (pointStarfield) {
+                    mUpdateGraph.addDependency (apply, prepare);
+                }
+            }
         }
 
         // Update skydome.
         if (getSkyDome ()) {
-            getSkyDome ()->setSunDirection (sunDir);
-            getSkyDome ()->setHazeColour (fogColour * mSceneFogColourMultiplier);
+            Ogre::ColourValue hazeColour = fogColour * mSceneFogColourMultiplier;
+            const LongReal inputs[] = {
+                    sunDir.x, sunDir.y, sunDir.z, hazeColour.r, hazeColour.g, hazeColour.b };
+            if (shouldUpdate (mUpdateThrottles[UPDATE_SKY_DOME], timeSinceLastFrame, inputs, force)) {
+                mUpdateGraph.addTask ("sky dome", [this, &sunDir, hazeColour] () {
+                    getSkyDome ()->setSunDirection (sunDir);
+                    getSkyDome ()->setHazeColour (hazeColour);
+                }, TaskGraph::CALLING_THREAD);
+            }
         }
 
-        // Update scene fog.
-		if (mManageSceneFogMode != Ogre::FOG_NONE) {
-            mSceneMgr->setFog (mManageSceneFogMode,
-                    fogColour * mSceneFogColourMultiplier,
-                    fogDensity * mSceneFogDensityMultiplier,
-					mManageSceneFogFromDistance,
-					mManageSceneFogToDistance);
+        // Update scene fog, ground fog and screen space fog.
+        const LongReal fogInputs[] = {
+                fogColour.r, fogColour.g, fogColour.b, fogDensity, sunDir.x, sunDir.y, sunDir.z };
+        bool fogTask = false;
+        TaskGraph::TaskId fog = 0;
+        if (shouldUpdate (mUpdateThrottles[UPDATE_FOG], timeSinceLastFrame, fogInputs, force)) {
+            fogTask = true;
+            fog = mUpdateGraph.addTask ("fog", [&] () {
+                if (mManageSceneFogMode != Ogre::FOG_NONE) {
+                    mSceneMgr->setFog (mManageSceneFogMode,
+                            fogColour * mSceneFogColourMultiplier,
+                            fogDensity * mSceneFogDensityMultiplier,
+                            mManageSceneFogFromDistance,
+                            mManageSceneFogToDistance);
+                }
+
+                if (getGroundFog ()) {
+                    getGroundFog ()->setColour (fogColour * mGroundFogColourMultiplier);
+                    getGroundFog ()->setDensity (fogDensity * mGroundFogDensityMultiplier);
+                }
+
+                if (getDepthComposer ()) {
+                    getDepthComposer ()->setSunDirection (sunDir);
+                    getDepthComposer ()->setHazeColour (fogColour);
+                    getDepthComposer ()->setGroundFogColour (fogColour * mGroundFogColourMultiplier);
+                    getDepthComposer ()->setGroundFogDensity (fogDensity * mGroundFogDensityMultiplier);
+                }
+            }, TaskGraph::CALLING_THREAD);
         }
 
-        // Update ground fog.
-        if (getGroundFog ()) {
-            getGroundFog ()->setColour (fogColour * mGroundFogColourMultiplier);
-            getGroundFog ()->setDensity (fogDensity * mGroundFogDensityMultiplier);
+        // Update lights; extra suns and moons move with the clock, so it is part of the inputs.
+        const LongReal lightInputs[] = {
+                sunDir.x, sunDir.y, sunDir.z,
+                sunLightColour.r, sunLightColour.g, sunLightColour.b,
+                sunSphereColour.r, sunSphereColour.g, sunSphereColour.b,
+                moonDir.x, moonDir.y, moonDir.z,
+                moonLightColour.r, moonLightColour.g, moonLightColour.b,
+                moonPhase, julDay * Ogre::Math::TWO_PI };
+        if (shouldUpdate (mUpdateThrottles[UPDATE_LIGHTS], timeSinceLastFrame, lightInputs, force)) {
+            TaskGraph::TaskId lights = mUpdateGraph.addTask ("lights", [&] () {
+                updateLights (frame, sunLightColour, moonLightColour, moonBodyColour);
+            }, TaskGraph::CALLING_THREAD);
+            if (getManageAmbientLight ()) {
+                TaskGraph::TaskId ambient = mUpdateGraph.addTask ("ambient light", [this] () {
+                    updateAmbientLight ();
+                }, TaskGraph::CALLING_THREAD);
+                mUpdateGraph.addDependency (ambient, lights);
+            }
         }
 
-        // Choose between sun and moon (should be done before updating)
-        if (getSun() && getMoon ()) {
-            Ogre::Real moonBrightness = moonLightColour.r + moonLightColour.g + moonLightColour.b + moonLightColour.a;
-            Ogre::Real sunBrightness = sunLightColour.r + sunLightColour.g + sunLightColour.b + sunLightColour.a;
-            bool sunBrighterThanMoon = (sunBrightness > moonBrightness);
-
-            if (getEnsureSingleLightSource ()) {
-                getMoon()->setForceDisable (sunBrighterThanMoon);
-                getSun()->setForceDisable (!sunBrighterThanMoon);
+        // Update clouds; time skipped by the throttle still animates them.
+        if (getCloudSystem ()) {
+            const LongReal inputs[] = {
+                    sunDir.x, sunDir.y, sunDir.z,
+                    sunLightColour.r, sunLightColour.g, sunLightColour.b,
+                    fogColour.r, fogColour.g, fogColour.b,
+                    sunSphereColour.r, sunSphereColour.g, sunSphereColour.b };
+            if (shouldUpdate (mUpdateThrottles[UPDATE_CLOUDS], timeSinceLastFrame, inputs, force)) {
+                const Real cloudTime = mSkippedCloudTime + secondDiff;
+                mSkippedCloudTime = 0;
+                mUpdateGraph.addTask ("clouds", [&, cloudTime] () {
+                    getCloudSystem ()->update (cloudTime, sunDir, sunLightColour, fogColour, sunSphereColour);
+                }, TaskGraph::CALLING_THREAD);
+            } else {
+                mSkippedCloudTime += secondDiff;
             }
-            if (getEnsureSingleShadowSource ()) {
-                getMoon()->getMainLight ()->setCastShadows (!sunBrighterThanMoon);
-                getSun()->getMainLight ()->setCastShadows (sunBrighterThanMoon);
+        }
+
+        // Update precipitation
+        if (getPrecipitationController ()) {
+            mUpdateGraph.addTask ("precipitation", [&] () {
+                getPrecipitationController ()->update (secondDiff, fogColour);
+            }, TaskGraph::CALLING_THREAD);
+        }
+
+        // Screen space fog renders depth every frame, throttled or not; after its fog parameters.
+        if (getDepthComposer ()) {
+            TaskGraph::TaskId depth = mUpdateGraph.addTask ("depth composer", [this] () {
+                getDepthComposer ()->update ();
+            }, TaskGraph::CALLING_THREAD);
+            if (fogTask) {
+                mUpdateGraph.addDependency (depth, fog);
             }
         }
 
+        mUpdateGraph.run (mParallelUpdate ? mTaskExecutor.get () : 0);
+    }
+
+    void CaelumSystem::publishSkySnapshot (const SkyFrame &frame)
+    {
+        const SkyState &state = frame.state;
+        const Ogre::ColourValue fogColour = toColourValue (state.fogColour) * mGlobalFogColourMultiplier;
+        SkySnapshot snapshot = SkySnapshot ();
+        snapshot.julianDay = state.julianDay;
+        snapshot.longitude = Real (state.longitude);
+        snapshot.latitude = Real (state.latitude);
+        for (int i = 0; i < 3; ++i) {
+            snapshot.sunDirection[i] = frame.sunDirection[i];
+            snapshot.moonDirection[i] = frame.moonDirection[i];
+        }
+        const SkyColour &sun = state.sunLightColour, &moon = state.moonLightColour;
+        const float sunLight[4] = { sun.r, sun.g, sun.b, sun.a };
+        const float moonLight[4] = { moon.r, moon.g, moon.b, moon.a };
+        for (int i = 0; i < 4; ++i) {
+            snapshot.sunLightColour[i] = sunLight[i];
+            snapshot.moonLightColour[i] = moonLight[i];
+            snapshot.fogColour[i] = fogColour[i];
+        }
+        snapshot.sunVisibleFraction = state.sunVisibleFraction;
+        snapshot.moonPhase = state.sky.moonPhase;
+        snapshot.moonUmbraFraction = state.moonUmbraFraction;
+        snapshot.fogDensity = state.fogDensity * mGlobalFogDensityMultiplier;
+        mSkySnapshots.publish (snapshot);
+    }
+
+    void CaelumSystem::updateLights (const SkyFrame &frame,
+            const Ogre::ColourValue &sunLightColour,
+            const Ogre::ColourValue &moonLightColour, const Ogre::ColourValue &moonBodyColour)
+    {
+        // Choose between light sources (should be done before updating)
+        limitSkyLights (frame.bodies, sunLightColour, moonLightColour);
+
         // Update sun
         if (getSun ()) {
-            mSun->update (sunDir, sunLightColour, sunSphereColour);
+            mSun->update (frame.sunDirection, sunLightColour, toColourValue (frame.state.sunSphereColour));
         }
 
         // Update moon.
         if (getMoon ()) {
             mMoon->update (
-                    moonDir,
+                    frame.moonDirection,
                     moonLightColour,
                     moonBodyColour);
-            mMoon->setMoonNorthPoleDirection(getEclipticNorthPoleDirection(julDay)); // its not precise, but error is within 1.5 degrees
-            mMoon->setPhase (moonPhase);
+            mMoon->setMoonNorthPoleDirection(-makeDirection(frame.state.sky.eclipticNorthPole)); // its not precise, but error is within 1.5 degrees
+            mMoon->setPhase (frame.state.sky.moonPhase);
         }
 
-        // Update clouds
-        if (getCloudSystem ()) {
-            getCloudSystem ()->update (
-                    secondDiff, sunDir, sunLightColour, fogColour, sunSphereColour);
+        // Update extra bodies; bodies added since the state was computed wait for the next one.
+        size_t bodyCount = std::min (mCelestialBodyLights.size (), frame.bodies.size ());
+        for (size_t i = 0; i < bodyCount; ++i) {
+            BaseSkyLight *light = mCelestialBodyLights[i].get ();
+            if (!light) {
+                continue;
+            }
+            const CelestialBodies::State &body = frame.bodies[i];
+            const float *colour = mCelestialBodies.getBody (i).colour;
+            light->update (
+                    Ogre::Vector3 (body.east, -body.up, -body.north),
+                    Ogre::ColourValue (body.lightColour[0], body.lightColour[1], body.lightColour[2]),
+                    Ogre::ColourValue (colour[0], colour[1], colour[2]));
+            if (Moon *moon = dynamic_cast<Moon*> (light)) {
+                moon->setPhase (body.phase);
+            }
         }
+    }
 
-        // Update precipitation
-        if (getPrecipitationController ()) {
-            getPrecipitationController ()->update (secondDiff, fogColour);
+    void CaelumSystem::updateAmbientLight ()
+    {
+        Ogre::ColourValue ambient = Ogre::ColourValue::Black;
+        if (getMoon ()) {
+            ambient += getMoon ()->getLightColour () * getMoon ()->getAmbientMultiplier ();
+        }
+        if (getSun ()) {
+            ambient += getSun ()->getLightColour () * getSun ()->getAmbientMultiplier ();
         }
+        for (size_t i = 0; i < mCelestialBodyLights.size (); ++i) {
+            if (BaseSkyLight *light = mCelestialBodyLights[i].get ()) {
+                ambient += light->getLightColour () * light->getAmbientMultiplier ();
+            }
+        }
+        ambient.r = std::max(ambient.r, mMinimumAmbientLight.r);
+        ambient.g = std::max(ambient.g, mMinimumAmbientLight.g);
+        ambient.b = std::max(ambient.b, mMinimumAmbientLight.b);
+        ambient.a = std::max(ambient.a, mMinimumAmbientLight.a);
+        // Debug ambient factos (ick).
+        /*
+        LogManager::getSingleton().logMessage (
+                    "Sun is " + StringConverter::toString(sunLightColour) + "\n"
+                    "Moon is " + StringConverter::toString(moonLightColour) + "\n"
+                    "Ambient is " + StringConverter::toString(ambient) + "\n"
+                    );
+         */
+        mSceneMgr->setAmbientLight (ambient);
+    }
 
-        // Update screen space fog
-        if (getDepthComposer ()) {
-            getDepthComposer ()->update ();
-            getDepthComposer ()->setSunDirection (sunDir);
-            getDepthComposer ()->setHazeColour (fogColour);
-            getDepthComposer ()->setGroundFogColour (fogColour * mGroundFogColourMultiplier);
-            getDepthComposer ()->setGroundFogDensity (fogDensity * mGroundFogDensityMultiplier);
-        }
-
-        // Update ambient lighting.
-        if (getManageAmbientLight ()) {
-            Ogre::ColourValue ambient = Ogre::ColourValue::Black;
-            if (getMoon ()) {
-                ambient += getMoon ()->getLightColour () * getMoon ()->getAmbientMultiplier ();
-            }
-            if (getSun ()) {
-                ambient += getSun ()->getLightColour () * getSun ()->getAmbientMultiplier ();
-            }
-            ambient.r = std::max(ambient.r, mMinimumAmbientLight.r);
-            ambient.g = std::max(ambient.g, mMinimumAmbientLight.g);
-            ambient.b = std::max(ambient.b, mMinimumAmbientLight.b);
-            ambient.a = std::max(ambient.a, mMinimumAmbientLight.a);
-            // Debug ambient factos (ick).
-            /*
-            LogManager::getSingleton().logMessage (
-                        "Sun is " + StringConverter::toString(sunLightColour) + "\n"
-                        "Moon is " + StringConverter::toString(moonLightColour) + "\n"
-                        "Ambient is " + StringConverter::toString(ambient) + "\n"
-                        );
-             */
-            mSceneMgr->setAmbientLight (ambient);
+    void CaelumSystem::limitSkyLights (const std::vector<CelestialBodies::State> &bodies,
+            const Ogre::ColourValue &sunLightColour, const Ogre::ColourValue &moonLightColour)
+    {
+        // Candidates in the order they win ties; the moon beat the sun on a tie before bodies existed.
+        // All are ranked by the sum of their RGB light colour; bodies have no alpha.
+        std::vector<std::pair<Ogre::Real, BaseSkyLight*> > lights;
+        if (getMoon ()) {
+            lights.push_back (std::make_pair (
+                    moonLightColour.r + moonLightColour.g + moonLightColour.b,
+                    static_cast<BaseSkyLight*> (getMoon ())));
+        }
+        if (getSun ()) {
+            lights.push_back (std::make_pair (
+                    sunLightColour.r + sunLightColour.g + sunLightColour.b,
+                    getSun ()));
+        }
+        for (size_t i = 0; i < std::min (mCelestialBodyLights.size (), bodies.size ()); ++i) {
+            if (BaseSkyLight *light = mCelestialBodyLights[i].get ()) {
+                const float *colour = bodies[i].lightColour;
+                lights.push_back (std::make_pair (colour[0] + colour[1] + colour[2], light));
+            }
+        }
+        if (lights.size () < 2) {
+            return;
+        }
+
+        std::stable_sort (lights.begin (), lights.end (),
+                [] (const std::pair<Ogre::Real, BaseSkyLight*> &a, const std::pair<Ogre::Real, BaseSkyLight*> &b) {
+                    return a.first > b.first;
+                });
+
+        size_t limit = getEnsureSingleLightSource () ? 1 : size_t (std::max (0, getMaxSkyLights ()));
+        if (limit > 0) {
+            for (size_t rank = 0; rank < lights.size (); ++rank) {
+                lights[rank].second->setForceDisable (rank >= limit);
+            }
+        }
+        if (getEnsureSingleShadowSource ()) {
+            for (size_t rank = 0; rank < lights.size (); ++rank) {
+                lights[rank].second->getMainLight ()->setCastShadows (rank == 0);
+            }
         }
     }
 
@@ -622,80 +1172,61 @@ namespace Caelum
     }
 
     void CaelumSystem::setSkyGradientsImage (const Ogre::String &filename) {
-        mSkyGradientsImage.reset(new Ogre::Image ());
-        mSkyGradientsImage->load (filename, RESOURCE_GROUP_NAME);
+        waitForSkyState ();
+        Ogre::Image image;
+        image.load (filename, RESOURCE_GROUP_NAME);
+        invalidateSkySamples ();
+        mSkyGradients = makeColourGradient (image);
     }
 
     void CaelumSystem::setSunColoursImage (const Ogre::String &filename) {
-        mSunColoursImage.reset(new Ogre::Image ());
-        mSunColoursImage->load (filename, RESOURCE_GROUP_NAME);
+        waitForSkyState ();
+        Ogre::Image image;
+        image.load (filename, RESOURCE_GROUP_NAME);
+        invalidateSkySamples ();
+        mSunColours = makeColourGradient (image);
     }
 
-    Ogre::ColourValue CaelumSystem::getFogColour (Real time, const Ogre::Vector3 &sunDir) {
-        if (!mSkyGradientsImage.get()) {
-            return Ogre::ColourValue::Black;
-        }
+    SkyStateConfig CaelumSystem::getSkyStateConfig () const
+    {
+        SkyStateConfig config;
+        config.skyGradients = &mSkyGradients;
+        config.sunColours = &mSunColours;
+        config.ephemerisCache = getEphemerisCache ();
+        config.eclipseTable = getEclipseTable ();
+        config.refraction = mAtmosphericRefraction ? &mAtmosphere : 0;
+        config.lunarEclipseColour = SkyColour (
+                mLunarEclipseColour.r, mLunarEclipseColour.g, mLunarEclipseColour.b, mLunarEclipseColour.a);
+        return config;
+    }
 
-        Real elevation = sunDir.dotProduct (Ogre::Vector3::UNIT_Y) * 0.5 + 0.5;
-        Ogre::ColourValue col = InternalUtilities::getInterpolatedColour (elevation, 1, mSkyGradientsImage.get(), false);
-        return col;
+    // The sky colour model lives in SkyStateEvaluator; these take Ogre directions, where y is down.
+    Ogre::ColourValue CaelumSystem::getFogColour (Real time, const Ogre::Vector3 &sunDir) {
+        return toColourValue (SkyStateEvaluator::getFogColour (getSkyStateConfig (), -sunDir.y));
     }
 
     Real CaelumSystem::getFogDensity (Real time, const Ogre::Vector3 &sunDir)
     {
-        if (!mSkyGradientsImage.get()) {
-            return 0;
-        }
-
-        Real elevation = sunDir.dotProduct (Ogre::Vector3::UNIT_Y) * 0.5 + 0.5;
-        Ogre::ColourValue col = InternalUtilities::getInterpolatedColour (elevation, 1, mSkyGradientsImage.get(), false);
-        return col.a;
+        return SkyStateEvaluator::getFogDensity (getSkyStateConfig (), -sunDir.y);
     }
 
     Ogre::ColourValue CaelumSystem::getSunSphereColour (Real time, const Ogre::Vector3 &sunDir)
     {
-        if (!mSunColoursImage.get()) {
-            return Ogre::ColourValue::White;
-        }
-
-        Real elevation = sunDir.dotProduct (Ogre::Vector3::UNIT_Y);
-        elevation = elevation * 2 + 0.4;
-        return InternalUtilities::getInterpolatedColour (elevation, 1, mSunColoursImage.get(), false);
+        return toColourValue (SkyStateEvaluator::getSunSphereColour (getSkyStateConfig (), -sunDir.y));
     }
 
     Ogre::ColourValue CaelumSystem::getSunLightColour (Real time, const Ogre::Vector3 &sunDir)
     {
-        if (!mSkyGradientsImage.get()) {
-            exit(-1);
-            return Ogre::ColourValue::White;
-        }
-        Real elevation = sunDir.dotProduct (Ogre::Vector3::UNIT_Y) * 0.5 + 0.5;
-
-        // Hack: return averaged sky colours.
-        // Don't use an alpha value for lights, this can cause nasty problems.
-        Ogre::ColourValue col = InternalUtilities::getInterpolatedColour (elevation, elevation, mSkyGradientsImage.get(), false);
-        Real val = (col.r + col.g + col.b) / 3;
-        col = Ogre::ColourValue(val, val, val, 1.0);
-        assert(Ogre::Math::RealEqual(col.a, 1));
-        return col;
+        return toColourValue (SkyStateEvaluator::getSunLightColour (getSkyStateConfig (), -sunDir.y));
     }
 
     Ogre::ColourValue CaelumSystem::getMoonBodyColour (const Ogre::Vector3 &moonDir) {
-        return Ogre::ColourValue::White;
+        return toColourValue (SkyStateEvaluator::getMoonBodyColour (getSkyStateConfig (), -moonDir.y));
     }
 
     Ogre::ColourValue CaelumSystem::getMoonLightColour (const Ogre::Vector3 &moonDir)
     {
-        if (!mSkyGradientsImage.get()) {
-            return Ogre::ColourValue::Blue;
-        }
-        // Scaled version of getSunLightColor
-        Real elevation = moonDir.dotProduct (Ogre::Vector3::UNIT_Y) * 0.5 + 0.5;
-        Ogre::ColourValue col = InternalUtilities::getInterpolatedColour (elevation, elevation, mSkyGradientsImage.get(), false);
-        Real val = (col.r + col.g + col.b) / 3;
-        col = Ogre::ColourValue(val / 2.5f, val / 2.5f, val / 2.5f, 1.0);
-        assert(Ogre::Math::RealEqual(col.a, 1));
-        return col;
+        return toColourValue (SkyStateEvaluator::getMoonLightColour (getSkyStateConfig (), -moonDir.y));
     }
 
     const Ogre::Vector3 CaelumSystem::makeDirection (
@@ -708,47 +1239,70 @@ namespace Caelum
         return res;
     }
 
-    const Ogre::Vector3 CaelumSystem::getSunDirection (LongReal jday)
+    const Ogre::Vector3 CaelumSystem::makeDirection (
+            const FastAstronomy::HorizontalVector &direction)
     {
-        Ogre::Degree azimuth, altitude;
-        {
-            ScopedHighPrecissionFloatSwitch precissionSwitch;
+        return Ogre::Vector3 (direction.east, -direction.up, -direction.north);
+    }
+
+    void CaelumSystem::updateObserver (LongReal jday)
+    {
+        updateObserver (jday, getObserverLongitude (), getObserverLatitude ());
+    }
+
+    void CaelumSystem::updateObserver (LongReal jday, Ogre::Degree longitude, Ogre::Degree latitude)
+    {
+        mObserver.setLocation (longitude.valueDegrees (), latitude.valueDegrees ());
+        mObserver.setJulianDay (jday);
+    }
 
-		    Astronomy::getHorizontalSunPosition(jday,
-                    getObserverLongitude(), getObserverLatitude(),
-                    azimuth, altitude);
+    const Ogre::Vector3 CaelumSystem::getSunDirection (LongReal jday)
+    {
+        ScopedHighPrecissionFloatSwitch precissionSwitch;
+
+        // Only drives visuals; the float path is plenty.
+        updateObserver (jday);
+        float azimuth, altitude;
+        LongReal x, y, z;
+        if (getEphemerisCache () && getEphemerisCache ()->getEquatorialSunVector (jday, x, y, z)) {
+            FastAstronomy::convertEquatorialRectangularToHorizontal (mObserver, x, y, z, azimuth, altitude);
+        } else {
+            FastAstronomy::getHorizontalSunPosition (mObserver, azimuth, altitude);
+        }
+        if (mAtmosphericRefraction) {
+            altitude = float (mAtmosphere.getApparentAltitude (altitude));
         }
-        Ogre::Vector3 res = makeDirection(azimuth, altitude);
+        Ogre::Vector3 res = makeDirection(Ogre::Degree (azimuth), Ogre::Degree (altitude));
 
         return res;
     }
 
 	const Ogre::Vector3 CaelumSystem::getEclipticNorthPoleDirection (LongReal jday)
     {
-        Ogre::Degree azimuth, altitude;
-        {
-            ScopedHighPrecissionFloatSwitch precissionSwitch;
-
-            Astronomy::getHorizontalNorthEclipticPolePosition(jday,
-					getObserverLongitude (), getObserverLatitude (),
-					azimuth, altitude);
-        }
-        Ogre::Vector3 res = -makeDirection(azimuth, altitude);
+        updateObserver (jday);
+        float azimuth, altitude;
+        FastAstronomy::getHorizontalNorthEclipticPolePosition (mObserver, azimuth, altitude);
+        Ogre::Vector3 res = -makeDirection(Ogre::Degree (azimuth), Ogre::Degree (altitude));
 
 		return res;
 	}
 
 	const Ogre::Vector3 CaelumSystem::getMoonDirection (LongReal jday)
     {
-        Ogre::Degree azimuth, altitude;
-        {
-            ScopedHighPrecissionFloatSwitch precissionSwitch;
+        ScopedHighPrecissionFloatSwitch precissionSwitch;
 
-            Astronomy::getHorizontalMoonPosition(jday,
-                    getObserverLongitude (), getObserverLatitude (),
-                    azimuth, altitude);
+        updateObserver (jday);
+        float azimuth, altitude;
+        LongReal x, y, z;
+        if (getEphemerisCache () && getEphemerisCache ()->getEquatorialMoonVector (jday, x, y, z)) {
+            FastAstronomy::convertEquatorialRectangularToHorizontal (mObserver, x, y, z, azimuth, altitude);
+        } else {
+            FastAstronomy::getHorizontalMoonPosition (mObserver, azimuth, altitude);
         }
-        Ogre::Vector3 res = makeDirection(azimuth, altitude);
+        if (mAtmosphericRefraction) {
+            altitude = float (mAtmosphere.getApparentAltitude (altitude));
+        }
+        Ogre::Vector3 res = makeDirection(Ogre::Degree (azimuth), Ogre::Degree (altitude));
 
 		return res;
 	}
@@ -769,6 +1323,9 @@ namespace Caelum
         if (getSkyDome ()) getSkyDome ()->setQueryFlags (flags);
         if (getSun ()) getSun ()->setQueryFlags (flags);
         if (getMoon ()) getMoon ()->setQueryFlags (flags);
+        for (size_t i = 0; i < mCelestialBodyLights.size (); ++i) {
+            if (mCelestialBodyLights[i]) mCelestialBodyLights[i]->setQueryFlags (flags);
+        }
         if (getImageStarfield ()) getImageStarfield ()->setQueryFlags (flags);
         if (getPointStarfield ()) getPointStarfield ()->setQueryFlags (flags);
         if (getGroundFog ()) getGroundFog ()->setQueryFlags (flags);
@@ -780,6 +1337,9 @@ namespace Caelum
         if (getSkyDome ()) getSkyDome ()->setVisibilityFlags (flags);
         if (getSun ()) getSun ()->setVisibilityFlags (flags);
         if (getMoon ()) getMoon ()->setVisibilityFlags (flags);
+        for (size_t i = 0; i < mCelestialBodyLights.size (); ++i) {
+            if (mCelestialBodyLights[i]) mCelestialBodyLights[i]->setVisibilityFlags (flags);
+        }
         if (getImageStarfield ()) getImageStarfield ()->setVisibilityFlags (flags);
         if (getPointStarfield ()) getPointStarfield ()->setVisibilityFlags (flags);
         if (getGroundFog ()) getGroundFog ()->setVisibilityFlags (flags);
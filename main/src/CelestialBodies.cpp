@@ -0,0 +1,177 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#include "CaelumCorePrerequisites.h"
+#include "CelestialBodies.h"
+#include "Astronomy.h"
+
+namespace Caelum
+{
+    namespace
+    {
+        const LongReal DEG_TO_RAD = 0.017453292519943295769;
+        const LongReal RAD_TO_DEG = 57.295779513082320877;
+
+        /// 2000 Jan 0.0 UT; element rates are per day since then.
+        const LongReal ELEMENT_EPOCH = 2451543.5;
+
+        /// Fixed iteration count so all bodies solve in lockstep; enough for e < 0.9.
+        const int KEPLER_ITERATIONS = 6;
+
+        /// Bodies fade out while their direction's up component drops through this range (about 3 degrees each way).
+        const float HORIZON_FADE_TOP = 0.05f;
+        const float HORIZON_FADE_BOTTOM = -0.05f;
+
+        /// Equatorial rectangular to (north, east, up); same rotation as SatelliteConstellation.
+        inline void equatorialToHorizontal (
+                LongReal x, LongReal y, LongReal z,
+                LongReal sinLat, LongReal cosLat, LongReal sinLst, LongReal cosLst,
+                LongReal &north, LongReal &east, LongReal &up)
+        {
+            north = -sinLat * cosLst * x - sinLat * sinLst * y + cosLat * z;
+            east = -sinLst * x + cosLst * y;
+            up = cosLat * cosLst * x + cosLat * sinLst * y + sinLat * z;
+        }
+    }
+
+    CelestialBodies::Body::Body ():
+            type (BODY_STAR),
+            N0 (0), N1 (0), i0 (0), i1 (0),
+            w0 (282.9404), w1 (4.70935E-5),
+            a (1), e (0.016709), M0 (356.0470), M1 (0.9856002585),
+            radius (0.00465047),
+            intensity (1),
+            illuminator (ILLUMINATED_BY_SUN)
+    {
+        colour[0] = colour[1] = colour[2] = 1;
+    }
+
+    CelestialBodies::CelestialBodies ()
+    {
+    }
+
+    size_t CelestialBodies::add (const Body &body)
+    {
+        mBodies.push_back (body);
+
+        // Below the horizon and dark until the first update.
+        State state = State ();
+        state.up = -1;
+        state.distance = body.a;
+        mStates.push_back (state);
+
+        const size_t count = mBodies.size ();
+        mMeanAnomaly.resize (count);
+        mEccentricAnomaly.resize (count);
+        mEclipticX.resize (count);
+        mEclipticY.resize (count);
+        mEclipticZ.resize (count);
+        return count - 1;
+    }
+
+    void CelestialBodies::clear ()
+    {
+        mBodies.clear ();
+        mStates.clear ();
+        mMeanAnomaly.clear ();
+        mEccentricAnomaly.clear ();
+        mEclipticX.clear ();
+        mEclipticY.clear ();
+        mEclipticZ.clear ();
+    }
+
+    void CelestialBodies::update (LongReal jday,
+            LongReal sinLatitude, LongReal cosLatitude,
+            LongReal sinSiderealAngle, LongReal cosSiderealAngle)
+    {
+        const size_t count = mBodies.size ();
+        const LongReal d = jday - ELEMENT_EPOCH;
+        LongReal *M = mMeanAnomaly.data (), *E = mEccentricAnomaly.data ();
+        LongReal *x = mEclipticX.data (), *y = mEclipticY.data (), *z = mEclipticZ.data ();
+
+        // Mean anomalies and the usual first guess.
+        for (size_t b = 0; b < count; ++b) {
+            const Body &body = mBodies[b];
+            M[b] = std::fmod (body.M0 + body.M1 * d, LongReal (360)) * DEG_TO_RAD;
+            E[b] = M[b] + body.e * std::sin (M[b]) * (1 + body.e * std::cos (M[b]));
+        }
+
+        // Kepler's equation; Newton's method.
+        for (int iter = 0; iter < KEPLER_ITERATIONS; ++iter) {
+            for (size_t b = 0; b < count; ++b) {
+                const LongReal e = mBodies[b].e;
+                E[b] -= (E[b] - e * std::sin (E[b]) - M[b]) / (1 - e * std::cos (E[b]));
+            }
+        }
+
+        // Ecliptic rectangular coordinates around the observer's planet.
+        for (size_t b = 0; b < count; ++b) {
+            const Body &body = mBodies[b];
+            LongReal xv = body.a * (std::cos (E[b]) - body.e);
+            LongReal yv = body.a * std::sqrt (1 - body.e * body.e) * std::sin (E[b]);
+            LongReal r = std::sqrt (xv * xv + yv * yv);
+            LongReal vw = std::atan2 (yv, xv) + (body.w0 + body.w1 * d) * DEG_TO_RAD;
+            LongReal N = (body.N0 + body.N1 * d) * DEG_TO_RAD;
+            LongReal i = (body.i0 + body.i1 * d) * DEG_TO_RAD;
+            x[b] = r * (std::cos (N) * std::cos (vw) - std::sin (N) * std::sin (vw) * std::cos (i));
+            y[b] = r * (std::sin (N) * std::cos (vw) + std::cos (N) * std::sin (vw) * std::cos (i));
+            z[b] = r * std::sin (vw) * std::sin (i);
+        }
+
+        // Horizontal unit vectors, through the equator of date.
+        const LongReal obliquity = Astronomy::getMeanObliquity (jday) * DEG_TO_RAD;
+        const LongReal sinEcl = std::sin (obliquity), cosEcl = std::cos (obliquity);
+        for (size_t b = 0; b < count; ++b) {
+            State &state = mStates[b];
+            LongReal r = std::sqrt (x[b] * x[b] + y[b] * y[b] + z[b] * z[b]);
+            LongReal north, east, up;
+            equatorialToHorizontal (
+                    x[b], cosEcl * y[b] - sinEcl * z[b], sinEcl * y[b] + cosEcl * z[b],
+                    sinLatitude, cosLatitude, sinSiderealAngle, cosSiderealAngle,
+                    north, east, up);
+            state.north = float (north / r);
+            state.east = float (east / r);
+            state.up = float (up / r);
+            state.distance = r;
+            state.angularRadius = float (std::asin (std::min (LongReal (1), mBodies[b].radius / r)) * RAD_TO_DEG);
+        }
+
+        // The real sun, for moons it lights.
+        LongReal sunX, sunY, sunZ, sunNorth, sunEast, sunUp;
+        DoubleAstronomy::getEquatorialSunVector (jday, sunX, sunY, sunZ);
+        equatorialToHorizontal (sunX, sunY, sunZ,
+                sinLatitude, cosLatitude, sinSiderealAngle, cosSiderealAngle,
+                sunNorth, sunEast, sunUp);
+        const LongReal sunScale = 1 / std::sqrt (sunX * sunX + sunY * sunY + sunZ * sunZ);
+
+        // Phases and light colours.
+        for (size_t b = 0; b < count; ++b) {
+            const Body &body = mBodies[b];
+            State &state = mStates[b];
+
+            LongReal phase = 1;
+            if (body.type == BODY_MOON) {
+                // Elongation from the illuminator; full when opposite.
+                LongReal cosElongation;
+                if (body.illuminator >= 0 && size_t (body.illuminator) < count) {
+                    const State &light = mStates[body.illuminator];
+                    cosElongation = state.north * light.north + state.east * light.east + state.up * light.up;
+                } else {
+                    cosElongation = (state.north * sunNorth + state.east * sunEast + state.up * sunUp) * sunScale;
+                }
+                phase = (1 - cosElongation) / 2;
+            }
+
+            LongReal relativeDistance = state.distance / body.a;
+            float fade = float ((state.up - HORIZON_FADE_BOTTOM) / (HORIZON_FADE_TOP - HORIZON_FADE_BOTTOM));
+            fade = std::max (0.0f, std::min (1.0f, fade));
+
+            state.phase = float (phase);
+            state.brightness = float (body.intensity * phase / (relativeDistance * relativeDistance)) * fade;
+            for (int c = 0; c < 3; ++c) {
+                state.lightColour[c] = body.colour[c] * state.brightness;
+            }
+        }
+    }
+}
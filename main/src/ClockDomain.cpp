@@ -0,0 +1,16 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#include "CaelumPrecompiled.h"
+#include "ClockDomain.h"
+
+namespace Caelum
+{
+    ClockDomain::ClockDomain (const Ogre::String &name):
+            mName (name),
+            mObserverLongitude (0),
+            mObserverLatitude (45)
+    {
+    }
+}
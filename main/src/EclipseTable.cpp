@@ -0,0 +1,448 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#include "CaelumCorePrerequisites.h"
+#include "EclipseTable.h"
+#include "Astronomy.h"
+#include "AstronomyScalar.h"
+#include <algorithm>
+#include <future>
+#include <thread>
+
+namespace Caelum
+{
+    namespace
+    {
+        const LongReal PI = 3.1415926535897932384626433832795029L;
+        const LongReal DEG_TO_RAD = PI / 180;
+
+        const LongReal AU_KM = 149597870.7;
+        const LongReal EARTH_RADIUS_KM = 6378.14;
+        const LongReal MOON_RADIUS_KM = 1737.4;
+        const LongReal SUN_RADIUS_KM = 696000;
+
+        /// Enlargement of the earth's shadow by the atmosphere (Danjon).
+        const LongReal SHADOW_ENLARGEMENT = 1.02;
+
+        /// Mean new moon (Meeus 49.1) and synodic month, in days.
+        const LongReal FIRST_NEW_MOON = 2451550.09766;
+        const LongReal SYNODIC_MONTH = 29.530588861;
+
+        /// Distance from a mean syzygy to search for the true one, in days.
+        const LongReal SYZYGY_SEARCH_HALF_WIDTH = 1.5;
+
+        /// Longest time from first to last contact is well under this, in days.
+        const LongReal MAX_ECLIPSE_HALF_DURATION = 0.5;
+
+        /// Search tolerance for event times, in days (about 0.01 seconds).
+        const LongReal TIME_TOLERANCE = 1e-7;
+
+        /// Conjunction sampling step, in days.
+        const LongReal CONJUNCTION_STEP = 0.25;
+
+        /// Upper bounds of relative motion, degrees per day.
+        const LongReal MOON_RELATIVE_MOTION = 16;
+        const LongReal PLANET_RELATIVE_MOTION = 4;
+
+        const int BODY_COUNT = Astronomy::PLANET_COUNT + 1;
+
+        LongReal dot (const LongReal a[3], const LongReal b[3])
+        {
+            return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+        }
+
+        LongReal length (const LongReal a[3])
+        {
+            return std::sqrt (dot (a, a));
+        }
+
+        /// Angle between two vectors in radians; robust for tiny angles.
+        LongReal angleBetween (const LongReal a[3], const LongReal b[3])
+        {
+            LongReal cx = a[1] * b[2] - a[2] * b[1];
+            LongReal cy = a[2] * b[0] - a[0] * b[2];
+            LongReal cz = a[0] * b[1] - a[1] * b[0];
+            return std::atan2 (std::sqrt (cx * cx + cy * cy + cz * cz), dot (a, b));
+        }
+
+        /// Geocentric equatorial positions of date of the sun and moon, in km.
+        void getSunMoonPositions (LongReal jday, LongReal sun[3], LongReal moon[3])
+        {
+            const LongReal SIN_ECL = 0.397776994021848, COS_ECL = 0.917482132265769;
+
+            DoubleAstronomy::getEquatorialSunVector (jday, sun[0], sun[1], sun[2]);
+            for (int i = 0; i < 3; ++i) {
+                sun[i] *= AU_KM;
+            }
+
+            double lon, lat;
+            LunarTheory::getEclipticPositionRad<LUNAR_THEORY_PLANETARIUM> (jday, lon, lat);
+            LongReal r = LunarTheory::getDistanceKm (jday);
+            LongReal x = r * std::cos (lon) * std::cos (lat);
+            LongReal y = r * std::sin (lon) * std::cos (lat);
+            LongReal z = r * std::sin (lat);
+            moon[0] = x;
+            moon[1] = COS_ECL * y - SIN_ECL * z;
+            moon[2] = SIN_ECL * y + COS_ECL * z;
+        }
+
+        /// Apparent radius of a sphere, in radians.
+        LongReal getApparentRadius (LongReal radius, LongReal distance)
+        {
+            return std::asin (radius / distance);
+        }
+
+        /// Area of the intersection of two discs on the sky.
+        LongReal getDiscOverlap (LongReal r1, LongReal r2, LongReal d)
+        {
+            if (d >= r1 + r2) {
+                return 0;
+            }
+            if (d <= std::abs (r1 - r2)) {
+                LongReal r = std::min (r1, r2);
+                return PI * r * r;
+            }
+            LongReal a1 = std::acos (std::max (LongReal (-1), std::min (LongReal (1), (d * d + r1 * r1 - r2 * r2) / (2 * d * r1))));
+            LongReal a2 = std::acos (std::max (LongReal (-1), std::min (LongReal (1), (d * d + r2 * r2 - r1 * r1) / (2 * d * r2))));
+            LongReal k = (-d + r1 + r2) * (d + r1 - r2) * (d - r1 + r2) * (d + r1 + r2);
+            return r1 * r1 * a1 + r2 * r2 * a2 - std::sqrt (std::max (LongReal (0), k)) / 2;
+        }
+
+        /// Geocentric eclipse circumstances at one time; angles in radians.
+        struct EclipseGeometry
+        {
+            /// Separation of the moon from the sun (solar) or the shadow axis (lunar).
+            LongReal separation;
+            LongReal sunRadius, moonRadius;
+            LongReal sunParallax, moonParallax;
+            LongReal moonDistance;
+
+            EclipseGeometry (LongReal jday, bool solar)
+            {
+                LongReal sun[3], moon[3];
+                getSunMoonPositions (jday, sun, moon);
+                LongReal sunDistance = length (sun);
+                moonDistance = length (moon);
+                sunRadius = getApparentRadius (SUN_RADIUS_KM, sunDistance);
+                moonRadius = getApparentRadius (MOON_RADIUS_KM, moonDistance);
+                sunParallax = getApparentRadius (EARTH_RADIUS_KM, sunDistance);
+                moonParallax = getApparentRadius (EARTH_RADIUS_KM, moonDistance);
+                if (!solar) {
+                    for (int i = 0; i < 3; ++i) {
+                        sun[i] = -sun[i];
+                    }
+                }
+                separation = angleBetween (sun, moon);
+            }
+
+            /// Separation at first contact of a partial solar eclipse somewhere on earth.
+            LongReal getSolarLimit () const { return moonParallax - sunParallax + sunRadius + moonRadius; }
+
+            /// Separation below which the shadow axis hits the earth.
+            LongReal getCentralLimit () const { return moonParallax - sunParallax; }
+
+            LongReal getUmbraRadius () const { return SHADOW_ENLARGEMENT * (moonParallax + sunParallax - sunRadius); }
+            LongReal getPenumbraRadius () const { return SHADOW_ENLARGEMENT * (moonParallax + sunParallax + sunRadius); }
+
+            /// Distance inside first contact; positive during the eclipse.
+            LongReal getMargin (bool solar) const
+            {
+                return (solar ? getSolarLimit () : getPenumbraRadius () + moonRadius) - separation;
+            }
+        };
+
+        /// Minimize a unimodal function on [a, b] by golden section search.
+        template <class Function>
+        LongReal findMinimum (Function f, LongReal a, LongReal b, LongReal tol)
+        {
+            const LongReal INV_PHI = 0.6180339887498948482;
+            LongReal c = b - (b - a) * INV_PHI, d = a + (b - a) * INV_PHI;
+            LongReal fc = f (c), fd = f (d);
+            while (b - a > tol) {
+                if (fc < fd) {
+                    b = d; d = c; fd = fc;
+                    c = b - (b - a) * INV_PHI;
+                    fc = f (c);
+                } else {
+                    a = c; c = d; fc = fd;
+                    d = a + (b - a) * INV_PHI;
+                    fd = f (d);
+                }
+            }
+            return (a + b) / 2;
+        }
+
+        /// Bisect for the sign change of f between inside (f > 0) and outside.
+        template <class Function>
+        LongReal findBoundary (Function f, LongReal inside, LongReal outside, LongReal tol)
+        {
+            while (std::abs (outside - inside) > tol) {
+                LongReal mid = (inside + outside) / 2;
+                if (f (mid) > 0) {
+                    inside = mid;
+                } else {
+                    outside = mid;
+                }
+            }
+            return (inside + outside) / 2;
+        }
+
+        /// Look for an eclipse around a mean new (solar) or full moon.
+        bool findEclipseNear (LongReal guess, bool solar, EclipseTable::Eclipse &eclipse)
+        {
+            auto separation = [=] (LongReal t) { return EclipseGeometry (t, solar).separation; };
+            LongReal maximum = findMinimum (separation,
+                    guess - SYZYGY_SEARCH_HALF_WIDTH, guess + SYZYGY_SEARCH_HALF_WIDTH, TIME_TOLERANCE);
+
+            EclipseGeometry g (maximum, solar);
+            if (g.getMargin (solar) <= 0) {
+                return false;
+            }
+
+            auto margin = [=] (LongReal t) { return EclipseGeometry (t, solar).getMargin (solar); };
+            eclipse.maximum = maximum;
+            eclipse.start = findBoundary (margin, maximum, maximum - MAX_ECLIPSE_HALF_DURATION, TIME_TOLERANCE);
+            eclipse.end = findBoundary (margin, maximum, maximum + MAX_ECLIPSE_HALF_DURATION, TIME_TOLERANCE);
+
+            if (solar) {
+                if (g.separation < g.getCentralLimit ()) {
+                    // Seen from the center of the shadow path, about one earth radius closer.
+                    LongReal moonRadius = getApparentRadius (MOON_RADIUS_KM, g.moonDistance - EARTH_RADIUS_KM);
+                    eclipse.magnitude = float (moonRadius / g.sunRadius);
+                    eclipse.type = (moonRadius >= g.sunRadius) ? EclipseTable::SOLAR_TOTAL : EclipseTable::SOLAR_ANNULAR;
+                } else {
+                    eclipse.magnitude = float ((g.getSolarLimit () - g.separation) / (2 * g.sunRadius));
+                    eclipse.type = EclipseTable::SOLAR_PARTIAL;
+                }
+            } else {
+                LongReal umbra = g.getUmbraRadius ();
+                eclipse.magnitude = float ((umbra + g.moonRadius - g.separation) / (2 * g.moonRadius));
+                if (g.separation < umbra - g.moonRadius) {
+                    eclipse.type = EclipseTable::LUNAR_TOTAL;
+                } else if (g.separation < umbra + g.moonRadius) {
+                    eclipse.type = EclipseTable::LUNAR_PARTIAL;
+                } else {
+                    eclipse.type = EclipseTable::LUNAR_PENUMBRAL;
+                }
+            }
+            return true;
+        }
+
+        /// J2000 unit vectors of the moon and planets; moon first.
+        void getBodyVectors (LongReal jday, LongReal bodies[BODY_COUNT][3])
+        {
+            LongReal sun[3], moon[3], m[3][3];
+            getSunMoonPositions (jday, sun, moon);
+            Astronomy::getPrecessionNutationMatrix (jday, m);
+            LongReal r = length (moon);
+            for (int i = 0; i < 3; ++i) {
+                // Transpose: of date back to J2000.
+                bodies[0][i] = (m[0][i] * moon[0] + m[1][i] * moon[1] + m[2][i] * moon[2]) / r;
+            }
+
+            Astronomy::PlanetPosition planets[Astronomy::PLANET_COUNT];
+            Astronomy::getPlanetPositions (jday, planets);
+            for (int p = 0; p < Astronomy::PLANET_COUNT; ++p) {
+                LongReal *v = bodies[p + 1];
+                Astronomy::convertSphericalToRectangular (planets[p].rasc, planets[p].decl, 1, v[0], v[1], v[2]);
+            }
+        }
+
+        LongReal getBodySeparation (LongReal jday, int first, int second)
+        {
+            LongReal bodies[BODY_COUNT][3];
+            getBodyVectors (jday, bodies);
+            return angleBetween (bodies[first], bodies[second]) / DEG_TO_RAD;
+        }
+    }
+
+    const int EclipseTable::MOON;
+
+    EclipseTable::EclipseTable ():
+        mStart (0),
+        mEnd (0),
+        mThreadCount (0),
+        mConjunctionThreshold (1)
+    {
+    }
+
+    void EclipseTable::scanEclipses (LongReal start, LongReal end, std::vector<Eclipse> &eclipses)
+    {
+        ScopedHighPrecissionFloatSwitch precissionSwitch;
+
+        // Include syzygies just outside; the true one can be up to a day from the mean.
+        long first = long (std::floor ((start - SYZYGY_SEARCH_HALF_WIDTH - FIRST_NEW_MOON) / SYNODIC_MONTH));
+        long last = long (std::ceil ((end + SYZYGY_SEARCH_HALF_WIDTH - FIRST_NEW_MOON) / SYNODIC_MONTH));
+        for (long k = first; k <= last; ++k) {
+            for (int half = 0; half < 2; ++half) {
+                LongReal guess = FIRST_NEW_MOON + (k + half * LongReal (0.5)) * SYNODIC_MONTH;
+                Eclipse eclipse;
+                if (findEclipseNear (guess, half == 0, eclipse) &&
+                        eclipse.maximum >= start && eclipse.maximum < end) {
+                    eclipses.push_back (eclipse);
+                }
+            }
+        }
+    }
+
+    void EclipseTable::scanConjunctions (LongReal start, LongReal end, LongReal threshold,
+            std::vector<Conjunction> &conjunctions)
+    {
+        ScopedHighPrecissionFloatSwitch precissionSwitch;
+
+        // Sample separations of all pairs; refine every local minimum which
+        // could be under the threshold. One extra sample on each side so
+        // minima near the chunk edges are seen.
+        const int PAIR_COUNT = BODY_COUNT * (BODY_COUNT - 1) / 2;
+        const long sampleCount = long (std::ceil ((end - start) / CONJUNCTION_STEP)) + 3;
+        LongReal history[3][PAIR_COUNT];
+        for (long i = 0; i < sampleCount; ++i) {
+            LongReal t = start + (i - 1) * CONJUNCTION_STEP;
+            LongReal bodies[BODY_COUNT][3];
+            getBodyVectors (t, bodies);
+
+            LongReal *current = history[i % 3];
+            const LongReal *middle = history[(i + 2) % 3];
+            const LongReal *previous = history[(i + 1) % 3];
+            int pair = 0;
+            for (int a = 0; a < BODY_COUNT; ++a) {
+                for (int b = a + 1; b < BODY_COUNT; ++b, ++pair) {
+                    current[pair] = angleBetween (bodies[a], bodies[b]) / DEG_TO_RAD;
+                    if (i < 2 || !(middle[pair] <= previous[pair] && middle[pair] < current[pair])) {
+                        continue;
+                    }
+                    LongReal motion = (a == 0) ? MOON_RELATIVE_MOTION : PLANET_RELATIVE_MOTION;
+                    if (middle[pair] > threshold + motion * CONJUNCTION_STEP) {
+                        continue;
+                    }
+                    auto separation = [=] (LongReal jday) { return getBodySeparation (jday, a, b); };
+                    LongReal time = findMinimum (separation,
+                            t - 2 * CONJUNCTION_STEP, t, TIME_TOLERANCE * 100);
+                    LongReal minimum = separation (time);
+                    if (minimum < threshold && time >= start && time < end) {
+                        Conjunction c;
+                        c.time = time;
+                        c.separation = float (minimum);
+                        c.first = (signed char) (a - 1);
+                        c.second = (signed char) (b - 1);
+                        conjunctions.push_back (c);
+                    }
+                }
+            }
+        }
+    }
+
+    void EclipseTable::generate (LongReal start, LongReal end)
+    {
+        mStart = start;
+        mEnd = end;
+        mEclipses.clear ();
+        mConjunctions.clear ();
+        if (end <= start) {
+            return;
+        }
+
+        unsigned threadCount = mThreadCount ? mThreadCount : std::thread::hardware_concurrency ();
+        threadCount = std::max (1u, threadCount);
+        // Keep chunks at least a couple of lunations long.
+        threadCount = std::min (threadCount, unsigned (std::ceil ((end - start) / (2 * SYNODIC_MONTH))));
+
+        const LongReal threshold = mConjunctionThreshold;
+        std::vector<std::future<Chunk> > chunks;
+        for (unsigned i = 0; i < threadCount; ++i) {
+            LongReal chunkStart = start + (end - start) * i / threadCount;
+            LongReal chunkEnd = (i + 1 == threadCount) ? end : start + (end - start) * (i + 1) / threadCount;
+            chunks.push_back (std::async (std::launch::async, [=] () {
+                Chunk chunk;
+                scanEclipses (chunkStart, chunkEnd, chunk.eclipses);
+                if (threshold > 0) {
+                    scanConjunctions (chunkStart, chunkEnd, threshold, chunk.conjunctions);
+                }
+                return chunk;
+            }));
+        }
+
+        for (std::future<Chunk> &future : chunks) {
+            Chunk chunk = future.get ();
+            mEclipses.insert (mEclipses.end (), chunk.eclipses.begin (), chunk.eclipses.end ());
+            mConjunctions.insert (mConjunctions.end (), chunk.conjunctions.begin (), chunk.conjunctions.end ());
+        }
+
+        std::sort (mEclipses.begin (), mEclipses.end (),
+                [] (const Eclipse &a, const Eclipse &b) { return a.start < b.start; });
+        std::sort (mConjunctions.begin (), mConjunctions.end (),
+                [] (const Conjunction &a, const Conjunction &b) { return a.time < b.time; });
+    }
+
+    const EclipseTable::Eclipse* EclipseTable::findEclipse (LongReal jday) const
+    {
+        // Eclipses never overlap, so the only candidate is the last one started.
+        std::vector<Eclipse>::const_iterator it = std::upper_bound (mEclipses.begin (), mEclipses.end (), jday,
+                [] (LongReal t, const Eclipse &e) { return t < e.start; });
+        if (it == mEclipses.begin ()) {
+            return 0;
+        }
+        --it;
+        return (jday < it->end) ? &*it : 0;
+    }
+
+    const EclipseTable::Eclipse* EclipseTable::findNextEclipse (LongReal jday) const
+    {
+        std::vector<Eclipse>::const_iterator it = std::partition_point (mEclipses.begin (), mEclipses.end (),
+                [=] (const Eclipse &e) { return e.end <= jday; });
+        return (it == mEclipses.end ()) ? 0 : &*it;
+    }
+
+    const EclipseTable::Conjunction* EclipseTable::findNextConjunction (LongReal jday) const
+    {
+        std::vector<Conjunction>::const_iterator it = std::partition_point (mConjunctions.begin (), mConjunctions.end (),
+                [=] (const Conjunction &c) { return c.time < jday; });
+        return (it == mConjunctions.end ()) ? 0 : &*it;
+    }
+
+    LongReal EclipseTable::getSunVisibleFraction (LongReal jday, LongReal longitude, LongReal latitude) const
+    {
+        const Eclipse *eclipse = findEclipse (jday);
+        if (!eclipse || !eclipse->isSolar ()) {
+            return 1;
+        }
+
+        ScopedHighPrecissionFloatSwitch precissionSwitch;
+
+        LongReal sun[3], moon[3];
+        getSunMoonPositions (jday, sun, moon);
+
+        // Move to the observer; the zenith is the third row of the
+        // equatorial to horizontal basis. Flattening is ignored.
+        Observer observer (longitude, latitude, jday);
+        const LongReal zenith[3] = {
+            observer.getCosLatitude () * observer.getCosLocalSiderealAngle (),
+            observer.getCosLatitude () * observer.getSinLocalSiderealAngle (),
+            observer.getSinLatitude (),
+        };
+        for (int i = 0; i < 3; ++i) {
+            sun[i] -= EARTH_RADIUS_KM * zenith[i];
+            moon[i] -= EARTH_RADIUS_KM * zenith[i];
+        }
+
+        LongReal sunRadius = getApparentRadius (SUN_RADIUS_KM, length (sun));
+        LongReal moonRadius = getApparentRadius (MOON_RADIUS_KM, length (moon));
+        LongReal covered = getDiscOverlap (sunRadius, moonRadius, angleBetween (sun, moon));
+        return 1 - covered / (PI * sunRadius * sunRadius);
+    }
+
+    LongReal EclipseTable::getMoonUmbraFraction (LongReal jday) const
+    {
+        const Eclipse *eclipse = findEclipse (jday);
+        if (!eclipse || eclipse->isSolar ()) {
+            return 0;
+        }
+
+        ScopedHighPrecissionFloatSwitch precissionSwitch;
+
+        EclipseGeometry g (jday, false);
+        LongReal covered = getDiscOverlap (g.getUmbraRadius (), g.moonRadius, g.separation);
+        return covered / (PI * g.moonRadius * g.moonRadius);
+    }
+}
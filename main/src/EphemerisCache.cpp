@@ -0,0 +1,259 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#include "CaelumCorePrerequisites.h"
+#include "EphemerisCache.h"
+#include "Astronomy.h"
+
+namespace Caelum
+{
+    namespace
+    {
+        const LongReal PI = 3.1415926535897932384626433832795029L;
+
+        void sphericalDegreesToVector (LongReal rasc, LongReal decl, LongReal v[3])
+        {
+            rasc *= PI / 180;
+            decl *= PI / 180;
+            v[0] = std::cos (decl) * std::cos (rasc);
+            v[1] = std::cos (decl) * std::sin (rasc);
+            v[2] = std::sin (decl);
+        }
+
+        /// Angle between two vectors in degrees; robust for tiny angles.
+        LongReal angleBetween (const LongReal a[3], const LongReal b[3])
+        {
+            LongReal cx = a[1] * b[2] - a[2] * b[1];
+            LongReal cy = a[2] * b[0] - a[0] * b[2];
+            LongReal cz = a[0] * b[1] - a[1] * b[0];
+            LongReal dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+            return std::atan2 (std::sqrt (cx * cx + cy * cy + cz * cz), dot) * 180 / PI;
+        }
+    }
+
+    EphemerisCache::EphemerisCache (LongReal halfWidth, int degree):
+        mHalfWidth (halfWidth),
+        mDegree (degree),
+        mRefitMargin (0.5),
+        mAsynchronous (true),
+        mFitCount (0)
+    {
+    }
+
+    EphemerisCache::~EphemerisCache ()
+    {
+        if (mPendingFit.valid ()) {
+            mPendingFit.wait ();
+        }
+    }
+
+    EphemerisCache::FitPtr EphemerisCache::computeFit (LongReal center, LongReal halfWidth, int degree)
+    {
+        ScopedHighPrecissionFloatSwitch precissionSwitch;
+
+        assert (degree >= 1);
+        const int nodeCount = degree + 1;
+        std::shared_ptr<Fit> fit (new Fit ());
+        fit->center = center;
+        fit->halfWidth = halfWidth;
+
+        // Sample the exact routines at the Chebyshev nodes.
+        std::vector<LongReal> sunSamples[3], moonSamples[3];
+        for (int c = 0; c < 3; ++c) {
+            sunSamples[c].resize (nodeCount);
+            moonSamples[c].resize (nodeCount);
+        }
+        for (int k = 0; k < nodeCount; ++k) {
+            LongReal t = std::cos (PI * (k + 0.5) / nodeCount);
+            LongReal rasc, decl, v[3];
+            Astronomy::getEquatorialSunPosition (center + halfWidth * t, rasc, decl);
+            sphericalDegreesToVector (rasc, decl, v);
+            for (int c = 0; c < 3; ++c) {
+                sunSamples[c][k] = v[c];
+            }
+            Astronomy::getEquatorialMoonPosition (center + halfWidth * t, rasc, decl);
+            sphericalDegreesToVector (rasc, decl, v);
+            for (int c = 0; c < 3; ++c) {
+                moonSamples[c][k] = v[c];
+            }
+        }
+
+        // Discrete Chebyshev transform.
+        for (int c = 0; c < 3; ++c) {
+            fit->sun[c].assign (nodeCount, 0);
+            fit->moon[c].assign (nodeCount, 0);
+            for (int j = 0; j < nodeCount; ++j) {
+                LongReal sunSum = 0, moonSum = 0;
+                for (int k = 0; k < nodeCount; ++k) {
+                    LongReal weight = std::cos (PI * j * (k + 0.5) / nodeCount);
+                    sunSum += sunSamples[c][k] * weight;
+                    moonSum += moonSamples[c][k] * weight;
+                }
+                LongReal norm = (j == 0 ? 1.0 : 2.0) / nodeCount;
+                fit->sun[c][j] = sunSum * norm;
+                fit->moon[c][j] = moonSum * norm;
+            }
+        }
+
+        // Measure the error halfway between nodes, where it peaks.
+        fit->sunError = 0;
+        fit->moonError = 0;
+        const int testCount = 4 * nodeCount;
+        for (int k = 0; k <= testCount; ++k) {
+            LongReal t = -1 + 2 * LongReal (k) / testCount;
+            LongReal rasc, decl, exact[3], fitted[3];
+
+            Astronomy::getEquatorialSunPosition (center + halfWidth * t, rasc, decl);
+            sphericalDegreesToVector (rasc, decl, exact);
+            evaluate (fit->sun, t, fitted[0], fitted[1], fitted[2]);
+            fit->sunError = std::max (fit->sunError, angleBetween (exact, fitted));
+
+            Astronomy::getEquatorialMoonPosition (center + halfWidth * t, rasc, decl);
+            sphericalDegreesToVector (rasc, decl, exact);
+            evaluate (fit->moon, t, fitted[0], fitted[1], fitted[2]);
+            fit->moonError = std::max (fit->moonError, angleBetween (exact, fitted));
+        }
+
+        return fit;
+    }
+
+    void EphemerisCache::evaluate (const std::vector<LongReal> *coeffs, LongReal t,
+            LongReal &x, LongReal &y, LongReal &z)
+    {
+        // Clenshaw recurrence, all three components at once.
+        LongReal res[3];
+        const int count = static_cast<int> (coeffs[0].size ());
+        for (int c = 0; c < 3; ++c) {
+            LongReal b1 = 0, b2 = 0;
+            for (int j = count - 1; j >= 1; --j) {
+                LongReal b0 = 2 * t * b1 - b2 + coeffs[c][j];
+                b2 = b1;
+                b1 = b0;
+            }
+            res[c] = t * b1 - b2 + coeffs[c][0];
+        }
+        x = res[0];
+        y = res[1];
+        z = res[2];
+    }
+
+    void EphemerisCache::scheduleFit (LongReal jday)
+    {
+        if (mAsynchronous) {
+            mPendingFit = std::async (std::launch::async, &EphemerisCache::computeFit,
+                    jday, mHalfWidth, mDegree);
+        } else {
+            mFit = computeFit (jday, mHalfWidth, mDegree);
+            ++mFitCount;
+        }
+    }
+
+    void EphemerisCache::update (LongReal jday)
+    {
+        // Collect a finished background fit.
+        if (mPendingFit.valid () &&
+                mPendingFit.wait_for (std::chrono::seconds (0)) == std::future_status::ready) {
+            mFit = mPendingFit.get ();
+            ++mFitCount;
+        }
+
+        if (mPendingFit.valid ()) {
+            return;
+        }
+
+        bool needFit = !mFit ||
+                std::abs (jday - mFit->center) > mFit->halfWidth * mRefitMargin;
+        if (needFit) {
+            scheduleFit (jday);
+        }
+    }
+
+    void EphemerisCache::invalidate ()
+    {
+        if (mPendingFit.valid ()) {
+            mPendingFit.wait ();
+            mPendingFit = std::future<FitPtr> ();
+        }
+        mFit.reset ();
+    }
+
+    bool EphemerisCache::getNormalizedTime (LongReal jday, LongReal &t) const
+    {
+        if (!mFit) {
+            return false;
+        }
+        t = (jday - mFit->center) / mFit->halfWidth;
+        return t >= -1 && t <= 1;
+    }
+
+    bool EphemerisCache::isValidAt (LongReal jday) const
+    {
+        LongReal t;
+        return getNormalizedTime (jday, t);
+    }
+
+    bool EphemerisCache::getEquatorialSunVector (LongReal jday, LongReal &x, LongReal &y, LongReal &z) const
+    {
+        LongReal t;
+        if (!getNormalizedTime (jday, t)) {
+            return false;
+        }
+        evaluate (mFit->sun, t, x, y, z);
+        return true;
+    }
+
+    bool EphemerisCache::getEquatorialMoonVector (LongReal jday, LongReal &x, LongReal &y, LongReal &z) const
+    {
+        LongReal t;
+        if (!getNormalizedTime (jday, t)) {
+            return false;
+        }
+        evaluate (mFit->moon, t, x, y, z);
+        return true;
+    }
+
+    bool EphemerisCache::getHorizontalSunPosition (
+            LongReal jday,
+            LongReal longitude, LongReal latitude,
+            LongReal &azimuth, LongReal &altitude) const
+    {
+        LongReal x, y, z;
+        if (!getEquatorialSunVector (jday, x, y, z)) {
+            return false;
+        }
+        Astronomy::convertEquatorialRectangularToHorizontal (
+                jday, longitude, latitude, x, y, z, azimuth, altitude);
+        return true;
+    }
+
+    bool EphemerisCache::getHorizontalMoonPosition (
+            LongReal jday,
+            LongReal longitude, LongReal latitude,
+            LongReal &azimuth, LongReal &altitude) const
+    {
+        LongReal x, y, z;
+        if (!getEquatorialMoonVector (jday, x, y, z)) {
+            return false;
+        }
+        Astronomy::convertEquatorialRectangularToHorizontal (
+                jday, longitude, latitude, x, y, z, azimuth, altitude);
+        return true;
+    }
+
+    LongReal EphemerisCache::getWindowStart () const {
+        return mFit ? mFit->center - mFit->halfWidth : 0;
+    }
+
+    LongReal EphemerisCache::getWindowEnd () const {
+        return mFit ? mFit->center + mFit->halfWidth : 0;
+    }
+
+    LongReal EphemerisCache::getSunFitError () const {
+        return mFit ? mFit->sunError : 0;
+    }
+
+    LongReal EphemerisCache::getMoonFitError () const {
+        return mFit ? mFit->moonError : 0;
+    }
+}
@@ -0,0 +1,174 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#include "CaelumCorePrerequisites.h"
+#include "KeyframedSky.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Caelum
+{
+    namespace
+    {
+        const LongReal SECONDS_PER_DAY = 86400;
+
+        inline float lerp (float from, float to, LongReal alpha)
+        {
+            return float (from + (to - from) * alpha);
+        }
+
+        inline SkyColour lerp (const SkyColour &from, const SkyColour &to, LongReal alpha)
+        {
+            return SkyColour (
+                    lerp (from.r, to.r, alpha), lerp (from.g, to.g, alpha),
+                    lerp (from.b, to.b, alpha), lerp (from.a, to.a, alpha));
+        }
+
+        LongReal getAngle (const FastAstronomy::HorizontalVector &a, const FastAstronomy::HorizontalVector &b)
+        {
+            const LongReal cn = LongReal (a.east) * b.up - LongReal (a.up) * b.east;
+            const LongReal ce = LongReal (a.up) * b.north - LongReal (a.north) * b.up;
+            const LongReal cu = LongReal (a.north) * b.east - LongReal (a.east) * b.north;
+            const LongReal dot = LongReal (a.north) * b.north + LongReal (a.east) * b.east + LongReal (a.up) * b.up;
+            return std::atan2 (std::sqrt (cn * cn + ce * ce + cu * cu), dot);
+        }
+
+        LongReal getDifference (const SkyColour &a, const SkyColour &b)
+        {
+            return std::max (
+                    std::max (std::fabs (a.r - b.r), std::fabs (a.g - b.g)),
+                    std::max (std::fabs (a.b - b.b), std::fabs (a.a - b.a)));
+        }
+    }
+
+    // Earth turns once a sidereal day; the moon adds about 13.2 degrees a day.
+    const LongReal KeyframedSky::MAX_ANGULAR_SPEED =
+            2 * 3.14159265358979323846 / 86164.0905 + 13.2 * 3.14159265358979323846 / 180 / SECONDS_PER_DAY;
+
+    KeyframedSky::KeyframedSky ():
+            mInterval (60),
+            mMaxAngle (0.25 * 3.14159265358979323846 / 180),
+            mErrorTracking (false),
+            mValid (false),
+            mLongitude (0), mLatitude (0),
+            mLastJulianDay (0),
+            mHaveLastJulianDay (false)
+    {
+        resetStatistics ();
+    }
+
+    LongReal KeyframedSky::getEffectiveInterval () const
+    {
+        LongReal interval = mInterval > 0 ? mInterval : 0;
+        if (mMaxAngle > 0) {
+            const LongReal angleInterval = mMaxAngle / MAX_ANGULAR_SPEED;
+            if (interval == 0 || angleInterval < interval) {
+                interval = angleInterval;
+            }
+        }
+        return interval;
+    }
+
+    void KeyframedSky::invalidate ()
+    {
+        mValid = false;
+        mHaveLastJulianDay = false;
+    }
+
+    void KeyframedSky::resetStatistics ()
+    {
+        mEvaluateCount = 0;
+        mExactCount = 0;
+        mMaxDirectionError = 0;
+        mMaxColourError = 0;
+    }
+
+    void KeyframedSky::sample (LongReal julianDay, SkyState &state)
+    {
+        state = SkyStateEvaluator::evaluate (julianDay, mLongitude, mLatitude, mConfig);
+        ++mExactCount;
+    }
+
+    void KeyframedSky::evaluate (LongReal julianDay, LongReal longitude, LongReal latitude,
+            const SkyStateConfig &config, SkyState &state)
+    {
+        ++mEvaluateCount;
+        if (mValid && (longitude != mLongitude || latitude != mLatitude || config != mConfig)) {
+            invalidate ();
+        }
+        mLongitude = longitude;
+        mLatitude = latitude;
+        mConfig = config;
+
+        const LongReal interval = getEffectiveInterval () / SECONDS_PER_DAY;
+        const LongReal step = mHaveLastJulianDay ? std::fabs (julianDay - mLastJulianDay) : 0;
+        mLastJulianDay = julianDay;
+        mHaveLastJulianDay = true;
+
+        // No limits, or a clock so fast that every call would need a new sample.
+        if (interval <= 0 || step >= interval) {
+            mValid = false;
+            sample (julianDay, state);
+            return;
+        }
+
+        if (!mValid || julianDay < mSamples[0].julianDay || julianDay > mSamples[1].julianDay) {
+            if (mValid && julianDay > mSamples[1].julianDay && julianDay <= mSamples[1].julianDay + interval) {
+                mSamples[0] = mSamples[1];
+                sample (mSamples[0].julianDay + interval, mSamples[1]);
+            } else if (mValid && julianDay < mSamples[0].julianDay && julianDay >= mSamples[0].julianDay - interval) {
+                mSamples[1] = mSamples[0];
+                sample (mSamples[1].julianDay - interval, mSamples[0]);
+            } else {
+                sample (julianDay, mSamples[0]);
+                sample (julianDay + interval, mSamples[1]);
+            }
+            mValid = true;
+            if (mErrorTracking) {
+                trackError ();
+            }
+        }
+
+        const LongReal alpha = (julianDay - mSamples[0].julianDay) / (mSamples[1].julianDay - mSamples[0].julianDay);
+        interpolate (mSamples[0], mSamples[1], alpha, state);
+        state.julianDay = julianDay;
+    }
+
+    void KeyframedSky::trackError ()
+    {
+        const LongReal middle = (mSamples[0].julianDay + mSamples[1].julianDay) / 2;
+        SkyState exact, interpolated;
+        sample (middle, exact);
+        interpolate (mSamples[0], mSamples[1], 0.5, interpolated);
+
+        mMaxDirectionError = std::max (mMaxDirectionError, std::max (
+                getAngle (exact.sky.sun, interpolated.sky.sun),
+                getAngle (exact.sky.moon, interpolated.sky.moon)));
+
+        LongReal colourError = std::fabs (exact.fogDensity - interpolated.fogDensity);
+        colourError = std::max (colourError, getDifference (exact.fogColour, interpolated.fogColour));
+        colourError = std::max (colourError, getDifference (exact.sunLightColour, interpolated.sunLightColour));
+        colourError = std::max (colourError, getDifference (exact.sunSphereColour, interpolated.sunSphereColour));
+        colourError = std::max (colourError, getDifference (exact.moonLightColour, interpolated.moonLightColour));
+        colourError = std::max (colourError, getDifference (exact.moonBodyColour, interpolated.moonBodyColour));
+        mMaxColourError = std::max (mMaxColourError, colourError);
+    }
+
+    void KeyframedSky::interpolate (const SkyState &from, const SkyState &to, LongReal alpha, SkyState &result)
+    {
+        result.julianDay = from.julianDay + (to.julianDay - from.julianDay) * alpha;
+        result.longitude = from.longitude;
+        result.latitude = from.latitude;
+        FastAstronomy::interpolateSky (from.sky, to.sky, FastAstronomy::Scalar (alpha), result.sky);
+        result.fogDensity = lerp (from.fogDensity, to.fogDensity, alpha);
+        result.fogColour = lerp (from.fogColour, to.fogColour, alpha);
+        result.sunLightColour = lerp (from.sunLightColour, to.sunLightColour, alpha);
+        result.sunSphereColour = lerp (from.sunSphereColour, to.sunSphereColour, alpha);
+        result.moonLightColour = lerp (from.moonLightColour, to.moonLightColour, alpha);
+        result.moonBodyColour = lerp (from.moonBodyColour, to.moonBodyColour, alpha);
+        result.sunVisibleFraction = lerp (from.sunVisibleFraction, to.sunVisibleFraction, alpha);
+        result.moonUmbraFraction = lerp (from.moonUmbraFraction, to.moonUmbraFraction, alpha);
+    }
+}
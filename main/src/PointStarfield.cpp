@@ -6,6 +6,7 @@
 #include "PointStarfield.h"
 #include "CaelumExceptions.h"
 #include "Astronomy.h"
+#include "AstronomyScalar.h"
 #include "InternalUtilities.h"
 
 using namespace Ogre;
@@ -14,6 +15,37 @@ namespace Caelum
 {
 	const Ogre::String PointStarfield::STARFIELD_MATERIAL_NAME = "Caelum/StarPoint";
 
+    namespace
+    {
+        /// Unit vector for a star; north celestial pole is at +Y, vernal equinox at -X.
+        Ogre::Vector3 getStarDirection (Ogre::Degree rasc, Ogre::Degree decl)
+        {
+            Ogre::Vector3 pos;
+            pos.z =  Math::Sin(rasc) * Math::Cos(decl);
+            pos.x = -Math::Cos(rasc) * Math::Cos(decl);
+            pos.y =  Math::Sin(decl);
+            return pos;
+        }
+
+        /// Emit the two triangles of one star; the vertex program expands them.
+        void addStarQuad (Ogre::ManualObject *obj, const Ogre::Vector3 &pos, Real magnitude)
+        {
+            obj->position (pos);
+            obj->textureCoord (+1, -1, magnitude);
+            obj->position (pos);
+            obj->textureCoord (+1, +1, magnitude);
+            obj->position (pos);
+            obj->textureCoord (-1, -1, magnitude);
+
+            obj->position (pos);
+            obj->textureCoord (-1, -1, magnitude);
+            obj->position (pos);
+            obj->textureCoord (+1, +1, magnitude);
+            obj->position (pos);
+            obj->textureCoord (-1, +1, magnitude);
+        }
+    }
+
 	PointStarfield::PointStarfield (
 			Ogre::SceneManager *sceneMgr,
 			Ogre::SceneNode *caelumRootNode,
@@ -25,6 +57,22 @@ namespace Caelum
 		mMagnitudeScale = Math::Pow(100, 0.2);
 		mObserverLatitude = 45;
 		mObserverLongitude = 0;
+        mPlanetJulDay = 0;
+        mPlanetUpdateInterval = 5.0 / (24 * 60);
+        mPlanetsEnabled = true;
+        mValidPlanets = false;
+        mPlanetGeometryDirty = false;
+        mPrecessionOrientation = Ogre::Quaternion::IDENTITY;
+        mEquationOfEquinoxes = 0;
+        mPrecessionJulDay = 0;
+        mPrecessionUpdateInterval = 1;
+        mPrecessionEnabled = true;
+        mValidPrecession = false;
+        mExtinctionEnabled = true;
+        mSatelliteVertexCount = 0;
+        mPreparedJulDay = 0;
+        mPreparedLongitude = mPreparedLatitude = 0;
+        mPrepared = false;
 
         String uniqueSuffix = "/" + InternalUtilities::pointerToString(this);
 
@@ -34,6 +82,7 @@ namespace Caelum
                     STARFIELD_MATERIAL_NAME + uniqueSuffix));
 
         mParams.setup(mMaterial->getTechnique(0)->getPass(0)->getVertexProgramParameters());
+        updateExtinctionTable ();
 
 		// We use a separate data source.
 		Ogre::String objName = "Caelum/PointStarfield" + uniqueSuffix;
@@ -43,8 +92,22 @@ namespace Caelum
 		sceneMgr->getRenderQueue()->getQueueGroup(CAELUM_RENDER_QUEUE_STARFIELD)->setShadowsEnabled (false);
         mManualObj->setCastShadows(false);
 
+        // Planets move every frame; keep them out of the static star buffers.
+        mPlanetManualObj.reset (sceneMgr->createManualObject (objName + "/Planets"));
+        mPlanetManualObj->setDynamic(true);
+        mPlanetManualObj->setRenderQueueGroup (CAELUM_RENDER_QUEUE_STARFIELD);
+        mPlanetManualObj->setCastShadows(false);
+
+        // Satellites are rewritten every frame; a buffer of their own.
+        mSatelliteManualObj.reset (sceneMgr->createManualObject (objName + "/Satellites"));
+        mSatelliteManualObj->setDynamic(true);
+        mSatelliteManualObj->setRenderQueueGroup (CAELUM_RENDER_QUEUE_STARFIELD);
+        mSatelliteManualObj->setCastShadows(false);
+
 		mNode.reset (caelumRootNode->createChildSceneNode ());
 		mNode->attachObject (mManualObj.get ());
+		mNode->attachObject (mPlanetManualObj.get ());
+		mNode->attachObject (mSatelliteManualObj.get ());
 
 		if (initWithCatalogue) {
 			addBrightStarCatalogue ();
@@ -159,27 +222,7 @@ namespace Caelum
         for (uint i = 0; i < starCount; ++i)
         {
             const Star& star = mStars[i];
-
-            // North celestial pole is at +Y, vernal equinox at -X
-            Ogre::Vector3 pos;
-            pos.z =  Math::Sin(star.RightAscension) * Math::Cos(star.Declination);
-            pos.x = -Math::Cos(star.RightAscension) * Math::Cos(star.Declination);
-            pos.y =  Math::Sin(star.Declination);
-
-            //mManualObj->colour (Ogre::ColourValue::White);
-            mManualObj->position (pos);
-            mManualObj->textureCoord (+1, -1, star.Magnitude);
-            mManualObj->position (pos);
-            mManualObj->textureCoord (+1, +1, star.Magnitude);
-            mManualObj->position (pos);
-            mManualObj->textureCoord (-1, -1, star.Magnitude);
-
-            mManualObj->position (pos);
-            mManualObj->textureCoord (-1, -1, star.Magnitude);
-            mManualObj->position (pos);
-            mManualObj->textureCoord (+1, +1, star.Magnitude);
-            mManualObj->position (pos);
-            mManualObj->textureCoord (-1, +1, star.Magnitude);
+            addStarQuad (mManualObj.get (), getStarDirection (star.RightAscension, star.Declination), star.Magnitude);
         }
         mManualObj->end();
 
@@ -190,6 +233,139 @@ namespace Caelum
 		mValidGeometry = true;
 	}
     
+    void PointStarfield::setPlanetsEnabled (bool value)
+    {
+        mPlanetsEnabled = value;
+        mPlanetManualObj->setVisible (value);
+        mValidPlanets = false;
+    }
+
+    void PointStarfield::updatePlanetGeometry ()
+    {
+        // The section is created once; later updates rewrite the same
+        // (dynamic) vertex buffer in place.
+        if (mPlanetManualObj->getNumSections () == 0) {
+            mPlanetManualObj->estimateVertexCount (6 * Astronomy::PLANET_COUNT);
+            mPlanetManualObj->begin (mMaterial->getName (), Ogre::RenderOperation::OT_TRIANGLE_LIST, mMaterial->getGroup ());
+        } else {
+            mPlanetManualObj->beginUpdate (0);
+        }
+        for (int i = 0; i < Astronomy::PLANET_COUNT; ++i) {
+            const Astronomy::PlanetPosition &planet = mPlanets[i];
+            addStarQuad (mPlanetManualObj.get (),
+                    getStarDirection (Ogre::Degree (Real (planet.rasc)), Ogre::Degree (Real (planet.decl))),
+                    Real (planet.magnitude));
+        }
+        mPlanetManualObj->end ();
+
+        AxisAlignedBox box(Ogre::AxisAlignedBox::EXTENT_FINITE);
+        mPlanetManualObj->setBoundingBox (box);
+    }
+
+    void PointStarfield::setPrecessionEnabled (bool value)
+    {
+        mPrecessionEnabled = value;
+        mValidPrecession = false;
+    }
+
+    void PointStarfield::updatePrecession (LongReal julDay)
+    {
+        LongReal m[3][3];
+        Astronomy::getPrecessionNutationMatrix (julDay, m);
+
+        // Same matrix in node space: getStarDirection maps equatorial
+        // (x, y, z) to (-x, z, y).
+        Ogre::Matrix3 rot (
+                 Real (m[0][0]), -Real (m[0][2]), -Real (m[0][1]),
+                -Real (m[2][0]),  Real (m[2][2]),  Real (m[2][1]),
+                -Real (m[1][0]),  Real (m[1][2]),  Real (m[1][1]));
+        mPrecessionOrientation = Ogre::Quaternion (rot);
+        mPrecessionOrientation.normalise ();
+
+        // Hour angle from the true equinox of date; part of the same nutation terms.
+        mEquationOfEquinoxes = Astronomy::getEquationOfEquinoxes (julDay);
+        mPrecessionJulDay = julDay;
+        mValidPrecession = true;
+    }
+
+    void PointStarfield::setExtinctionEnabled (bool value)
+    {
+        mExtinctionEnabled = value;
+        updateExtinctionTable ();
+    }
+
+    void PointStarfield::setExtinctionCoefficient (Ogre::Real value)
+    {
+        mAtmosphere.setExtinctionCoefficient (value);
+        updateExtinctionTable ();
+    }
+
+    void PointStarfield::updateExtinctionTable ()
+    {
+        // float4 array in the shader; one register per entry.
+        const int size = AtmosphericLookup::EXTINCTION_TABLE_SIZE;
+        float values[4 * size] = { 0 };
+        if (mExtinctionEnabled) {
+            for (int i = 0; i < size; ++i) {
+                values[4 * i] = mAtmosphere.getExtinctionTable ()[i];
+            }
+        }
+        mParams.extinction_lut.setArray (mParams.vpParams, values, 4 * size);
+    }
+
+    void PointStarfield::setSatelliteConstellation (SatelliteConstellation *value)
+    {
+        mSatellites.reset (value);
+        mSatelliteManualObj->clear ();
+        mSatelliteVertexCount = 0;
+    }
+
+    void PointStarfield::updateSatelliteGeometry (const Ogre::Quaternion &orientation)
+    {
+        const size_t vertexCount = 6 * mSatellites->getSatelliteCount ();
+        if (vertexCount != mSatelliteVertexCount) {
+            // Size the buffer for the new count; the contents are streamed below.
+            mSatelliteManualObj->clear ();
+            mSatelliteVertexCount = vertexCount;
+            if (vertexCount == 0) {
+                return;
+            }
+            mSatelliteManualObj->estimateVertexCount (vertexCount);
+            mSatelliteManualObj->begin (mMaterial->getName (), Ogre::RenderOperation::OT_TRIANGLE_LIST, mMaterial->getGroup ());
+            for (size_t i = 0; i < vertexCount; ++i) {
+                mSatelliteManualObj->position (Ogre::Vector3::ZERO);
+                mSatelliteManualObj->textureCoord (0, 0, SatelliteConstellation::SHADOW_MAGNITUDE);
+            }
+            mSatelliteManualObj->end ();
+
+            AxisAlignedBox box(Ogre::AxisAlignedBox::EXTENT_FINITE);
+            mSatelliteManualObj->setBoundingBox (box);
+        }
+        if (vertexCount == 0) {
+            return;
+        }
+
+        // Horizontal (north, east, up) is (-east, up, north) in caelum
+        // space; take that to node space so satellites share the node
+        // (and the zenith used for extinction) with the stars.
+        Ogre::Matrix3 toNode;
+        orientation.Inverse ().ToRotationMatrix (toNode);
+        float transform[3][3];
+        for (int row = 0; row < 3; ++row) {
+            transform[row][0] = float (toNode[row][2]);
+            transform[row][1] = float (-toNode[row][0]);
+            transform[row][2] = float (toNode[row][1]);
+        }
+
+        // Same layout as addStarQuad: float3 position, float3 texture coordinates.
+        Ogre::HardwareVertexBufferSharedPtr buffer = mSatelliteManualObj->getSection (0)->
+                getRenderOperation ()->vertexData->vertexBufferBinding->getBuffer (0);
+        assert (buffer->getVertexSize () == 6 * sizeof (float));
+        float *dest = static_cast<float*> (buffer->lock (Ogre::HardwareBuffer::HBL_DISCARD));
+        mSatellites->writeVertices (transform, dest);
+        buffer->unlock ();
+    }
+
     void PointStarfield::Params::setup(Ogre::GpuProgramParametersSharedPtr vpParams)
     {
         this->vpParams = vpParams;
@@ -198,6 +374,8 @@ namespace Caelum
         this->min_size.bind(vpParams, "min_size");
         this->max_size.bind(vpParams, "max_size");
         this->aspect_ratio.bind(vpParams, "aspect_ratio");
+        this->zenith_direction.bind(vpParams, "zenith_direction");
+        this->extinction_lut.bind(vpParams, "extinction_lut");
     }
 
 	void PointStarfield::notifyCameraChanged (Ogre::Camera *cam) {
@@ -231,12 +409,70 @@ namespace Caelum
 	}
 
 	void PointStarfield::update (LongReal julDay) {
-		LongReal vernalEquinoxHourAngle;
-		Astronomy::getVernalEquinoxHourAngle(julDay, mObserverLongitude.valueDegrees(), vernalEquinoxHourAngle);
+        update (FastObserver (mObserverLongitude.valueDegrees (), mObserverLatitude.valueDegrees (), julDay));
+    }
+
+    void PointStarfield::prepareUpdate (const FastObserver &observer) {
+        LongReal julDay = observer.getJulianDay ();
+        if (mPrecessionEnabled) {
+            if (!mValidPrecession || Math::Abs (Real (julDay - mPrecessionJulDay)) >= mPrecessionUpdateInterval) {
+                updatePrecession (julDay);
+            }
+        }
+
+        if (mPlanetsEnabled) {
+            if (!mValidPlanets || Math::Abs (Real (julDay - mPlanetJulDay)) >= mPlanetUpdateInterval) {
+                Astronomy::getPlanetPositions (julDay, mPlanets);
+                mPlanetJulDay = julDay;
+                mValidPlanets = true;
+                mPlanetGeometryDirty = true;
+            }
+        }
+
+        if (mSatellites) {
+            mSatellites->update (observer);
+        }
+
+        mPreparedJulDay = julDay;
+        mPreparedLongitude = observer.getLongitude ();
+        mPreparedLatitude = observer.getLatitude ();
+        mPrepared = true;
+    }
+
+    void PointStarfield::update (const FastObserver &observer) {
+        if (!mPrepared ||
+                mPreparedJulDay != observer.getJulianDay () ||
+                mPreparedLongitude != observer.getLongitude () ||
+                mPreparedLatitude != observer.getLatitude ()) {
+            prepareUpdate (observer);
+        }
+        mPrepared = false;
+
+        mObserverLongitude = Ogre::Degree (observer.getLongitude ());
+        mObserverLatitude = Ogre::Degree (observer.getLatitude ());
+
+        // Same sidereal angle as the sun and moon transforms.
+		float vernalEquinoxHourAngle = observer.getLocalSiderealAngle ();
 		Ogre::Quaternion orientation = 
 			Ogre::Quaternion (Ogre::Radian (-mObserverLatitude + Ogre::Degree (90)), Ogre::Vector3::UNIT_X) *
 			Ogre::Quaternion(-Ogre::Degree(vernalEquinoxHourAngle + 90.0), Ogre::Vector3::UNIT_Y );
+
+        if (mPrecessionEnabled) {
+            orientation = orientation *
+                    Ogre::Quaternion (-Ogre::Degree (Real (mEquationOfEquinoxes)), Ogre::Vector3::UNIT_Y) *
+                    mPrecessionOrientation;
+        }
 		mNode->setOrientation (orientation);
+        mParams.zenith_direction.set (mParams.vpParams, orientation.Inverse () * Ogre::Vector3::UNIT_Y);
         ensureGeometry ();
+
+        if (mPlanetsEnabled && mPlanetGeometryDirty) {
+            updatePlanetGeometry ();
+            mPlanetGeometryDirty = false;
+        }
+
+        if (mSatellites) {
+            updateSatelliteGeometry (orientation);
+        }
 	}
 }
@@ -0,0 +1,510 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#include "CaelumCorePrerequisites.h"
+#include "SatelliteConstellation.h"
+#include "BatchMath.h"
+
+namespace Caelum
+{
+    const float SatelliteConstellation::SHADOW_MAGNITUDE = 30;
+
+    namespace
+    {
+        const double PI = 3.14159265358979323846;
+        const double TWO_PI = 2 * PI;
+        const double DEG_TO_RAD = PI / 180;
+        const double MINUTES_PER_DAY = 1440;
+
+        // WGS72, as used for fitting TLEs.
+        const double EARTH_RADIUS_KM = 6378.135;
+        const double EARTH_FLATTENING = 1 / 298.26;
+        const double MU = 398600.8;
+        const double J2 = 0.001082616;
+        const double J3 = -0.00000253881;
+        const double J4 = -0.00000165597;
+        const double J3OJ2 = J3 / J2;
+        const double X2O3 = 2.0 / 3.0;
+
+        /// sqrt (GM) in earth radii ^ 1.5 per minute.
+        double getXke () {
+            return 60 / std::sqrt (EARTH_RADIUS_KM * EARTH_RADIUS_KM * EARTH_RADIUS_KM / MU);
+        }
+
+        /** One damped Newton step for SGP4's form of Kepler's equation.
+         *  propagate calls this a fixed number of times, written out, so
+         *  the loop over satellites has no inner loop; four steps converge
+         *  to 1e-13 radians for eccentricities up to 0.5.
+         */
+        inline void keplerStep (double u, double axnl, double aynl, double &eo1)
+        {
+            double sineo1, coseo1;
+            BatchMath::sinCos (eo1, sineo1, coseo1);
+            double step = (u - aynl * coseo1 + axnl * sineo1 - eo1) / (1 - coseo1 * axnl - sineo1 * aynl);
+            eo1 += std::min (0.95, std::max (-0.95, step));
+        }
+
+        /// Satellites propagated per block of local results.
+        const size_t SATELLITE_BLOCK_SIZE = 256;
+
+        /// Orbits with longer periods need SDP4, in minutes.
+        const double DEEP_SPACE_PERIOD = 225;
+
+        /// Angle in [-pi, pi] for a (possibly large) angle in radians.
+        inline double reduceRadians (double x) {
+            return x - TWO_PI * BatchMath::roundNearest (x * (1 / TWO_PI));
+        }
+
+        /// Parse a fixed column field; false if there is no number there.
+        bool parseField (const std::string &line, size_t column, size_t width, double &value)
+        {
+            if (line.size () < column + width) {
+                return false;
+            }
+            std::string field = line.substr (column, width);
+            const char *begin = field.c_str ();
+            char *end;
+            value = std::strtod (begin, &end);
+            return end != begin;
+        }
+
+        /** Parse a TLE field with an implied decimal point and exponent, like " 28098-4".
+         *  Blank fields are zero.
+         */
+        bool parseExponentField (const std::string &line, size_t column, double &value)
+        {
+            if (line.size () < column + 8) {
+                return false;
+            }
+            std::string field = line.substr (column, 8);
+            if (field.find_first_not_of (' ') == std::string::npos) {
+                value = 0;
+                return true;
+            }
+            double mantissa, exponent;
+            std::string digits = field.substr (1, 5);
+            std::string power = field.substr (6, 2);
+            if (!parseField (digits, 0, 5, mantissa) || !parseField (power, 0, 2, exponent)) {
+                return false;
+            }
+            value = (field[0] == '-' ? -1 : 1) * mantissa * 1e-5 * std::pow (10.0, exponent);
+            return true;
+        }
+
+        inline void trimLine (std::string &line)
+        {
+            while (!line.empty () && (line.back () == '\r' || line.back () == ' ')) {
+                line.pop_back ();
+            }
+        }
+    }
+
+    SatelliteConstellation::SatelliteConstellation ():
+            mJulianDay (0)
+    {
+    }
+
+    bool SatelliteConstellation::parseTle (const std::string &line1, const std::string &line2, OrbitalElements &elements)
+    {
+        if (line1.size () < 61 || line2.size () < 63 || line1[0] != '1' || line2[0] != '2') {
+            return false;
+        }
+
+        double number, year, day;
+        if (!parseField (line1, 2, 5, number) || !parseField (line1, 18, 2, year) ||
+                !parseField (line1, 20, 12, day) || !parseExponentField (line1, 53, elements.bstar)) {
+            return false;
+        }
+
+        double eccentricity;
+        if (!parseField (line2, 8, 8, elements.inclination) ||
+                !parseField (line2, 17, 8, elements.rightAscension) ||
+                !parseField (line2, 26, 7, eccentricity) ||
+                !parseField (line2, 34, 8, elements.argumentOfPerigee) ||
+                !parseField (line2, 43, 8, elements.meanAnomaly) ||
+                !parseField (line2, 52, 11, elements.meanMotion)) {
+            return false;
+        }
+
+        // Two digit years; the first satellite flew in 1957.
+        int fullYear = int (year) + (year < 57 ? 2000 : 1900);
+        // Julian day of January 0.0 of the epoch year.
+        double january0 = 367.0 * fullYear - std::floor (7.0 * fullYear / 4) + 30 + 1721013.5;
+
+        elements.catalogNumber = int (number);
+        elements.epoch = january0 + day;
+        elements.eccentricity = eccentricity * 1e-7;
+        return true;
+    }
+
+    bool SatelliteConstellation::addSatellite (const OrbitalElements &elements, float standardMagnitude,
+            const std::string &name)
+    {
+        const double xke = getXke ();
+        const double ecco = elements.eccentricity;
+        const double inclo = elements.inclination * DEG_TO_RAD;
+        const double argpo = elements.argumentOfPerigee * DEG_TO_RAD;
+        const double mo = elements.meanAnomaly * DEG_TO_RAD;
+        const double bstar = elements.bstar;
+        const double noKozai = elements.meanMotion * TWO_PI / MINUTES_PER_DAY;
+        if (!(noKozai > 0) || !(ecco >= 0 && ecco < 1)) {
+            return false;
+        }
+
+        // Recover the original mean motion and semi major axis (initl).
+        const double eccsq = ecco * ecco;
+        const double omeosq = 1 - eccsq;
+        const double rteosq = std::sqrt (omeosq);
+        const double cosio = std::cos (inclo);
+        const double sinio = std::sin (inclo);
+        const double cosio2 = cosio * cosio;
+        const double ak = std::pow (xke / noKozai, X2O3);
+        const double d1 = 0.75 * J2 * (3 * cosio2 - 1) / (rteosq * omeosq);
+        double del = d1 / (ak * ak);
+        const double adel = ak * (1 - del * del - del * (1.0 / 3 + 134 * del * del / 81));
+        del = d1 / (adel * adel);
+        const double no = noKozai / (1 + del);
+        const double ao = std::pow (xke / no, X2O3);
+        const double po = ao * omeosq;
+        const double con42 = 1 - 5 * cosio2;
+        const double con41 = -con42 - cosio2 - cosio2;
+        const double posq = po * po;
+        const double rp = ao * (1 - ecco);
+
+        if (TWO_PI / no >= DEEP_SPACE_PERIOD || rp < 1) {
+            return false;
+        }
+
+        // Perigees below 220 km use the simplified drag model.
+        const bool simple = rp < 220 / EARTH_RADIUS_KM + 1;
+
+        // Atmospheric density parameters, lowered for low perigees.
+        double sfour = 78 / EARTH_RADIUS_KM + 1;
+        double qzms24 = std::pow ((120 - 78) / EARTH_RADIUS_KM, 4);
+        const double perigee = (rp - 1) * EARTH_RADIUS_KM;
+        if (perigee < 156) {
+            sfour = perigee < 98 ? 20 : perigee - 78;
+            qzms24 = std::pow ((120 - sfour) / EARTH_RADIUS_KM, 4);
+            sfour = sfour / EARTH_RADIUS_KM + 1;
+        }
+
+        const double pinvsq = 1 / posq;
+        const double tsi = 1 / (ao - sfour);
+        const double eta = ao * ecco * tsi;
+        const double etasq = eta * eta;
+        const double eeta = ecco * eta;
+        const double psisq = std::fabs (1 - etasq);
+        const double coef = qzms24 * std::pow (tsi, 4);
+        const double coef1 = coef / std::pow (psisq, 3.5);
+        const double cc2 = coef1 * no * (ao * (1 + 1.5 * etasq + eeta * (4 + etasq)) +
+                0.375 * J2 * tsi / psisq * con41 * (8 + 3 * etasq * (8 + etasq)));
+        const double cc1 = bstar * cc2;
+        const double cc3 = ecco > 1e-4 ? -2 * coef * tsi * J3OJ2 * no * sinio / ecco : 0;
+        const double x1mth2 = 1 - cosio2;
+        const double cc4 = 2 * no * coef1 * ao * omeosq * (eta * (2 + 0.5 * etasq) + ecco * (0.5 + 2 * etasq) -
+                J2 * tsi / (ao * psisq) * (-3 * con41 * (1 - 2 * eeta + etasq * (1.5 - 0.5 * eeta)) +
+                0.75 * x1mth2 * (2 * etasq - eeta * (1 + etasq)) * std::cos (2 * argpo)));
+        const double cc5 = 2 * coef1 * ao * omeosq * (1 + 2.75 * (etasq + eeta) + eeta * etasq);
+
+        // Secular rates.
+        const double cosio4 = cosio2 * cosio2;
+        const double temp1 = 1.5 * J2 * pinvsq * no;
+        const double temp2 = 0.5 * temp1 * J2 * pinvsq;
+        const double temp3 = -0.46875 * J4 * pinvsq * pinvsq * no;
+        const double mdot = no + 0.5 * temp1 * rteosq * con41 + 0.0625 * temp2 * rteosq * (13 - 78 * cosio2 + 137 * cosio4);
+        const double argpdot = -0.5 * temp1 * con42 + 0.0625 * temp2 * (7 - 114 * cosio2 + 395 * cosio4) +
+                temp3 * (3 - 36 * cosio2 + 49 * cosio4);
+        const double xhdot1 = -temp1 * cosio;
+        const double nodedot = xhdot1 + (0.5 * temp2 * (4 - 19 * cosio2) + 2 * temp3 * (3 - 7 * cosio2)) * cosio;
+        const double nodecf = 3.5 * omeosq * xhdot1 * cc1;
+        const double t2cof = 1.5 * cc1;
+        const double xlcofDenominator = std::fabs (cosio + 1) > 1.5e-12 ? 1 + cosio : 1.5e-12;
+        const double xlcof = -0.25 * J3OJ2 * sinio * (3 + 5 * cosio) / xlcofDenominator;
+        const double aycof = -0.5 * J3OJ2 * sinio;
+
+        // Higher order drag terms. The simplified model is the same
+        // equations with all of these zero, so propagate has no branch.
+        double omgcof = 0, xmcof = 0, d2 = 0, d3 = 0, d4 = 0, t3cof = 0, t4cof = 0, t5cof = 0, bstarCc5 = 0;
+        if (!simple) {
+            omgcof = bstar * cc3 * std::cos (argpo);
+            xmcof = ecco > 1e-4 ? -X2O3 * coef * bstar / eeta : 0;
+            const double cc1sq = cc1 * cc1;
+            d2 = 4 * ao * tsi * cc1sq;
+            const double temp = d2 * tsi * cc1 / 3;
+            d3 = (17 * ao + sfour) * temp;
+            d4 = 0.5 * temp * ao * tsi * (221 * ao + 31 * sfour) * cc1;
+            t3cof = d2 + 2 * cc1sq;
+            t4cof = 0.25 * (3 * d3 + cc1 * (12 * d2 + 10 * cc1sq));
+            t5cof = 0.2 * (3 * d4 + 12 * cc1 * d3 + 6 * d2 * d2 + 15 * cc1sq * (2 * d2 + cc1sq));
+            bstarCc5 = bstar * cc5;
+        }
+
+        const double values[COEFFICIENT_COUNT] = {
+            elements.epoch, no, ecco, inclo, elements.rightAscension * DEG_TO_RAD, argpo, mo, bstar,
+            mdot, argpdot, nodedot, nodecf, std::pow (xke / no, X2O3),
+            cc1, bstar * cc4, bstarCc5, d2, d3, d4, t2cof, t3cof, t4cof, t5cof,
+            omgcof, xmcof, eta, std::pow (1 + eta * std::cos (mo), 3), std::sin (mo),
+            aycof, xlcof, con41, x1mth2, 7 * cosio2 - 1, sinio, cosio,
+            standardMagnitude,
+        };
+        for (int i = 0; i < COEFFICIENT_COUNT; ++i) {
+            mCoefficients[i].push_back (values[i]);
+        }
+        mNames.push_back (name);
+        mCatalogNumbers.push_back (elements.catalogNumber);
+
+        const size_t count = getSatelliteCount ();
+        mX.resize (count);
+        mY.resize (count);
+        mZ.resize (count);
+        mNorth.resize (count);
+        mEast.resize (count);
+        mUp.resize (count);
+        mRange.resize (count);
+        mMagnitude.resize (count, SHADOW_MAGNITUDE);
+        return true;
+    }
+
+    bool SatelliteConstellation::addTle (const std::string &line1, const std::string &line2,
+            float standardMagnitude, const std::string &name)
+    {
+        OrbitalElements elements;
+        return parseTle (line1, line2, elements) && addSatellite (elements, standardMagnitude, name);
+    }
+
+    size_t SatelliteConstellation::addTleStream (std::istream &stream, float standardMagnitude)
+    {
+        size_t added = 0;
+        std::string name, line, previous;
+        while (std::getline (stream, line)) {
+            trimLine (line);
+            if (line.size () > 1 && line[0] == '2' && line[1] == ' ' &&
+                    previous.size () > 1 && previous[0] == '1' && previous[1] == ' ') {
+                added += addTle (previous, line, standardMagnitude, name);
+                name.clear ();
+                line.clear ();
+            } else if (!line.empty () && !(line.size () > 1 && line[0] == '1' && line[1] == ' ')) {
+                // Title line of the three line format; some files prefix it with "0 ".
+                name = line.compare (0, 2, "0 ") == 0 ? line.substr (2) : line;
+            }
+            previous = line;
+        }
+        return added;
+    }
+
+    void SatelliteConstellation::clear ()
+    {
+        for (int i = 0; i < COEFFICIENT_COUNT; ++i) {
+            mCoefficients[i].clear ();
+        }
+        mNames.clear ();
+        mCatalogNumbers.clear ();
+        mX.clear ();
+        mY.clear ();
+        mZ.clear ();
+        mNorth.clear ();
+        mEast.clear ();
+        mUp.clear ();
+        mRange.clear ();
+        mMagnitude.clear ();
+    }
+
+    void SatelliteConstellation::propagate (LongReal jday)
+    {
+        mJulianDay = jday;
+        const size_t count = getSatelliteCount ();
+
+        const double *epoch = mCoefficients[EPOCH].data ();
+        const double *no = mCoefficients[NO].data ();
+        const double *ecco = mCoefficients[ECCO].data ();
+        const double *inclo = mCoefficients[INCLO].data ();
+        const double *nodeo = mCoefficients[NODEO].data ();
+        const double *argpo = mCoefficients[ARGPO].data ();
+        const double *mo = mCoefficients[MO].data ();
+        const double *mdot = mCoefficients[MDOT].data ();
+        const double *argpdot = mCoefficients[ARGPDOT].data ();
+        const double *nodedot = mCoefficients[NODEDOT].data ();
+        const double *nodecf = mCoefficients[NODECF].data ();
+        const double *aoBase = mCoefficients[AO_BASE].data ();
+        const double *cc1 = mCoefficients[CC1].data ();
+        const double *bstarCc4 = mCoefficients[CC4].data ();
+        const double *bstarCc5 = mCoefficients[CC5].data ();
+        const double *d2 = mCoefficients[D2].data ();
+        const double *d3 = mCoefficients[D3].data ();
+        const double *d4 = mCoefficients[D4].data ();
+        const double *t2cof = mCoefficients[T2COF].data ();
+        const double *t3cof = mCoefficients[T3COF].data ();
+        const double *t4cof = mCoefficients[T4COF].data ();
+        const double *t5cof = mCoefficients[T5COF].data ();
+        const double *omgcof = mCoefficients[OMGCOF].data ();
+        const double *xmcof = mCoefficients[XMCOF].data ();
+        const double *eta = mCoefficients[ETA].data ();
+        const double *delmo = mCoefficients[DELMO].data ();
+        const double *sinmao = mCoefficients[SINMAO].data ();
+        const double *aycof = mCoefficients[AYCOF].data ();
+        const double *xlcof = mCoefficients[XLCOF].data ();
+        const double *con41 = mCoefficients[CON41].data ();
+        const double *x1mth2 = mCoefficients[X1MTH2].data ();
+        const double *x7thm1 = mCoefficients[X7THM1].data ();
+        const double *sinio = mCoefficients[SINIO].data ();
+        const double *cosio = mCoefficients[COSIO].data ();
+
+        // Results go to local blocks first; with dozens of input arrays
+        // writing straight to members needs too many aliasing checks for
+        // the compiler to vectorize.
+        double x[SATELLITE_BLOCK_SIZE], y[SATELLITE_BLOCK_SIZE], z[SATELLITE_BLOCK_SIZE];
+        for (size_t begin = 0; begin < count; begin += SATELLITE_BLOCK_SIZE) {
+            const size_t n = std::min (SATELLITE_BLOCK_SIZE, count - begin);
+            for (size_t k = 0; k < n; ++k) {
+                const size_t i = begin + k;
+                const double t = (jday - epoch[i]) * MINUTES_PER_DAY;
+                const double t2 = t * t, t3 = t2 * t, t4 = t3 * t;
+
+                // Secular gravity and atmospheric drag.
+                const double xmdf = mo[i] + mdot[i] * t;
+                const double argpdf = argpo[i] + argpdot[i] * t;
+                const double nodem = nodeo[i] + nodedot[i] * t + nodecf[i] * t2;
+                const double delmtemp = 1 + eta[i] * BatchMath::cos (xmdf);
+                const double delm = xmcof[i] * (delmtemp * delmtemp * delmtemp - delmo[i]);
+                const double delta = omgcof[i] * t + delm;
+                double mm = xmdf + delta;
+                const double argpm = argpdf - delta;
+                const double tempa = 1 - cc1[i] * t - d2[i] * t2 - d3[i] * t3 - d4[i] * t4;
+                const double tempe = bstarCc4[i] * t + bstarCc5[i] * (BatchMath::sin (mm) - sinmao[i]);
+                const double templ = t2cof[i] * t2 + t3cof[i] * t3 + t4 * (t4cof[i] + t * t5cof[i]);
+
+                const double am = aoBase[i] * tempa * tempa;
+                const double em = std::max (ecco[i] - tempe, 1e-6);
+                mm += no[i] * templ;
+                const double xlm = mm + argpm + nodem;
+
+                // Long period periodics.
+                double sinArgp, cosArgp;
+                BatchMath::sinCos (argpm, sinArgp, cosArgp);
+                const double axnl = em * cosArgp;
+                const double temp = 1 / (am * (1 - em * em));
+                const double aynl = em * sinArgp + temp * aycof[i];
+                const double xl = xlm + temp * xlcof[i] * axnl;
+
+                // Kepler's equation, in a fixed number of damped Newton steps.
+                const double u = reduceRadians (xl - nodem);
+                double eo1 = u;
+                keplerStep (u, axnl, aynl, eo1);
+                keplerStep (u, axnl, aynl, eo1);
+                keplerStep (u, axnl, aynl, eo1);
+                keplerStep (u, axnl, aynl, eo1);
+                double sineo1, coseo1;
+                BatchMath::sinCos (eo1, sineo1, coseo1);
+
+                // Short period preliminary quantities.
+                const double ecose = axnl * coseo1 + aynl * sineo1;
+                const double esine = axnl * sineo1 - aynl * coseo1;
+                const double el2 = axnl * axnl + aynl * aynl;
+                const double pl = am * (1 - el2);
+                const double rl = am * (1 - ecose);
+                const double betal = std::sqrt (1 - el2);
+                const double esineOverBeta = esine / (1 + betal);
+                const double sinu = am / rl * (sineo1 - aynl - axnl * esineOverBeta);
+                const double cosu = am / rl * (coseo1 - axnl + aynl * esineOverBeta);
+                const double su = BatchMath::atan2 (sinu, cosu);
+                const double sin2u = (cosu + cosu) * sinu;
+                const double cos2u = 1 - 2 * sinu * sinu;
+                const double temp1 = 0.5 * J2 / pl;
+                const double temp2 = temp1 / pl;
+
+                // Short period periodics.
+                const double mrt = rl * (1 - 1.5 * temp2 * betal * con41[i]) + 0.5 * temp1 * x1mth2[i] * cos2u;
+                const double suk = su - 0.25 * temp2 * x7thm1[i] * sin2u;
+                const double xnode = nodem + 1.5 * temp2 * cosio[i] * sin2u;
+                const double xinc = inclo[i] + 1.5 * temp2 * cosio[i] * sinio[i] * cos2u;
+
+                double sinsu, cossu, snod, cnod, sini, cosi;
+                BatchMath::sinCos (suk, sinsu, cossu);
+                BatchMath::sinCos (xnode, snod, cnod);
+                BatchMath::sinCos (xinc, sini, cosi);
+                const double r = mrt * EARTH_RADIUS_KM;
+                x[k] = r * (cnod * cossu - snod * cosi * sinsu);
+                y[k] = r * (snod * cossu + cnod * cosi * sinsu);
+                z[k] = r * sini * sinsu;
+            }
+            std::copy (x, x + n, mX.begin () + begin);
+            std::copy (y, y + n, mY.begin () + begin);
+            std::copy (z, z + n, mZ.begin () + begin);
+        }
+    }
+
+    void SatelliteConstellation::update (LongReal jday,
+            LongReal sinLatitude, LongReal cosLatitude,
+            LongReal sinSiderealAngle, LongReal cosSiderealAngle)
+    {
+        propagate (jday);
+
+        // Observer on the WGS72 ellipsoid, at sea level, in TEME.
+        const double e2 = EARTH_FLATTENING * (2 - EARTH_FLATTENING);
+        const double n = EARTH_RADIUS_KM / std::sqrt (1 - e2 * sinLatitude * sinLatitude);
+        const double observerX = n * cosLatitude * cosSiderealAngle;
+        const double observerY = n * cosLatitude * sinSiderealAngle;
+        const double observerZ = n * (1 - e2) * sinLatitude;
+
+        // Rows of the TEME to (north, east, up) rotation.
+        const double northX = -sinLatitude * cosSiderealAngle, northY = -sinLatitude * sinSiderealAngle, northZ = cosLatitude;
+        const double eastX = -sinSiderealAngle, eastY = cosSiderealAngle;
+        const double upX = cosLatitude * cosSiderealAngle, upY = cosLatitude * sinSiderealAngle, upZ = sinLatitude;
+
+        double sunX, sunY, sunZ;
+        DoubleAstronomy::getEquatorialSunVector (jday, sunX, sunY, sunZ);
+        const double sunScale = 1 / std::sqrt (sunX * sunX + sunY * sunY + sunZ * sunZ);
+        sunX *= sunScale;
+        sunY *= sunScale;
+        sunZ *= sunScale;
+
+        const size_t count = getSatelliteCount ();
+        const double *x = mX.data (), *y = mY.data (), *z = mZ.data ();
+        const double *standardMagnitude = mCoefficients[STANDARD_MAGNITUDE].data ();
+        float *north = mNorth.data (), *east = mEast.data (), *up = mUp.data ();
+        float *range = mRange.data (), *magnitude = mMagnitude.data ();
+        for (size_t i = 0; i < count; ++i) {
+            const double dx = x[i] - observerX, dy = y[i] - observerY, dz = z[i] - observerZ;
+            const double distance = std::sqrt (dx * dx + dy * dy + dz * dz);
+            const double scale = 1 / distance;
+            north[i] = float ((northX * dx + northY * dy + northZ * dz) * scale);
+            east[i] = float ((eastX * dx + eastY * dy) * scale);
+            up[i] = float ((upX * dx + upY * dy + upZ * dz) * scale);
+            range[i] = float (distance);
+
+            // Cylindrical shadow behind the earth.
+            const double alongSun = x[i] * sunX + y[i] * sunY + z[i] * sunZ;
+            const double offAxis2 = x[i] * x[i] + y[i] * y[i] + z[i] * z[i] - alongSun * alongSun;
+            const bool shadowed = alongSun < 0 && offAxis2 < EARTH_RADIUS_KM * EARTH_RADIUS_KM;
+            const double distanceMagnitude = 5 * BatchMath::log10 (distance * 0.001);
+            magnitude[i] = shadowed ? SHADOW_MAGNITUDE : float (standardMagnitude[i] + distanceMagnitude);
+        }
+    }
+
+    void SatelliteConstellation::writeVertices (const float transform[3][3], float *dest) const
+    {
+        // Corners in the same order as PointStarfield's star quads.
+        static const float CORNERS[6][2] = {
+            { +1, -1 }, { +1, +1 }, { -1, -1 },
+            { -1, -1 }, { +1, +1 }, { -1, +1 },
+        };
+
+        const size_t count = getSatelliteCount ();
+        for (size_t i = 0; i < count; ++i) {
+            const float n = mNorth[i], e = mEast[i], u = mUp[i];
+            const float px = transform[0][0] * n + transform[0][1] * e + transform[0][2] * u;
+            const float py = transform[1][0] * n + transform[1][1] * e + transform[1][2] * u;
+            const float pz = transform[2][0] * n + transform[2][1] * e + transform[2][2] * u;
+            for (int k = 0; k < 6; ++k) {
+                dest[0] = px;
+                dest[1] = py;
+                dest[2] = pz;
+                dest[3] = CORNERS[k][0];
+                dest[4] = CORNERS[k][1];
+                dest[5] = mMagnitude[i];
+                dest += 6;
+            }
+        }
+    }
+}
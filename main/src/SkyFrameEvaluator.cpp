@@ -0,0 +1,133 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#include "CaelumCorePrerequisites.h"
+#include "SkyFrameEvaluator.h"
+#include "SkyTimeline.h"
+
+namespace Caelum
+{
+    SkyClockTime::SkyClockTime ():
+            day (0), nanosecond (0),
+            previousDay (0), previousNanosecond (0),
+            julianDay (0), previousTickJulianDay (0), renderJulianDay (0),
+            renderAlpha (0),
+            ticking (false)
+    {
+    }
+
+    CachedSky::CachedSky ():
+            day (0), nanosecond (0),
+            previousDay (0), previousNanosecond (0),
+            longitude (0), latitude (0),
+            valid (false),
+            evaluationCount (0)
+    {
+    }
+
+    bool CachedSky::isCurrent (const SkyClockTime &time, LongReal longitude, LongReal latitude) const
+    {
+        return isAt (time.day, time.nanosecond, longitude, latitude) &&
+                previousDay == time.previousDay &&
+                previousNanosecond == time.previousNanosecond;
+    }
+
+    bool CachedSky::isAt (std::int64_t day, std::int64_t nanosecond,
+            LongReal longitude, LongReal latitude) const
+    {
+        return valid &&
+                this->day == day &&
+                this->nanosecond == nanosecond &&
+                this->longitude == longitude &&
+                this->latitude == latitude;
+    }
+
+    void CachedSky::markCurrent (const SkyClockTime &time, LongReal longitude, LongReal latitude)
+    {
+        valid = true;
+        day = time.day;
+        nanosecond = time.nanosecond;
+        previousDay = time.previousDay;
+        previousNanosecond = time.previousNanosecond;
+        this->longitude = longitude;
+        this->latitude = latitude;
+        ++evaluationCount;
+    }
+
+    SkyFrameConfig::SkyFrameConfig ():
+            timeline (0),
+            keyframed (false),
+            keyframeInterval (KeyframedSky ().getInterval ()),
+            keyframeMaxAngle (KeyframedSky ().getMaxAngle ()),
+            bodies (0)
+    {
+    }
+
+    const FastAstronomy::SkyEvaluation& SkyFrameEvaluator::evaluateCachedSky (const SkyClockTime &time,
+            LongReal longitude, LongReal latitude, const SkyStateConfig &config,
+            CachedSky &cache, FastObserver &observer)
+    {
+        if (!cache.isCurrent (time, longitude, latitude)) {
+            if (time.ticking) {
+                // The tick the clock actually came from; a scale or time
+                // change since then does not move it.
+                if (cache.isAt (time.previousDay, time.previousNanosecond, longitude, latitude)) {
+                    cache.previousSky = cache.sky;
+                } else {
+                    SkyStateEvaluator::evaluateSky (time.previousTickJulianDay,
+                            longitude, latitude, config, observer, cache.previousSky);
+                }
+            }
+            SkyStateEvaluator::evaluateSky (time.julianDay, longitude, latitude, config, observer, cache.sky);
+            cache.markCurrent (time, longitude, latitude);
+        }
+        return cache.sky;
+    }
+
+    void SkyFrameEvaluator::evaluate (const SkyClockTime &time, LongReal longitude, LongReal latitude,
+            const SkyFrameConfig &config, CachedSky &cache, Frame &frame)
+    {
+        // A ticking clock renders between its last two ticks.
+        SkyState &state = frame.state;
+        state.julianDay = time.renderJulianDay;
+        state.longitude = longitude;
+        state.latitude = latitude;
+
+        const bool timeline = config.timeline && !time.ticking;
+        const bool keyframed = !timeline && config.keyframed && !time.ticking;
+        if (timeline) {
+            // Precomputed around this time on the timeline's thread.
+            SkyStateConfig timelineConfig = config.sky;
+            timelineConfig.ephemerisCache = 0;
+            config.timeline->evaluate (state.julianDay, longitude, latitude, timelineConfig, state);
+        } else if (keyframed) {
+            // Sky, colours and eclipses blended from the keyframes around this time.
+            cache.keyframes.setInterval (config.keyframeInterval);
+            cache.keyframes.setMaxAngle (config.keyframeMaxAngle);
+            cache.keyframes.evaluate (state.julianDay, longitude, latitude, config.sky, state);
+        } else {
+            // Get astronomical parameters; cached per clock, but the observer must follow the place.
+            state.sky = evaluateCachedSky (time, longitude, latitude, config.sky, cache, frame.observer);
+            if (time.ticking) {
+                FastAstronomy::interpolateSky (cache.previousSky, cache.sky, time.renderAlpha, state.sky);
+            }
+        }
+        frame.observer.setLocation (longitude, latitude);
+        frame.observer.setJulianDay (state.julianDay);
+
+        // Sky colour model and eclipses.
+        if (!timeline && !keyframed) {
+            SkyStateEvaluator::evaluateColours (config.sky, state);
+        }
+
+        // Extra suns and moons, all in one pass.
+        if (config.bodies) {
+            config.bodies->update (frame.observer);
+        }
+        frame.bodies.resize (config.bodies ? config.bodies->getBodyCount () : 0);
+        for (size_t i = 0; i < frame.bodies.size (); ++i) {
+            frame.bodies[i] = config.bodies->getState (i);
+        }
+    }
+}
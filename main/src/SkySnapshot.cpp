@@ -0,0 +1,77 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#include "CaelumCorePrerequisites.h"
+#include "SkySnapshot.h"
+
+#include <cstddef>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+namespace Caelum
+{
+    static_assert (std::is_trivially_copyable<SkySnapshot>::value,
+            "SkySnapshot is copied word by word");
+    static_assert (offsetof (SkySnapshot, version) == 0,
+            "publish writes the version into the first word");
+
+    SkySnapshotBuffer::SkySnapshotBuffer ():
+            mSequence (0)
+    {
+        for (size_t i = 0; i < WORD_COUNT; ++i) {
+            mWords[i].store (0, std::memory_order_relaxed);
+        }
+    }
+
+    void SkySnapshotBuffer::publish (const SkySnapshot &snapshot)
+    {
+        const std::uint64_t sequence = mSequence.load (std::memory_order_relaxed);
+        std::uint64_t words[WORD_COUNT] = { 0 };
+        std::memcpy (words, &snapshot, sizeof (SkySnapshot));
+        const std::uint64_t version = sequence / 2 + 1;
+        std::memcpy (words, &version, sizeof (version));
+
+        // Odd while writing; the fence keeps the word stores after it.
+        mSequence.store (sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence (std::memory_order_release);
+        for (size_t i = 0; i < WORD_COUNT; ++i) {
+            mWords[i].store (words[i], std::memory_order_relaxed);
+        }
+        mSequence.store (sequence + 2, std::memory_order_release);
+    }
+
+    bool SkySnapshotBuffer::tryRead (SkySnapshot &snapshot) const
+    {
+        const std::uint64_t before = mSequence.load (std::memory_order_acquire);
+        if (before & 1) {
+            return false;
+        }
+        std::uint64_t words[WORD_COUNT];
+        for (size_t i = 0; i < WORD_COUNT; ++i) {
+            words[i] = mWords[i].load (std::memory_order_relaxed);
+        }
+        // The fence keeps the word loads before the second check.
+        std::atomic_thread_fence (std::memory_order_acquire);
+        if (mSequence.load (std::memory_order_relaxed) != before) {
+            return false;
+        }
+        std::memcpy (&snapshot, words, sizeof (SkySnapshot));
+        return true;
+    }
+
+    SkySnapshot SkySnapshotBuffer::read () const
+    {
+        SkySnapshot snapshot;
+        while (!tryRead (snapshot)) {
+            std::this_thread::yield ();
+        }
+        return snapshot;
+    }
+
+    std::uint64_t SkySnapshotBuffer::getVersion () const
+    {
+        return mSequence.load (std::memory_order_acquire) / 2;
+    }
+}
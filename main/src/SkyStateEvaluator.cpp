@@ -0,0 +1,230 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#include "CaelumCorePrerequisites.h"
+#include "SkyStateEvaluator.h"
+#include "Astronomy.h"
+#include "EphemerisCache.h"
+#include "EclipseTable.h"
+#include "AtmosphericLookup.h"
+
+namespace Caelum
+{
+    ColourGradient::ColourGradient ():
+            mWidth (0), mHeight (0)
+    {
+    }
+
+    ColourGradient::ColourGradient (size_t width, size_t height, const float *rgba):
+            mWidth (width), mHeight (height),
+            mPixels (rgba, rgba + width * height * 4)
+    {
+    }
+
+    SkyColour ColourGradient::getColour (size_t x, size_t y) const
+    {
+        assert (x < mWidth && y < mHeight);
+        const float *pixel = &mPixels[(y * mWidth + x) * 4];
+        return SkyColour (pixel[0], pixel[1], pixel[2], pixel[3]);
+    }
+
+    SkyColour ColourGradient::getInterpolatedColour (float fx, float fy) const
+    {
+        assert (!isEmpty ());
+        int width = static_cast<int> (mWidth);
+        int height = static_cast<int> (mHeight);
+
+        // Nearest row, snapped to the image.
+        int py = static_cast<int> (std::floor (std::fabs (fy) * (height - 1)));
+        py = std::max (0, std::min (py, height - 1));
+
+        // The two closest columns.
+        float px = fx * (mWidth - 1);
+        int px1 = static_cast<int> (std::floor (px));
+        int px2 = static_cast<int> (std::ceil (px));
+        px1 = std::max (0, std::min (px1, width - 1));
+        px2 = std::max (0, std::min (px2, width - 1));
+
+        SkyColour c1 = getColour (px1, py);
+        SkyColour c2 = getColour (px2, py);
+        float diff = px - px1;
+        return SkyColour (
+                c1.r + (c2.r - c1.r) * diff,
+                c1.g + (c2.g - c1.g) * diff,
+                c1.b + (c2.b - c1.b) * diff,
+                c1.a + (c2.a - c1.a) * diff);
+    }
+
+    SkyStateConfig::SkyStateConfig ():
+            skyGradients (0), sunColours (0),
+            ephemerisCache (0), eclipseTable (0), refraction (0),
+            lunarEclipseColour (0.5, 0.2, 0.1)
+    {
+    }
+
+    bool SkyStateConfig::operator== (const SkyStateConfig &other) const
+    {
+        return skyGradients == other.skyGradients &&
+                sunColours == other.sunColours &&
+                ephemerisCache == other.ephemerisCache &&
+                eclipseTable == other.eclipseTable &&
+                refraction == other.refraction &&
+                lunarEclipseColour.r == other.lunarEclipseColour.r &&
+                lunarEclipseColour.g == other.lunarEclipseColour.g &&
+                lunarEclipseColour.b == other.lunarEclipseColour.b &&
+                lunarEclipseColour.a == other.lunarEclipseColour.a;
+    }
+
+    SkyState::SkyState ():
+            julianDay (0), longitude (0), latitude (0),
+            sky (),
+            fogDensity (0),
+            sunLightColour (1, 1, 1), sunSphereColour (1, 1, 1),
+            moonLightColour (1, 1, 1), moonBodyColour (1, 1, 1),
+            sunVisibleFraction (1), moonUmbraFraction (0)
+    {
+    }
+
+    SkyState SkyStateEvaluator::evaluate (LongReal julianDay,
+            LongReal longitude, LongReal latitude, const SkyStateConfig &config)
+    {
+        SkyState state;
+        state.julianDay = julianDay;
+        state.longitude = longitude;
+        state.latitude = latitude;
+        FastObserver observer;
+        evaluateSky (julianDay, longitude, latitude, config, observer, state.sky);
+        evaluateColours (config, state);
+        return state;
+    }
+
+    void SkyStateEvaluator::evaluateSky (LongReal julianDay,
+            LongReal longitude, LongReal latitude, const SkyStateConfig &config,
+            FastObserver &observer, FastAstronomy::SkyEvaluation &sky)
+    {
+        ScopedHighPrecissionFloatSwitch precissionSwitch;
+
+        observer.setLocation (longitude, latitude);
+        observer.setJulianDay (julianDay);
+        LongReal sun[3], moon[3];
+        if (config.ephemerisCache &&
+                config.ephemerisCache->getEquatorialSunVector (julianDay, sun[0], sun[1], sun[2]) &&
+                config.ephemerisCache->getEquatorialMoonVector (julianDay, moon[0], moon[1], moon[2])) {
+            const float fsun[3] = { float (sun[0]), float (sun[1]), float (sun[2]) };
+            const float fmoon[3] = { float (moon[0]), float (moon[1]), float (moon[2]) };
+            FastAstronomy::evaluateSky (observer, fsun, fmoon, sky);
+        } else {
+            FastAstronomy::evaluateSky (observer, sky);
+        }
+
+        if (config.refraction) {
+            config.refraction->refract (sky.sun.north, sky.sun.east, sky.sun.up);
+            config.refraction->refract (sky.moon.north, sky.moon.east, sky.moon.up);
+        }
+    }
+
+    void SkyStateEvaluator::evaluateColours (const SkyStateConfig &config, SkyState &state)
+    {
+        const float sunUp = state.sky.sun.up;
+        const float moonUp = state.sky.moon.up;
+        state.fogDensity = getFogDensity (config, sunUp);
+        state.fogColour = getFogColour (config, sunUp);
+        state.sunLightColour = getSunLightColour (config, sunUp);
+        state.sunSphereColour = getSunSphereColour (config, sunUp);
+        state.moonLightColour = getMoonLightColour (config, moonUp);
+        state.moonBodyColour = getMoonBodyColour (config, moonUp);
+
+        // Eclipses; both lookups are a binary search outside an eclipse.
+        state.sunVisibleFraction = 1;
+        state.moonUmbraFraction = 0;
+        if (!config.eclipseTable) {
+            return;
+        }
+        state.sunVisibleFraction = float (config.eclipseTable->getSunVisibleFraction (
+                state.julianDay, state.longitude, state.latitude));
+        state.moonUmbraFraction = float (config.eclipseTable->getMoonUmbraFraction (state.julianDay));
+
+        SkyColour &sun = state.sunLightColour;
+        sun.r *= state.sunVisibleFraction;
+        sun.g *= state.sunVisibleFraction;
+        sun.b *= state.sunVisibleFraction;
+        sun.a = 1;
+
+        const float umbra = state.moonUmbraFraction;
+        const SkyColour &eclipse = config.lunarEclipseColour;
+        const SkyColour tint (
+                (1 - umbra) + eclipse.r * umbra,
+                (1 - umbra) + eclipse.g * umbra,
+                (1 - umbra) + eclipse.b * umbra);
+        SkyColour *moonColours[] = { &state.moonBodyColour, &state.moonLightColour };
+        for (int i = 0; i < 2; ++i) {
+            SkyColour &moon = *moonColours[i];
+            moon.r *= tint.r;
+            moon.g *= tint.g;
+            moon.b *= tint.b;
+            moon.a = 1;
+        }
+    }
+
+    SkyColour SkyStateEvaluator::getFogColour (const SkyStateConfig &config, float sunUp)
+    {
+        if (!config.skyGradients || config.skyGradients->isEmpty ()) {
+            return SkyColour (0, 0, 0);
+        }
+
+        float elevation = float (-sunUp * 0.5 + 0.5);
+        return config.skyGradients->getInterpolatedColour (elevation, 1);
+    }
+
+    float SkyStateEvaluator::getFogDensity (const SkyStateConfig &config, float sunUp)
+    {
+        if (!config.skyGradients || config.skyGradients->isEmpty ()) {
+            return 0;
+        }
+
+        float elevation = float (-sunUp * 0.5 + 0.5);
+        return config.skyGradients->getInterpolatedColour (elevation, 1).a;
+    }
+
+    SkyColour SkyStateEvaluator::getSunSphereColour (const SkyStateConfig &config, float sunUp)
+    {
+        if (!config.sunColours || config.sunColours->isEmpty ()) {
+            return SkyColour (1, 1, 1);
+        }
+
+        float elevation = float (-sunUp * 2 + 0.4);
+        return config.sunColours->getInterpolatedColour (elevation, 1);
+    }
+
+    SkyColour SkyStateEvaluator::getSunLightColour (const SkyStateConfig &config, float sunUp)
+    {
+        if (!config.skyGradients || config.skyGradients->isEmpty ()) {
+            return SkyColour (1, 1, 1);
+        }
+        float elevation = float (-sunUp * 0.5 + 0.5);
+
+        // Hack: return averaged sky colours.
+        // Don't use an alpha value for lights, this can cause nasty problems.
+        SkyColour col = config.skyGradients->getInterpolatedColour (elevation, elevation);
+        float val = (col.r + col.g + col.b) / 3;
+        return SkyColour (val, val, val, 1);
+    }
+
+    SkyColour SkyStateEvaluator::getMoonBodyColour (const SkyStateConfig &config, float moonUp)
+    {
+        return SkyColour (1, 1, 1);
+    }
+
+    SkyColour SkyStateEvaluator::getMoonLightColour (const SkyStateConfig &config, float moonUp)
+    {
+        if (!config.skyGradients || config.skyGradients->isEmpty ()) {
+            return SkyColour (0, 0, 1);
+        }
+        // Scaled version of getSunLightColour
+        float elevation = float (-moonUp * 0.5 + 0.5);
+        SkyColour col = config.skyGradients->getInterpolatedColour (elevation, elevation);
+        float val = (col.r + col.g + col.b) / 3;
+        return SkyColour (val / 2.5f, val / 2.5f, val / 2.5f, 1);
+    }
+}
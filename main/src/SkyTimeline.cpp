@@ -0,0 +1,295 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#include "CaelumCorePrerequisites.h"
+#include "SkyTimeline.h"
+#include "KeyframedSky.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace Caelum
+{
+    namespace
+    {
+        const LongReal SECONDS_PER_DAY = 86400;
+    }
+
+    const std::int64_t SkyTimeline::NO_SAMPLE = std::numeric_limits<std::int64_t>::min ();
+
+    SkyTimeline::SkyTimeline ():
+            mSpacing (60),
+            mCapacity (2880),
+            mHaveSource (false),
+            mLongitude (0), mLatitude (0),
+            mGeneration (0),
+            mCursor (0),
+            mDirection (1),
+            mFilledLow (1), mFilledHigh (0),
+            mHitCount (0), mMissCount (0), mComputedCount (0),
+            mComputing (false),
+            mWindowFilled (true),
+            mStopping (false)
+    {
+        mThread = std::thread (&SkyTimeline::workerLoop, this);
+    }
+
+    SkyTimeline::~SkyTimeline ()
+    {
+        {
+            std::lock_guard<std::mutex> lock (mMutex);
+            mStopping = true;
+        }
+        mWork.notify_all ();
+        mThread.join ();
+    }
+
+    void SkyTimeline::setSpacing (LongReal seconds)
+    {
+        std::unique_lock<std::mutex> lock (mMutex);
+        mSpacing = seconds;
+        dropSamples (lock);
+    }
+
+    void SkyTimeline::setCapacity (size_t samples)
+    {
+        std::unique_lock<std::mutex> lock (mMutex);
+        assert (samples >= 4);
+        mCapacity = samples;
+        dropSamples (lock);
+    }
+
+    void SkyTimeline::clear ()
+    {
+        std::unique_lock<std::mutex> lock (mMutex);
+        dropSamples (lock);
+        mHaveSource = false;
+        mIdle.notify_all ();
+    }
+
+    unsigned long SkyTimeline::getHitCount () const
+    {
+        std::lock_guard<std::mutex> lock (mMutex);
+        return mHitCount;
+    }
+
+    unsigned long SkyTimeline::getMissCount () const
+    {
+        std::lock_guard<std::mutex> lock (mMutex);
+        return mMissCount;
+    }
+
+    unsigned long SkyTimeline::getComputedCount () const
+    {
+        std::lock_guard<std::mutex> lock (mMutex);
+        return mComputedCount;
+    }
+
+    void SkyTimeline::resetStatistics ()
+    {
+        std::lock_guard<std::mutex> lock (mMutex);
+        mHitCount = mMissCount = mComputedCount = 0;
+    }
+
+    void SkyTimeline::dropSamples (std::unique_lock<std::mutex> &lock)
+    {
+        // The worker may be reading the old config; wait for it to let go.
+        while (mComputing) {
+            mIdle.wait (lock);
+        }
+        ++mGeneration;
+        mSamples.clear ();
+        mFilledLow = 1;
+        mFilledHigh = 0;
+        mWindowFilled = false;
+    }
+
+    std::int64_t SkyTimeline::getIndex (LongReal julianDay) const
+    {
+        return std::int64_t (std::floor (julianDay * SECONDS_PER_DAY / mSpacing));
+    }
+
+    size_t SkyTimeline::getSlot (std::int64_t index) const
+    {
+        const std::int64_t capacity = std::int64_t (mCapacity);
+        const std::int64_t slot = index % capacity;
+        return size_t (slot < 0 ? slot + capacity : slot);
+    }
+
+    const SkyTimeline::Sample* SkyTimeline::findSample (std::int64_t index) const
+    {
+        if (mSamples.empty ()) {
+            return 0;
+        }
+        const Sample &sample = mSamples[getSlot (index)];
+        return sample.index == index ? &sample : 0;
+    }
+
+    bool SkyTimeline::findMissing (std::int64_t &index)
+    {
+        // The pair around the cursor first.
+        for (std::int64_t i = mCursor; i <= mCursor + 1; ++i) {
+            if (!findSample (i)) {
+                index = i;
+                return true;
+            }
+        }
+
+        // Then grow the run of samples around it, ahead first. Samples
+        // found on the way are skipped once, so a shifted window only
+        // costs its new end. The window is one shorter than the ring, so
+        // storing a sample never evicts another in it.
+        const std::int64_t behind = std::int64_t (mCapacity / 4);
+        const std::int64_t ahead = std::int64_t (mCapacity) - behind - 2;
+        const std::int64_t low = mDirection > 0 ? mCursor - behind : mCursor + 1 - ahead;
+        const std::int64_t high = mDirection > 0 ? mCursor + ahead : mCursor + 1 + behind;
+        if (mFilledLow > mCursor || mFilledHigh < mCursor + 1) {
+            mFilledLow = mCursor;
+            mFilledHigh = mCursor + 1;
+        }
+        mFilledLow = std::max (mFilledLow, low);
+        mFilledHigh = std::min (mFilledHigh, high);
+
+        for (int pass = 0; pass < 2; ++pass) {
+            if ((mDirection > 0) == (pass == 0)) {
+                for (; mFilledHigh < high; ++mFilledHigh) {
+                    if (!findSample (mFilledHigh + 1)) {
+                        index = mFilledHigh + 1;
+                        return true;
+                    }
+                }
+            } else {
+                for (; mFilledLow > low; --mFilledLow) {
+                    if (!findSample (mFilledLow - 1)) {
+                        index = mFilledLow - 1;
+                        return true;
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    bool SkyTimeline::needsRefill () const
+    {
+        if (mFilledLow > mCursor || mFilledHigh < mCursor + 1) {
+            return true;
+        }
+        const std::int64_t behind = std::int64_t (mCapacity / 4);
+        const std::int64_t ahead = std::int64_t (mCapacity) - behind - 2;
+        const std::int64_t left = mDirection > 0 ? mFilledHigh - (mCursor + 1) : mCursor - mFilledLow;
+        return left < ahead / 2;
+    }
+
+    bool SkyTimeline::evaluate (LongReal julianDay, LongReal longitude, LongReal latitude,
+            const SkyStateConfig &config, SkyState &state)
+    {
+        std::unique_lock<std::mutex> lock (mMutex);
+        if (!mHaveSource || longitude != mLongitude || latitude != mLatitude || config != mConfig) {
+            dropSamples (lock);
+            mHaveSource = true;
+            mLongitude = longitude;
+            mLatitude = latitude;
+            mConfig = config;
+        }
+
+        const std::int64_t cursor = getIndex (julianDay);
+        if (cursor != mCursor) {
+            mDirection = cursor > mCursor ? 1 : -1;
+            mCursor = cursor;
+            if (mWindowFilled && needsRefill ()) {
+                mWindowFilled = false;
+            }
+        }
+        if (!mWindowFilled) {
+            mWork.notify_one ();
+        }
+
+        const Sample *from = findSample (cursor);
+        const Sample *to = findSample (cursor + 1);
+        if (from && to) {
+            ++mHitCount;
+            const LongReal alpha = julianDay * SECONDS_PER_DAY / mSpacing - LongReal (cursor);
+            KeyframedSky::interpolate (from->state, to->state, alpha, state);
+            state.julianDay = julianDay;
+            return true;
+        }
+        ++mMissCount;
+        lock.unlock ();
+
+        // The caller's config is good on the caller's thread.
+        state = SkyStateEvaluator::evaluate (julianDay, longitude, latitude, config);
+        return false;
+    }
+
+    bool SkyTimeline::isCached (LongReal julianDay) const
+    {
+        std::lock_guard<std::mutex> lock (mMutex);
+        const std::int64_t index = getIndex (julianDay);
+        return findSample (index) && findSample (index + 1);
+    }
+
+    size_t SkyTimeline::getCachedCount () const
+    {
+        std::lock_guard<std::mutex> lock (mMutex);
+        size_t count = 0;
+        for (size_t i = 0; i < mSamples.size (); ++i) {
+            count += mSamples[i].index != NO_SAMPLE;
+        }
+        return count;
+    }
+
+    void SkyTimeline::waitForWindow ()
+    {
+        std::unique_lock<std::mutex> lock (mMutex);
+        while (mHaveSource && !mWindowFilled) {
+            mIdle.wait (lock);
+        }
+    }
+
+    void SkyTimeline::workerLoop ()
+    {
+        std::unique_lock<std::mutex> lock (mMutex);
+        for (;;) {
+            std::int64_t index = 0;
+            while (!mStopping && (mWindowFilled || !mHaveSource)) {
+                mWork.wait (lock);
+            }
+            if (mStopping) {
+                return;
+            }
+            if (!findMissing (index)) {
+                mWindowFilled = true;
+                mIdle.notify_all ();
+                continue;
+            }
+
+            // Compute unlocked; the config stays alive while mComputing is set.
+            const unsigned long generation = mGeneration;
+            const LongReal longitude = mLongitude, latitude = mLatitude;
+            const SkyStateConfig config = mConfig;
+            const LongReal julianDay = LongReal (index) * mSpacing / SECONDS_PER_DAY;
+            mComputing = true;
+            lock.unlock ();
+            SkyState state = SkyStateEvaluator::evaluate (julianDay, longitude, latitude, config);
+            lock.lock ();
+            mComputing = false;
+            mIdle.notify_all ();
+
+            if (generation != mGeneration) {
+                continue;
+            }
+            if (mSamples.empty ()) {
+                Sample empty;
+                empty.index = NO_SAMPLE;
+                mSamples.assign (mCapacity, empty);
+            }
+            Sample &sample = mSamples[getSlot (index)];
+            sample.index = index;
+            sample.state = state;
+            ++mComputedCount;
+        }
+    }
+}
@@ -0,0 +1,274 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#include "CaelumCorePrerequisites.h"
+#include "TaskGraph.h"
+
+namespace Caelum
+{
+    TaskExecutor::~TaskExecutor ()
+    {
+    }
+
+    ThreadPoolExecutor::ThreadPoolExecutor (unsigned threadCount):
+            mStopping (false)
+    {
+        if (threadCount == 0) {
+            threadCount = std::max (2u, std::thread::hardware_concurrency ()) - 1;
+        }
+        for (unsigned i = 0; i < threadCount; ++i) {
+            mThreads.push_back (std::thread (&ThreadPoolExecutor::workerLoop, this));
+        }
+    }
+
+    ThreadPoolExecutor::~ThreadPoolExecutor ()
+    {
+        {
+            std::lock_guard<std::mutex> lock (mMutex);
+            mStopping = true;
+        }
+        mCondition.notify_all ();
+        for (size_t i = 0; i < mThreads.size (); ++i) {
+            mThreads[i].join ();
+        }
+    }
+
+    void ThreadPoolExecutor::submit (const std::function<void ()> &task)
+    {
+        {
+            std::lock_guard<std::mutex> lock (mMutex);
+            mQueue.push_back (task);
+        }
+        mCondition.notify_one ();
+    }
+
+    void ThreadPoolExecutor::workerLoop ()
+    {
+        std::unique_lock<std::mutex> lock (mMutex);
+        for (;;) {
+            // Drain the queue before stopping, so every task runs.
+            while (mQueue.empty () && !mStopping) {
+                mCondition.wait (lock);
+            }
+            if (mQueue.empty ()) {
+                return;
+            }
+            std::function<void ()> task;
+            task.swap (mQueue.front ());
+            mQueue.pop_front ();
+            lock.unlock ();
+            task ();
+            lock.lock ();
+        }
+    }
+
+    TaskGraph::TaskGraph ():
+            mFinishedCount (0),
+            mRunDuration (0)
+    {
+    }
+
+    void TaskGraph::clear ()
+    {
+        mTasks.clear ();
+        mRunDuration = 0;
+    }
+
+    TaskGraph::TaskId TaskGraph::addTask (const std::string &name, const std::function<void ()> &work,
+            Affinity affinity)
+    {
+        Task task;
+        task.name = name;
+        task.work = work;
+        task.affinity = affinity;
+        task.pending = 0;
+        task.timing.start = task.timing.finish = 0;
+        mTasks.push_back (task);
+        return mTasks.size () - 1;
+    }
+
+    void TaskGraph::addDependency (TaskId task, TaskId dependsOn)
+    {
+        assert (dependsOn < task && task < mTasks.size ());
+        mTasks[task].dependencies.push_back (dependsOn);
+        mTasks[dependsOn].dependents.push_back (task);
+    }
+
+    void TaskGraph::run (TaskExecutor *executor)
+    {
+        mRunStart = Clock::now ();
+        mException = std::exception_ptr ();
+
+        if (!executor) {
+            // Dependencies always come first, so this order is fine.
+            for (TaskId task = 0; task < mTasks.size (); ++task) {
+                execute (task);
+            }
+        } else {
+            std::vector<TaskId> ready;
+            std::unique_lock<std::mutex> lock (mMutex);
+            mFinishedCount = 0;
+            mCallingQueue.clear ();
+            for (TaskId task = 0; task < mTasks.size (); ++task) {
+                mTasks[task].pending = mTasks[task].dependencies.size ();
+            }
+            for (TaskId task = 0; task < mTasks.size (); ++task) {
+                if (mTasks[task].pending > 0) {
+                    continue;
+                }
+                if (mTasks[task].affinity == CALLING_THREAD) {
+                    mCallingQueue.push_back (task);
+                } else {
+                    ready.push_back (task);
+                }
+            }
+
+            while (mFinishedCount < mTasks.size ()) {
+                if (!ready.empty ()) {
+                    lock.unlock ();
+                    submit (executor, ready);
+                    ready.clear ();
+                    lock.lock ();
+                } else if (!mCallingQueue.empty ()) {
+                    TaskId task = mCallingQueue.front ();
+                    mCallingQueue.pop_front ();
+                    lock.unlock ();
+                    execute (task);
+                    lock.lock ();
+                    release (task, ready);
+                } else {
+                    mCondition.wait (lock);
+                }
+            }
+        }
+
+        mRunDuration = std::chrono::duration<double> (Clock::now () - mRunStart).count ();
+        if (mException) {
+            std::exception_ptr exception = mException;
+            mException = std::exception_ptr ();
+            std::rethrow_exception (exception);
+        }
+    }
+
+    void TaskGraph::execute (TaskId task)
+    {
+        Task &t = mTasks[task];
+        Clock::time_point start = Clock::now ();
+        try {
+            t.work ();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock (mMutex);
+            if (!mException) {
+                mException = std::current_exception ();
+            }
+        }
+        t.timing.start = std::chrono::duration<double> (start - mRunStart).count ();
+        t.timing.finish = std::chrono::duration<double> (Clock::now () - mRunStart).count ();
+    }
+
+    void TaskGraph::release (TaskId task, std::vector<TaskId> &submit)
+    {
+        ++mFinishedCount;
+        const std::vector<TaskId> &dependents = mTasks[task].dependents;
+        for (size_t i = 0; i < dependents.size (); ++i) {
+            Task &dependent = mTasks[dependents[i]];
+            if (--dependent.pending > 0) {
+                continue;
+            }
+            if (dependent.affinity == CALLING_THREAD) {
+                mCallingQueue.push_back (dependents[i]);
+            } else {
+                submit.push_back (dependents[i]);
+            }
+        }
+    }
+
+    void TaskGraph::submit (TaskExecutor *executor, const std::vector<TaskId> &tasks)
+    {
+        for (size_t i = 0; i < tasks.size (); ++i) {
+            const TaskId task = tasks[i];
+            executor->submit ([this, executor, task] () {
+                execute (task);
+                std::vector<TaskId> ready;
+                {
+                    std::lock_guard<std::mutex> lock (mMutex);
+                    release (task, ready);
+                    // The calling thread may be waiting for this task, or for ones it released.
+                    mCondition.notify_one ();
+                }
+                // Nothing released means this may have been the last task; the graph can be gone.
+                if (!ready.empty ()) {
+                    submit (executor, ready);
+                }
+            });
+        }
+    }
+
+    std::vector<TaskGraph::TaskId> TaskGraph::getCriticalPath () const
+    {
+        // Dependencies come first, so one pass finds the longest chain ending at each task.
+        const size_t count = mTasks.size ();
+        std::vector<double> length (count);
+        std::vector<size_t> previous (count, count);
+        size_t last = count;
+        for (TaskId task = 0; task < count; ++task) {
+            const Task &t = mTasks[task];
+            double before = 0;
+            for (size_t i = 0; i < t.dependencies.size (); ++i) {
+                const TaskId dependency = t.dependencies[i];
+                if (previous[task] == count || length[dependency] > before) {
+                    before = length[dependency];
+                    previous[task] = dependency;
+                }
+            }
+            length[task] = before + t.timing.getDuration ();
+            if (last == count || length[task] > length[last]) {
+                last = task;
+            }
+        }
+
+        std::vector<TaskId> path;
+        for (size_t task = last; task != count; task = previous[task]) {
+            path.push_back (task);
+        }
+        std::reverse (path.begin (), path.end ());
+        return path;
+    }
+
+    double TaskGraph::getCriticalPathDuration () const
+    {
+        std::vector<TaskId> path = getCriticalPath ();
+        double duration = 0;
+        for (size_t i = 0; i < path.size (); ++i) {
+            duration += mTasks[path[i]].timing.getDuration ();
+        }
+        return duration;
+    }
+
+    void TaskGraph::dumpTimings (std::ostream &out) const
+    {
+        std::vector<TaskId> path = getCriticalPath ();
+        std::vector<bool> critical (mTasks.size (), false);
+        for (size_t i = 0; i < path.size (); ++i) {
+            critical[path[i]] = true;
+        }
+
+        std::ios::fmtflags flags = out.flags ();
+        std::streamsize precision = out.precision ();
+        out.setf (std::ios::fixed);
+        out.precision (3);
+        out << "Task graph: " << mTasks.size () << " tasks, "
+            << mRunDuration * 1000 << " ms run, "
+            << getCriticalPathDuration () * 1000 << " ms critical path" << std::endl;
+        for (TaskId task = 0; task < mTasks.size (); ++task) {
+            const Task &t = mTasks[task];
+            out << (critical[task] ? " * " : "   ") << t.name
+                << (t.affinity == CALLING_THREAD ? " (calling thread)" : "")
+                << ": " << t.timing.start * 1000 << " - " << t.timing.finish * 1000
+                << " ms, " << t.timing.getDuration () * 1000 << " ms" << std::endl;
+        }
+        out.flags (flags);
+        out.precision (precision);
+    }
+}
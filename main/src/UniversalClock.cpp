@@ -5,55 +5,97 @@
 #include "CaelumPrecompiled.h"
 #include "UniversalClock.h"
 #include "Astronomy.h"
+#include "SkyFrameEvaluator.h"
 
 namespace Caelum
 {
     const Caelum::LongReal UniversalClock::SECONDS_PER_DAY = 86400.0;
+    const std::int64_t UniversalClock::NANOSECONDS_PER_DAY;
 
-    UniversalClock::UniversalClock () {
+    UniversalClock::UniversalClock ():
+            mTickLength (0),
+            mTickAdvance (0),
+            mAccumulator (0),
+            mPreviousTickDay (0),
+            mPreviousTickNanosecond (0)
+    {
         setJulianDay (Astronomy::J2000);        
 	    setTimeScale (1.0);
     }
 
+    void UniversalClock::setTime (std::int64_t day, std::int64_t nanosecond)
+    {
+        // Floored division without branches; the shift is all ones for a negative remainder.
+        std::int64_t carry = nanosecond / NANOSECONDS_PER_DAY;
+        std::int64_t rest = nanosecond % NANOSECONDS_PER_DAY;
+        std::int64_t negative = rest >> 63;
+        mDay = day + carry + negative;
+        mNanosecond = rest + (NANOSECONDS_PER_DAY & negative);
+    }
+
     void UniversalClock::setJulianDay (Caelum::LongReal value) {
-        mJulianDayBase = value;
-        mCurrentTime = 0;
-        mLastUpdateTime = 0;
+        LongReal day = std::floor (value);
+        setJulianDay (std::int64_t (day), std::llround ((value - day) * LongReal (NANOSECONDS_PER_DAY)));
+    }
+
+    void UniversalClock::setJulianDay (std::int64_t day, std::int64_t nanosecond) {
+        setTime (day, nanosecond);
+        mLastUpdateDifference = 0;
+        mAccumulator = 0;
+        mPreviousTickDay = mDay;
+        mPreviousTickNanosecond = mNanosecond;
     }
 
     void UniversalClock::setGregorianDateTime(
             int year, int month, int day,
             int hour, int minute, double second)
     {
-        ScopedHighPrecissionFloatSwitch precissionSwitch;
-        setJulianDay(Astronomy::getJulianDayFromGregorianDateTime(year, month, day, hour, minute, second));
+        // The julian day number starts at noon.
+        std::int64_t seconds = (hour - 12) * 3600 + minute * 60;
+        setJulianDay (Astronomy::getJulianDayFromGregorianDate (year, month, day),
+                seconds * 1000000000LL + std::llround (second * 1e9));
     }
 
     LongReal UniversalClock::getJulianDay () const
     {
-        ScopedHighPrecissionFloatSwitch precissionSwitch;
-        Caelum::LongReal res = mJulianDayBase + mCurrentTime / SECONDS_PER_DAY;
-        return res;
+        return LongReal (mDay) + LongReal (mNanosecond) / LongReal (NANOSECONDS_PER_DAY);
+    }
+
+    LongReal UniversalClock::getPreviousTickJulianDay () const
+    {
+        return LongReal (mPreviousTickDay) + LongReal (mPreviousTickNanosecond) / LongReal (NANOSECONDS_PER_DAY);
+    }
+
+    SkyClockTime UniversalClock::getSkyClockTime () const
+    {
+        SkyClockTime time;
+        time.day = mDay;
+        time.nanosecond = mNanosecond;
+        time.previousDay = mPreviousTickDay;
+        time.previousNanosecond = mPreviousTickNanosecond;
+        time.julianDay = getJulianDay ();
+        time.previousTickJulianDay = getPreviousTickJulianDay ();
+        time.renderJulianDay = getRenderJulianDay ();
+        time.renderAlpha = getRenderAlpha ();
+        time.ticking = mTickLength != 0;
+        return time;
     }
 
     LongReal UniversalClock::getJulianDayDifference () const {
-        ScopedHighPrecissionFloatSwitch precissionSwitch;
-        return (mCurrentTime - mLastUpdateTime) / SECONDS_PER_DAY;
+        return LongReal (mLastUpdateDifference) / LongReal (NANOSECONDS_PER_DAY);
     }
 
     LongReal UniversalClock::getJulianSecond () const {
-        ScopedHighPrecissionFloatSwitch precissionSwitch;
-        LongReal res = mJulianDayBase * SECONDS_PER_DAY + mCurrentTime;
-        return res;
+        return LongReal (mDay) * SECONDS_PER_DAY + LongReal (mNanosecond) * 1e-9;
     }
 
     LongReal UniversalClock::getJulianSecondDifference () const {
-        ScopedHighPrecissionFloatSwitch precissionSwitch;
-        return mCurrentTime - mLastUpdateTime;
+        return LongReal (mLastUpdateDifference) * 1e-9;
     }
 
     void UniversalClock::setTimeScale (const Ogre::Real scale) {
 	    mTimeScale = scale;
+        mTickAdvance = std::llround (LongReal (mTickLength) * mTimeScale);
     }
 
     Ogre::Real UniversalClock::getTimeScale () const {
@@ -61,8 +103,66 @@ namespace Caelum
     }
 
     void UniversalClock::update (const Ogre::Real time) {
-        mLastUpdateTime = mCurrentTime;
-        mCurrentTime += time * mTimeScale;
+        if (mTickLength == 0) {
+            advance (std::llround (LongReal (time) * mTimeScale * 1e9));
+            return;
+        }
+
+        // Only whole ticks reach the clock; the time scale is already in mTickAdvance.
+        mAccumulator += std::llround (LongReal (time) * 1e9);
+        std::int64_t ticks = mAccumulator / mTickLength;
+        mAccumulator -= ticks * mTickLength;
+        if (mAccumulator < 0) {
+            --ticks;
+            mAccumulator += mTickLength;
+        }
+        stepTicks (ticks);
+    }
+
+    void UniversalClock::setTickLength (std::int64_t nanoseconds) {
+        assert (nanoseconds >= 0);
+        mTickLength = nanoseconds;
+        mTickAdvance = std::llround (LongReal (mTickLength) * mTimeScale);
+        mAccumulator = 0;
+        mPreviousTickDay = mDay;
+        mPreviousTickNanosecond = mNanosecond;
+    }
+
+    void UniversalClock::stepTicks (std::int64_t count) {
+        if (count == 0) {
+            mLastUpdateDifference = 0;
+            return;
+        }
+
+        // All but the last tick, then remember where the last one started.
+        advance ((count > 0 ? count - 1 : count + 1) * mTickAdvance);
+        const std::int64_t day = mDay, nanosecond = mNanosecond;
+        advance (count > 0 ? mTickAdvance : -mTickAdvance);
+        mPreviousTickDay = day;
+        mPreviousTickNanosecond = nanosecond;
+        mLastUpdateDifference = count * mTickAdvance;
     }
-}
 
+    Ogre::Real UniversalClock::getRenderAlpha () const {
+        if (mTickLength == 0) {
+            return 0;
+        }
+        return Ogre::Real (LongReal (mAccumulator) / LongReal (mTickLength));
+    }
+
+    LongReal UniversalClock::getRenderJulianDay () const {
+        if (mTickLength == 0) {
+            return getJulianDay ();
+        }
+        std::int64_t span = (mDay - mPreviousTickDay) * NANOSECONDS_PER_DAY + (mNanosecond - mPreviousTickNanosecond);
+        LongReal behind = LongReal (mTickLength - mAccumulator) / LongReal (mTickLength) * LongReal (span);
+        return LongReal (mDay) + (LongReal (mNanosecond) - behind) / LongReal (NANOSECONDS_PER_DAY);
+    }
+
+    void UniversalClock::advance (std::int64_t nanoseconds) {
+        setTime (mDay, mNanosecond + nanoseconds);
+        mLastUpdateDifference = nanoseconds;
+        mPreviousTickDay = mDay;
+        mPreviousTickNanosecond = mNanosecond;
+    }
+}
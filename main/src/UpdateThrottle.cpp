@@ -0,0 +1,72 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#include "CaelumPrecompiled.h"
+#include "UpdateThrottle.h"
+
+namespace Caelum
+{
+    const size_t UpdateThrottle::MAX_INPUTS;
+
+    UpdateThrottle::UpdateThrottle ():
+            mPolicy (UPDATE_EVERY_FRAME),
+            mInterval (0.1),
+            mEpsilon (1e-4),
+            mElapsed (0),
+            mValid (false),
+            mInputCount (0),
+            mUpdateCount (0),
+            mSkipCount (0)
+    {
+    }
+
+    bool UpdateThrottle::shouldUpdate (Ogre::Real timeSinceLastFrame,
+            const LongReal *inputs, size_t count, bool force)
+    {
+        assert (count <= MAX_INPUTS);
+        mElapsed += timeSinceLastFrame;
+
+        bool update = force || !mValid || count != mInputCount;
+        if (!update) {
+            switch (mPolicy) {
+                case UPDATE_EVERY_FRAME:
+                    update = true;
+                    break;
+
+                case UPDATE_INTERVAL:
+                    update = mElapsed >= mInterval;
+                    break;
+
+                case UPDATE_ON_CHANGE:
+                    for (size_t i = 0; i < count && !update; ++i) {
+                        update = std::abs (inputs[i] - mInputs[i]) > mEpsilon;
+                    }
+                    break;
+            }
+        }
+
+        if (!update) {
+            ++mSkipCount;
+            return false;
+        }
+
+        ++mUpdateCount;
+        mElapsed = 0;
+        mValid = true;
+        mInputCount = count;
+        std::copy (inputs, inputs + count, mInputs);
+        return true;
+    }
+
+    void UpdateThrottle::invalidate ()
+    {
+        mValid = false;
+    }
+
+    void UpdateThrottle::resetCounters ()
+    {
+        mUpdateCount = 0;
+        mSkipCount = 0;
+    }
+}
@@ -0,0 +1,1004 @@
+// This file is part of the Caelum project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "CaelumCore.h"
+
+using namespace Caelum;
+
+namespace
+{
+    const LongReal RAD_TO_DEG = 57.295779513082320877;
+
+    /// Sample times spread over a century, so every term goes through many periods.
+    std::vector<LongReal> makeSampleTimes (size_t count)
+    {
+        std::vector<LongReal> jday (count);
+        for (size_t i = 0; i < count; ++i) {
+            jday[i] = 2433282.5 + 36525.0 * LongReal (i) / count;
+        }
+        return jday;
+    }
+
+    /// Angle between two ecliptic directions, in arc seconds.
+    LongReal separationArcSec (LongReal lon1, LongReal lat1, LongReal lon2, LongReal lat2)
+    {
+        LongReal x1 = std::cos (lat1) * std::cos (lon1), y1 = std::cos (lat1) * std::sin (lon1), z1 = std::sin (lat1);
+        LongReal x2 = std::cos (lat2) * std::cos (lon2), y2 = std::cos (lat2) * std::sin (lon2), z2 = std::sin (lat2);
+        LongReal cx = y1 * z2 - z1 * y2, cy = z1 * x2 - x1 * z2, cz = x1 * y2 - y1 * x2;
+        return std::atan2 (std::sqrt (cx * cx + cy * cy + cz * cz), x1 * x2 + y1 * y2 + z1 * z2) * RAD_TO_DEG * 3600;
+    }
+
+    /// Keeps timed results alive.
+    volatile LongReal benchSink;
+
+    /** How much slower than its baseline a routine may get before it fails.
+     *  Set with --throughput-ratio; raise it for noisy CI machines.
+     */
+    double throughputRatio = 3;
+
+    /** If timings decide the exit code; off with --no-timing-gate.
+     *  Baselines are for optimised builds, so unoptimised ones never gate.
+     */
+#if defined (__GNUC__) && !defined (__OPTIMIZE__)
+    bool timingGate = false;
+#else
+    bool timingGate = true;
+#endif
+
+    /// Time of one calibration step in ns, from measureCalibration.
+    double calibrationNs = 1;
+
+    /** Time a fixed dependent chain of the sines, square roots and
+     *  multiply-adds the astronomy routines are made of.
+     *  Timings are gated in multiples of this, so a slower or faster
+     *  machine moves the routines and the baselines alike.
+     */
+    void measureCalibration ()
+    {
+        const int steps = 2000000;
+        double best = 1e30;
+        LongReal x = 0.5;
+        for (int run = 0; run < 5; ++run) {
+            auto start = std::chrono::steady_clock::now ();
+            for (int i = 0; i < steps; ++i) {
+                x = std::sin (x * 1.0001 + 0.3) + std::sqrt (x * x + 1) * 0.25;
+            }
+            auto end = std::chrono::steady_clock::now ();
+            best = std::min (best, std::chrono::duration<double, std::nano> (end - start).count () / steps);
+        }
+        benchSink = x;
+        calibrationNs = best;
+        std::printf ("Calibration: %.2f ns per step%s\n", calibrationNs,
+                timingGate ? "" : "; timings are not gated");
+    }
+
+    template <LunarTheoryPrecision P>
+    void benchLunarTier (const char *name, const std::vector<LongReal> &jday)
+    {
+        const size_t count = jday.size ();
+        std::vector<LongReal> lon (count), lat (count);
+
+        // Best of a few runs, to hide scheduling noise.
+        double best = 1e30;
+        for (int run = 0; run < 5; ++run) {
+            auto start = std::chrono::steady_clock::now ();
+            for (size_t i = 0; i < count; ++i) {
+                LunarTheory::getEclipticPositionRad<P> (jday[i], lon[i], lat[i]);
+            }
+            auto end = std::chrono::steady_clock::now ();
+            best = std::min (best, std::chrono::duration<double, std::nano> (end - start).count () / count);
+        }
+
+        // Error against the most precise tier.
+        LongReal maxError = 0, sumSquares = 0;
+        for (size_t i = 0; i < count; ++i) {
+            LongReal refLon, refLat;
+            LunarTheory::getEclipticPositionRad<LUNAR_THEORY_PLANETARIUM> (jday[i], refLon, refLat);
+            LongReal error = separationArcSec (lon[i], lat[i], refLon, refLat);
+            maxError = std::max (maxError, error);
+            sumSquares += error * error;
+        }
+
+        std::printf ("%-12s %10.1f %14.1f %14.1f\n", name, best,
+                std::sqrt (sumSquares / count), maxError);
+    }
+
+    void benchLunarTheory ()
+    {
+        std::printf ("Lunar theory, ns per evaluation and arc second error against the planetarium tier\n");
+        std::printf ("%-12s %10s %14s %14s\n", "tier", "ns", "rms error", "max error");
+        std::vector<LongReal> jday = makeSampleTimes (200000);
+        benchLunarTier<LUNAR_THEORY_GAME> ("game", jday);
+        benchLunarTier<LUNAR_THEORY_CLASSIC> ("classic", jday);
+        benchLunarTier<LUNAR_THEORY_PLANETARIUM> ("planetarium", jday);
+
+        // The reference itself, against Meeus example 47.a.
+        LongReal lon, lat;
+        LunarTheory::getEclipticPositionRad<LUNAR_THEORY_PLANETARIUM> (2448724.5, lon, lat);
+        std::printf ("planetarium tier error on Meeus example 47.a: %.3f arc seconds\n",
+                separationArcSec (lon, lat, 133.162655 / RAD_TO_DEG, -3.229126 / RAD_TO_DEG));
+    }
+
+    template <class Policy>
+    void benchScalarPolicy (const char *name, const std::vector<LongReal> &jday)
+    {
+        typedef BasicAstronomy<Policy> AstronomyT;
+        typedef typename AstronomyT::Scalar Scalar;
+        const size_t count = jday.size ();
+        std::vector<Scalar> azimuth (count), altitude (count);
+
+        double best = 1e30;
+        for (int run = 0; run < 5; ++run) {
+            auto start = std::chrono::steady_clock::now ();
+            for (size_t i = 0; i < count; ++i) {
+                AstronomyT::getHorizontalSunPosition (jday[i], Scalar (15), Scalar (60), azimuth[i], altitude[i]);
+            }
+            auto end = std::chrono::steady_clock::now ();
+            best = std::min (best, std::chrono::duration<double, std::nano> (end - start).count () / count);
+        }
+
+        LongReal maxError = 0;
+        for (size_t i = 0; i < count; ++i) {
+            LongReal az, alt;
+            Astronomy::getHorizontalSunPosition (jday[i], 15, 60, az, alt);
+            LongReal azError = std::remainder (LongReal (azimuth[i]) - az, LongReal (360)) * std::cos (alt / RAD_TO_DEG);
+            maxError = std::max (maxError, std::max (std::fabs (azError), std::fabs (LongReal (altitude[i]) - alt)));
+        }
+
+        std::printf ("%-12s %10.1f %14.1f\n", name, best, maxError * 3600);
+    }
+
+    void benchScalarPolicies ()
+    {
+        std::printf ("Sun position, ns per evaluation and max arc second error against Astronomy\n");
+        std::printf ("%-12s %10s %14s\n", "policy", "ns", "max error");
+        std::vector<LongReal> jday = makeSampleTimes (200000);
+        benchScalarPolicy<FastFloatAstronomyPolicy> ("fast float", jday);
+        benchScalarPolicy<FloatAstronomyPolicy> ("float", jday);
+        benchScalarPolicy<BatchDoubleAstronomyPolicy> ("batch double", jday);
+        benchScalarPolicy<DoubleAstronomyPolicy> ("double", jday);
+        benchScalarPolicy<LongDoubleAstronomyPolicy> ("long double", jday);
+    }
+
+    /// Horizontal angles to a direction, like CaelumSystem::makeDirection.
+    template <class AstronomyT>
+    void makeDirection (typename AstronomyT::Scalar azimuth, typename AstronomyT::Scalar altitude,
+            typename AstronomyT::HorizontalVector &result)
+    {
+        result.north = AstronomyT::cosDeg (azimuth) * AstronomyT::cosDeg (altitude);
+        result.east = AstronomyT::sinDeg (azimuth) * AstronomyT::cosDeg (altitude);
+        result.up = AstronomyT::sinDeg (altitude);
+    }
+
+    template <class Policy>
+    void benchFusedSky (const char *name, const std::vector<LongReal> &jday)
+    {
+        typedef BasicAstronomy<Policy> AstronomyT;
+        typedef typename AstronomyT::Scalar Scalar;
+        const size_t count = jday.size ();
+        const Scalar longitude = 15, latitude = 60;
+        std::vector<typename AstronomyT::SkyEvaluation> sky (count);
+
+        // Four separate calls per frame, as updateSubcomponents used to do.
+        double separate = 1e30;
+        for (int run = 0; run < 5; ++run) {
+            auto start = std::chrono::steady_clock::now ();
+            for (size_t i = 0; i < count; ++i) {
+                typename Policy::PrecissionSwitch precissionSwitch;
+                Scalar az, alt;
+                AstronomyT::getHorizontalSunPosition (jday[i], longitude, latitude, az, alt);
+                makeDirection<AstronomyT> (az, alt, sky[i].sun);
+                AstronomyT::getHorizontalMoonPosition (jday[i], longitude, latitude, az, alt);
+                makeDirection<AstronomyT> (az, alt, sky[i].moon);
+                AstronomyT::getHorizontalNorthEclipticPolePosition (jday[i], longitude, latitude, az, alt);
+                makeDirection<AstronomyT> (az, alt, sky[i].eclipticNorthPole);
+                LongReal T = (jday[i] - 2449143.3552943347L) / 29.53058867L;
+                sky[i].moonPhase = Scalar (T - std::floor (T));
+            }
+            auto end = std::chrono::steady_clock::now ();
+            separate = std::min (separate, std::chrono::duration<double, std::nano> (end - start).count () / count);
+        }
+
+        double fused = 1e30;
+        BasicObserver<Policy> observer (longitude, latitude, jday[0]);
+        for (int run = 0; run < 5; ++run) {
+            auto start = std::chrono::steady_clock::now ();
+            for (size_t i = 0; i < count; ++i) {
+                observer.setJulianDay (jday[i]);
+                AstronomyT::evaluateSky (observer, sky[i]);
+            }
+            auto end = std::chrono::steady_clock::now ();
+            fused = std::min (fused, std::chrono::duration<double, std::nano> (end - start).count () / count);
+        }
+
+        std::printf ("%-12s %10.1f %10.1f %8.2fx\n", name, separate, fused, separate / fused);
+    }
+
+    void benchFusedSkies ()
+    {
+        std::printf ("Sky per frame (sun, moon, phase, ecliptic pole), ns per frame\n");
+        std::printf ("%-12s %10s %10s %9s\n", "policy", "separate", "fused", "speedup");
+        std::vector<LongReal> jday = makeSampleTimes (200000);
+        benchFusedSky<FastFloatAstronomyPolicy> ("fast float", jday);
+        benchFusedSky<DoubleAstronomyPolicy> ("double", jday);
+    }
+
+    /** Keyframed against exact sky states for 10 minutes at 60 frames a second.
+     *  Errors are measured in a second pass, at the middle of every keyframe
+     *  interval, so tracking them does not count against the time.
+     */
+    void benchKeyframedSky (LongReal timeScale, LongReal interval, LongReal maxAngleDeg)
+    {
+        // Fog and light colours that change through the day.
+        const float pixels[] = {
+                0.1f, 0.1f, 0.3f, 0.0f,  0.9f, 0.4f, 0.2f, 0.5f,  0.6f, 0.8f, 1.0f, 1.0f,
+                0.0f, 0.0f, 0.1f, 0.0f,  1.0f, 0.6f, 0.3f, 0.2f,  1.0f, 1.0f, 1.0f, 0.1f };
+        ColourGradient gradient (3, 2, pixels);
+        SkyStateConfig config;
+        config.skyGradients = &gradient;
+        config.sunColours = &gradient;
+        const LongReal start = Astronomy::J2000 + 0.2, longitude = 15, latitude = 60;
+        const size_t frames = 60 * 600;
+        const LongReal step = timeScale / 60 / 86400;
+        SkyState state;
+
+        double exact = 1e30;
+        for (int run = 0; run < 3; ++run) {
+            auto begin = std::chrono::steady_clock::now ();
+            for (size_t i = 0; i < frames; ++i) {
+                state = SkyStateEvaluator::evaluate (start + step * i, longitude, latitude, config);
+            }
+            auto end = std::chrono::steady_clock::now ();
+            exact = std::min (exact, std::chrono::duration<double, std::nano> (end - begin).count () / frames);
+        }
+
+        double keyframed = 1e30;
+        unsigned long exactCount = 0;
+        for (int run = 0; run < 3; ++run) {
+            KeyframedSky keyframes;
+            keyframes.setInterval (interval);
+            keyframes.setMaxAngle (maxAngleDeg / RAD_TO_DEG);
+            auto begin = std::chrono::steady_clock::now ();
+            for (size_t i = 0; i < frames; ++i) {
+                keyframes.evaluate (start + step * i, longitude, latitude, config, state);
+            }
+            auto end = std::chrono::steady_clock::now ();
+            keyframed = std::min (keyframed, std::chrono::duration<double, std::nano> (end - begin).count () / frames);
+            exactCount = keyframes.getExactCount ();
+        }
+
+        KeyframedSky keyframes;
+        keyframes.setInterval (interval);
+        keyframes.setMaxAngle (maxAngleDeg / RAD_TO_DEG);
+        keyframes.setErrorTracking (true);
+        for (size_t i = 0; i < frames; ++i) {
+            keyframes.evaluate (start + step * i, longitude, latitude, config, state);
+        }
+
+        std::printf ("%6.0f %8.0f %8.2f %10.1f %10.1f %8.1fx %8.2f %10.4f %10.6f\n",
+                timeScale, interval, maxAngleDeg, exact, keyframed, exact / keyframed,
+                100.0 * exactCount / frames, keyframes.getMaxDirectionError () * RAD_TO_DEG * 3600,
+                keyframes.getMaxColourError ());
+    }
+
+    void benchKeyframedSkies ()
+    {
+        std::printf ("Keyframed sky state, ns per frame at 60 fps; error in arc seconds and colour units\n");
+        std::printf ("%6s %8s %8s %10s %10s %9s %8s %10s %10s\n",
+                "scale", "interval", "max deg", "exact", "keyframed", "speedup", "% exact", "direction", "colour");
+        benchKeyframedSky (1, 60, 0.25);
+        benchKeyframedSky (1, 600, 0);
+        benchKeyframedSky (60, 60, 0.25);
+        benchKeyframedSky (600, 60, 0.25);
+        benchKeyframedSky (6000, 60, 0.25);
+    }
+
+    /** Time-lapse frames read from a SkyTimeline against exact states.
+     *  Only the frame's own call is timed; the worker catches up in
+     *  between, like it would during the rest of a real frame.
+     */
+    void benchSkyTimeline (LongReal timeScale)
+    {
+        SkyStateConfig config;
+        const LongReal start = Astronomy::J2000 + 0.2, longitude = 15, latitude = 60;
+        const size_t frames = 2000;
+        const LongReal step = timeScale / 60 / 86400;
+        SkyState state;
+
+        double exact = 0;
+        for (size_t i = 0; i < frames; ++i) {
+            auto begin = std::chrono::steady_clock::now ();
+            state = SkyStateEvaluator::evaluate (start + step * i, longitude, latitude, config);
+            auto end = std::chrono::steady_clock::now ();
+            exact += std::chrono::duration<double, std::nano> (end - begin).count ();
+        }
+
+        SkyTimeline timeline;
+        double cached = 0;
+        size_t hits = 0;
+        for (size_t i = 0; i < frames; ++i) {
+            auto begin = std::chrono::steady_clock::now ();
+            hits += timeline.evaluate (start + step * i, longitude, latitude, config, state);
+            auto end = std::chrono::steady_clock::now ();
+            cached += std::chrono::duration<double, std::nano> (end - begin).count ();
+            timeline.waitForWindow ();
+        }
+
+        std::printf ("%8.0f %10.1f %10.1f %8.1fx %8.1f %10lu\n", timeScale, exact / frames, cached / frames,
+                exact / cached, 100.0 * hits / frames, timeline.getComputedCount ());
+    }
+
+    void benchSkyTimelines ()
+    {
+        std::printf ("Sky timeline at 60 fps, ns per frame; samples every %.0f game seconds\n", SkyTimeline ().getSpacing ());
+        std::printf ("%8s %10s %10s %9s %8s %10s\n", "scale", "exact", "timeline", "speedup", "% hits", "computed");
+        benchSkyTimeline (1000);
+        benchSkyTimeline (10000);
+        benchSkyTimeline (100000);
+    }
+
+    void benchEclipseTable (LongReal years, unsigned threads)
+    {
+        EclipseTable table;
+        table.setThreadCount (threads);
+        auto start = std::chrono::steady_clock::now ();
+        table.generate (Astronomy::J2000, Astronomy::J2000 + 365.25 * years);
+        auto end = std::chrono::steady_clock::now ();
+        double generate = std::chrono::duration<double, std::milli> (end - start).count ();
+
+        // Frames spread over the range; mostly outside eclipses like real use.
+        // Frames inside a local eclipse are counted to show how rare they are.
+        const size_t count = 200000;
+        double best = 1e30;
+        size_t eclipsed = 0;
+        for (int run = 0; run < 5; ++run) {
+            eclipsed = 0;
+            start = std::chrono::steady_clock::now ();
+            for (size_t i = 0; i < count; ++i) {
+                LongReal jday = table.getStart () + (table.getEnd () - table.getStart ()) * LongReal (i) / count;
+                eclipsed += (table.getSunVisibleFraction (jday, 15, 60) < 1 || table.getMoonUmbraFraction (jday) > 0);
+            }
+            end = std::chrono::steady_clock::now ();
+            best = std::min (best, std::chrono::duration<double, std::nano> (end - start).count () / count);
+        }
+
+        std::printf ("%6.0f %8u %10.1f %10zu %12zu %10.1f %10.4f\n", years, threads, generate,
+                table.getEclipses ().size (), table.getConjunctions ().size (), best, 100.0 * eclipsed / count);
+    }
+
+    void benchEclipseTables ()
+    {
+        std::printf ("Eclipse table, generation ms and per frame lookup ns\n");
+        std::printf ("%6s %8s %10s %10s %12s %10s %10s\n", "years", "threads", "generate", "eclipses", "conjunctions", "lookup", "% frames");
+        benchEclipseTable (10, 1);
+        benchEclipseTable (10, 0);
+        benchEclipseTable (200, 0);
+    }
+
+    /** Starlink like shells; circular orbits spread evenly over planes and phases.
+     *  Elements are only needed in SGP4 units, so no TLE text is made.
+     */
+    void addSyntheticShells (SatelliteConstellation &satellites, size_t count)
+    {
+        const LongReal altitude[] = { 550, 540, 570, 560 };
+        const LongReal inclination[] = { 53, 53.2, 70, 97.6 };
+        const size_t planes = 72;
+        for (size_t i = 0; i < count; ++i) {
+            size_t shell = i % 4;
+            size_t plane = (i / 4) % planes;
+            size_t slot = i / (4 * planes);
+            LongReal a = 6378.135 + altitude[shell];
+            SatelliteConstellation::OrbitalElements elements;
+            elements.catalogNumber = int (i);
+            elements.epoch = Astronomy::J2000;
+            elements.bstar = 1e-4;
+            elements.inclination = inclination[shell];
+            elements.rightAscension = 360.0 * plane / planes;
+            elements.argumentOfPerigee = 0;
+            elements.meanAnomaly = std::fmod (137.5 * slot + 5.0 * plane, 360.0);
+            elements.eccentricity = 1e-4;
+            elements.meanMotion = std::sqrt (398600.8 / (a * a * a)) * 86400 / (2 * 3.14159265358979);
+            satellites.addSatellite (elements);
+        }
+    }
+
+    /** Cost of a satellite per frame on an optimised build, in calibration steps.
+     *  That is 1770 us for 10000 satellites on the reference desktop,
+     *  inside the 2000 us, an eighth of a 60 Hz frame, the batch is for.
+     */
+    const double SATELLITE_BASELINE_STEPS = 15.4;
+
+    /** How much more than its baseline a satellite may cost before the
+     *  10000 satellite batch fails; set with --satellite-ratio. Like the
+     *  throughput gate this is in calibration steps, so the budget
+     *  scales with the machine, and only holds on optimised builds.
+     */
+    double satelliteRatio = 1.5;
+
+    /// Time a batch of satellites; true if within satelliteRatio of the baseline.
+    bool benchSatellites (size_t count)
+    {
+        SatelliteConstellation satellites;
+        addSyntheticShells (satellites, count);
+        std::vector<float> vertices (satellites.getSatelliteCount () * SatelliteConstellation::VERTEX_FLOATS_PER_SATELLITE);
+        const float transform[3][3] = { { 0, -1, 0 }, { 0, 0, 1 }, { 1, 0, 0 } };
+
+        // One simulated minute per frame; a day of frames.
+        FastObserver observer (15, 50, Astronomy::J2000);
+        const int frames = 200;
+        double bestPropagate = 1e30, bestUpdate = 1e30, bestVertices = 1e30;
+        size_t sunlit = 0;
+        for (int run = 0; run < 3; ++run) {
+            double propagate = 0, update = 0, write = 0;
+            sunlit = 0;
+            for (int frame = 0; frame < frames; ++frame) {
+                LongReal jday = Astronomy::J2000 + 7 * frame / 1440.0;
+                observer.setJulianDay (jday);
+                auto start = std::chrono::steady_clock::now ();
+                satellites.propagate (jday);
+                auto middle = std::chrono::steady_clock::now ();
+                satellites.update (observer);
+                auto end = std::chrono::steady_clock::now ();
+                satellites.writeVertices (transform, vertices.data ());
+                auto written = std::chrono::steady_clock::now ();
+                propagate += std::chrono::duration<double, std::micro> (middle - start).count ();
+                update += std::chrono::duration<double, std::micro> (end - middle).count ();
+                write += std::chrono::duration<double, std::micro> (written - end).count ();
+                sunlit += satellites.isSunlit (frame % count);
+            }
+            bestPropagate = std::min (bestPropagate, propagate / frames);
+            bestUpdate = std::min (bestUpdate, update / frames);
+            bestVertices = std::min (bestVertices, write / frames);
+        }
+
+        // update includes its own propagate.
+        double total = bestUpdate + bestVertices;
+        double steps = total * 1000 / count / calibrationNs;
+        bool ok = steps <= SATELLITE_BASELINE_STEPS * satelliteRatio;
+        std::printf ("%8zu %10.1f %10.1f %10.1f %10.1f %8.2f %8s %8.0f\n", count,
+                bestPropagate, bestUpdate, bestVertices, total, steps,
+                ok ? "ok" : "OVER", 100.0 * sunlit / frames);
+        return ok;
+    }
+
+    /// Time several batch sizes; false if 10000 satellites cost too much.
+    bool benchSatelliteBatches ()
+    {
+        std::printf ("Satellite batch (SGP4, horizontal, vertices), us per frame and calibration steps per satellite\n");
+        std::printf ("Budget %.2f steps per satellite, %.0f us for 10000 on this machine\n",
+                SATELLITE_BASELINE_STEPS * satelliteRatio,
+                10000 * SATELLITE_BASELINE_STEPS * satelliteRatio * calibrationNs / 1000);
+        std::printf ("%8s %10s %10s %10s %10s %8s %8s %8s\n", "count", "propagate", "update", "vertices", "total", "steps", "budget", "% lit");
+        benchSatellites (1000);
+        bool ok = benchSatellites (10000);
+        benchSatellites (30000);
+        return ok || !timingGate;
+    }
+
+    /** Positions from the worked examples in Meeus, "Astronomical
+     *  Algorithms" (2nd ed.), and USNO equinox and solstice times.
+     *  Apparent ecliptic coordinates of date, in degrees. Meeus gives
+     *  dynamical time; the 1 minute difference to UT is left in the error.
+     */
+    struct ReferencePosition
+    {
+        /// Planets in the order of Astronomy::Planet, from MERCURY on.
+        enum Body { SUN, MOON, MERCURY, VENUS, MARS, JUPITER, SATURN } body;
+        LongReal jday;
+        LongReal lon, lat;
+    };
+
+    const ReferencePosition REFERENCE_POSITIONS[] = {
+        { ReferencePosition::SUN,   2448908.5,        199.90895,   0 },         // Meeus 25.a
+        { ReferencePosition::SUN,   2451623.81597222,   0,         0 },         // 2000 March equinox, 07:35 UT
+        { ReferencePosition::SUN,   2451716.575,       90,         0 },         // 2000 June solstice, 01:48 UT
+        { ReferencePosition::SUN,   2451810.22708333, 180,         0 },         // 2000 September equinox, 17:27 UT
+        { ReferencePosition::SUN,   2451900.06736111, 270,         0 },         // 2000 December solstice, 13:37 UT
+        { ReferencePosition::SUN,   2458928.65972222,   0,         0 },         // 2020 March equinox, 03:50 UT
+        { ReferencePosition::SUN,   2459021.40486111,  90,         0 },         // 2020 June solstice, 21:43 UT
+        { ReferencePosition::SUN,   2459115.06319444, 180,         0 },         // 2020 September equinox, 13:31 UT
+        { ReferencePosition::SUN,   2459204.91805556, 270,         0 },         // 2020 December solstice, 10:02 UT
+        { ReferencePosition::MOON,  2448724.5,        133.162655, -3.229126 },  // Meeus 47.a
+        { ReferencePosition::VENUS, 2448976.5,        313.08102,  -2.08474 },   // Meeus 33.a
+    };
+
+    /** Published event times, which pin a body against the sun.
+     *  At a new or full moon and at a planet's opposition the apparent
+     *  longitudes differ by a whole multiple of 90 degrees; at greatest
+     *  transit the planet's centre is a given distance from the sun's.
+     *  Phases and oppositions from the USNO, transits from NASA's
+     *  Espenak tables, both in UT; Meeus 49.a is dynamical time. The
+     *  error includes the sun's own, so these get their own thresholds.
+     */
+    struct ReferenceEvent
+    {
+        ReferencePosition::Body body;
+        LongReal jday;
+        enum Kind {
+            /// Apparent longitude minus the sun's, in degrees.
+            ELONGATION,
+            /// Geocentric distance of the centres, in arc seconds.
+            SEPARATION,
+        } kind;
+        LongReal value;
+    };
+
+    const ReferenceEvent REFERENCE_EVENTS[] = {
+        { ReferencePosition::MOON,    2443192.65118,    ReferenceEvent::ELONGATION,   0 },    // Meeus 49.a, new moon
+        { ReferencePosition::MOON,    2448449.29583333, ReferenceEvent::ELONGATION,   0 },    // 1991 July 11, new moon 19:06
+        { ReferencePosition::MOON,    2451401.96388889, ReferenceEvent::ELONGATION,   0 },    // 1999 August 11, new moon 11:08
+        { ReferencePosition::MOON,    2451564.69444444, ReferenceEvent::ELONGATION, 180 },    // 2000 January 21, full moon 04:40
+        { ReferencePosition::MOON,    2451919.35,       ReferenceEvent::ELONGATION, 180 },    // 2001 January 9, full moon 20:24
+        { ReferencePosition::MOON,    2457987.27083333, ReferenceEvent::ELONGATION,   0 },    // 2017 August 21, new moon 18:30
+        { ReferencePosition::MOON,    2458504.71944444, ReferenceEvent::ELONGATION, 180 },    // 2019 January 21, full moon 05:16
+        { ReferencePosition::MOON,    2459891.95972222, ReferenceEvent::ELONGATION, 180 },    // 2022 November 8, full moon 11:02
+        { ReferencePosition::MOON,    2460409.26458333, ReferenceEvent::ELONGATION,   0 },    // 2024 April 8, new moon 18:21
+        { ReferencePosition::MERCURY, 2452766.82777778, ReferenceEvent::SEPARATION, 708 },    // 2003 May 7 transit, 07:52:00
+        { ReferencePosition::MERCURY, 2454048.40347222, ReferenceEvent::SEPARATION, 423 },    // 2006 November 8 transit, 21:41:00
+        { ReferencePosition::MERCURY, 2457518.12321759, ReferenceEvent::SEPARATION, 318.5 },  // 2016 May 9 transit, 14:57:26
+        { ReferencePosition::MERCURY, 2458799.13875,    ReferenceEvent::SEPARATION, 75.9 },   // 2019 November 11 transit, 15:19:48
+        { ReferencePosition::VENUS,   2453164.84703704, ReferenceEvent::SEPARATION, 626.9 },  // 2004 June 8 transit, 08:19:44
+        { ReferencePosition::VENUS,   2456084.56222222, ReferenceEvent::SEPARATION, 554.4 },  // 2012 June 6 transit, 01:29:36
+        { ReferencePosition::MARS,    2452880.24722222, ReferenceEvent::ELONGATION, 180 },    // 2003 August 28 opposition, 17:56
+        { ReferencePosition::MARS,    2458326.71319444, ReferenceEvent::ELONGATION, 180 },    // 2018 July 27 opposition, 05:07
+        { ReferencePosition::MARS,    2459136.47222222, ReferenceEvent::ELONGATION, 180 },    // 2020 October 13 opposition, 23:20
+        { ReferencePosition::JUPITER, 2459849.31458333, ReferenceEvent::ELONGATION, 180 },    // 2022 September 26 opposition, 19:33
+        { ReferencePosition::JUPITER, 2460251.71041667, ReferenceEvent::ELONGATION, 180 },    // 2023 November 3 opposition, 05:03
+        { ReferencePosition::SATURN,  2460183.85277778, ReferenceEvent::ELONGATION, 180 },    // 2023 August 27 opposition, 08:28
+    };
+
+    /// Dates from Meeus chapter 7, with their julian days.
+    struct ReferenceDate
+    {
+        int year, month, day, hour, minute;
+        LongReal second;
+        LongReal jday;
+    };
+
+    const ReferenceDate REFERENCE_DATES[] = {
+        { 1957, 10,  4, 19, 26, 24, 2436116.31 },
+        { 2000,  1,  1, 12,  0,  0, 2451545.0 },
+        { 1999,  1,  1,  0,  0,  0, 2451179.5 },
+        { 1987,  1, 27,  0,  0,  0, 2446822.5 },
+        { 1987,  6, 19, 12,  0,  0, 2446966.0 },
+        { 1988,  1, 27,  0,  0,  0, 2447187.5 },
+        { 1988,  6, 19, 12,  0,  0, 2447332.0 },
+        { 1900,  1,  1,  0,  0,  0, 2415020.5 },
+        { 1600,  1,  1,  0,  0,  0, 2305447.5 },
+        { 1600, 12, 31,  0,  0,  0, 2305812.5 },
+    };
+
+    /// Rotate an equatorial unit vector of date to ecliptic angles, in degrees.
+    void equatorialToEcliptic (LongReal x, LongReal y, LongReal z, LongReal obliquity, LongReal &lon, LongReal &lat)
+    {
+        LongReal sinEcl = std::sin (obliquity / RAD_TO_DEG), cosEcl = std::cos (obliquity / RAD_TO_DEG);
+        LongReal ey = cosEcl * y + sinEcl * z;
+        LongReal ez = -sinEcl * y + cosEcl * z;
+        lon = std::atan2 (ey, x) * RAD_TO_DEG;
+        lat = std::atan2 (ez, std::sqrt (x * x + ey * ey)) * RAD_TO_DEG;
+    }
+
+    /// Apparent ecliptic position of a body from Astronomy, in degrees.
+    void getEclipticPosition (ReferencePosition::Body body, LongReal jday, LongReal &lon, LongReal &lat)
+    {
+        LongReal x, y, z;
+        switch (body) {
+        case ReferencePosition::SUN: {
+            LongReal rasc, decl;
+            Astronomy::getEquatorialSunPosition (jday, rasc, decl);
+            Astronomy::convertSphericalToRectangular (rasc, decl, 1, x, y, z);
+            equatorialToEcliptic (x, y, z, Astronomy::getMeanObliquity (jday), lon, lat);
+            break;
+        }
+        case ReferencePosition::MOON:
+            Astronomy::getEclipticMoonPositionRad (jday, lon, lat);
+            lon *= RAD_TO_DEG;
+            lat *= RAD_TO_DEG;
+            break;
+        default: {
+            // J2000 output; rotated to the true equator and ecliptic of date.
+            Astronomy::PlanetPosition planets[Astronomy::PLANET_COUNT];
+            Astronomy::getPlanetPositions (jday, planets);
+            const Astronomy::PlanetPosition &planet = planets[body - ReferencePosition::MERCURY];
+            LongReal j2000[3], matrix[3][3];
+            Astronomy::convertSphericalToRectangular (planet.rasc, planet.decl, 1, j2000[0], j2000[1], j2000[2]);
+            Astronomy::getPrecessionNutationMatrix (jday, matrix);
+            x = matrix[0][0] * j2000[0] + matrix[0][1] * j2000[1] + matrix[0][2] * j2000[2];
+            y = matrix[1][0] * j2000[0] + matrix[1][1] * j2000[1] + matrix[1][2] * j2000[2];
+            z = matrix[2][0] * j2000[0] + matrix[2][1] * j2000[1] + matrix[2][2] * j2000[2];
+            LongReal nutationLon, nutationObl;
+            Astronomy::getNutation (jday, nutationLon, nutationObl);
+            equatorialToEcliptic (x, y, z, Astronomy::getMeanObliquity (jday) + nutationObl, lon, lat);
+            break;
+        }
+        }
+    }
+
+    /// Error statistics for one group of reference values.
+    class ErrorGroup
+    {
+    public:
+        ErrorGroup (): mCount (0), mMax (0), mSumSquares (0) {}
+
+        void add (LongReal error) {
+            error = std::fabs (error);
+            ++mCount;
+            mMax = std::max (mMax, error);
+            mSumSquares += error * error;
+        }
+
+        /// Print one row; true if within the threshold.
+        bool report (const char *name, const char *unit, LongReal threshold) const {
+            LongReal rms = mCount ? std::sqrt (mSumSquares / mCount) : 0;
+            bool ok = mMax <= threshold;
+            std::printf ("%-20s %6zu %12.3f %12.3f %10.2f %6s %s\n", name, mCount, rms, mMax, threshold, unit, ok ? "ok" : "FAIL");
+            return ok;
+        }
+
+    private:
+        size_t mCount;
+        LongReal mMax, mSumSquares;
+    };
+
+    /** Stored accuracy thresholds, in the unit of each row.
+     *  Roughly twice the current errors with the CLASSIC lunar theory, so
+     *  a regression in any term fails long before it is visible. The
+     *  horizontal row includes the short sidereal time formula the
+     *  horizontal conversions use, which is about a second of time off.
+     */
+    const LongReal SUN_MAX_ERROR = 90;
+    const LongReal MOON_MAX_ERROR = 90;
+    const LongReal PLANET_MAX_ERROR = 60;
+    const LongReal MOON_PHASE_MAX_ERROR = 130;
+    const LongReal PLANET_EVENT_MAX_ERROR = 120;
+    const LongReal SIDEREAL_MAX_ERROR = 0.5;
+    const LongReal HORIZONTAL_MAX_ERROR = 40;
+    const LongReal NUTATION_MAX_ERROR = 0.5;
+    const LongReal OBLIQUITY_MAX_ERROR = 0.1;
+    const LongReal JULIAN_DAY_MAX_ERROR = 0.01;
+
+    /// Compare Astronomy with the reference tables; false on a regression.
+    bool checkReferenceAccuracy ()
+    {
+        std::printf ("Astronomy against reference values\n");
+        std::printf ("%-20s %6s %12s %12s %10s %6s\n", "quantity", "rows", "rms error", "max error", "threshold", "unit");
+
+        ErrorGroup sun, moon, planets;
+        for (const ReferencePosition &ref: REFERENCE_POSITIONS) {
+            LongReal lon, lat;
+            getEclipticPosition (ref.body, ref.jday, lon, lat);
+            LongReal error = separationArcSec (lon / RAD_TO_DEG, lat / RAD_TO_DEG, ref.lon / RAD_TO_DEG, ref.lat / RAD_TO_DEG);
+            (ref.body == ReferencePosition::SUN ? sun : ref.body == ReferencePosition::MOON ? moon : planets).add (error);
+        }
+
+        ErrorGroup moonPhases, planetEvents;
+        for (const ReferenceEvent &ref: REFERENCE_EVENTS) {
+            LongReal sunLon, sunLat, lon, lat;
+            getEclipticPosition (ReferencePosition::SUN, ref.jday, sunLon, sunLat);
+            getEclipticPosition (ref.body, ref.jday, lon, lat);
+            LongReal error = ref.kind == ReferenceEvent::ELONGATION ?
+                    std::remainder (lon - sunLon - ref.value, LongReal (360)) * 3600 :
+                    separationArcSec (lon / RAD_TO_DEG, lat / RAD_TO_DEG, sunLon / RAD_TO_DEG, sunLat / RAD_TO_DEG) - ref.value;
+            (ref.body == ReferencePosition::MOON ? moonPhases : planetEvents).add (error);
+        }
+
+        // Meeus 12.a and 12.b; mean sidereal time at Greenwich.
+        ErrorGroup sidereal;
+        const LongReal siderealTimes[][2] = {
+            { 2446895.5, 197.693195 },
+            { 2446896.30625, 128.7378734 },
+        };
+        for (const LongReal *row: siderealTimes) {
+            LongReal hourAngle;
+            Astronomy::getVernalEquinoxHourAngle (row[0], 0, hourAngle);
+            sidereal.add (std::remainder (hourAngle - row[1], LongReal (360)) * 3600);
+        }
+
+        // Meeus 13.b; Venus from the US Naval Observatory. Meeus uses
+        // apparent sidereal time, which is 3.5" off the mean one here.
+        ErrorGroup horizontal;
+        {
+            LongReal azimuth, altitude;
+            Astronomy::convertEquatorialToHorizontal (2446896.30625, -77.065556, 38.921389,
+                    347.3193375, -6.719892, azimuth, altitude);
+            horizontal.add (separationArcSec (azimuth / RAD_TO_DEG, altitude / RAD_TO_DEG,
+                    248.0337 / RAD_TO_DEG, 15.1249 / RAD_TO_DEG));
+        }
+
+        // Meeus 22.a.
+        ErrorGroup nutation, obliquity;
+        {
+            LongReal nutationLon, nutationObl;
+            Astronomy::getNutation (2446895.5, nutationLon, nutationObl);
+            nutation.add (nutationLon * 3600 + 3.788);
+            nutation.add (nutationObl * 3600 - 9.443);
+            obliquity.add ((Astronomy::getMeanObliquity (2446895.5) - 23.440946) * 3600);
+        }
+
+        // Calendar conversions both ways, in seconds of time.
+        ErrorGroup julianDay;
+        for (const ReferenceDate &ref: REFERENCE_DATES) {
+            LongReal jday = Astronomy::getJulianDayFromGregorianDateTime (
+                    ref.year, ref.month, ref.day, ref.hour, ref.minute, ref.second);
+            julianDay.add ((jday - ref.jday) * 86400);
+
+            int year, month, day, hour, minute;
+            LongReal second;
+            Astronomy::getGregorianDateTimeFromJulianDay (ref.jday, year, month, day, hour, minute, second);
+            LongReal dayError = year != ref.year || month != ref.month || day != ref.day ? 86400 : 0;
+            julianDay.add (dayError + (hour - ref.hour) * 3600 + (minute - ref.minute) * 60 + (second - ref.second));
+        }
+
+        bool ok = true;
+        ok &= sun.report ("sun", "arcsec", SUN_MAX_ERROR);
+        ok &= moon.report ("moon", "arcsec", MOON_MAX_ERROR);
+        ok &= planets.report ("planets", "arcsec", PLANET_MAX_ERROR);
+        ok &= moonPhases.report ("moon phases", "arcsec", MOON_PHASE_MAX_ERROR);
+        ok &= planetEvents.report ("planet events", "arcsec", PLANET_EVENT_MAX_ERROR);
+        ok &= sidereal.report ("sidereal time", "arcsec", SIDEREAL_MAX_ERROR);
+        ok &= horizontal.report ("horizontal", "arcsec", HORIZONTAL_MAX_ERROR);
+        ok &= nutation.report ("nutation", "arcsec", NUTATION_MAX_ERROR);
+        ok &= obliquity.report ("mean obliquity", "arcsec", OBLIQUITY_MAX_ERROR);
+        ok &= julianDay.report ("julian day", "s", JULIAN_DAY_MAX_ERROR);
+        return ok;
+    }
+
+    /** Time one routine over the inputs and check it against its stored baseline.
+     *  Baselines are the best of five runs on an optimised build, in
+     *  calibration steps per element; batch routines handle
+     *  elementsPerCall elements in every call.
+     */
+    template <class Routine>
+    bool checkThroughput (const char *name, double baseline, const std::vector<LongReal> &inputs,
+            Routine routine, size_t elementsPerCall = 1)
+    {
+        double best = 1e30;
+        LongReal sum = 0;
+        for (int run = 0; run < 5; ++run) {
+            auto start = std::chrono::steady_clock::now ();
+            for (LongReal t: inputs) {
+                sum += routine (t);
+            }
+            auto end = std::chrono::steady_clock::now ();
+            best = std::min (best, std::chrono::duration<double, std::nano> (end - start).count () /
+                    (inputs.size () * elementsPerCall));
+        }
+        benchSink = sum;
+
+        const double steps = best / calibrationNs;
+        const double ratio = steps / baseline;
+        bool ok = ratio <= throughputRatio;
+        std::printf ("%-44s %10.1f %10.2f %10.2f %8.2f %s\n", name, best, steps, baseline, ratio, ok ? "ok" : "FAIL");
+        return ok || !timingGate;
+    }
+
+    /// Ogre::Degree stand-in for the angle templates.
+    struct BenchDegree
+    {
+        LongReal degrees;
+        explicit BenchDegree (LongReal value = 0): degrees (value) {}
+        LongReal valueDegrees () const { return degrees; }
+    };
+
+    /// Time every public Astronomy routine; false if one got much slower than its baseline.
+    bool checkAstronomyThroughput ()
+    {
+        std::printf ("Astronomy routines, per call or element; fail above %.1fx the baseline in calibration steps\n", throughputRatio);
+        std::printf ("%-44s %10s %10s %10s %8s\n", "routine", "ns", "steps", "baseline", "ratio");
+        std::vector<LongReal> jday = makeSampleTimes (100000);
+        std::vector<LongReal> days = makeSampleTimes (200);
+        const LongReal lon = 15, lat = 60;
+        bool ok = true;
+
+        // Batches of consecutive frames, as the batch routines are used.
+        const size_t batchSize = 256;
+        std::vector<LongReal> batchStarts = makeSampleTimes (400);
+        std::vector<LongReal> batchTimes (batchSize), batchAzimuth (batchSize), batchAltitude (batchSize);
+
+        // A grid of observers, as for a server with many players.
+        const size_t observerCount = 256;
+        std::vector<LongReal> observerLon (observerCount), observerLat (observerCount);
+        for (size_t i = 0; i < observerCount; ++i) {
+            observerLon[i] = -180 + 360.0 * (i % 16) / 16;
+            observerLat[i] = -75 + 150.0 * (i / 16) / 15;
+        }
+        Astronomy::ObserverBatch observers;
+        observers.assign (observerLon.data (), observerLat.data (), observerCount);
+        std::vector<LongReal> observerAzimuth (observerCount), observerAltitude (observerCount);
+        std::vector<LongReal> observerTimes = makeSampleTimes (2000);
+
+        // Calendar and sidereal time.
+        ok &= checkThroughput ("getJulianDayFromGregorianDateTime", 0.443, jday, [] (LongReal t) {
+            return Astronomy::getJulianDayFromGregorianDateTime (1900 + int (t) % 200, 1 + int (t) % 12, 1 + int (t) % 28, 12, 30, 15.5);
+        });
+        ok &= checkThroughput ("getGregorianDateTimeFromJulianDay", 1.3, jday, [] (LongReal t) {
+            int year, month, day, hour, minute;
+            LongReal second;
+            Astronomy::getGregorianDateTimeFromJulianDay (t, year, month, day, hour, minute, second);
+            return second + day;
+        });
+        ok &= checkThroughput ("getVernalEquinoxHourAngle", 0.365, jday, [=] (LongReal t) {
+            LongReal hourAngle;
+            Astronomy::getVernalEquinoxHourAngle (t, lon, hourAngle);
+            return hourAngle;
+        });
+        ok &= checkThroughput ("getLocalSiderealAngle", 0.278, jday, [=] (LongReal t) {
+            return Astronomy::getLocalSiderealAngle (t, lon);
+        });
+        ok &= checkThroughput ("getEquationOfEquinoxes", 6.86, jday, [] (LongReal t) {
+            return Astronomy::getEquationOfEquinoxes (t);
+        });
+
+        // Coordinate conversions.
+        ok &= checkThroughput ("convertEclipticToEquatorialRad", 3.21, jday, [] (LongReal t) {
+            LongReal rasc, decl;
+            Astronomy::convertEclipticToEquatorialRad (t * 1e-3, 0.1, rasc, decl);
+            return rasc + decl;
+        });
+        ok &= checkThroughput ("convertSphericalToRectangular", 1.91, jday, [] (LongReal t) {
+            LongReal x, y, z;
+            Astronomy::convertSphericalToRectangular (std::fmod (t, 360), 20, 1, x, y, z);
+            return x + y + z;
+        });
+        ok &= checkThroughput ("convertRectangularToSpherical", 3.74, jday, [] (LongReal t) {
+            LongReal rasc, decl, dist;
+            Astronomy::convertRectangularToSpherical (std::fmod (t, 1), 0.4, 0.5, rasc, decl, dist);
+            return rasc + decl + dist;
+        });
+        ok &= checkThroughput ("convertEquatorialToHorizontal", 4.69, jday, [=] (LongReal t) {
+            LongReal azimuth, altitude;
+            Astronomy::convertEquatorialToHorizontal (t, lon, lat, 100, 20, azimuth, altitude);
+            return azimuth + altitude;
+        });
+        ok &= checkThroughput ("convertEquatorialRectangularToHorizontal", 4.43, jday, [=] (LongReal t) {
+            LongReal azimuth, altitude;
+            Astronomy::convertEquatorialRectangularToHorizontal (t, lon, lat, 0.3, 0.4, 0.5, azimuth, altitude);
+            return azimuth + altitude;
+        });
+
+        // Sun, moon and ecliptic pole.
+        ok &= checkThroughput ("getEquatorialSunPosition", 8.69, jday, [] (LongReal t) {
+            LongReal rasc, decl;
+            Astronomy::getEquatorialSunPosition (t, rasc, decl);
+            return rasc + decl;
+        });
+        ok &= checkThroughput ("getHorizontalSunPosition", 14.4, jday, [=] (LongReal t) {
+            LongReal azimuth, altitude;
+            Astronomy::getHorizontalSunPosition (t, lon, lat, azimuth, altitude);
+            return azimuth + altitude;
+        });
+        ok &= checkThroughput ("getEclipticMoonPositionRad", 18.1, jday, [] (LongReal t) {
+            LongReal moonLon, moonLat;
+            Astronomy::getEclipticMoonPositionRad (t, moonLon, moonLat);
+            return moonLon + moonLat;
+        });
+        ok &= checkThroughput ("getEquatorialMoonPosition", 22.5, jday, [] (LongReal t) {
+            LongReal rasc, decl;
+            Astronomy::getEquatorialMoonPosition (t, rasc, decl);
+            return rasc + decl;
+        });
+        ok &= checkThroughput ("getHorizontalMoonPosition", 28.4, jday, [=] (LongReal t) {
+            LongReal azimuth, altitude;
+            Astronomy::getHorizontalMoonPosition (t, lon, lat, azimuth, altitude);
+            return azimuth + altitude;
+        });
+        ok &= checkThroughput ("getHorizontalNorthEclipticPolePosition", 3.48, jday, [=] (LongReal t) {
+            BenchDegree azimuth, altitude;
+            Astronomy::getHorizontalNorthEclipticPolePosition (t, BenchDegree (lon), BenchDegree (lat), azimuth, altitude);
+            return azimuth.valueDegrees () + altitude.valueDegrees ();
+        });
+
+        // Batches over time and over observers; per element.
+        ok &= checkThroughput ("getHorizontalSunPositionBatch", 6.17, batchStarts, [&] (LongReal t) {
+            for (size_t i = 0; i < batchSize; ++i) {
+                batchTimes[i] = t + i / 1440.0;
+            }
+            Astronomy::getHorizontalSunPositionBatch (batchTimes.data (), batchSize, lon, lat,
+                    batchAzimuth.data (), batchAltitude.data ());
+            return batchAzimuth[batchSize - 1];
+        }, batchSize);
+        ok &= checkThroughput ("getHorizontalMoonPositionBatch", 12, batchStarts, [&] (LongReal t) {
+            for (size_t i = 0; i < batchSize; ++i) {
+                batchTimes[i] = t + i / 1440.0;
+            }
+            Astronomy::getHorizontalMoonPositionBatch (batchTimes.data (), batchSize, lon, lat,
+                    batchAzimuth.data (), batchAltitude.data ());
+            return batchAzimuth[batchSize - 1];
+        }, batchSize);
+        ok &= checkThroughput ("convertEquatorialToHorizontalBatch", 1.24, observerTimes, [&] (LongReal t) {
+            Astronomy::convertEquatorialToHorizontalBatch (t, 100, 20, observers,
+                    observerAzimuth.data (), observerAltitude.data ());
+            return observerAzimuth[observerCount - 1];
+        }, observerCount);
+        ok &= checkThroughput ("getHorizontalSunPositionForObservers", 1.27, observerTimes, [&] (LongReal t) {
+            Astronomy::getHorizontalSunPositionForObservers (t, observers,
+                    observerAzimuth.data (), observerAltitude.data ());
+            return observerAzimuth[observerCount - 1];
+        }, observerCount);
+        ok &= checkThroughput ("getHorizontalMoonPositionForObservers", 1.55, observerTimes, [&] (LongReal t) {
+            Astronomy::getHorizontalMoonPositionForObservers (t, observers,
+                    observerAzimuth.data (), observerAltitude.data ());
+            return observerAzimuth[observerCount - 1];
+        }, observerCount);
+
+        // Precession, nutation and planets.
+        ok &= checkThroughput ("getMeanObliquity", 0.209, jday, [] (LongReal t) {
+            return Astronomy::getMeanObliquity (t);
+        });
+        ok &= checkThroughput ("getNutation", 5.82, jday, [] (LongReal t) {
+            LongReal nutationLon, nutationObl;
+            Astronomy::getNutation (t, nutationLon, nutationObl);
+            return nutationLon + nutationObl;
+        });
+        ok &= checkThroughput ("getPrecessionNutationMatrix", 14.5, jday, [] (LongReal t) {
+            LongReal matrix[3][3];
+            Astronomy::getPrecessionNutationMatrix (t, matrix);
+            return matrix[0][1];
+        });
+        ok &= checkThroughput ("getPlanetPositions", 162, jday, [] (LongReal t) {
+            Astronomy::PlanetPosition planets[Astronomy::PLANET_COUNT];
+            Astronomy::getPlanetPositions (t, planets);
+            return planets[Astronomy::PLANET_MARS].rasc;
+        });
+
+        // Event solvers; per day.
+        ok &= checkThroughput ("findAltitudeCrossing", 175, days, [=] (LongReal t) {
+            LongReal sunrise = 0;
+            Astronomy::findAltitudeCrossing (Astronomy::EVENT_BODY_SUN, std::floor (t) + 0.5, std::floor (t) + 1.5,
+                    lon, lat, -0.833, true, sunrise);
+            return sunrise;
+        });
+        ok &= checkThroughput ("findCulmination", 65.2, days, [=] (LongReal t) {
+            LongReal culmination = 0;
+            Astronomy::findCulmination (Astronomy::EVENT_BODY_MOON, std::floor (t) + 0.5, std::floor (t) + 1.5,
+                    lon, culmination);
+            return culmination;
+        });
+        ok &= checkThroughput ("getDailyEvents", 1396, days, [=] (LongReal t) {
+            Astronomy::DailyEvents events;
+            Astronomy::getDailyEvents (std::floor (t) + 0.5, lon, lat, events);
+            return events.sunrise;
+        });
+        std::vector<Astronomy::DailyEvents> yearEvents (30);
+        ok &= checkThroughput ("getDailyEventsBatch", 1354, days, [&] (LongReal t) {
+            Astronomy::getDailyEventsBatch (std::floor (t) + 0.5, yearEvents.size (), lon, lat, yearEvents.data ());
+            return yearEvents.back ().sunrise;
+        }, yearEvents.size ());
+        return ok;
+    }
+}
+
+int main (int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 < argc && std::strcmp (argv[i], "--throughput-ratio") == 0) {
+            throughputRatio = std::atof (argv[++i]);
+        } else if (std::strcmp (argv[i], "--no-timing-gate") == 0) {
+            timingGate = false;
+        } else if (i + 1 < argc && std::strcmp (argv[i], "--satellite-ratio") == 0) {
+            satelliteRatio = std::atof (argv[++i]);
+        }
+    }
+
+    measureCalibration ();
+    benchLunarTheory ();
+    benchScalarPolicies ();
+    benchFusedSkies ();
+    benchEclipseTables ();
+    benchKeyframedSkies ();
+    benchSkyTimelines ();
+    bool satellitesOk = benchSatelliteBatches ();
+
+    // Only these gate; the other tables are for comparing options.
+    bool ok = checkAstronomyThroughput ();
+    ok &= checkReferenceAccuracy ();
+    ok &= satellitesOk;
+    return ok ? 0 : 1;
+}
@@ -2,7 +2,10 @@
 // It is subject to the license terms in the LICENSE file found in the top-level directory
 // of this distribution.
 
+#include <cstring>
+#include <future>
 #include <iostream>
+#include <stdexcept>
 
 #include "Caelum.h"
 
@@ -145,6 +148,1319 @@ void checkAstronomy () {
             1.68, 48.08, 147.0071, 24.4169);
 }
 
+LongReal angleDifference (LongReal x, LongReal y) {
+    LongReal dif = fmod (x - y, 360);
+    if (dif > 180) {
+        dif -= 360;
+    } else if (dif < -180) {
+        dif += 360;
+    }
+    return dif;
+}
+
+void checkBatchAstronomy () {
+    std::cout << "Testing batch sun and moon positions" << std::endl;
+    // Deliberately not a multiple of the internal block size.
+    const size_t count = 1000;
+    std::vector<LongReal> jday (count), azimuth (count), altitude (count);
+    LongReal start = Caelum::Astronomy::getJulianDayFromGregorianDateTime (1900, 1, 1, 0, 0, 0);
+    LongReal end = Caelum::Astronomy::getJulianDayFromGregorianDateTime (2100, 1, 1, 0, 0, 0);
+    for (size_t i = 0; i < count; ++i) {
+        jday[i] = start + (end - start) * i / (count - 1) + 0.37 * i;
+    }
+
+    const LongReal observers[][2] = { { 0, 45 }, { -82.63, 27.97 }, { 151.2, -33.9 }, { 24.3, 89.5 } };
+    for (size_t o = 0; o < sizeof (observers) / sizeof (observers[0]); ++o) {
+        LongReal longitude = observers[o][0];
+        LongReal latitude = observers[o][1];
+
+        Caelum::Astronomy::getHorizontalSunPositionBatch (
+                &jday[0], count, longitude, latitude, &azimuth[0], &altitude[0]);
+        for (size_t i = 0; i < count; ++i) {
+            LongReal az, alt;
+            Caelum::Astronomy::getHorizontalSunPosition (jday[i], longitude, latitude, az, alt);
+            testAlmostEqual (angleDifference (azimuth[i], az), 0, 1e-6);
+            testAlmostEqual (altitude[i], alt, 1e-6);
+        }
+
+        Caelum::Astronomy::getHorizontalMoonPositionBatch (
+                &jday[0], count, longitude, latitude, &azimuth[0], &altitude[0]);
+        for (size_t i = 0; i < count; ++i) {
+            LongReal az, alt;
+            Caelum::Astronomy::getHorizontalMoonPosition (jday[i], longitude, latitude, az, alt);
+            testAlmostEqual (angleDifference (azimuth[i], az), 0, 1e-6);
+            testAlmostEqual (altitude[i], alt, 1e-6);
+        }
+    }
+}
+
+void checkMultiObserverAstronomy () {
+    std::cout << "Testing multi-observer positions" << std::endl;
+    const size_t count = 500;
+    std::vector<LongReal> longitude (count), latitude (count), azimuth (count), altitude (count);
+    for (size_t i = 0; i < count; ++i) {
+        longitude[i] = -180 + 360.0 * i / count;
+        latitude[i] = -89 + 178.0 * ((i * 7919) % count) / count;
+    }
+    Caelum::Astronomy::ObserverBatch observers;
+    observers.assign (&longitude[0], &latitude[0], count);
+
+    const LongReal jdays[] = { 2448000.5, 2451545.0, 2454466.115, 2460000.77 };
+    for (size_t j = 0; j < sizeof (jdays) / sizeof (jdays[0]); ++j) {
+        Caelum::Astronomy::getHorizontalSunPositionForObservers (
+                jdays[j], observers, &azimuth[0], &altitude[0]);
+        for (size_t i = 0; i < count; ++i) {
+            LongReal az, alt;
+            Caelum::Astronomy::getHorizontalSunPosition (jdays[j], longitude[i], latitude[i], az, alt);
+            testAlmostEqual (angleDifference (azimuth[i], az), 0, 1e-6);
+            testAlmostEqual (altitude[i], alt, 1e-6);
+        }
+
+        Caelum::Astronomy::getHorizontalMoonPositionForObservers (
+                jdays[j], observers, &azimuth[0], &altitude[0]);
+        for (size_t i = 0; i < count; ++i) {
+            LongReal az, alt;
+            Caelum::Astronomy::getHorizontalMoonPosition (jdays[j], longitude[i], latitude[i], az, alt);
+            testAlmostEqual (angleDifference (azimuth[i], az), 0, 1e-6);
+            testAlmostEqual (altitude[i], alt, 1e-6);
+        }
+    }
+}
+
+void checkDailyEvents () {
+    std::cout << "Testing rise/set events" << std::endl;
+    using Caelum::Astronomy;
+
+    // Greenwich, 2000-01-01: sunrise 08:06, sunset 16:02 UTC.
+    Astronomy::DailyEvents events;
+    LongReal start = Astronomy::getLocalMidnight (2000, 1, 1, 0);
+    Astronomy::getDailyEvents (start, 0, 51.48, events);
+    LongReal minute = 1.0 / 1440;
+    testAlmostEqual (events.sunrise, Astronomy::getJulianDayFromGregorianDateTime (2000, 1, 1, 8, 6, 0), 2 * minute);
+    testAlmostEqual (events.sunset, Astronomy::getJulianDayFromGregorianDateTime (2000, 1, 1, 16, 2, 0), 2 * minute);
+    assert (events.astronomicalDawn < events.nauticalDawn);
+    assert (events.nauticalDawn < events.civilDawn);
+    assert (events.civilDawn < events.sunrise);
+    assert (events.sunrise < events.solarNoon);
+    assert (events.solarNoon < events.sunset);
+
+    // Events are refined to the exact altitude.
+    LongReal azimuth, altitude;
+    Astronomy::getHorizontalSunPosition (events.sunrise, 0.0, 51.48, azimuth, altitude);
+    testAlmostEqual (altitude, Astronomy::SUN_RISE_SET_ALTITUDE, 1e-4);
+    Astronomy::getHorizontalSunPosition (events.solarNoon, 0.0, 51.48, azimuth, altitude);
+    testAlmostEqual (azimuth, 180, 1e-4);
+    Astronomy::getHorizontalMoonPosition (events.moonrise, 0.0, 51.48, azimuth, altitude);
+    testAlmostEqual (altitude, Astronomy::MOON_RISE_SET_ALTITUDE, 1e-4);
+
+    // Polar night.
+    Astronomy::getDailyEvents (Astronomy::getLocalMidnight (2000, 12, 21, 15), 15, 80, events);
+    assert (events.sunrise != events.sunrise);
+    assert (events.sunset != events.sunset);
+
+    // The batch form gives the same results.
+    std::vector<Astronomy::DailyEvents> year (366);
+    Astronomy::getDailyEventsBatch (start, year.size (), 0, 51.48, &year[0]);
+    Astronomy::getDailyEvents (start + 200, 0, 51.48, events);
+    testAlmostEqual (year[200].sunrise, events.sunrise, 1e-5);
+    testAlmostEqual (year[200].moonCulmination, events.moonCulmination, 1e-5);
+}
+
+void checkEphemerisCache () {
+    std::cout << "Testing ephemeris cache" << std::endl;
+    Caelum::EphemerisCache cache;
+    cache.setAsynchronous (false);
+    LongReal jday = 2454000.3;
+    cache.update (jday);
+    assert (cache.isValidAt (jday));
+    assert (!cache.isValidAt (jday + cache.getHalfWidth () * 1.5));
+    testAlmostEqual (cache.getSunFitError (), 0, 1e-6);
+    testAlmostEqual (cache.getMoonFitError (), 0, 1e-6);
+
+    for (int i = -10; i <= 10; ++i) {
+        LongReal t = jday + cache.getHalfWidth () * i / 10;
+        LongReal az, alt, caz, calt;
+        Caelum::Astronomy::getHorizontalSunPosition (t, 15.0, 60.0, az, alt);
+        assert (cache.getHorizontalSunPosition (t, 15.0, 60.0, caz, calt));
+        testAlmostEqual (angleDifference (caz, az), 0, 1e-6);
+        testAlmostEqual (calt, alt, 1e-6);
+        Caelum::Astronomy::getHorizontalMoonPosition (t, 15.0, 60.0, az, alt);
+        assert (cache.getHorizontalMoonPosition (t, 15.0, 60.0, caz, calt));
+        testAlmostEqual (angleDifference (caz, az), 0, 1e-6);
+        testAlmostEqual (calt, alt, 1e-6);
+    }
+
+    // Moving past the margin refits around the new time.
+    cache.update (jday + cache.getHalfWidth ());
+    assert (cache.getFitCount () == 2);
+    assert (cache.isValidAt (jday + cache.getHalfWidth () * 1.5));
+}
+
+void checkLunarTheory () {
+    std::cout << "Testing lunar theory tiers" << std::endl;
+    using namespace Caelum;
+    const LongReal RAD_TO_DEG = 57.295779513082320877;
+    LongReal lon, lat;
+
+    // Meeus, Astronomical Algorithms, example 47.a.
+    LunarTheory::getEclipticPositionRad<LUNAR_THEORY_PLANETARIUM> (2448724.5, lon, lat);
+    testAlmostEqual (angleDifference (lon * RAD_TO_DEG, 133.162655), 0, 1e-5);
+    testAlmostEqual (lat * RAD_TO_DEG, -3.229126, 1e-5);
+    testAlmostEqual (LunarTheory::getDistanceKm (2448724.5), 368409.7, 10);
+
+    // Cheaper tiers stay within their advertised error of the planetarium tier.
+    for (int i = 0; i < 100; ++i) {
+        LongReal jday = 2451545 + i * 73.1;
+        LongReal refLon, refLat;
+        LunarTheory::getEclipticPositionRad<LUNAR_THEORY_PLANETARIUM> (jday, refLon, refLat);
+        Astronomy::getEclipticMoonPositionRad (jday, LUNAR_THEORY_CLASSIC, lon, lat);
+        testAlmostEqual (angleDifference (lon * RAD_TO_DEG, refLon * RAD_TO_DEG), 0, 0.15);
+        testAlmostEqual (lat * RAD_TO_DEG, refLat * RAD_TO_DEG, 0.15);
+        Astronomy::getEclipticMoonPositionRad (jday, LUNAR_THEORY_GAME, lon, lat);
+        testAlmostEqual (angleDifference (lon * RAD_TO_DEG, refLon * RAD_TO_DEG), 0, 1);
+        testAlmostEqual (lat * RAD_TO_DEG, refLat * RAD_TO_DEG, 1);
+    }
+}
+
+void checkPlanetPositions () {
+    std::cout << "Testing planet positions" << std::endl;
+    using Caelum::Astronomy;
+    Astronomy::PlanetPosition planets[Astronomy::PLANET_COUNT];
+
+    // Great conjunction of Jupiter and Saturn, 2020-12-21 18:00 UT.
+    Astronomy::getPlanetPositions (Astronomy::getJulianDayFromGregorianDateTime (2020, 12, 21, 18, 0, 0), planets);
+    const Astronomy::PlanetPosition &jupiter = planets[Astronomy::PLANET_JUPITER];
+    const Astronomy::PlanetPosition &saturn = planets[Astronomy::PLANET_SATURN];
+    testAlmostEqual (jupiter.rasc, 302.5, 0.3);
+    testAlmostEqual (jupiter.decl, -20.5, 0.3);
+    testAlmostEqual (angleDifference (jupiter.rasc, saturn.rasc), 0, 0.2);
+    testAlmostEqual (jupiter.decl, saturn.decl, 0.2);
+
+    // Mars opposition, 2020-10-13.
+    Astronomy::getPlanetPositions (Astronomy::getJulianDayFromGregorianDate (2020, 10, 13), planets);
+    const Astronomy::PlanetPosition &mars = planets[Astronomy::PLANET_MARS];
+    testAlmostEqual (mars.distance, 0.419, 0.005);
+    testAlmostEqual (mars.phase, 1, 0.01);
+    testAlmostEqual (mars.magnitude, -2.6, 0.2);
+}
+
+void checkPrecessionNutation () {
+    std::cout << "Testing precession and nutation" << std::endl;
+    using Caelum::Astronomy;
+
+    // Meeus examples 21.b and 23.a: theta Persei on 2028 November 13.19.
+    // Expected values are the mean place plus the nutation terms only.
+    LongReal jday = 2462088.69;
+    LongReal m[3][3], v[3], r[3];
+    LongReal dist;
+    Astronomy::convertSphericalToRectangular (41.054063, 49.227750, 1, v[0], v[1], v[2]);
+    Astronomy::getPrecessionNutationMatrix (jday, m);
+    for (int i = 0; i < 3; ++i) {
+        r[i] = m[i][0] * v[0] + m[i][1] * v[1] + m[i][2] * v[2];
+    }
+    LongReal rasc, decl;
+    Astronomy::convertRectangularToSpherical (r[0], r[1], r[2], rasc, decl, dist);
+    testAlmostEqual (rasc, 41.547214 + 15.843 / 3600, 1.0 / 3600);
+    testAlmostEqual (decl, 49.348483 + 6.218 / 3600, 1.0 / 3600);
+    testAlmostEqual (dist, 1, 1e-12);
+
+    LongReal dpsi, deps;
+    Astronomy::getNutation (2446895.5, dpsi, deps);
+    testAlmostEqual (dpsi * 3600, -3.788, 0.5);
+    testAlmostEqual (deps * 3600, 9.443, 0.5);
+}
+
+void checkScalarPolicies () {
+    std::cout << "Testing scalar policies" << std::endl;
+    using namespace Caelum;
+
+    for (int i = 0; i < 1000; ++i) {
+        LongReal jday = 2415020.5 + 73.0 * i;
+        LongReal longitude = -170 + (i * 37) % 340;
+        LongReal latitude = -85 + (i * 53) % 170;
+
+        LongReal az, alt;
+        float faz, falt;
+        long double laz, lalt;
+
+        Astronomy::getHorizontalSunPosition (jday, longitude, latitude, az, alt);
+        FastAstronomy::getHorizontalSunPosition (jday, float (longitude), float (latitude), faz, falt);
+        LongDoubleAstronomy::getHorizontalSunPosition (jday, longitude, latitude, laz, lalt);
+        testAlmostEqual (angleDifference (faz, az) * cos (alt * 0.017453292519943295), 0, 5e-4);
+        testAlmostEqual (falt, alt, 5e-4);
+        testAlmostEqual (angleDifference (LongReal (laz), az), 0, 1e-9);
+        testAlmostEqual (LongReal (lalt), alt, 1e-9);
+
+        Astronomy::getHorizontalMoonPosition (jday, longitude, latitude, az, alt);
+        FastAstronomy::getHorizontalMoonPosition (jday, float (longitude), float (latitude), faz, falt);
+        testAlmostEqual (angleDifference (faz, az) * cos (alt * 0.017453292519943295), 0, 5e-4);
+        testAlmostEqual (falt, alt, 5e-4);
+    }
+
+    // Long double julian days survive a round trip through the calendar.
+    int year, month, day, hour, minute;
+    long double second;
+    long double jday = LongDoubleAstronomy::getJulianDayFromGregorianDateTime (1987, 4, 10, 19, 21, 0);
+    LongDoubleAstronomy::getGregorianDateTimeFromJulianDay (jday, year, month, day, hour, minute, second);
+    assert (year == 1987 && month == 4 && day == 10 && hour == 19 && minute == 21);
+    testAlmostEqual (LongReal (second), 0, 1e-5);
+}
+
+void checkObserver () {
+    std::cout << "Testing observer cache" << std::endl;
+    using namespace Caelum;
+
+    Observer observer (-82.63, 27.97, 2451545.0);
+    for (int frame = 0; frame < 100; ++frame) {
+        LongReal jday = 2455000.5 + frame * 0.01;
+        observer.setLocation (-82.63, 27.97);
+        observer.setJulianDay (jday);
+
+        // Sun, moon and pole share one evaluation per frame.
+        LongReal az, alt, caz, calt;
+        DoubleAstronomy::getHorizontalSunPosition (observer, az, alt);
+        Astronomy::getHorizontalSunPosition (jday, -82.63, 27.97, caz, calt);
+        testAlmostEqual (angleDifference (az, caz), 0, 1e-9);
+        testAlmostEqual (alt, calt, 1e-9);
+        DoubleAstronomy::getHorizontalMoonPosition (observer, az, alt);
+        Astronomy::getHorizontalMoonPosition (jday, -82.63, 27.97, caz, calt);
+        testAlmostEqual (angleDifference (az, caz), 0, 1e-9);
+        testAlmostEqual (alt, calt, 1e-9);
+        DoubleAstronomy::getHorizontalNorthEclipticPolePosition (observer, az, alt);
+        DoubleAstronomy::getHorizontalNorthEclipticPolePosition (jday, -82.63, 27.97, caz, calt);
+        testAlmostEqual (angleDifference (az, caz), 0, 1e-9);
+        testAlmostEqual (alt, calt, 1e-9);
+
+        assert (observer.getLocationEvaluationCount () == 1);
+        assert (observer.getTimeEvaluationCount () == 2 + (unsigned long) frame);
+    }
+
+    observer.setLocation (10, 20);
+    assert (observer.getLocationEvaluationCount () == 2);
+}
+
+void checkFusedSky () {
+    std::cout << "Testing fused sky evaluation" << std::endl;
+    using namespace Caelum;
+
+    for (int i = 0; i < 500; ++i) {
+        LongReal jday = 2415020.5 + 146.1 * i;
+        LongReal longitude = -170 + (i * 37) % 340;
+        LongReal latitude = -85 + (i * 53) % 170;
+        Observer observer (longitude, latitude, jday);
+
+        DoubleAstronomy::SkyEvaluation sky;
+        DoubleAstronomy::evaluateSky (observer, sky);
+
+        LongReal az, alt;
+        Astronomy::getHorizontalSunPosition (jday, longitude, latitude, az, alt);
+        testAlmostEqual (angleDifference (sky.sun.getAzimuth (), az) * cos (alt * 0.017453292519943295), 0, 1e-9);
+        testAlmostEqual (sky.sun.getAltitude (), alt, 1e-9);
+        Astronomy::getHorizontalMoonPosition (jday, longitude, latitude, az, alt);
+        testAlmostEqual (angleDifference (sky.moon.getAzimuth (), az) * cos (alt * 0.017453292519943295), 0, 1e-9);
+        testAlmostEqual (sky.moon.getAltitude (), alt, 1e-9);
+        DoubleAstronomy::getHorizontalNorthEclipticPolePosition (jday, longitude, latitude, az, alt);
+        testAlmostEqual (angleDifference (sky.eclipticNorthPole.getAzimuth (), az) * cos (alt * 0.017453292519943295), 0, 1e-9);
+        testAlmostEqual (sky.eclipticNorthPole.getAltitude (), alt, 1e-9);
+
+        LongReal T = (jday - 2449143.3552943347L) / 29.53058867L;
+        testAlmostEqual (sky.moonPhase, T - floor (T), 1e-12);
+        testAlmostEqual (sky.sun.north * sky.sun.north + sky.sun.east * sky.sun.east + sky.sun.up * sky.sun.up, 1, 1e-12);
+    }
+}
+
+void checkEclipseTable () {
+    std::cout << "Testing eclipse table" << std::endl;
+    using namespace Caelum;
+
+    // Eclipses of 2024; maxima from the NASA eclipse catalogues.
+    EclipseTable table;
+    table.setThreadCount (1);
+    table.generate (Astronomy::getJulianDayFromGregorianDate (2024, 1, 1), Astronomy::getJulianDayFromGregorianDate (2025, 1, 1));
+    const std::vector<EclipseTable::Eclipse> &eclipses = table.getEclipses ();
+    assert (eclipses.size () == 4);
+    assert (eclipses[0].type == EclipseTable::LUNAR_PENUMBRAL);
+    assert (eclipses[1].type == EclipseTable::SOLAR_TOTAL);
+    assert (eclipses[2].type == EclipseTable::LUNAR_PARTIAL);
+    assert (eclipses[3].type == EclipseTable::SOLAR_ANNULAR);
+    const LongReal MINUTE = 1.0 / 1440;
+    testAlmostEqual (eclipses[0].maximum, Astronomy::getJulianDayFromGregorianDateTime (2024, 3, 25, 7, 13, 0), 10 * MINUTE);
+    testAlmostEqual (eclipses[1].maximum, Astronomy::getJulianDayFromGregorianDateTime (2024, 4, 8, 18, 17, 0), 10 * MINUTE);
+    testAlmostEqual (eclipses[2].maximum, Astronomy::getJulianDayFromGregorianDateTime (2024, 9, 18, 2, 44, 0), 10 * MINUTE);
+    testAlmostEqual (eclipses[3].maximum, Astronomy::getJulianDayFromGregorianDateTime (2024, 10, 2, 18, 45, 0), 10 * MINUTE);
+    testAlmostEqual (eclipses[2].magnitude, 0.085, 0.03);
+
+    // Splitting the range over threads finds the same events.
+    EclipseTable threaded;
+    threaded.setThreadCount (4);
+    threaded.generate (table.getStart (), table.getEnd ());
+    assert (threaded.getEclipses ().size () == eclipses.size ());
+    assert (threaded.getConjunctions ().size () == table.getConjunctions ().size ());
+    for (size_t i = 0; i < eclipses.size (); ++i) {
+        testAlmostEqual (threaded.getEclipses ()[i].maximum, eclipses[i].maximum, 1e-6);
+    }
+
+    // Lookups.
+    LongReal totality = Astronomy::getJulianDayFromGregorianDateTime (2024, 4, 8, 18, 42, 0);
+    assert (table.findEclipse (totality) == &eclipses[1]);
+    assert (table.findEclipse (totality + 1) == 0);
+    assert (table.findNextEclipse (totality + 1) == &eclipses[2]);
+    assert (table.findNextEclipse (table.getEnd ()) == 0);
+
+    // Totality in Dallas; nothing in Paris.
+    testAlmostEqual (table.getSunVisibleFraction (totality, -96.8, 32.78), 0, 0.05);
+    testAlmostEqual (table.getSunVisibleFraction (totality, 2.35, 48.85), 1, 1e-12);
+    testAlmostEqual (table.getSunVisibleFraction (totality + 1, -96.8, 32.78), 1, 1e-12);
+    LongReal umbra = table.getMoonUmbraFraction (eclipses[2].maximum);
+    assert (umbra > 0 && umbra < 0.1);
+    testAlmostEqual (table.getMoonUmbraFraction (eclipses[0].maximum), 0, 1e-12);
+
+    // Great conjunction of Jupiter and Saturn.
+    table.generate (Astronomy::getJulianDayFromGregorianDate (2020, 12, 1), Astronomy::getJulianDayFromGregorianDate (2021, 1, 1));
+    const EclipseTable::Conjunction *conjunction = table.findNextConjunction (table.getStart ());
+    while (conjunction && conjunction->first == EclipseTable::MOON) {
+        conjunction = table.findNextConjunction (conjunction->time + MINUTE);
+    }
+    assert (conjunction);
+    assert (conjunction->first == Astronomy::PLANET_JUPITER && conjunction->second == Astronomy::PLANET_SATURN);
+    testAlmostEqual (conjunction->time, Astronomy::getJulianDayFromGregorianDateTime (2020, 12, 21, 18, 0, 0), 0.5);
+    testAlmostEqual (conjunction->separation, 0.1, 0.05);
+}
+
+void checkAtmosphericLookup () {
+    std::cout << "Testing atmospheric lookup tables" << std::endl;
+    using Caelum::AtmosphericLookup;
+    AtmosphericLookup atmosphere;
+
+    // Tables against the reference formulas.
+    for (LongReal altitude = -10; altitude <= 90; altitude += 0.0137) {
+        testAlmostEqual (atmosphere.getRefraction (altitude), AtmosphericLookup::computeRefraction (altitude),
+                altitude > 0 ? 1.0 / 3600 : 60.0 / 3600);
+        if (altitude >= 0) {
+            testAlmostEqual (atmosphere.getExtinction (altitude),
+                    0.2 * (AtmosphericLookup::computeAirmass (altitude) - 1), 0.05);
+        }
+    }
+
+    // About 29' for a true altitude of 0, nothing at the zenith or far below the horizon.
+    testAlmostEqual (atmosphere.getRefraction (0) * 60, 29, 0.5);
+    testAlmostEqual (atmosphere.getRefraction (90), 0, 1e-4);
+    testAlmostEqual (atmosphere.getRefraction (-6), 0, 1e-12);
+    testAlmostEqual (atmosphere.getExtinction (90), 0, 1e-3);
+    testAlmostEqual (AtmosphericLookup::computeAirmass (30), 2, 0.01);
+
+    // Refracting a vector raises it and keeps the azimuth.
+    const LongReal DEG_TO_RAD = 0.017453292519943295;
+    float north = float (cos (0.2 * DEG_TO_RAD) * cos (1.0)), east = float (cos (0.2 * DEG_TO_RAD) * sin (1.0));
+    float up = float (sin (0.2 * DEG_TO_RAD));
+    atmosphere.refract (north, east, up);
+    testAlmostEqual (atan2 (east, north), 1, 1e-6);
+    testAlmostEqual (asin (up) / DEG_TO_RAD, atmosphere.getApparentAltitude (0.2), 1e-5);
+    testAlmostEqual (north * north + east * east + up * up, 1, 1e-6);
+
+    // Setting the coefficient rebuilds the shader table.
+    atmosphere.setExtinctionCoefficient (0.4);
+    testAlmostEqual (atmosphere.getExtinctionTable ()[0], 0.4 * (AtmosphericLookup::computeAirmass (0) - 1), 1e-5);
+}
+
+void checkSatelliteConstellation () {
+    std::cout << "Testing satellite constellation" << std::endl;
+    using Caelum::SatelliteConstellation;
+
+    // Vanguard 1 from the SGP4 verification set, a GPS satellite (deep
+    // space, refused) and a truncated entry.
+    std::stringstream tle;
+    tle << "VANGUARD 1\n"
+        << "1 00005U 58002B   00179.78495062  .00000023  00000-0  28098-4 0  4753\n"
+        << "2 00005  34.2682 348.7242 1859667 331.7664  19.3264 10.82419157413667\n"
+        << "GPS BIIR-2\n"
+        << "1 24876U 97035A   08239.72451799  .00000023  00000-0  10000-3 0  5538\n"
+        << "2 24876  55.8949 162.9869 0044154 231.5741 128.0461  2.00564052 81377\n"
+        << "BROKEN\n"
+        << "1 99999U\n";
+    SatelliteConstellation satellites;
+    testAlmostEqual (LongReal (satellites.addTleStream (tle)), 1, 0.5);
+    testAlmostEqual (satellites.getCatalogNumber (0), 5, 0.5);
+    if (satellites.getName (0) != "VANGUARD 1") {
+        std::cout << "Wrong satellite name " << satellites.getName (0) << std::endl;
+        exit (1);
+    }
+
+    // Reference vectors from Vallado's SGP4 verification output, in km.
+    const LongReal epoch = 2451723.28495062;
+    const LongReal expected[][4] = {
+        {    0,  7022.46529266, -1400.08296755,     0.03995155 },
+        {  360, -7154.03120202, -3783.17682504, -3536.19412294 },
+        {  720, -7134.59340119,  6531.68641334,  3260.27186483 },
+        { 1440,  -938.55923943, -6268.18748831, -4294.02924751 },
+    };
+    for (const LongReal *row: expected) {
+        satellites.propagate (epoch + row[0] / 1440);
+        LongReal x, y, z;
+        satellites.getTemePosition (0, x, y, z);
+        testAlmostEqual (x, row[1], 1e-5);
+        testAlmostEqual (y, row[2], 1e-5);
+        testAlmostEqual (z, row[3], 1e-5);
+    }
+
+    // An observer right under the satellite sees it at the zenith, and
+    // one on the other side of the earth not at all.
+    satellites.propagate (epoch + 0.1);
+    LongReal x, y, z;
+    satellites.getTemePosition (0, x, y, z);
+    LongReal distance = sqrt (x * x + y * y + z * z);
+    LongReal horizontal = sqrt (x * x + y * y);
+    satellites.update (epoch + 0.1, z / distance, horizontal / distance, y / horizontal, x / horizontal);
+    float north, east, up;
+    satellites.getHorizontalDirection (0, north, east, up);
+    testAlmostEqual (up, 1, 1e-4);
+    testAlmostEqual (north * north + east * east + up * up, 1, 1e-5);
+    testAlmostEqual (satellites.getRange (0), distance - 6378, 25);
+    satellites.update (epoch + 0.1, -z / distance, horizontal / distance, -y / horizontal, -x / horizontal);
+    satellites.getHorizontalDirection (0, north, east, up);
+    testAlmostEqual (up, -1, 1e-3);
+
+    // Brightness follows the distance while sunlit; the shadow is found
+    // over one orbit.
+    int sunlit = 0;
+    for (int minute = 0; minute < 134; ++minute) {
+        satellites.update (Caelum::FastObserver (10, 50, epoch + minute / 1440.0));
+        if (satellites.isSunlit (0)) {
+            ++sunlit;
+            testAlmostEqual (satellites.getMagnitude (0), 5 + 5 * log10 (satellites.getRange (0) / 1000), 1e-4);
+        }
+    }
+    testAlmostEqual (sunlit, 110, 24);
+
+    // Vertices: six corners per satellite, all at the transformed direction.
+    const float identity[3][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+    float vertices[SatelliteConstellation::VERTEX_FLOATS_PER_SATELLITE];
+    satellites.writeVertices (identity, vertices);
+    satellites.getHorizontalDirection (0, north, east, up);
+    for (int corner = 0; corner < 6; ++corner) {
+        testAlmostEqual (vertices[6 * corner], north, 1e-7);
+        testAlmostEqual (vertices[6 * corner + 2], up, 1e-7);
+        testAlmostEqual (vertices[6 * corner + 5], satellites.getMagnitude (0), 1e-7);
+    }
+
+    for (LongReal value = 1e-3; value < 1e8; value *= 1.37) {
+        testAlmostEqual (Caelum::BatchMath::log10 (value), log10 (value), 1e-12);
+    }
+}
+
+void checkCelestialBodies () {
+    std::cout << "Testing celestial bodies" << std::endl;
+    using Caelum::CelestialBodies;
+
+    // Default elements are the sun's; a moon on the opposite side of the
+    // sky is full, one next to the sun is new.
+    CelestialBodies bodies;
+    CelestialBodies::Body sun;
+    bodies.add (sun);
+    CelestialBodies::Body fullMoon = sun;
+    fullMoon.type = CelestialBodies::BODY_MOON;
+    fullMoon.M0 += 180;
+    fullMoon.a = 2;
+    fullMoon.e = 0;
+    bodies.add (fullMoon);
+    CelestialBodies::Body newMoon = fullMoon;
+    newMoon.M0 = sun.M0;
+    newMoon.illuminator = 0;
+    bodies.add (newMoon);
+
+    for (LongReal jday = 2451545.0; jday < 2451545.0 + 365; jday += 36.6) {
+        Caelum::Observer observer (-20, 40, jday);
+        Caelum::DoubleAstronomy::SkyEvaluation sky;
+        Caelum::DoubleAstronomy::evaluateSky (observer, sky);
+        bodies.update (observer);
+
+        const CelestialBodies::State &state = bodies.getState (0);
+        testAlmostEqual (state.north, sky.sun.north, 1e-3);
+        testAlmostEqual (state.east, sky.sun.east, 1e-3);
+        testAlmostEqual (state.up, sky.sun.up, 1e-3);
+        testAlmostEqual (state.phase, 1, 1e-7);
+        testAlmostEqual (state.angularRadius, 0.2666 * (1 / state.distance), 1e-3);
+        testAlmostEqual (state.brightness, state.up > 0.05 ? 1 / (state.distance * state.distance) : 0, 1e-5);
+
+        testAlmostEqual (bodies.getState (1).phase, 1, 1e-3);
+        testAlmostEqual (bodies.getState (2).phase, 0, 1e-3);
+
+        // Light colour is brightness times colour, and fades out below the horizon.
+        const CelestialBodies::State &moon = bodies.getState (1);
+        testAlmostEqual (moon.lightColour[1], moon.brightness, 1e-7);
+        if (moon.up < -0.05) {
+            testAlmostEqual (moon.brightness, 0, 1e-7);
+        } else if (moon.up > 0.05) {
+            testAlmostEqual (moon.brightness, moon.phase, 1e-5);
+        }
+    }
+}
+
+void checkUniversalClock () {
+    std::cout << "Testing universal clock" << std::endl;
+    using Caelum::UniversalClock;
+
+    // Gregorian dates are exact and agree with Astronomy.
+    UniversalClock clock;
+    testAlmostEqual (clock.getJulianDay (), Caelum::Astronomy::J2000, 1e-12);
+    clock.setGregorianDateTime (1987, 4, 10, 19, 21, 0.25);
+    testAlmostEqual (clock.getJulianDay (),
+            Caelum::Astronomy::getJulianDayFromGregorianDateTime (1987, 4, 10, 19, 21, 0.25), 1e-9);
+    testAlmostEqual (LongReal (clock.getJulianDayNumber ()), 2446896, 0.5);
+    testAlmostEqual (LongReal (clock.getNanosecondOfDay ()), (7 * 3600 + 21 * 60 + 0.25) * 1e9, 0.5);
+    clock.setGregorianDateTime (1987, 4, 10, 0, 0, 0);
+    testAlmostEqual (clock.getJulianDay (), 2446895.5, 1e-12);
+
+    // Four weeks of 60 Hz frames lose nothing, forwards and back.
+    UniversalClock other;
+    clock.setJulianDay (Caelum::Astronomy::J2000);
+    const LongReal frames = 4 * 7 * 86400 * 60;
+    for (LongReal frame = 0; frame < frames; ++frame) {
+        clock.advance (16666667);
+    }
+    testAlmostEqual (LongReal (clock.getNanosecondDifference ()), 16666667, 0.5);
+    testAlmostEqual (clock.getJulianSecondDifference (), 0.016666667, 1e-15);
+    testAlmostEqual (clock.getJulianDay (), Caelum::Astronomy::J2000 + frames * 0.016666667 / 86400, 1e-9);
+    other.setJulianDay (clock.getJulianDayNumber (), clock.getNanosecondOfDay ());
+    if (clock != other) {
+        std::cout << "Clock copy differs" << std::endl;
+        exit (1);
+    }
+    for (LongReal frame = 0; frame < frames; ++frame) {
+        clock.advance (-16666667);
+    }
+    other.setJulianDay (Caelum::Astronomy::J2000);
+    if (clock != other) {
+        std::cout << "Clock did not return to J2000" << std::endl;
+        exit (1);
+    }
+
+    // Scaled updates round to the nanosecond, also backwards over midnight.
+    clock.setJulianDay (2451545.0, -1000);
+    testAlmostEqual (LongReal (clock.getJulianDayNumber ()), 2451544, 0.5);
+    testAlmostEqual (LongReal (clock.getNanosecondOfDay ()), LongReal (UniversalClock::NANOSECONDS_PER_DAY - 1000), 0.5);
+    clock.setTimeScale (-2);
+    clock.update (0.5);
+    testAlmostEqual (LongReal (clock.getNanosecondDifference ()), -1e9, 0.5);
+    testAlmostEqual (clock.getJulianDayDifference (), -1 / 86400.0, 1e-15);
+    testAlmostEqual (clock.getJulianDay (), 2451545.0 - (1 + 1e-6) / 86400, 1e-10);
+}
+
+void checkClockDomain () {
+    std::cout << "Testing clock domains" << std::endl;
+    using namespace Caelum;
+
+    // Domains start where CaelumSystem does.
+    ClockDomain domain ("dungeon");
+    testAlmostEqual (domain.getUniversalClock ()->getJulianDay (), Astronomy::J2000, 1e-12);
+    testAlmostEqual (domain.getObserverLatitude ().valueDegrees (), 45, 1e-6);
+
+    // A cached sky stays current until the clock or the place moves.
+    CachedSky &cache = domain.getCachedSky ();
+    const UniversalClock &clock = *domain.getUniversalClock ();
+    if (cache.isCurrent (clock.getSkyClockTime (), domain.getObserverLongitude ().valueDegrees (),
+            domain.getObserverLatitude ().valueDegrees ())) {
+        std::cout << "New cache is current" << std::endl;
+        exit (1);
+    }
+    cache.markCurrent (clock.getSkyClockTime (), domain.getObserverLongitude ().valueDegrees (),
+            domain.getObserverLatitude ().valueDegrees ());
+    bool current = cache.isCurrent (clock.getSkyClockTime (), domain.getObserverLongitude ().valueDegrees (),
+            domain.getObserverLatitude ().valueDegrees ());
+    domain.getUniversalClock ()->advance (1);
+    bool afterTick = cache.isCurrent (clock.getSkyClockTime (), domain.getObserverLongitude ().valueDegrees (),
+            domain.getObserverLatitude ().valueDegrees ());
+    cache.markCurrent (clock.getSkyClockTime (), domain.getObserverLongitude ().valueDegrees (),
+            domain.getObserverLatitude ().valueDegrees ());
+    domain.setObserverLongitude (Ogre::Degree (10));
+    bool afterMove = cache.isCurrent (clock.getSkyClockTime (), domain.getObserverLongitude ().valueDegrees (),
+            domain.getObserverLatitude ().valueDegrees ());
+    if (!current || afterTick || afterMove) {
+        std::cout << "Cached sky currency is wrong" << std::endl;
+        exit (1);
+    }
+    testAlmostEqual (LongReal (cache.evaluationCount), 2, 0.5);
+}
+
+void checkFixedTickClock () {
+    std::cout << "Testing fixed tick clock" << std::endl;
+    using namespace Caelum;
+
+    // Clients at different frame rates only ever land on whole ticks,
+    // at most one apart, and equal tick counts are equal clocks.
+    UniversalClock fast, slow, stepped;
+    fast.setTickLength (100000000);
+    slow.setTickLength (100000000);
+    fast.setTimeScale (60);
+    slow.setTimeScale (60);
+    testAlmostEqual (LongReal (fast.getTickAdvance ()), 6e9, 0.5);
+    for (int second = 0; second < 600; ++second) {
+        for (int frame = 0; frame < 144; ++frame) {
+            fast.update (1 / 144.0f);
+        }
+        for (int frame = 0; frame < 30; ++frame) {
+            slow.update (1 / 30.0f);
+        }
+        std::int64_t fastTicks = ((fast.getJulianDayNumber () - 2451545) * UniversalClock::NANOSECONDS_PER_DAY +
+                fast.getNanosecondOfDay ()) / 6000000000LL;
+        std::int64_t slowTicks = ((slow.getJulianDayNumber () - 2451545) * UniversalClock::NANOSECONDS_PER_DAY +
+                slow.getNanosecondOfDay ()) / 6000000000LL;
+        stepped.setJulianDay (Astronomy::J2000);
+        stepped.setTimeScale (60);
+        stepped.setTickLength (100000000);
+        stepped.stepTicks (slowTicks);
+        if (fast.getNanosecondOfDay () % 6000000000LL != 0 || slow != stepped ||
+                std::abs (fastTicks - slowTicks) > 1) {
+            std::cout << "Ticking clocks drifted apart" << std::endl;
+            exit (1);
+        }
+    }
+    testAlmostEqual (stepped.getJulianDay (), Astronomy::J2000 + 6000 * 6 / 86400.0, 1e-6);
+
+    // Partial ticks only show in the render time.
+    UniversalClock clock;
+    clock.setTickLength (100000000);
+    clock.update (0.25f);
+    testAlmostEqual (LongReal (clock.getNanosecondDifference ()), 2e8, 0.5);
+    testAlmostEqual (clock.getRenderAlpha (), 0.5, 1e-6);
+    testAlmostEqual (clock.getRenderJulianDay (), clock.getJulianDay () - 0.05 / 86400, 1e-10);
+    clock.update (0.04f);
+    testAlmostEqual (LongReal (clock.getNanosecondDifference ()), 0, 0.5);
+    testAlmostEqual (clock.getRenderAlpha (), 0.9, 1e-6);
+    clock.setTickLength (0);
+    testAlmostEqual (clock.getRenderJulianDay (), clock.getJulianDay (), 1e-12);
+
+    // The previous tick is the one the clock visited, whatever the scale is now.
+    UniversalClock scaled;
+    scaled.setTickLength (100000000);
+    scaled.update (0.25f);
+    testAlmostEqual (scaled.getPreviousTickJulianDay (), Astronomy::J2000 + 0.1 / 86400, 1e-10);
+    scaled.setTimeScale (60);
+    testAlmostEqual (scaled.getPreviousTickJulianDay (), Astronomy::J2000 + 0.1 / 86400, 1e-10);
+    testAlmostEqual (scaled.getRenderJulianDay (), Astronomy::J2000 + 0.15 / 86400, 1e-10);
+    scaled.update (0.1f);
+    testAlmostEqual (scaled.getPreviousTickJulianDay (), Astronomy::J2000 + 0.2 / 86400, 1e-10);
+    testAlmostEqual (scaled.getJulianDay (), Astronomy::J2000 + 6.2 / 86400, 1e-10);
+    scaled.setJulianDay (Astronomy::J2000 + 1);
+    testAlmostEqual (scaled.getPreviousTickJulianDay (), scaled.getJulianDay (), 1e-12);
+    testAlmostEqual (scaled.getRenderJulianDay (), scaled.getJulianDay (), 1e-12);
+
+    // Interpolated skies follow the real sky between ticks.
+    FastAstronomy::SkyEvaluation from, to, between, exact;
+    FastObserver fastObserver;
+    for (int i = 0; i < 3; ++i) {
+        LongReal jday = 2451545.0 + 0.3 * i;
+        fastObserver.setLocation (20, 45);
+        fastObserver.setJulianDay (jday);
+        FastAstronomy::evaluateSky (fastObserver, from);
+        fastObserver.setJulianDay (jday + 0.1 / 86400 * 60);
+        FastAstronomy::evaluateSky (fastObserver, to);
+        fastObserver.setJulianDay (jday + 0.025 / 86400 * 60);
+        FastAstronomy::evaluateSky (fastObserver, exact);
+        FastAstronomy::interpolateSky (from, to, 0.25f, between);
+        testAlmostEqual (between.sun.north, exact.sun.north, 1e-5);
+        testAlmostEqual (between.sun.up, exact.sun.up, 1e-5);
+        testAlmostEqual (between.moon.east, exact.moon.east, 1e-5);
+        testAlmostEqual (between.moonPhase, exact.moonPhase, 1e-5);
+    }
+    from.moonPhase = 0.99f;
+    to.moonPhase = 0.01f;
+    FastAstronomy::interpolateSky (from, to, 0.75f, between);
+    testAlmostEqual (between.moonPhase, 0.005, 1e-5);
+}
+
+void checkUpdateThrottle () {
+    std::cout << "Testing update throttle" << std::endl;
+    using namespace Caelum;
+
+    // Every frame by default, also with unchanged inputs.
+    UpdateThrottle throttle;
+    LongReal inputs[3] = { 0, 1, 0 };
+    for (int frame = 0; frame < 10; ++frame) {
+        throttle.shouldUpdate (0.01f, inputs, 3);
+    }
+    testAlmostEqual (LongReal (throttle.getUpdateCount ()), 10, 0.5);
+    testAlmostEqual (LongReal (throttle.getSkipCount ()), 0, 0.5);
+
+    // 100 frames of 10 ms at an interval of 0.1 s.
+    throttle.setPolicy (UpdateThrottle::UPDATE_INTERVAL);
+    throttle.setInterval (0.1f);
+    throttle.resetCounters ();
+    for (int frame = 0; frame < 100; ++frame) {
+        throttle.shouldUpdate (0.0101f, inputs, 3);
+    }
+    testAlmostEqual (LongReal (throttle.getUpdateCount ()), 10, 0.5);
+    testAlmostEqual (LongReal (throttle.getSkipCount ()), 90, 0.5);
+
+    // Changes below epsilon add up until they pass it; forcing always updates.
+    throttle.setPolicy (UpdateThrottle::UPDATE_ON_CHANGE);
+    throttle.setEpsilon (1e-3f);
+    throttle.resetCounters ();
+    for (int frame = 0; frame < 100; ++frame) {
+        inputs[0] += 1e-4;
+        throttle.shouldUpdate (0.01f, inputs, 3);
+    }
+    testAlmostEqual (LongReal (throttle.getUpdateCount ()), 9, 1.5);
+    if (!throttle.shouldUpdate (0.01f, inputs, 3, true) || throttle.shouldUpdate (0.01f, inputs, 3)) {
+        std::cout << "Forced throttle update is wrong" << std::endl;
+        exit (1);
+    }
+    throttle.invalidate ();
+    if (!throttle.shouldUpdate (0.01f, inputs, 3)) {
+        std::cout << "Invalidated throttle skipped" << std::endl;
+        exit (1);
+    }
+}
+
+void checkSkyStateEvaluator () {
+    std::cout << "Testing sky state evaluator" << std::endl;
+    using namespace Caelum;
+
+    // Without images the colours are the old defaults, and the sky is plain astronomy.
+    SkyStateConfig config;
+    const LongReal jday = 2451545.25, longitude = 10, latitude = 50;
+    SkyState state = SkyStateEvaluator::evaluate (jday, longitude, latitude, config);
+    FastObserver observer (longitude, latitude, jday);
+    FastAstronomy::SkyEvaluation sky;
+    FastAstronomy::evaluateSky (observer, sky);
+    testAlmostEqual (state.sky.sun.up, sky.sun.up, 1e-6);
+    testAlmostEqual (state.sky.moon.north, sky.moon.north, 1e-6);
+    testAlmostEqual (state.fogDensity, 0, 1e-12);
+    testAlmostEqual (state.sunLightColour.g, 1, 1e-12);
+    testAlmostEqual (state.moonLightColour.b, 1, 1e-12);
+    testAlmostEqual (state.sunVisibleFraction, 1, 1e-12);
+
+    // Same inputs, same state; nothing is kept between calls.
+    SkyState again = SkyStateEvaluator::evaluate (jday, longitude, latitude, config);
+    testAlmostEqual (again.sky.moonPhase, state.sky.moonPhase, 1e-12);
+    testAlmostEqual (again.sky.sun.east, state.sky.sun.east, 1e-12);
+
+    // A 3x2 gradient; red is the column, alpha the row. Elevation 0.5 is the middle column.
+    const float pixels[] = {
+            0.0f, 0, 0, 0.0f,  0.5f, 0, 0, 0.0f,  1.0f, 0, 0, 0.0f,
+            0.0f, 0, 0, 1.0f,  0.5f, 0, 0, 1.0f,  1.0f, 0, 0, 1.0f };
+    ColourGradient gradient (3, 2, pixels);
+    testAlmostEqual (gradient.getInterpolatedColour (0.25f, 1).r, 0.25, 1e-6);
+    testAlmostEqual (gradient.getInterpolatedColour (2.0f, 0).r, 1, 1e-6);
+    config.skyGradients = &gradient;
+    testAlmostEqual (SkyStateEvaluator::getFogColour (config, 0).r, 0.5, 1e-6);
+    testAlmostEqual (SkyStateEvaluator::getFogDensity (config, 0), 1, 1e-6);
+    testAlmostEqual (SkyStateEvaluator::getFogColour (config, -1).r, 1, 1e-6);
+    testAlmostEqual (SkyStateEvaluator::getSunLightColour (config, 1).r, 0, 1e-6);
+
+    // Refraction only lifts the sun.
+    AtmosphericLookup atmosphere;
+    config.refraction = &atmosphere;
+    for (int i = 0; i < 48; ++i) {
+        LongReal time = jday + i / 48.0;
+        SkyState geometric = SkyStateEvaluator::evaluate (time, longitude, latitude, SkyStateConfig ());
+        SkyState refracted = SkyStateEvaluator::evaluate (time, longitude, latitude, config);
+        if (refracted.sky.sun.up < geometric.sky.sun.up - 1e-6f) {
+            std::cout << "Refraction lowered the sun" << std::endl;
+            exit (1);
+        }
+    }
+}
+
+void checkTaskGraph () {
+    std::cout << "Testing task graph" << std::endl;
+    using namespace Caelum;
+
+    // A diamond with a calling thread tail: 0 -> (1, 2) -> 3.
+    std::vector<int> order;
+    std::mutex orderMutex;
+    std::thread::id callingThread = std::this_thread::get_id (), tailThread;
+    TaskGraph graph;
+    for (int i = 0; i < 3; ++i) {
+        graph.addTask ("task", [&order, &orderMutex, i] () {
+            std::lock_guard<std::mutex> lock (orderMutex);
+            order.push_back (i);
+        });
+    }
+    TaskGraph::TaskId tail = graph.addTask ("tail", [&] () {
+        tailThread = std::this_thread::get_id ();
+        order.push_back (3);
+    }, TaskGraph::CALLING_THREAD);
+    graph.addDependency (1, 0);
+    graph.addDependency (2, 0);
+    graph.addDependency (tail, 1);
+    graph.addDependency (tail, 2);
+
+    // Inline runs in the order tasks were added.
+    graph.run (0);
+    if (order != std::vector<int> ({ 0, 1, 2, 3 })) {
+        std::cout << "Inline task graph ran out of order" << std::endl;
+        exit (1);
+    }
+
+    ThreadPoolExecutor pool (3);
+    for (int run = 0; run < 200; ++run) {
+        order.clear ();
+        tailThread = std::thread::id ();
+        graph.run (&pool);
+        if (order.size () != 4 || order[0] != 0 || order[3] != 3 || tailThread != callingThread) {
+            std::cout << "Parallel task graph broke a dependency" << std::endl;
+            exit (1);
+        }
+    }
+
+    // Exceptions come out of run after every task finished.
+    TaskGraph failing;
+    int finished = 0;
+    failing.addTask ("throws", [] () { throw std::runtime_error ("task failed"); });
+    failing.addTask ("runs anyway", [&finished] () { ++finished; }, TaskGraph::CALLING_THREAD);
+    bool caught = false;
+    try {
+        failing.run (&pool);
+    } catch (const std::runtime_error &) {
+        caught = true;
+    }
+    if (!caught || finished != 1) {
+        std::cout << "Task graph lost an exception or a task" << std::endl;
+        exit (1);
+    }
+
+    // The critical path is the slow chain, not the quick side task.
+    TaskGraph timed;
+    TaskGraph::TaskId slow1 = timed.addTask ("slow 1", [] () { std::this_thread::sleep_for (std::chrono::milliseconds (20)); });
+    timed.addTask ("quick", [] () { std::this_thread::sleep_for (std::chrono::milliseconds (2)); });
+    TaskGraph::TaskId slow2 = timed.addTask ("slow 2", [] () { std::this_thread::sleep_for (std::chrono::milliseconds (20)); },
+            TaskGraph::CALLING_THREAD);
+    timed.addDependency (slow2, slow1);
+    timed.run (&pool);
+    std::vector<TaskGraph::TaskId> path = timed.getCriticalPath ();
+    if (path.size () != 2 || path[0] != slow1 || path[1] != slow2) {
+        std::cout << "Wrong critical path" << std::endl;
+        timed.dumpTimings (std::cout);
+        exit (1);
+    }
+    if (timed.getCriticalPathDuration () < 0.039 || timed.getCriticalPathDuration () > timed.getRunDuration () + 1e-6) {
+        std::cout << "Wrong critical path duration" << std::endl;
+        timed.dumpTimings (std::cout);
+        exit (1);
+    }
+}
+
+void checkSkySnapshot () {
+    std::cout << "Testing sky snapshot" << std::endl;
+    using namespace Caelum;
+
+    SkySnapshotBuffer buffer;
+    if (buffer.read ().version != 0 || buffer.getVersion () != 0) {
+        std::cout << "Fresh snapshot buffer has a version" << std::endl;
+        exit (1);
+    }
+
+    // One writer, many readers; every field of update k is k, so a torn copy shows.
+    const int updates = 200000, readerCount = 8;
+    std::atomic<bool> done (false);
+    std::atomic<int> torn (0), backwards (0);
+    std::atomic<long> reads (0);
+    std::atomic<int> started (0);
+    std::vector<std::thread> readers;
+    for (int r = 0; r < readerCount; ++r) {
+        readers.push_back (std::thread ([&] () {
+            std::uint64_t last = 0;
+            ++started;
+            do {
+                SkySnapshot snapshot = buffer.read ();
+                const float k = float (snapshot.version);
+                const float *fields[] = {
+                        snapshot.sunDirection, snapshot.sunLightColour, snapshot.moonDirection,
+                        snapshot.moonLightColour, snapshot.fogColour };
+                const int sizes[] = { 3, 4, 3, 4, 4 };
+                bool consistent = snapshot.julianDay == LongReal (snapshot.version) &&
+                        snapshot.fogDensity == k && snapshot.moonPhase == k;
+                for (int f = 0; f < 5; ++f) {
+                    for (int i = 0; i < sizes[f]; ++i) {
+                        consistent = consistent && fields[f][i] == k;
+                    }
+                }
+                torn += consistent ? 0 : 1;
+                backwards += snapshot.version < last ? 1 : 0;
+                last = snapshot.version;
+                ++reads;
+            } while (!done.load ());
+        }));
+    }
+
+    while (started.load () < readerCount) {
+        std::this_thread::yield ();
+    }
+    for (int k = 1; k <= updates; ++k) {
+        SkySnapshot snapshot;
+        const float value = float (k);
+        snapshot.julianDay = k;
+        snapshot.longitude = snapshot.latitude = 0;
+        snapshot.sunVisibleFraction = snapshot.moonUmbraFraction = 0;
+        snapshot.fogDensity = snapshot.moonPhase = value;
+        for (int i = 0; i < 4; ++i) {
+            snapshot.sunLightColour[i] = snapshot.moonLightColour[i] = snapshot.fogColour[i] = value;
+            if (i < 3) {
+                snapshot.sunDirection[i] = snapshot.moonDirection[i] = value;
+            }
+        }
+        buffer.publish (snapshot);
+        if (k % 256 == 0) {
+            std::this_thread::yield ();
+        }
+    }
+    done = true;
+    for (size_t r = 0; r < readers.size (); ++r) {
+        readers[r].join ();
+    }
+
+    if (torn.load () != 0 || backwards.load () != 0 || reads.load () < readerCount) {
+        std::cout << "Snapshot readers saw " << torn.load () << " torn and "
+                << backwards.load () << " older copies in " << reads.load () << " reads" << std::endl;
+        exit (1);
+    }
+    if (buffer.getVersion () != std::uint64_t (updates) || buffer.read ().version != std::uint64_t (updates)) {
+        std::cout << "Snapshot version is not the number of updates" << std::endl;
+        exit (1);
+    }
+}
+
+void checkKeyframedSky () {
+    std::cout << "Testing keyframed sky" << std::endl;
+    using namespace Caelum;
+
+    // A gradient so colours change with the sun.
+    const float pixels[] = {
+            0.0f, 0, 0, 0.0f,  0.5f, 0, 0, 0.0f,  1.0f, 0, 0, 0.0f,
+            0.0f, 0, 0, 1.0f,  0.5f, 0, 0, 1.0f,  1.0f, 0, 0, 1.0f };
+    ColourGradient gradient (3, 2, pixels);
+    SkyStateConfig config;
+    config.skyGradients = &gradient;
+    const LongReal start = 2451545.25, longitude = 10, latitude = 50;
+
+    KeyframedSky keyframes;
+    keyframes.setErrorTracking (true);
+    testAlmostEqual (keyframes.getEffectiveInterval (), keyframes.getMaxAngle () / KeyframedSky::MAX_ANGULAR_SPEED, 1e-9);
+
+    // A day at one call per game second, some compared with exact states.
+    SkyState state;
+    double maxError = 0;
+    const unsigned long calls = 86400;
+    for (unsigned long i = 0; i < calls; ++i) {
+        const LongReal jday = start + i / 86400.0;
+        keyframes.evaluate (jday, longitude, latitude, config, state);
+        if (i % 97 == 0) {
+            SkyState exact = SkyStateEvaluator::evaluate (jday, longitude, latitude, config);
+            maxError = std::max (maxError, double (std::fabs (state.sky.sun.up - exact.sky.sun.up)));
+            maxError = std::max (maxError, double (std::fabs (state.sky.moon.east - exact.sky.moon.east)));
+            maxError = std::max (maxError, double (std::fabs (state.fogColour.r - exact.fogColour.r)));
+            testAlmostEqual (state.julianDay, jday, 1e-12);
+        }
+    }
+    if (maxError > 1e-4 || keyframes.getEvaluateCount () != calls ||
+            keyframes.getExactCount () * 10 > calls) {
+        std::cout << "Keyframes were off by " << maxError << " with " << keyframes.getExactCount ()
+                << " exact evaluations in " << keyframes.getEvaluateCount () << " calls" << std::endl;
+        exit (1);
+    }
+    if (keyframes.getMaxDirectionError () <= 0 || keyframes.getMaxDirectionError () > 1e-4) {
+        std::cout << "Keyframe direction error is " << keyframes.getMaxDirectionError () << std::endl;
+        exit (1);
+    }
+
+    // Running backwards moves the samples back too.
+    keyframes.resetStatistics ();
+    for (unsigned long i = 0; i < 3600; ++i) {
+        keyframes.evaluate (start + (calls - i) / 86400.0, longitude, latitude, config, state);
+    }
+    SkyState exact = SkyStateEvaluator::evaluate (start + (calls - 3599) / 86400.0, longitude, latitude, config);
+    testAlmostEqual (state.sky.sun.north, exact.sky.sun.north, 1e-4);
+    if (keyframes.getExactCount () * 10 > 3600) {
+        std::cout << "Keyframes resampled " << keyframes.getExactCount () << " times backwards" << std::endl;
+        exit (1);
+    }
+
+    // Another place starts over.
+    keyframes.evaluate (start + 0.5, longitude + 90, latitude, config, state);
+    exact = SkyStateEvaluator::evaluate (start + 0.5, longitude + 90, latitude, config);
+    testAlmostEqual (state.sky.sun.east, exact.sky.sun.east, 1e-6);
+
+    // A clock passing an interval per call is evaluated exactly every time.
+    keyframes.evaluate (start, longitude, latitude, config, state);
+    keyframes.resetStatistics ();
+    for (int i = 1; i <= 100; ++i) {
+        const LongReal jday = start + i / 24.0;
+        keyframes.evaluate (jday, longitude, latitude, config, state);
+        exact = SkyStateEvaluator::evaluate (jday, longitude, latitude, config);
+        testAlmostEqual (state.sky.moon.up, exact.sky.moon.up, 1e-12);
+    }
+    if (keyframes.getExactCount () != 100) {
+        std::cout << "Fast clock got " << keyframes.getExactCount () << " exact evaluations" << std::endl;
+        exit (1);
+    }
+}
+
+void checkSkyTimeline () {
+    std::cout << "Testing sky timeline" << std::endl;
+    using namespace Caelum;
+
+    const float pixels[] = {
+            0.0f, 0, 0, 0.0f,  0.5f, 0, 0, 0.0f,  1.0f, 0, 0, 0.0f,
+            0.0f, 0, 0, 1.0f,  0.5f, 0, 0, 1.0f,  1.0f, 0, 0, 1.0f };
+    ColourGradient gradient (3, 2, pixels);
+    SkyStateConfig config;
+    config.skyGradients = &gradient;
+    const LongReal start = 2451545.25, longitude = 10, latitude = 50;
+    const LongReal minute = 1 / 1440.0;
+
+    SkyTimeline timeline;
+    timeline.setCapacity (64);
+    SkyState state, exact;
+
+    // Nothing is cached at first; then the worker fills the window.
+    if (timeline.evaluate (start, longitude, latitude, config, state)) {
+        std::cout << "Empty timeline had a sample" << std::endl;
+        exit (1);
+    }
+    timeline.waitForWindow ();
+    if (timeline.getCachedCount () != 63 || !timeline.isCached (start + 40 * minute) || timeline.isCached (start + 50 * minute)) {
+        std::cout << "Timeline window has " << timeline.getCachedCount () << " samples" << std::endl;
+        exit (1);
+    }
+
+    // A time-lapse of ten game minutes a frame reads from the cache.
+    for (int frame = 0; frame < 200; ++frame) {
+        const LongReal jday = start + (frame * 10 + 0.3) * minute;
+        const bool hit = timeline.evaluate (jday, longitude, latitude, config, state);
+        exact = SkyStateEvaluator::evaluate (jday, longitude, latitude, config);
+        testAlmostEqual (state.sky.sun.up, exact.sky.sun.up, 1e-4);
+        testAlmostEqual (state.sky.moon.east, exact.sky.moon.east, 1e-4);
+        testAlmostEqual (state.fogColour.r, exact.fogColour.r, 1e-3);
+        testAlmostEqual (state.julianDay, jday, 1e-12);
+        if (frame > 0 && !hit) {
+            std::cout << "Time-lapse frame " << frame << " missed the timeline" << std::endl;
+            exit (1);
+        }
+        timeline.waitForWindow ();
+        if (timeline.getCachedCount () > timeline.getCapacity ()) {
+            std::cout << "Timeline grew past its capacity" << std::endl;
+            exit (1);
+        }
+    }
+
+    // Scrubbing back inside the window is served from the cache, and turns the window round.
+    const LongReal now = start + 1990 * minute;
+    for (int i = 1; i <= 15; ++i) {
+        if (!timeline.evaluate (now - i * minute, longitude, latitude, config, state)) {
+            std::cout << "Scrubbing back " << i << " minutes missed the timeline" << std::endl;
+            exit (1);
+        }
+    }
+    timeline.waitForWindow ();
+    if (!timeline.isCached (now - 40 * minute)) {
+        std::cout << "Timeline did not fill backwards" << std::endl;
+        exit (1);
+    }
+
+    // Far jumps and another place are evaluated exactly.
+    if (timeline.evaluate (start + 100, longitude, latitude, config, state) ||
+            timeline.evaluate (start + 100, longitude + 1, latitude, config, state)) {
+        std::cout << "Timeline had samples it can't have" << std::endl;
+        exit (1);
+    }
+    exact = SkyStateEvaluator::evaluate (start + 100, longitude + 1, latitude, config);
+    testAlmostEqual (state.sky.sun.north, exact.sky.sun.north, 1e-12);
+
+    // Frames racing the worker get either; every one is right.
+    timeline.clear ();
+    for (int frame = 0; frame < 2000; ++frame) {
+        const LongReal jday = start + frame * 3.7 * minute;
+        timeline.evaluate (jday, longitude, latitude, config, state);
+        exact = SkyStateEvaluator::evaluate (jday, longitude, latitude, config);
+        testAlmostEqual (state.sky.sun.up, exact.sky.sun.up, 1e-4);
+    }
+    if (timeline.getHitCount () + timeline.getMissCount () < 2000 || timeline.getComputedCount () == 0) {
+        std::cout << "Timeline counted " << timeline.getHitCount () << " hits and "
+                << timeline.getMissCount () << " misses" << std::endl;
+        exit (1);
+    }
+}
+
+/// Bit for bit equality, so signed zeros and rounding count.
+template <class T>
+bool sameBits (const T &a, const T &b) {
+    return std::memcmp (&a, &b, sizeof (T)) == 0;
+}
+
+bool sameBits (const Caelum::FastAstronomy::HorizontalVector &a, const Caelum::FastAstronomy::HorizontalVector &b) {
+    return sameBits (a.north, b.north) && sameBits (a.east, b.east) && sameBits (a.up, b.up);
+}
+
+bool sameBits (const Caelum::SkyColour &a, const Caelum::SkyColour &b) {
+    return sameBits (a.r, b.r) && sameBits (a.g, b.g) && sameBits (a.b, b.b) && sameBits (a.a, b.a);
+}
+
+bool sameBits (const Caelum::SkyFrameEvaluator::Frame &a, const Caelum::SkyFrameEvaluator::Frame &b) {
+    const Caelum::SkyState &x = a.state, &y = b.state;
+    bool same = sameBits (x.julianDay, y.julianDay) && sameBits (x.longitude, y.longitude) &&
+            sameBits (x.latitude, y.latitude) && sameBits (x.sky.sun, y.sky.sun) &&
+            sameBits (x.sky.moon, y.sky.moon) && sameBits (x.sky.eclipticNorthPole, y.sky.eclipticNorthPole) &&
+            sameBits (x.sky.moonPhase, y.sky.moonPhase) && sameBits (x.fogDensity, y.fogDensity) &&
+            sameBits (x.fogColour, y.fogColour) && sameBits (x.sunLightColour, y.sunLightColour) &&
+            sameBits (x.sunSphereColour, y.sunSphereColour) && sameBits (x.moonLightColour, y.moonLightColour) &&
+            sameBits (x.moonBodyColour, y.moonBodyColour) && sameBits (x.sunVisibleFraction, y.sunVisibleFraction) &&
+            sameBits (x.moonUmbraFraction, y.moonUmbraFraction) &&
+            sameBits (a.observer.getJulianDay (), b.observer.getJulianDay ()) && a.bodies.size () == b.bodies.size ();
+    for (size_t i = 0; same && i < a.bodies.size (); ++i) {
+        const Caelum::CelestialBodies::State &p = a.bodies[i], &q = b.bodies[i];
+        same = sameBits (p.north, q.north) && sameBits (p.east, q.east) && sameBits (p.up, q.up) &&
+                sameBits (p.distance, q.distance) && sameBits (p.angularRadius, q.angularRadius) &&
+                sameBits (p.phase, q.phase) && sameBits (p.brightness, q.brightness) &&
+                sameBits (p.lightColour[0], q.lightColour[0]) && sameBits (p.lightColour[1], q.lightColour[1]) &&
+                sameBits (p.lightColour[2], q.lightColour[2]);
+    }
+    return same;
+}
+
+/// Ways CaelumSystem::computeSkyState gets its sky.
+enum TestSkySource {
+    TEST_SKY_CACHED,
+    TEST_SKY_KEYFRAMED,
+    TEST_SKY_TICKING,
+    TEST_SKY_TIMELINE,
+    TEST_SKY_SOURCE_COUNT,
+};
+
+/// One CaelumSystem's worth of sky state: clock, caches and extra bodies.
+struct TestSkyPipeline {
+    static const Caelum::LongReal longitude, latitude;
+
+    Caelum::UniversalClock clock;
+    Caelum::EphemerisCache ephemeris;
+    Caelum::SkyTimeline timeline;
+    Caelum::SkyFrameConfig config;
+    Caelum::CachedSky cache;
+    Caelum::CelestialBodies bodies;
+
+    TestSkyPipeline (TestSkySource source, Ogre::Real timeScale) {
+        using namespace Caelum;
+        clock.setJulianDay (2451545.25);
+        clock.setTimeScale (timeScale);
+        if (source == TEST_SKY_TICKING) {
+            clock.setTickLength (100000000);
+        }
+        // Background fits land on whatever frame they finish; fit in
+        // update instead, so both runs switch fits on the same frame.
+        ephemeris.setAsynchronous (false);
+        config.sky.ephemerisCache = &ephemeris;
+        config.keyframed = source == TEST_SKY_KEYFRAMED;
+        if (source == TEST_SKY_TIMELINE) {
+            // Fill the window first, so every frame is interpolated
+            // however far the worker got.
+            config.timeline = &timeline;
+            SkyStateConfig timelineConfig = config.sky;
+            timelineConfig.ephemerisCache = 0;
+            SkyState state;
+            timeline.evaluate (clock.getJulianDay (), longitude, latitude, timelineConfig, state);
+            timeline.waitForWindow ();
+        }
+        config.bodies = &bodies;
+        CelestialBodies::Body star;
+        bodies.add (star);
+        CelestialBodies::Body moon = star;
+        moon.type = CelestialBodies::BODY_MOON;
+        moon.M0 += 120;
+        moon.a = 2;
+        moon.e = 0;
+        bodies.add (moon);
+    }
+
+    void compute (const Caelum::UniversalClock &at, Caelum::SkyFrameEvaluator::Frame &frame) {
+        Caelum::SkyFrameEvaluator::evaluate (at.getSkyClockTime (), longitude, latitude, config, cache, frame);
+        if (config.timeline) {
+            timeline.waitForWindow ();
+        }
+    }
+};
+
+const Caelum::LongReal TestSkyPipeline::longitude = 10;
+const Caelum::LongReal TestSkyPipeline::latitude = 50;
+
+void checkAsynchronousSkyState () {
+    std::cout << "Testing asynchronous sky state" << std::endl;
+    using namespace Caelum;
+
+    // Like CaelumSystem::updateSubcomponents with and without
+    // setAsynchronousSkyState: the async frame shows what the sync one
+    // showed a frame earlier, to the bit. Slow clocks move through
+    // keyframes, fast ones through ephemeris cache refits; ticking
+    // clocks reuse their cached ticks.
+    const Ogre::Real frameTime = 1 / 30.0f;
+    const int frameCount = 300;
+    const Ogre::Real timeScales[] = { 600, 50000 };
+    for (int source = 0; source < TEST_SKY_SOURCE_COUNT; ++source) {
+        for (Ogre::Real timeScale: timeScales) {
+            std::vector<SkyFrameEvaluator::Frame> syncFrames (frameCount);
+            TestSkyPipeline sync (TestSkySource (source), timeScale);
+            for (int frame = 0; frame < frameCount; ++frame) {
+                sync.clock.update (frameTime);
+                sync.ephemeris.update (sync.clock.getJulianDay ());
+                sync.compute (sync.clock, syncFrames[frame]);
+            }
+
+            std::vector<SkyFrameEvaluator::Frame> asyncFrames (frameCount);
+            TestSkyPipeline async (TestSkySource (source), timeScale);
+            SkyFrameEvaluator::Frame frames[2];
+            int front = 0;
+            std::future<void> pending;
+            for (int frame = 0; frame < frameCount; ++frame) {
+                async.clock.update (frameTime);
+                const bool finished = pending.valid ();
+                if (finished) {
+                    pending.get ();
+                }
+                async.ephemeris.update (async.clock.getJulianDay ());
+                if (finished) {
+                    front = 1 - front;
+                } else {
+                    async.compute (async.clock, frames[front]);
+                }
+                asyncFrames[frame] = frames[front];
+
+                const int back = 1 - front;
+                const UniversalClock clock = async.clock;
+                pending = std::async (std::launch::async, [&async, &frames, back, clock] () {
+                    async.compute (clock, frames[back]);
+                });
+            }
+            pending.get ();
+
+            for (int frame = 0; frame < frameCount; ++frame) {
+                const SkyFrameEvaluator::Frame &expected = syncFrames[frame == 0 ? 0 : frame - 1];
+                if (!sameBits (asyncFrames[frame], expected)) {
+                    std::cout << "Asynchronous frame " << frame << " differs, source " << source
+                            << ", time scale " << timeScale << std::endl;
+                    exit (1);
+                }
+            }
+
+            // Every path this is meant to cover was taken.
+            const bool refitted = sync.ephemeris.getFitCount () > 1;
+            const bool interpolated = sync.cache.keyframes.getExactCount () < sync.cache.keyframes.getEvaluateCount ();
+            const bool reused = sync.cache.evaluationCount < size_t (frameCount);
+            const bool cached = sync.timeline.getHitCount () == size_t (frameCount) &&
+                    sync.timeline.getMissCount () == 1;
+            if ((source != TEST_SKY_TIMELINE && timeScale > 1000 && !refitted) ||
+                    (source == TEST_SKY_KEYFRAMED && timeScale < 1000 && !interpolated) ||
+                    (source == TEST_SKY_TICKING && !reused) ||
+                    (source == TEST_SKY_TIMELINE && !cached)) {
+                std::cout << "Asynchronous test missed its cases, source " << source << ": "
+                        << sync.ephemeris.getFitCount () << " fits, "
+                        << sync.cache.keyframes.getExactCount () << " exact keyframes, "
+                        << sync.cache.evaluationCount << " cached skies, "
+                        << sync.timeline.getMissCount () << " timeline misses" << std::endl;
+                exit (1);
+            }
+        }
+    }
+}
+
 int main (int argc, char **argv)
 {
     // Run astronomy math tests.
@@ -152,5 +1468,29 @@ int main (int argc, char **argv)
     // are probably even less precise.
     // The tests are only used to catch huge visible errors.
     checkAstronomy ();
+    checkBatchAstronomy ();
+    checkMultiObserverAstronomy ();
+    checkDailyEvents ();
+    checkEphemerisCache ();
+    checkLunarTheory ();
+    checkPlanetPositions ();
+    checkPrecessionNutation ();
+    checkScalarPolicies ();
+    checkObserver ();
+    checkFusedSky ();
+    checkEclipseTable ();
+    checkAtmosphericLookup ();
+    checkSatelliteConstellation ();
+    checkCelestialBodies ();
+    checkUniversalClock ();
+    checkClockDomain ();
+    checkFixedTickClock ();
+    checkUpdateThrottle ();
+    checkSkyStateEvaluator ();
+    checkTaskGraph ();
+    checkSkySnapshot ();
+    checkKeyframedSky ();
+    checkSkyTimeline ();
+    checkAsynchronousSkyState ();
     return 0;
 }
\ No newline at end of file